@@ -84,6 +84,8 @@ int main()
         if(exchange_path_plan.updated()){
             path = exchange_path_plan.read();
             updated=true;
+            if (verbose) printf("andretti: new %d step path, within %.2fx of optimal\n",
+                path.plan_len, path.suboptimality);
         }
         if(exchange_plan_current.updated()){
             cur = exchange_plan_current.read();
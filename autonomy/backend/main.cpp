@@ -35,6 +35,7 @@
 
 #include "aurora/lunatic.h"
 #include "nanoslot/nanoslot_sanity.h"
+#include "nanoslot/nanoslot_update.h"
 
 using namespace aurora;
 
@@ -42,12 +43,12 @@ using namespace aurora;
 // Inertial measurement unit sanity check
 bool robot_IMUs_OK = true; 
 
-void IMU_sanity_check(const nanoslot_IMU_state &s,const char *what)
+// Return true if this IMU's data looks sane
+bool IMU_sanity_check(const nanoslot_IMU_state &s,const char *what)
 {
     const vec3 global_should(0,0,9.8); // Earth gravity vector
     float g_err = length(s.global - global_should);
     if (g_err > 3.0*length(s.vibe) + 4.0) { // global gravity vector is totally wrong--either sudden-onset vibe or a bad IMU
-        robot_IMUs_OK = false;
         printf("IMU %s error: g_err = %.3f m/s^2\n", what,g_err);
         static FILE *IMU_errs = fopen("imu.errs","w+");
         if (IMU_errs) {
@@ -56,7 +57,9 @@ void IMU_sanity_check(const nanoslot_IMU_state &s,const char *what)
             fprintf(IMU_errs,"\n");
             fflush(IMU_errs);
         }
+        return false;
     }
+    return true;
 }
 
 
@@ -102,40 +105,77 @@ void arduino_sensor_read(robot_base &robot)
     // Read sensor data from the exchange
     const nanoslot_exchange &nano=exchange_nanoslot.read();
     
-    robot.sensor.load_TL=nano.slot_A1.state.load_L;
-    robot.sensor.load_TR=nano.slot_A1.state.load_R;
-    robot.sensor.load_SL=nano.slot_F1.state.load_L;
-    robot.sensor.load_SR=nano.slot_F1.state.load_R;
-    
-    robot.sensor.cell_M = nano.slot_C0.state.cell;
-    robot.sensor.charge_M = nano.slot_C0.state.charge;
-    robot.sensor.cell_D = nano.slot_F0.state.cell;
-    robot.sensor.charge_D = nano.slot_F0.state.charge;
-    
-    robot.sensor.minerate = filter_minerate(nano.slot_C0.state.spin);
-    
-    robot.sensor.Mcount = nano.slot_C0.sensor.spincount;
-    robot.sensor.Mstall = (0.0==robot.sensor.minerate);
+    // Each slot program bumps its own sequence number when it gets new data,
+    //  so we only redo the IMU and joint math for slots that actually changed.
+    static nanoslot_update_watcher watch_A1, watch_C0, watch_D0, watch_F0, watch_F1;
+    static bool IMUs_OK_A1=true, IMUs_OK_F1=true;
     
-    const static float pitch_cal = 4.0;
-    robot.sensor.frame_yaw   = nano.slot_F1.state.frame.yaw;
-    robot.sensor.frame_pitch = nano.slot_F1.state.frame.pitch - pitch_cal;
-    robot.sensor.frame_roll  = nano.slot_F1.state.frame.roll;
+    if (watch_A1.changed(nano.slot_A1.update)) {
+        robot.sensor.load_TL=nano.slot_A1.state.load_L;
+        robot.sensor.load_TR=nano.slot_A1.state.load_R;
+        
+        IMUs_OK_A1 = IMU_sanity_check(nano.slot_A1.state.stick,"stick")
+                   & IMU_sanity_check(nano.slot_A1.state.tool,"tool");
+        
+        robot.joint.angle.stick=nano.slot_A1.state.stick.pitch;
+        float tool_pitch_cal = +7.0;
+        robot.joint.angle.tilt=nano.slot_A1.state.tool.pitch + tool_pitch_cal;
+        robot.joint.angle.spin=0.0f; // nano.slot_A1.state.tool.roll; // now hardware locked
+    }
     
-    const auto &driveslot = nano.slot_D0;
-    int left_wire = 0;
-    int right_wire = 1;
-    robot.sensor.DRcount =   driveslot.sensor.counts[right_wire];
-    robot.sensor.DRstall =   driveslot.sensor.stall&(1<<right_wire);
+    if (watch_F1.changed(nano.slot_F1.update)) {
+        robot.sensor.load_SL=nano.slot_F1.state.load_L;
+        robot.sensor.load_SR=nano.slot_F1.state.load_R;
+        
+        const static float pitch_cal = 4.0;
+        robot.sensor.frame_yaw   = nano.slot_F1.state.frame.yaw;
+        robot.sensor.frame_pitch = nano.slot_F1.state.frame.pitch - pitch_cal;
+        robot.sensor.frame_roll  = nano.slot_F1.state.frame.roll;
+        
+        //  For safe autonomy, really need some additional sanity checking (here, or in slot program?)
+        IMUs_OK_F1 = IMU_sanity_check(nano.slot_F1.state.frame,"frame")
+                   & IMU_sanity_check(nano.slot_F1.state.boom,"boom")
+                   & IMU_sanity_check(nano.slot_F1.state.fork,"fork")
+                   & IMU_sanity_check(nano.slot_F1.state.dump,"dump");
+        
+        robot.joint.angle.boom=nano.slot_F1.state.boom.pitch;
+        robot.joint.angle.fork=nano.slot_F1.state.fork.pitch;
+        robot.joint.angle.dump=nano.slot_F1.state.dump.pitch;
+    }
+    robot_IMUs_OK = IMUs_OK_A1 && IMUs_OK_F1;
     
-    robot.sensor.DLcount =   driveslot.sensor.counts[left_wire];
-    robot.sensor.DLstall =   driveslot.sensor.stall&(1<<left_wire);
+    if (watch_C0.changed(nano.slot_C0.update)) {
+        robot.sensor.cell_M = nano.slot_C0.state.cell;
+        robot.sensor.charge_M = nano.slot_C0.state.charge;
+        
+        robot.sensor.minerate = filter_minerate(nano.slot_C0.state.spin);
+        
+        robot.sensor.Mcount = nano.slot_C0.sensor.spincount;
+        robot.sensor.Mstall = (0.0==robot.sensor.minerate);
+    }
     
-    robot.sensor.heartbeat = driveslot.debug.packet_count;
+    if (watch_F0.changed(nano.slot_F0.update)) {
+        robot.sensor.cell_D = nano.slot_F0.state.cell;
+        robot.sensor.charge_D = nano.slot_F0.state.charge;
+    }
     
-    robot.sensor.encoder_raw=int(driveslot.sensor.raw);
-    robot.sensor.stall_raw=int(driveslot.sensor.stall);
+    if (watch_D0.changed(nano.slot_D0.update)) {
+        const auto &driveslot = nano.slot_D0;
+        int left_wire = 0;
+        int right_wire = 1;
+        robot.sensor.DRcount =   driveslot.sensor.counts[right_wire];
+        robot.sensor.DRstall =   driveslot.sensor.stall&(1<<right_wire);
+        
+        robot.sensor.DLcount =   driveslot.sensor.counts[left_wire];
+        robot.sensor.DLstall =   driveslot.sensor.stall&(1<<left_wire);
+        
+        robot.sensor.heartbeat = driveslot.debug.packet_count;
+        
+        robot.sensor.encoder_raw=int(driveslot.sensor.raw);
+        robot.sensor.stall_raw=int(driveslot.sensor.stall);
+    }
     
+    // Connection flags are cheap, and slots that disconnect stop updating, so always copy these
     int connected=0;
     connected |= ((1&nano.slot_D0.state.connected) << robot_sensors_arduino::connected_D0);
     connected |= ((1&nano.slot_F0.state.connected) << robot_sensors_arduino::connected_F0);
@@ -144,26 +184,6 @@ void arduino_sensor_read(robot_base &robot)
     connected |= ((1&nano.slot_A1.state.connected) << robot_sensors_arduino::connected_A1);
     connected |= ((1&nano.slot_C0.state.connected) << robot_sensors_arduino::connected_C0);
     robot.sensor.connected = 0xFF & connected;
-    
-    // Copy joint orientations from IMU data
-    
-    //  For safe autonomy, really need some additional sanity checking (here, or in slot program?)
-    robot_IMUs_OK = true;
-    IMU_sanity_check(nano.slot_F1.state.frame,"frame");
-    IMU_sanity_check(nano.slot_F1.state.boom,"boom");
-    IMU_sanity_check(nano.slot_A1.state.stick,"stick");
-    IMU_sanity_check(nano.slot_A1.state.tool,"tool");
-    IMU_sanity_check(nano.slot_F1.state.fork,"fork");
-    IMU_sanity_check(nano.slot_F1.state.dump,"dump");
-    
-    robot.joint.angle.boom=nano.slot_F1.state.boom.pitch;
-    robot.joint.angle.stick=nano.slot_A1.state.stick.pitch;
-    float tool_pitch_cal = +7.0;
-    robot.joint.angle.tilt=nano.slot_A1.state.tool.pitch + tool_pitch_cal;
-    robot.joint.angle.spin=0.0f; // nano.slot_A1.state.tool.roll; // now hardware locked
-    
-    robot.joint.angle.fork=nano.slot_F1.state.fork.pitch;
-    robot.joint.angle.dump=nano.slot_F1.state.dump.pitch;
 }
 
 /*
@@ -239,7 +259,9 @@ void arduino_command_write(robot_base &robot)
 
 MAKE_exchange_backend_state();
 MAKE_exchange_mining_depth();
+MAKE_exchange_mining_heightmap();
 MAKE_exchange_drive_encoders();
+MAKE_exchange_drive_encoders_ring();
 MAKE_exchange_plan_target();
 MAKE_exchange_drive_commands();
 //Needed for localization
@@ -249,6 +271,7 @@ aurora::robot_loc2D currentLocation;
 bool show_GUI=true;
 bool simulate_only=false; // --sim flag
 bool should_plan_paths=true; // --noplan flag
+bool follow_mining_face=false; // --follow_face flag: cut relative to the observed mining face
 bool driver_test=false; // --driver_test, path planning testing
 
 bool nodrive=false; // --nodrive flag (for testing indoors)
@@ -370,6 +393,9 @@ class mine_planner {
 public:
     /// Location of the tip of the mining head scoop, in frame coordinates
     vec3 scoop_tip;
+    
+    /// If true, mining depth is relative to the face seen in the heightmap
+    bool follow_face=false;
 
     /// Orientation of mining head while cutting, relative to robot frame coords
     const float mine_tilt_slope=1.2; // 1.0 -> 45 deg.  2.0 -> about 60 deg
@@ -442,18 +468,37 @@ public:
         return 1;
     }
 
+    /// Look up how far forward of the nominal cut (at zero depth) the observed 
+    ///  mining face is, at this amount of mining progress.
+    ///  Returns false if the heightmap hasn't seen the face there.
+    bool lookup_face_depth(float frame_pitch,float progress,float &face_depth) {
+        vec3 target;
+        if (lookup_mine_target(frame_pitch,progress,0.0f,target)<=0) return false;
+        float face_y;
+        if (!heightmap.lookup(target.x,target.z,face_y)) return false;
+        face_depth=face_y-target.y;
+        return true;
+    }
+
     // Given a depth image, plan the joint states for a mining pass.
+    //  If follow_face is set, depth is relative to the observed face.
     //  Returns positive value if this joint state seems reachable and safe,
     //  negative on error.
     int mine_plan(float frame_pitch,float progress,float depth,robot_joint_state &mine_joint)
     {
+        float face_depth;
+        if (follow_face && lookup_face_depth(frame_pitch,progress,face_depth))
+        {
+            const float face_limit=0.3; // meters: don't trust the face past this (dust, arm in view)
+            depth += std::max(-face_limit,std::min(face_limit,face_depth));
+        }
         vec3 target;
         if (lookup_mine_target(frame_pitch,progress,depth,target)<=0) return -1;
         return target_plan(target,mine_joint);
     }
 
-    mine_planner(const aurora::mining_depth &mining_view)
-        :mining(mining_view)
+    mine_planner(const aurora::mining_depth &mining_view,const aurora::mining_heightmap &heightmap_view)
+        :mining(mining_view), heightmap(heightmap_view)
     {
         robot_link_coords coord(mine_joint_base);
         
@@ -464,6 +509,7 @@ public:
 
 private:
     const aurora::mining_depth &mining;
+    const aurora::mining_heightmap &heightmap;
     excahauler_IK ik;
     
 
@@ -504,6 +550,7 @@ public:
   
   // Autonomous mining interface
   aurora::mining_depth mining; // view of mined area
+  aurora::mining_heightmap heightmap; // dense view of the mining face
   mine_planner mp;
   float stall_backoff = 0.0f; // mining head stall response
 
@@ -511,7 +558,7 @@ public:
   int robot_insanity_counter = 0;
 
   robot_manager_t() 
-    :mp(mining)
+    :mp(mining,heightmap)
   {
     // Zero out the joints until we hear otherwise
     for (int i=0;i<robot_joint_state::count;i++) robot.joint.array[i]=0.0f;
@@ -1050,6 +1097,9 @@ void robot_manager_t::autonomous_state()
     float mine_cut_depth=0.0f + 0.01f*robot.tuneable.cut 
         - std::min(cap_backoff, stall_backoff) - out; // m
     
+    if (follow_mining_face && exchange_mining_heightmap.updated()) 
+        heightmap=exchange_mining_heightmap.read();
+    mp.follow_face = follow_mining_face && exchange_mining_heightmap.source_age()<1.0; // stale view: ignore it
     if (mp.mine_plan(robot.sensor.frame_pitch,up,mine_cut_depth,mine_joint)<0) enter_state(state_STOP);
     robotPrintln("Mining: progress %.3f -> out %.3f up %.3f",
         mine_progress,out,up);
@@ -1417,6 +1467,7 @@ void robot_manager_t::update(void) {
   enc.right=totalR;
   exchange_drive_encoders.write_begin()=enc;
   exchange_drive_encoders.write_end();
+  exchange_drive_encoders_ring.push(enc);
   
   locator.merged=exchange_plan_current.read();
 
@@ -1491,6 +1542,17 @@ void robot_manager_t::update_GUI(void) {
     }
     glEnd();
     
+    // Draw mining face heightmap
+    if (exchange_mining_heightmap.updated()) 
+        heightmap=exchange_mining_heightmap.read();
+    glColor3f(0,0.6,1);
+    glBegin(GL_POINTS);
+    for (int z=0;z<aurora::mining_heightmap::NZ;z++)
+    for (int x=0;x<aurora::mining_heightmap::NX;x++)
+        if (heightmap.valid(x,z))
+            glVertex3fv(heightmap.world(x,z));
+    glEnd();
+    
     robot_3D_draw(robot.joint_plan,tool,0.3f);
     
     robot_3D_cleanup();
@@ -1536,6 +1598,9 @@ int main(int argc,char *argv[])
     else if (0==strcmp(argv[argi],"--noplan")) {
       should_plan_paths=false;
     }
+    else if (0==strcmp(argv[argi],"--follow_face")) {
+      follow_mining_face=true;
+    }
     else if (0==strcmp(argv[argi],"--driver_test")) {
       simulate_only=true;
       driver_test=true;
@@ -1575,11 +1640,18 @@ int main(int argc,char *argv[])
   }
   else
   { // fast stripped-down no-GUI version (for headless robot)
+    const auto min_period=std::chrono::milliseconds(10); // at most 100 loops per second
     while (true) {
+      auto start=std::chrono::steady_clock::now();
       robot_manager->update();
       robot_display_telemetry(robot_manager->robot);
       
-      aurora::data_exchange_sleep(30); // limits CPU usage
+      // Run when a new autonomy drive command arrives, so this loop runs at 
+      //   the command rate, or every 30ms if no commands arrive.
+      exchange_drive_commands.wait_for_update(30);
+      
+      // Don't let a flood of commands spin the CPU
+      std::this_thread::sleep_until(start+min_period);
     }
   }
   return 0;
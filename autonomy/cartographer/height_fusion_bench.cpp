@@ -0,0 +1,157 @@
+/*
+  Benchmark and check multi-frame height fusion: a camera drives slowly
+  across a made-up field of rocks and craters, producing noisy
+  obstacle_grid frames (noise grows with distance, plus a few wild
+  outlier points), and we classify cells two ways:
+     single frame: the old cartographer rule, on just this frame's grid
+     fused: the same thresholds on the fused_height_grid, with slope
+        judged by the height step to neighboring cells
+  We report the time per frame, memory use, how often each way gets
+  a cell's class wrong, and how often cells flip class between frames.
+
+    ./height_fusion_bench [--frames N] [--decay F]
+
+  Doesn't need OpenCV or a camera.
+
+  This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "vision/grid.hpp"
+#include "vision/grid.cpp"
+#include "vision/height_fusion.hpp"
+
+// Same thresholds as cartographer's mark_obstacles.
+//   slope is the height difference across the cell, or to its neighbors.
+enum {CLASS_NONE=0, CLASS_FLAT, CLASS_HIGH, CLASS_LOW, CLASS_SLOPED};
+int classify(float mean,float slope) {
+    int c=CLASS_FLAT;
+    if (mean>40.0) c=CLASS_HIGH;
+    if (mean<-30.0) c=CLASS_LOW;
+    if (slope>8) c=CLASS_SLOPED;
+    return c;
+}
+
+// True height of the field at this cell: flat, with square rocks and craters
+float true_height(int x,int y) {
+    int bx=x/20, by=y/20, ix=x%20, iy=y%20;
+    if (ix<4 || ix>=16 || iy<4 || iy>=16) return 0.0; // flat between obstacles
+    int kind=(bx*7+by*13)%5;
+    if (kind==0) return 60.0; // rock
+    if (kind==1) return -40.0; // crater
+    return 0.0;
+}
+
+// True class of this cell: sloped at the edges of rocks and craters
+int true_class(int x,int y) {
+    float z=true_height(x,y), step=0.0f;
+    static const int dx[4]={1,-1,0,0}, dy[4]={0,0,1,-1};
+    for (int n=0;n<4;n++) step=std::max(step,fabsf(true_height(x+dx[n],y+dy[n])-z));
+    return classify(z,step);
+}
+
+// Uniform random in [0,1)
+float frand(void) { return rand()*(1.0f/(RAND_MAX+1.0f)); }
+
+// Roughly gaussian noise with this standard deviation
+float noise(float sigma) { return sigma*(frand()+frand()+frand()+frand()-2.0f)*1.732f; }
+
+// Fill this frame's grid with what a camera at cam, looking along +Y, would see
+void make_frame(obstacle_grid &obs,const vec3 &cam) {
+    obs.clear();
+    const int G=obstacle_grid::GRIDSIZE;
+    for (int y=(int)(cam.y/G)+15;y<(int)(cam.y/G)+125 && y<obstacle_grid::GRIDY;y++)
+    for (int x=0;x<obstacle_grid::GRIDX;x++) {
+        vec3 cell((x+0.5f)*G,(y+0.5f)*G,true_height(x,y));
+        vec3 ray=cell-cam;
+        if (fabs(ray.x)>ray.y*0.8f) continue; // outside the field of view
+        float d=length(ray)*0.01f; // meters
+        int count=std::min(60,std::max(1,(int)(60.0f/(d*d))));
+        float sigma=0.2f+0.4f*d*d; // depth error grows with distance squared
+        for (int p=0;p<count;p++) {
+            float z=cell.z+noise(sigma);
+            if (frand()<0.002f) z+=(frand()<0.5f?-1:1)*(30.0f+50.0f*frand()); // sparkle
+            obs.add_point(x,y,z);
+        }
+    }
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+// Error and flip counts for one way of classifying cells
+struct class_stats {
+    const char *name;
+    long cells=0, wrong=0, flips=0;
+    std::vector<unsigned char> last;
+
+    class_stats(const char *name_) :name(name_), last(obstacle_grid::GRIDTOTAL,CLASS_NONE) {}
+
+    void add(int x,int y,int c) {
+        int i=y*obstacle_grid::GRIDX+x;
+        if (c==CLASS_NONE) return;
+        cells++;
+        if (c!=true_class(x,y)) wrong++;
+        if (last[i]!=CLASS_NONE && last[i]!=c) flips++;
+        last[i]=c;
+    }
+    void print(int frames) const {
+        printf("  %-12s %8.0f cells/frame  %5.2f%% wrong  %8.1f flips/frame\n",
+            name,cells*1.0/frames,wrong*100.0/std::max(cells,1L),flips*1.0/frames);
+    }
+};
+
+int main(int argc,char *argv[]) {
+    int frames=200;
+    float decay=-1;
+    for (int argi=1;argi<argc;argi++) {
+        std::string arg=argv[argi];
+        if (arg=="--frames" && argi+1<argc) frames=atoi(argv[++argi]);
+        else if (arg=="--decay" && argi+1<argc) decay=atof(argv[++argi]);
+        else {
+            printf("Usage: height_fusion_bench [--frames N] [--decay F]\n");
+            return 1;
+        }
+    }
+    srand(1);
+    static obstacle_grid obs;
+    static fused_height_grid fused;
+    if (decay>0) fused.set_decay(decay);
+    printf("%d frames, decay %.3f, fused grid is %.1f MB\n",
+        frames,fused.params.decay,sizeof(fused)/(1024.0*1024.0));
+
+    class_stats single("single frame"), fusion("fused");
+    double fuse_ms=0.0, fuse_max=0.0;
+    for (int f=0;f<frames;f++) {
+        vec3 cam(obstacle_grid::GRIDX*obstacle_grid::GRIDSIZE*0.5f,50.0f+f*5.0f,100.0f);
+        if (cam.y>field_y_size-500) cam.y=field_y_size-500;
+        make_frame(obs,cam);
+
+        auto start=std::chrono::steady_clock::now();
+        fused.fuse(obs,cam);
+        double ms=elapsed_ms(start);
+        fuse_ms+=ms; fuse_max=std::max(fuse_max,ms);
+
+        obs.for_each_dirty_tile([&](int t) {
+            int x0,y0,x1,y1; obstacle_grid::tile_bounds(t,x0,y0,x1,y1);
+            for (int y=y0;y<y1;y++)
+            for (int x=x0;x<x1;x++)
+            {
+                grid_square s=obs.at(x,y);
+                if (s.getCount()>=3)
+                    single.add(x,y,classify(s.getTrimmedMean(),s.getMax()-s.getMin()));
+                if (fused.known(x,y))
+                    fusion.add(x,y,classify(fused.at(x,y).mean,fused.step(x,y)));
+            }
+        });
+    }
+    printf("fuse: %.3f ms/frame mean, %.3f ms max\n",fuse_ms/frames,fuse_max);
+    single.print(frames);
+    fusion.print(frames);
+    return 0;
+}
@@ -0,0 +1,175 @@
+/*
+  Probabilistic occupancy map for the cartographer.
+
+  Each field cell keeps the log-odds that it's an obstacle rather than
+  drivable.  Every frame, each cell the camera saw gets some evidence:
+     - The frame's grid_square says how high the cell is, and how sure
+       we are of that (points and spread), so heights just past a
+       threshold are weak evidence, and heights well past it strong.
+     - The fused height map says how big the step to the neighbors is.
+     - Everything is scaled by the fused map's weight for this view
+       (points, distance, and incidence angle).
+  A cell is only reclassified once its log-odds crosses a threshold
+  (with hysteresis between them), so one bad frame can't flip it.
+
+  Classified cells then get a 4-neighbor majority filter, to clean
+  up isolated pixels, and the filtered result is the field we publish.
+  Only tiles that changed get filtered, and field_raster records which
+  tiles changed, so the pathplanner only looks at those.
+
+  This file is Public Domain.
+*/
+#ifndef __AURORA_CARTOGRAPHER_OCCUPANCY_H
+#define __AURORA_CARTOGRAPHER_OCCUPANCY_H
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include "aurora/lunatic.h"
+#include "vision/grid.hpp"
+#include "vision/height_fusion.hpp"
+
+/* Tuning for the occupancy map */
+struct occupancy_params {
+    float high_thresh=40.0; // cm: taller than this is an obstacle
+    float low_thresh=-30.0; // cm: lower than this is a crater
+    float slope_thresh=8.0; // cm: a bigger step to a neighbor is too steep
+    float hit=0.9; // log-odds added by one full-weight obstacle observation
+    float miss=0.4; // log-odds removed by one full-weight drivable observation
+    float sigma_min=1.0; // cm: smallest height uncertainty we trust
+    float occupied=2.0; // log-odds above this is an obstacle (about 88%)
+    float free=-1.5; // log-odds below this is drivable (about 18%)
+    float clamp=5.0; // log-odds stay within +-clamp, so we can change our mind
+};
+
+class occupancy_grid {
+public:
+    enum {GRIDX=obstacle_grid::GRIDX, GRIDY=obstacle_grid::GRIDY, GRIDTOTAL=obstacle_grid::GRIDTOTAL};
+    enum {SCALE=64}; // fixed-point log-odds units per 1.0 of log-odds
+
+    occupancy_params params;
+
+    aurora::field_drivable classified; // thresholded log-odds, before filtering
+    aurora::field_drivable field; // filtered classification: what we publish
+
+    occupancy_grid() { clear(); }
+
+    /* Forget everything: all cells unknown */
+    void clear(void) {
+        memset(logodds,0,sizeof(logodds));
+        memset(kind,aurora::field_toohigh,sizeof(kind));
+        classified.clear(aurora::field_unknown);
+        field.clear(aurora::field_unknown);
+        seen_epoch=~(uint64_t)0; // filter everything next time
+        seen_version=0;
+    }
+
+    /* Add the evidence from one frame's grid (only its dirty tiles),
+       seen from this camera location, then update the published field. */
+    void update(const obstacle_grid &frame,const fused_height_grid &fused,const vec3 &camera) {
+        classified.begin_changes();
+        frame.for_each_dirty_tile([&](int t) {
+            int x0,y0,x1,y1; obstacle_grid::tile_bounds(t,x0,y0,x1,y1);
+            for (int y=y0;y<y1;y++)
+            for (int x=x0;x<x1;x++)
+            {
+                int i=y*GRIDX+x;
+                if (frame.count[i]==0) continue;
+                observe(x,y,frame.at(x,y),fused,camera);
+            }
+        });
+        filter_changes();
+    }
+
+    /* Return the log-odds that this cell is an obstacle */
+    float get_logodds(int x,int y) const { return logodds[y*GRIDX+x]*(1.0f/SCALE); }
+
+    /* Run the neighborhood filter on all of classified, not just the changes
+       (for benchmarking the full-field cost) */
+    void filter_all(void) {
+        field.begin_changes();
+        filter_rect(0,0,GRIDX,GRIDY);
+    }
+
+private:
+    int16_t logodds[GRIDTOTAL]; // fixed-point log-odds of obstacle
+    unsigned char kind[GRIDTOTAL]; // field value for the latest obstacle evidence
+    uint64_t seen_epoch; // last version of classified we've filtered
+    uint32_t seen_version;
+
+    /* Inverse sensor model: add this cell's evidence from one frame */
+    void observe(int x,int y,const grid_square &s,const fused_height_grid &fused,const vec3 &camera) {
+        int i=y*GRIDX+x;
+        float z=s.getTrimmedMean();
+        vec3 cell((x+0.5f)*obstacle_grid::GRIDSIZE,(y+0.5f)*obstacle_grid::GRIDSIZE,z);
+        float w=fused.observation_weight(s.getCount(),cell,camera);
+        if (w<=0.0f) return;
+
+        // How many standard errors past the height thresholds we are (positive: obstacle)
+        float sigma=std::max(params.sigma_min,(s.getMax()-s.getMin())*0.5f/sqrtf(s.getCount()));
+        float high=(z-params.high_thresh)/sigma, low=(params.low_thresh-z)/sigma;
+        float past=std::max(high,low);
+        unsigned char what=(high>low)?aurora::field_toohigh:aurora::field_toolow;
+        if (fused.known(x,y) && fused.step(x,y)>params.slope_thresh) {
+            past=1.0f; what=aurora::field_sloped; // steps are already fused: full evidence
+        }
+
+        float delta;
+        if (past>0.0f) {
+            delta=w*params.hit*std::min(past,1.0f);
+            kind[i]=what;
+        }
+        else delta=-w*params.miss*std::min(-past,1.0f);
+
+        int limit=params.clamp*SCALE;
+        int l=logodds[i]+(int)lrintf(delta*SCALE);
+        logodds[i]=std::max(-limit,std::min(limit,l));
+
+        // Reclassify once we're past a threshold, otherwise keep what we had
+        if (logodds[i]>=params.occupied*SCALE) classified.set(x,y,kind[i]);
+        else if (logodds[i]<=params.free*SCALE) classified.set(x,y,aurora::field_flat);
+    }
+
+    /* Filter the tiles of classified that changed since last time
+       (plus a pixel around them, since their neighbors' votes changed) */
+    void filter_changes(void) {
+        field.begin_changes();
+        classified.for_each_changed_tile(seen_epoch,seen_version,[&](int t) {
+            int x0,y0,x1,y1; obstacle_grid::tile_bounds(t,x0,y0,x1,y1);
+            filter_rect(std::max(x0-1,0),std::max(y0-1,0),
+                std::min(x1+1,(int)GRIDX),std::min(y1+1,(int)GRIDY));
+        });
+    }
+
+    /* Majority filter: if three of a pixel's four neighbors agree, it takes
+       their value.  Edge pixels are copied.  Writes x0<=x<x1, y0<=y<y1 of field. */
+    void filter_rect(int x0,int y0,int x1,int y1) {
+        unsigned char row[GRIDX];
+        for (int y=y0;y<y1;y++) {
+            const unsigned char *c=&classified.raster[y*GRIDX];
+            if (y==0 || y==GRIDY-1) {
+                for (int x=x0;x<x1;x++) row[x]=c[x];
+            }
+            else {
+                const unsigned char *n=c+GRIDX, *s=c-GRIDX;
+                int xa=std::max(x0,1), xb=std::min(x1,(int)GRIDX-1);
+                if (x0<xa) row[x0]=c[x0];
+                if (xb<x1) row[xb]=c[xb];
+                // Plain selects on byte arrays, which the compiler vectorizes
+                for (int x=xa;x<xb;x++) {
+                    unsigned char e=c[x+1], w=c[x-1], up=n[x], dn=s[x];
+                    bool e3=(e==up && e==dn) || (e==w && e==up) || (e==w && e==dn);
+                    bool w3=(w==up && w==dn);
+                    row[x]=e3?e:(w3?w:c[x]);
+                }
+            }
+            for (int x=x0;x<x1;x++) field.set(x,y,row[x]);
+        }
+    }
+
+    // Don't copy this type, it's big
+    occupancy_grid(const occupancy_grid &no_copies);
+    void operator=(const occupancy_grid &no_copies);
+};
+
+#endif
@@ -0,0 +1,160 @@
+/*
+  Benchmark and check the occupancy cartographer on the full 308x758 field:
+     - full-field frames, where every cell has data
+     - camera-wedge frames, like the robot really sees
+  For each we report the time to fuse heights and update the occupancy
+  map, how many field tiles changed (all the pathplanner looks at),
+  and how long the pathplanner takes to update from those changes.
+  We also check the incremental neighborhood filter against filtering
+  the whole field from scratch.
+
+    ./occupancy_bench [--frames N]
+
+  Doesn't need OpenCV or a camera.
+
+  This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include "aurora/lunatic.h"
+#include "vision/grid.cpp"
+#include "vision/height_fusion.hpp"
+#include "occupancy.h"
+
+// True height of the field at this cell: flat, with square rocks and craters
+float true_height(int x,int y) {
+    int bx=x/20, by=y/20, ix=x%20, iy=y%20;
+    if (ix<4 || ix>=16 || iy<4 || iy>=16) return 0.0;
+    int kind=(bx*7+by*13)%5;
+    if (kind==0) return 60.0; // rock
+    if (kind==1) return -40.0; // crater
+    return 0.0;
+}
+
+// Uniform random in [0,1)
+float frand(void) { return rand()*(1.0f/(RAND_MAX+1.0f)); }
+
+// Add this many noisy points to this cell
+void add_cell(obstacle_grid &obs,int x,int y,int count,float sigma) {
+    for (int p=0;p<count;p++)
+        obs.add_point(x,y,true_height(x,y)+sigma*(frand()+frand()+frand()+frand()-2.0f)*1.732f);
+}
+
+// Every cell on the field, seen from overhead
+void full_frame(obstacle_grid &obs) {
+    obs.clear();
+    for (int y=0;y<obstacle_grid::GRIDY;y++)
+    for (int x=0;x<obstacle_grid::GRIDX;x++)
+        add_cell(obs,x,y,8,1.0);
+}
+
+// The cells a camera at cam, looking along +Y, would see
+void wedge_frame(obstacle_grid &obs,const vec3 &cam) {
+    obs.clear();
+    const int G=obstacle_grid::GRIDSIZE;
+    for (int y=(int)(cam.y/G)+15;y<(int)(cam.y/G)+125 && y<obstacle_grid::GRIDY;y++)
+    for (int x=0;x<obstacle_grid::GRIDX;x++) {
+        vec3 ray=vec3((x+0.5f)*G,(y+0.5f)*G,0)-cam;
+        if (fabs(ray.x)>ray.y*0.8f) continue; // outside the field of view
+        float d=length(ray)*0.01f; // meters
+        add_cell(obs,x,y,std::min(60,std::max(1,(int)(60.0f/(d*d)))),0.2f+0.4f*d*d);
+    }
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+// Field as the pathplanner tracks it: just the changed tiles
+struct planner_side {
+    uint64_t epoch=~(uint64_t)0;
+    uint32_t version=0;
+    aurora::field_drivable last;
+    long changed_pixels=0;
+
+    // Return the number of tiles we had to look at
+    int update(const aurora::field_drivable &f) {
+        int tiles=0;
+        f.for_each_changed_tile(epoch,version,[&](int t) {
+            tiles++;
+            int x0,y0,x1,y1; obstacle_grid::tile_bounds(t,x0,y0,x1,y1);
+            for (int y=y0;y<y1;y++)
+            for (int x=x0;x<x1;x++)
+                if (last.at(x,y)!=f.at(x,y)) { last.at(x,y)=f.at(x,y); changed_pixels++; }
+        });
+        return tiles;
+    }
+};
+
+// Time one kind of frame
+void run(const char *name,int frames,bool full) {
+    static obstacle_grid obs;
+    static fused_height_grid fused;
+    static occupancy_grid occ;
+    static planner_side planner;
+    fused.clear(); occ.clear();
+    fused.params=height_fusion_params();
+    if (full) fused.params.full_distance=1.0e6; // overhead view: full weight everywhere
+    planner=planner_side();
+
+    double update_ms=0.0, planner_ms=0.0;
+    long tiles=0;
+    for (int f=0;f<frames;f++) {
+        vec3 cam(obstacle_grid::GRIDX*obstacle_grid::GRIDSIZE*0.5f,50.0f+f*5.0f,100.0f);
+        if (full) { full_frame(obs); cam=vec3(cam.x,field_y_size*0.5f,2000.0f); }
+        else wedge_frame(obs,cam);
+
+        auto start=std::chrono::steady_clock::now();
+        fused.fuse(obs,cam);
+        occ.update(obs,fused,cam);
+        update_ms+=elapsed_ms(start);
+
+        start=std::chrono::steady_clock::now();
+        tiles+=planner.update(occ.field);
+        planner_ms+=elapsed_ms(start);
+    }
+    printf("%s: fuse+occupancy %.2f ms/frame, pathplanner %.3f ms/frame on %.0f of %d tiles\n",
+        name,update_ms/frames,planner_ms/frames,tiles*1.0/frames,(int)obstacle_grid::TILETOTAL);
+
+    // Filter the whole field, and make sure the incremental version matches
+    static aurora::field_drivable incremental;
+    incremental=occ.field;
+    auto start=std::chrono::steady_clock::now();
+    occ.filter_all();
+    printf("  full-field neighborhood filter: %.3f ms\n",elapsed_ms(start));
+    long wrong=0;
+    for (int i=0;i<aurora::field_drivable::GRIDTOTAL;i++)
+        if (incremental.raster[i]!=occ.field.raster[i]) wrong++;
+    if (wrong) {
+        printf("ERROR: incremental filter differs from full filter in %ld pixels\n",wrong);
+        exit(1);
+    }
+    long obstacle=0, flat=0, bad=0;
+    for (int y=0;y<obstacle_grid::GRIDY;y++)
+    for (int x=0;x<obstacle_grid::GRIDX;x++) {
+        int v=occ.field.at(x,y);
+        if (v==aurora::field_flat) { flat++; if (true_height(x,y)!=0.0) bad++; }
+        else if (v!=aurora::field_unknown) obstacle++;
+    }
+    printf("  %ld drivable, %ld obstacle pixels; %ld drivable pixels are really rock or crater\n",flat,obstacle,bad);
+}
+
+int main(int argc,char *argv[]) {
+    int frames=50;
+    for (int argi=1;argi<argc;argi++) {
+        std::string arg=argv[argi];
+        if (arg=="--frames" && argi+1<argc) frames=atoi(argv[++argi]);
+        else {
+            printf("Usage: occupancy_bench [--frames N]\n");
+            return 1;
+        }
+    }
+    srand(1);
+    printf("%d x %d field, %d frames each\n",(int)obstacle_grid::GRIDX,(int)obstacle_grid::GRIDY,frames);
+    run("full field",frames,true);
+    run("camera wedge",frames,false);
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+  Benchmark the cut planner on a heightmap image, like
+  example_heightmap/heightmap.png (black is no data):
+
+    ./cut_bench [--map FILE] [--size W H] [--scale M] [--threads N] [--passes N] [--path]
+        [--ik_table FILE]
+
+     --size W H   heightmap covers W x H meters (default 4 x 8)
+     --scale M    each gray level is M meters of elevation (default 0.005)
+     --threads N  threads for the pose search (default: all cores)
+     --passes N   replan and carve this many passes from the best pose
+     --path       print the joint trajectory of the first pass
+     --ik_table F use this precomputed IK table (from kinematics/ik/ik_table_gen),
+                  which also keeps the grinder clear of the scoop and boom
+
+  Reports the full pose search time (single threaded, then threaded),
+  the best pass compared to the fixed mine_pit_angle line, and the
+  replan time and material removed for each following pass.
+
+  This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include "aurora/lunatic.h"
+#include "aurora/kinematics.h"
+#include "aurora/kinematic_links.cpp"
+#include "SOIL/stb_image_aug.h"
+#include "cutplanner.h"
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+// Load a grayscale heightmap image; 0 is no data
+bool load_heightmap(const std::string &file,float width,float height,float scale,cut_heightmap &map) {
+    int w,h,channels;
+    unsigned char *pixels=stbi_load(file.c_str(),&w,&h,&channels,1);
+    if (!pixels) return false;
+    map.resize(w,h);
+    map.cell_x=width/w; map.cell_y=height/h;
+    for (int y=0;y<h;y++)
+    for (int x=0;x<w;x++) {
+        unsigned char v=pixels[y*w+x];
+        if (v!=0) map.at(x,y)=v*scale;
+    }
+    stbi_image_free(pixels);
+    return true;
+}
+
+void print_plan(const char *name,const cut_plan &p) {
+    if (!p.valid) { printf("  %s: no valid pass\n",name); return; }
+    printf("  %s: %.0f deg, %zd steps, %.1f liters removed, deepest %.1f cm, %.3f liters/step\n",
+        name,p.angle,p.steps.size(),p.removed*1000.0,p.max_depth*100.0,p.score*1000.0);
+}
+
+int main(int argc,char *argv[]) {
+    std::string file="example_heightmap/heightmap.png";
+    float width=4.0, height=8.0, scale=0.005;
+    int threads=0, passes=5;
+    bool show_path=false;
+    std::string table_file;
+    for (int argi=1;argi<argc;argi++) {
+        std::string arg=argv[argi];
+        if (arg=="--map" && argi+1<argc) file=argv[++argi];
+        else if (arg=="--size" && argi+2<argc) { width=atof(argv[++argi]); height=atof(argv[++argi]); }
+        else if (arg=="--scale" && argi+1<argc) scale=atof(argv[++argi]);
+        else if (arg=="--threads" && argi+1<argc) threads=atoi(argv[++argi]);
+        else if (arg=="--passes" && argi+1<argc) passes=atoi(argv[++argi]);
+        else if (arg=="--path") show_path=true;
+        else if (arg=="--ik_table" && argi+1<argc) table_file=argv[++argi];
+        else {
+            printf("Usage: cut_bench [--map FILE] [--size W H] [--scale M] [--threads N] [--passes N] [--path] [--ik_table FILE]\n");
+            return 1;
+        }
+    }
+    static cut_heightmap map;
+    if (!load_heightmap(file,width,height,scale,map)) {
+        printf("Can't read heightmap %s\n",file.c_str());
+        return 1;
+    }
+    printf("%s: %d x %d cells of %.1f x %.1f cm\n",file.c_str(),map.w,map.h,map.cell_x*100,map.cell_y*100);
+
+    cut_planner planner;
+    if (threads>0) planner.threads=threads;
+    aurora::excahauler_IK_table ik_table;
+    if (table_file!="") {
+        if (!ik_table.load(table_file.c_str())) return 1;
+        const robot_joint_state base=cut_planner::base_joint();
+        if (ik_table.header().fork!=base.angle.fork || ik_table.header().dump!=base.angle.dump) {
+            printf("IK table %s was built for a different fork and dump\n",table_file.c_str());
+            return 1;
+        }
+        planner.ik_table=&ik_table;
+    }
+    int all_threads=planner.threads;
+
+    // Full pose search, single threaded and then threaded
+    planner.threads=1;
+    auto start=std::chrono::steady_clock::now();
+    cut_plan single=planner.plan(map);
+    double single_ms=elapsed_ms(start);
+    planner.threads=all_threads;
+    start=std::chrono::steady_clock::now();
+    cut_plan best=planner.plan(map);
+    double threaded_ms=elapsed_ms(start);
+    printf("Pose search: %ld poses, %ld usable; %.1f ms on 1 thread, %.1f ms on %d threads\n",
+        planner.poses_checked,planner.poses_usable,single_ms,threaded_ms,all_threads);
+    if (single.score!=best.score) {
+        printf("ERROR: threaded search found a different plan\n");
+        return 1;
+    }
+    if (!best.valid) {
+        printf("No place to mine on this map\n");
+        return 1;
+    }
+    const cut_pose &pose=best.pose;
+    printf("Best pose: %.2f, %.2f m, heading %.0f deg, wheels within %.1f cm of a plane\n",
+        pose.x,pose.y,pose.heading,pose.residual*100);
+    print_plan("planned",best);
+    print_plan("fixed pit angle",planner.plan_angle(map,pose,aurora::mine_pit_angle));
+
+    if (show_path) {
+        printf("  step   grinder Y,Z (m)   depth (cm)   boom stick tilt (deg)\n");
+        for (size_t i=0;i<best.steps.size();i++) {
+            const cut_step &s=best.steps[i];
+            printf("  %3zd   %6.3f %6.3f   %5.1f   %6.1f %6.1f %6.1f\n",i,s.grinder.y,s.grinder.z,s.depth*100,
+                s.joint.angle.boom,s.joint.angle.stick,s.joint.angle.tilt);
+        }
+    }
+
+    // Mine it, and replan from the same pose for the following passes
+    float deepest=best.max_depth;
+    cut_plan p=best;
+    for (int pass=1;pass<=passes && p.valid;pass++) {
+        planner.carve(map,p);
+        start=std::chrono::steady_clock::now();
+        p=planner.plan_at(map,pose);
+        double ms=elapsed_ms(start);
+        printf("Pass %d replan: %.2f ms\n",pass+1,ms);
+        print_plan("planned",p);
+        if (p.valid) deepest=std::max(deepest,p.max_depth);
+    }
+    if (deepest>planner.params.max_depth+0.001f) {
+        printf("ERROR: cut %.1f cm deep, over the %.1f cm limit\n",deepest*100,planner.params.max_depth*100);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,486 @@
+/*
+  Cut planner: plans a mining pass from a top-down heightmap of the pit.
+
+  Planning has two parts, like README.txt describes:
+   (1) A robot pose: the wheel footprint has to sit on ground we can
+       fit a plane to (flat enough, not too tilted), and the cut face
+       has to start just past the front scoop tip.
+   (2) An arm path: in the robot's YZ plane, the grinder cylinder
+       sweeps up the face along a line at some angle, staying a fixed
+       depth into the face, so it takes an even slice.  Each step's
+       depth of cut (material removed per distance moved) is bounded,
+       since too deep stalls the head, and each step has to be
+       reachable with excahauler_IK::solve_tilt.  Given an ik_table,
+       steps also have to keep the grinder clear of the scoop and boom.
+
+  We try every path angle at every candidate pose, sweeping the grinder
+  through a 2D profile of the face to measure the material it really
+  removes per step, and keep the plan that removes the most per step
+  (counting the time to get into position).  Poses are independent,
+  so they're evaluated on several threads.
+
+  Needs aurora/kinematic_links.cpp included first (for excahauler_IK
+  and the mining head geometry).
+
+  This file is Public Domain.
+*/
+#ifndef __AURORA_CUTPLANNER_H
+#define __AURORA_CUTPLANNER_H
+
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include "aurora/robot_base.h"
+#include "aurora/kinematics.h"
+#include "aurora/mining.h"
+#include "aurora/ik_table.h"
+
+/* Top-down heightmap: elevation (meters) of each cell, or NAN where we have no data */
+struct cut_heightmap {
+    int w=0, h=0; // size in cells
+    float cell_x=0.04, cell_y=0.04; // size of each cell (meters)
+    std::vector<float> z; // row-major elevations
+
+    void resize(int w_,int h_) {
+        w=w_; h=h_;
+        z.assign(w*h,NAN);
+    }
+
+    float &at(int x,int y) { return z[y*w+x]; }
+    float at(int x,int y) const { return z[y*w+x]; }
+
+    /* Bilinear elevation at this location (meters), or NAN if we don't know it */
+    float lookup(float fx,float fy) const {
+        float cx=fx/cell_x-0.5f, cy=fy/cell_y-0.5f; // cell centers are at +0.5
+        int x=(int)floorf(cx), y=(int)floorf(cy);
+        if (x<0 || y<0 || x+1>=w || y+1>=h) return NAN;
+        float ax=cx-x, ay=cy-y;
+        const float *r=&z[y*w+x];
+        float lo=r[0]+ax*(r[1]-r[0]);
+        float hi=r[w]+ax*(r[w+1]-r[w]);
+        return lo+ay*(hi-lo); // NAN if any corner is NAN
+    }
+};
+
+/* Tuning for the cut planner.  Distances in meters, angles in degrees. */
+struct cut_params {
+    // Cutting
+    float target_depth=0.04; // depth of cut we aim for
+    float max_depth=0.06; // never cut deeper than this (stalls the head)
+    float min_depth=0.01; // shallower than this is cutting air
+    float grinder_width=0.30; // width of the grinder cylinder, across the robot
+    float step=0.02; // path step length
+    int max_steps=80; // longest pass
+    int air_steps=4; // end the pass after this many steps not cutting
+    float max_offset_change=0.01; // per step: keeps the arm path smooth
+    float face_reach=0.30; // look this far along the path normal for the face
+    float start_distance=0.25; // cut starts this far past the scoop tip (like mine_start_distance)
+    float angle_min=15, angle_max=80, angle_step=5; // path angles to try, up from level
+    float overhead_steps=15; // time to start a pass, in steps (for scoring)
+    vec3 head_center=vec3(0,-0.2,1.2); // grinder looks away from here (like mine_planner)
+
+    // Robot pose
+    float footprint_x=0.35; // half width of the wheels
+    float footprint_y0=-0.50, footprint_y1=0.30; // wheels from back to front, frame Y
+    float flat_tolerance=0.04; // worst plane-fit error under the wheels
+    float max_tilt=15; // steepest ground we'll mine from
+    float face_start=0.05; // face starts where it rises this far above the ground plane
+    float contact_min=-0.10, contact_max=0.20; // face must start this far past the scoop tip
+    float face_height=0.15; // face must rise this high, so it's worth a pass
+};
+
+/* Where the robot sits to mine */
+struct cut_pose {
+    float x=0, y=0, heading=0; // heightmap location (meters) and heading (degrees)
+    float residual=0; // worst plane-fit error under the wheels
+    aurora::robot_coord3D frame; // robot frame in heightmap coordinates
+};
+
+/* One step of the arm path */
+struct cut_step {
+    vec3 grinder; // grinder cylinder center, in robot frame coordinates
+    float depth; // depth of cut: thickness of material removed per distance along the path
+    float removed; // material removed this step (cubic meters)
+    robot_joint_state joint; // joint angles to put the grinder there
+};
+
+/* A planned pass */
+struct cut_plan {
+    bool valid=false;
+    cut_pose pose;
+    float angle=0; // path angle up from the frame's Y axis (degrees)
+    std::vector<cut_step> steps;
+    float removed=0; // total material removed (cubic meters)
+    float max_depth=0; // deepest step
+    float score=0; // material removed per step, counting overhead
+};
+
+class cut_planner {
+public:
+    cut_params params;
+    int threads; // threads used by plan()
+
+    // Optional precomputed IK table, built for base_joint's fork and dump.
+    //  If set, we solve with it and only use steps its clear bitmap allows.
+    const aurora::excahauler_IK_table *ik_table=0;
+
+    // Statistics from the last plan()
+    long poses_checked=0, poses_usable=0;
+
+    cut_planner() {
+        threads=std::max(1u,std::thread::hardware_concurrency());
+        aurora::robot_link_coords coord(base_joint());
+        scoop_tip=coord.coord3D(aurora::link_dump).world_from_local(vec3(0,0.308,0.168));
+        tilt_to_grinder=aurora::robot_link_coords::parent_from_child(aurora::link_tilt,aurora::link_grinder,
+            aurora::robot_coord3D()).origin;
+    }
+
+    /* Joint angles at the start of mining (like the backend's mine_joint_base) */
+    static robot_joint_state base_joint(void) {
+        robot_joint_state j={-17,-30, 10,0,-30,0};
+        return j;
+    }
+
+    /* Search for the best pass over the whole map: poses every stride cells,
+       and this many headings. */
+    cut_plan plan(const cut_heightmap &map,int stride=4,int headings=16) {
+        struct candidate { float x,y,heading; };
+        std::vector<candidate> candidates;
+        for (int y=0;y<map.h;y+=stride)
+        for (int x=0;x<map.w;x+=stride)
+        for (int a=0;a<headings;a++)
+            candidates.push_back(candidate{(x+0.5f)*map.cell_x,(y+0.5f)*map.cell_y,a*360.0f/headings});
+
+        // Each thread takes the next candidate, and keeps its own best plan
+        int nthreads=std::max(1,std::min(threads,(int)candidates.size()));
+        std::vector<cut_plan> best(nthreads);
+        std::vector<long> usable(nthreads,0);
+        int next=0;
+        auto work=[&](int t) {
+            while (true) {
+                int i=__atomic_fetch_add(&next,1,__ATOMIC_RELAXED);
+                if (i>=(int)candidates.size()) break;
+                const candidate &c=candidates[i];
+                cut_pose pose;
+                if (!make_pose(map,c.x,c.y,c.heading,pose)) continue;
+                usable[t]++;
+                cut_plan p=plan_at(map,pose);
+                if (better(p,best[t])) best[t]=p;
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int t=1;t<nthreads;t++) workers.push_back(std::thread(work,t));
+        work(0);
+        for (std::thread &w:workers) w.join();
+
+        cut_plan result=best[0];
+        poses_checked=candidates.size(); poses_usable=usable[0];
+        for (int t=1;t<nthreads;t++) {
+            if (better(best[t],result)) result=best[t];
+            poses_usable+=usable[t];
+        }
+        return result;
+    }
+
+    /* Best pass from this pose, trying each path angle (for replanning between passes) */
+    cut_plan plan_at(const cut_heightmap &map,const cut_pose &pose) const {
+        profile prof;
+        make_profile(map,pose,prof);
+        cut_plan best;
+        for (float angle=params.angle_min;angle<=params.angle_max+0.01f;angle+=params.angle_step) {
+            cut_plan p=sweep(prof,pose,angle);
+            if (better(p,best)) best=p;
+        }
+        return best;
+    }
+
+    /* Pass from this pose along this path angle */
+    cut_plan plan_angle(const cut_heightmap &map,const cut_pose &pose,float angle) const {
+        profile prof;
+        make_profile(map,pose,prof);
+        return sweep(prof,pose,angle);
+    }
+
+    /* Check whether the robot can mine from here, and fill in pose.
+       Returns false if the wheels aren't on flat ground, or there's no
+       face just past the scoop. */
+    bool make_pose(const cut_heightmap &map,float x,float y,float heading,cut_pose &pose) const {
+        float ch=cosf(heading*M_PI/180), sh=sinf(heading*M_PI/180);
+        vec3 fwd(ch,sh,0), right(sh,-ch,0);
+
+        // Least-squares plane fit e = a + b*lx + c*ly under the wheels
+        double n=0, sx=0, sy=0, sxx=0, syy=0, sxy=0, se=0, sxe=0, sye=0;
+        std::vector<vec3> pts;
+        float d=std::min(map.cell_x,map.cell_y);
+        for (float ly=params.footprint_y0;ly<=params.footprint_y1;ly+=d)
+        for (float lx=-params.footprint_x;lx<=params.footprint_x;lx+=d) {
+            vec3 w=vec3(x,y,0)+right*lx+fwd*ly;
+            float e=map.lookup(w.x,w.y);
+            if (!(e==e)) return false; // no data under a wheel
+            pts.push_back(vec3(lx,ly,e));
+            n++; sx+=lx; sy+=ly; sxx+=lx*lx; syy+=ly*ly; sxy+=lx*ly;
+            se+=e; sxe+=lx*e; sye+=ly*e;
+        }
+        if (n<3) return false;
+        // Solve the 3x3 normal equations by Cramer's rule
+        double m[3][3]={{n,sx,sy},{sx,sxx,sxy},{sy,sxy,syy}}, r[3]={se,sxe,sye};
+        double det=det3(m);
+        if (fabs(det)<1.0e-12) return false;
+        double abc[3];
+        for (int k=0;k<3;k++) {
+            double mk[3][3];
+            for (int i=0;i<3;i++) for (int j=0;j<3;j++) mk[i][j]=(j==k)?r[i]:m[i][j];
+            abc[k]=det3(mk)/det;
+        }
+        float a=abc[0], b=abc[1], c=abc[2];
+        if (atanf(sqrtf(b*b+c*c))*180/M_PI>params.max_tilt) return false;
+        float worst=0;
+        for (const vec3 &p:pts) worst=std::max(worst,fabsf(p.z-(a+b*p.x+c*p.y)));
+        if (worst>params.flat_tolerance) return false;
+
+        // Robot frame sits on that plane
+        pose.x=x; pose.y=y; pose.heading=heading; pose.residual=worst;
+        aurora::robot_coord3D &f=pose.frame;
+        f.origin=vec3(x,y,a);
+        f.Y=(fwd+vec3(0,0,c)).dir();
+        f.X=(right+vec3(0,0,b)).dir();
+        f.Z=cross(f.X,f.Y).dir();
+        f.X=cross(f.Y,f.Z).dir();
+        f.percent=100.0;
+
+        // The face has to start right past the scoop, and be tall enough to bother
+        profile prof;
+        make_profile(map,pose,prof);
+        float face=NAN, top=-1.0e3;
+        for (int i=0;i<(int)prof.z.size();i++) {
+            float s=prof.s(i), z=prof.z[i];
+            if (s<params.footprint_y1) continue; // under the robot
+            if (!(z==z)) return false; // hole in the data before the face
+            if (!(face==face)) {
+                if (z>params.face_start) face=s;
+                else if (z<-params.flat_tolerance) return false; // pothole in front
+            }
+            if (face==face) {
+                if (s>face+params.face_reach*2) break;
+                top=std::max(top,z);
+            }
+        }
+        if (!(face==face)) return false;
+        float contact=face-scoop_tip.y;
+        return contact>=params.contact_min && contact<=params.contact_max
+            && top>=params.face_height;
+    }
+
+    /* Remove the material this plan cuts from the map */
+    void carve(cut_heightmap &map,const cut_plan &plan) const {
+        if (!plan.valid) return;
+        const aurora::robot_coord3D &f=plan.pose.frame;
+        const float R=MINING_HEAD_R, half=0.5f*params.grinder_width;
+        for (int y=0;y<map.h;y++)
+        for (int x=0;x<map.w;x++) {
+            float &e=map.at(x,y);
+            if (!(e==e)) continue;
+            vec3 local=f.local_from_world(vec3((x+0.5f)*map.cell_x,(y+0.5f)*map.cell_y,e));
+            if (fabsf(local.x)>half) continue;
+            float z=local.z;
+            for (const cut_step &s:plan.steps) {
+                float dy=local.y-s.grinder.y;
+                if (fabsf(dy)>=R) continue;
+                float h=sqrtf(R*R-dy*dy);
+                if (z>s.grinder.z-h && z<=s.grinder.z+h) z=s.grinder.z-h;
+            }
+            e+=(z-local.z)/f.Z.z; // back to elevation (small-tilt approximation)
+        }
+    }
+
+    /* Scoop tip at the start of mining, in frame coordinates */
+    vec3 get_scoop_tip(void) const { return scoop_tip; }
+
+private:
+    vec3 scoop_tip; // frame coords
+    vec3 tilt_to_grinder; // grinder origin relative to the tilt joint, in grinder orientation
+    mutable aurora::excahauler_IK ik; // solve_tilt isn't const, but doesn't change anything
+
+    /* Height of the face above the ground plane along the robot's Y axis,
+       the highest across the grinder's width (frame coordinates) */
+    struct profile {
+        float s0, ds; // frame Y of sample 0, and sample spacing
+        std::vector<float> z; // NAN where we have no data
+
+        float s(int i) const { return s0+i*ds; }
+        // Linear interpolated height at frame Y, or NAN outside
+        float at(float y) const {
+            float f=(y-s0)/ds;
+            int i=(int)floorf(f);
+            if (i<0 || i+1>=(int)z.size()) return NAN;
+            float a=f-i;
+            return z[i]+a*(z[i+1]-z[i]);
+        }
+    };
+
+    void make_profile(const cut_heightmap &map,const cut_pose &pose,profile &prof) const {
+        const aurora::robot_coord3D &f=pose.frame;
+        prof.ds=0.5f*params.step;
+        prof.s0=params.footprint_y1;
+        float length=scoop_tip.y+params.start_distance+params.max_steps*params.step+params.face_reach-prof.s0;
+        int n=(int)(length/prof.ds)+1;
+        prof.z.resize(n);
+        const int across=5;
+        for (int i=0;i<n;i++) {
+            float high=-1.0e3;
+            for (int k=0;k<across;k++) {
+                float lx=params.grinder_width*(k*(1.0f/(across-1))-0.5f);
+                vec3 w=f.world_from_local(vec3(lx,prof.s(i),0));
+                float e=map.lookup(w.x,w.y);
+                if (!(e==e)) { high=NAN; break; }
+                high=std::max(high,f.local_from_world(vec3(w.x,w.y,e)).z);
+            }
+            prof.z[i]=high;
+        }
+    }
+
+    /* Distance along n from p to the face: where we go from air into material.
+       Returns NAN if there's no face within reach. */
+    float face_distance(const profile &prof,const vec2 &p,const vec2 &n) const {
+        float reach=params.face_reach, dt=prof.ds;
+        float last=-reach;
+        bool was_inside=inside(prof,p+n*last);
+        if (was_inside) return -reach; // buried: as deep as we can look
+        for (float t=last+dt;t<=reach;t+=dt) {
+            if (inside(prof,p+n*t)) {
+                float lo=last, hi=t; // refine the crossing by bisection
+                for (int k=0;k<5;k++) {
+                    float mid=0.5f*(lo+hi);
+                    if (inside(prof,p+n*mid)) hi=mid; else lo=mid;
+                }
+                return 0.5f*(lo+hi);
+            }
+            last=t;
+        }
+        return NAN;
+    }
+    // p is (frame Y, frame Z)
+    static bool inside(const profile &prof,const vec2 &p) {
+        float z=prof.at(p.x);
+        return z==z && p.y<=z;
+    }
+
+    /* Remove the grinder circle at c from the profile, and return the area removed.
+       If apply is false, just return the area. */
+    static float carve_profile(profile &prof,const vec2 &c,float R,bool apply=true) {
+        int i0=std::max(0,(int)ceilf((c.x-R-prof.s0)/prof.ds));
+        int i1=std::min((int)prof.z.size()-1,(int)floorf((c.x+R-prof.s0)/prof.ds));
+        float area=0;
+        for (int i=i0;i<=i1;i++) {
+            float &z=prof.z[i];
+            if (!(z==z)) continue;
+            float dy=prof.s(i)-c.x;
+            if (fabsf(dy)>=R) continue;
+            float h=sqrtf(R*R-dy*dy), bottom=c.y-h, top=c.y+h;
+            if (z<=bottom) continue;
+            area+=(std::min(z,top)-bottom)*prof.ds;
+            if (apply && z<=top) z=bottom; // otherwise it's an overhang, leave it
+        }
+        return area;
+    }
+
+    /* Return the deepest grinder edge offset o along n from p, between lo and hi,
+       where the grinder removes at most this much area */
+    static float deepest_offset(const profile &prof,const vec2 &p,const vec2 &n,float lo,float hi,float area) {
+        const float R=MINING_HEAD_R;
+        profile &scratch=const_cast<profile &>(prof); // carve_profile doesn't change it with apply=false
+        if (carve_profile(scratch,p+n*(hi-R),R,false)<=area) return hi;
+        for (int b=0;b<10;b++) {
+            float mid=0.5f*(lo+hi);
+            if (carve_profile(scratch,p+n*(mid-R),R,false)>area) hi=mid; else lo=mid;
+        }
+        return lo;
+    }
+
+    /* Joint angles to put the grinder center here (frame coordinates).
+       Like mine_planner::target_plan, the grinder looks away from head_center. */
+    bool grinder_joints(const vec3 &center,robot_joint_state &joint) const {
+        vec3 look=(center-params.head_center).dir();
+        aurora::robot_coord3D head(vec3(0,0,0),vec3(1,0,0),look,vec3(0,-look.z,look.y),99.0);
+        vec3 tip=center-head.world_from_local_dir(MINING_HEAD_MID);
+        vec3 tilt_target=tip-head.world_from_local_dir(tilt_to_grinder);
+        joint=base_joint();
+        float tool=aurora::excahauler_IK::frame_degrees(head.Y);
+        if (ik_table) {
+            if (!ik_table->clear(tilt_target,tool)) return false;
+            if (ik_table->solve_tilt(joint,tilt_target,tool)<=0) return false;
+        }
+        else if (ik.solve_tilt(joint,tilt_target,tool)<=0) return false;
+        return aurora::joint_state_sane(joint);
+    }
+
+    /* Sweep the grinder up the face along this angle */
+    cut_plan sweep(const profile &face,const cut_pose &pose,float angle) const {
+        cut_plan plan;
+        plan.pose=pose; plan.angle=angle;
+        profile prof=face; // we carve this as we go
+        const float R=MINING_HEAD_R;
+        float ca=cosf(angle*M_PI/180), sa=sinf(angle*M_PI/180);
+        vec2 u(ca,sa), n(sa,-ca); // along the path, and into the face
+        vec2 start(scoop_tip.y+params.start_distance,scoop_tip.z+aurora::mine_floor_height);
+        float offset=NAN; // last step's grinder edge distance along n
+        int air=0, cutting=0;
+        for (int k=0;k<params.max_steps;k++) {
+            vec2 p=start+u*(k*params.step);
+            float t=face_distance(prof,p,n);
+            float o=offset;
+            if (t==t) {
+                // Depth of cut is the thickness of material this step removes.
+                //  The grinder engages more than just along n (like at the toe
+                //  of the face), so we pick the offset by what it removes.
+                o=deepest_offset(prof,p,n,t-2*R,t+params.max_depth,params.target_depth*params.step);
+                if (offset==offset)
+                    o=std::max(offset-params.max_offset_change,std::min(offset+params.max_offset_change,o));
+            }
+            else if (!(offset==offset)) break; // no face at the start
+            // Smoothing may have pushed us too deep: back off until we're not
+            o=deepest_offset(prof,p,n,o-2*R,o,params.max_depth*params.step);
+            vec2 c=p+n*(o-R);
+
+            cut_step s;
+            s.grinder=vec3(0,c.x,c.y);
+            if (!grinder_joints(s.grinder,s.joint)) break; // out of reach
+            float area=carve_profile(prof,c,R);
+            s.depth=area/params.step;
+            s.removed=area*params.grinder_width;
+            plan.steps.push_back(s);
+            plan.removed+=s.removed;
+            plan.max_depth=std::max(plan.max_depth,s.depth);
+            offset=o;
+
+            if (s.depth<params.min_depth) { if (++air>=params.air_steps) break; }
+            else { air=0; cutting++; }
+        }
+        // Drop trailing air steps
+        while (!plan.steps.empty() && plan.steps.back().depth<params.min_depth) plan.steps.pop_back();
+        plan.valid=cutting>0;
+        if (plan.valid) plan.score=plan.removed/(plan.steps.size()+params.overhead_steps);
+        return plan;
+    }
+
+    static bool better(const cut_plan &a,const cut_plan &b) {
+        if (!a.valid) return false;
+        if (!b.valid) return true;
+        if (a.score!=b.score) return a.score>b.score;
+        // Tie: stable order, so the result doesn't depend on the threads
+        if (a.pose.y!=b.pose.y) return a.pose.y<b.pose.y;
+        if (a.pose.x!=b.pose.x) return a.pose.x<b.pose.x;
+        if (a.pose.heading!=b.pose.heading) return a.pose.heading<b.pose.heading;
+        return a.angle<b.angle;
+    }
+
+    static double det3(const double m[3][3]) {
+        return m[0][0]*(m[1][1]*m[2][2]-m[1][2]*m[2][1])
+              -m[0][1]*(m[1][0]*m[2][2]-m[1][2]*m[2][0])
+              +m[0][2]*(m[1][0]*m[2][1]-m[1][1]*m[2][0]);
+    }
+};
+
+#endif
@@ -5,6 +5,11 @@ The basic idea here:
     - Make an aurora::data_exchange<T> to link a class T to a file.
     - Reads and writes modify the file.
     - Internally, this uses mmap and MAP_SHARED to be *very* efficient, like nanoseconds per read/write, even across separate processes, even on a Raspberry Pi.
+    - The header's update counter and writer count make a seqlock, so 
+      read_consistent() can detect and retry torn reads, even when several
+      processes write different parts of the same exchange (like the nanoslots).
+    - The update counter is also a Linux futex, so wait_for_update() and 
+      data_exchange_wait_any() can sleep until a writer calls write_end().
 
 Orion Lawlor, Arsh Chauhan, Addeline Mitchell 2019-11-24
 */
@@ -16,6 +21,7 @@ Orion Lawlor, Arsh Chauhan, Addeline Mitchell 2019-11-24
 #include <atomic> // for std::atomic_thread_fence
 #include <stdexcept> // for std::runtime_error
 #include <string.h>  // for strerror
+#include <initializer_list> // for data_exchange_wait_any
 
 #ifdef _WIN32
 #  error "Somebody needs to write a windows version of this header"
@@ -24,6 +30,10 @@ Orion Lawlor, Arsh Chauhan, Addeline Mitchell 2019-11-24
 #  include <unistd.h> // for seeks
 #  include <sys/stat.h> 
 #  include <fcntl.h> // for open
+#  include <sched.h> // for sched_yield
+#  include <limits.h> // for INT_MAX
+#  include <linux/futex.h> // for FUTEX_WAIT
+#  include <sys/syscall.h> // for SYS_futex
 #  define PAGE_SIZE 4096
 #endif
 
@@ -32,7 +42,28 @@ Orion Lawlor, Arsh Chauhan, Addeline Mitchell 2019-11-24
 
 namespace aurora {
 
+// Give up our timeslice, e.g. to let a writer finish.
+inline void data_exchange_yield(void) {
+    sched_yield();
+}
+
+/* Sleep until *addr no longer contains expected, 
+   somebody calls data_exchange_futex_wake(addr), or timeout_us passes.
+   This works across processes, as long as addr is in a MAP_SHARED file.
+*/
+inline void data_exchange_futex_wait(uint32_t *addr,uint32_t expected,long timeout_us)
+{
+    struct timespec timeout;
+    timeout.tv_sec=timeout_us/1000000;
+    timeout.tv_nsec=(timeout_us%1000000)*1000;
+    syscall(SYS_futex,addr,FUTEX_WAIT,expected,&timeout,NULL,0);
+}
 
+/* Wake up everybody sleeping in data_exchange_futex_wait on this address. */
+inline void data_exchange_futex_wake(uint32_t *addr)
+{
+    syscall(SYS_futex,addr,FUTEX_WAKE,INT_MAX,NULL,NULL,0);
+}
 
 inline void make_data_exchange_dir(bool silent=false) {
     // Try to create the data_exchange directory
@@ -116,6 +147,17 @@ public:
 
 
 
+// Nanosecond timestamps from CLOCK_MONOTONIC.
+//   These never jump (unlike the UTC clock), and are comparable across processes.
+typedef int64_t monotonic_time_t;
+
+// Return the monotonic time in nanoseconds (since boot)
+inline monotonic_time_t time_in_nanoseconds_monotonic() {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC,&tp);
+    return tp.tv_sec*(monotonic_time_t)1000000000 + tp.tv_nsec;
+}
+
 /** This is the on-disk format for the start of a data_exchange file. */
 struct data_exchange_disk_header {
     // This is the size, in bytes, of the type T of data being exchanged.
@@ -123,15 +165,37 @@ struct data_exchange_disk_header {
     //  T aren't the same size--check for version mismatch.
     uint64_t T_size;
     
-    // This counter changes everytime somebody calls write_end().
-    //   It's more useful for finding hangs than really tracking changes.
+    // This counter goes up by 2 (staying even) every time a write finishes.
+    //   Along with writers, it's a seqlock: if nobody is writing and it's 
+    //   the same value before and after you copy the data,
+    //   nobody wrote the data while you were copying it.
     uint32_t updates;
 
     // These are flags, like an in-use marker
     uint32_t flags;
     enum {
-        flag_being_written=1<<0 // bit 0: a write is in progress now
+        flag_being_written=1<<0, // bit 0: a write is in progress now
+        flag_has_waiters=1<<1, // bit 1: somebody is asleep in wait_for_update (write_end should wake them)
+        flag_wait_any=1<<2 // bit 2: somebody in data_exchange_wait_any is watching this (write_end should ring the doorbell)
     };
+    
+    // This marks the layout of this header.  Files from older programs 
+    //   (with a shorter header) have their data here instead, so they don't match.
+    //   Change layout_value whenever this header changes.
+    uint32_t layout;
+    enum {layout_value=0xDA7A0003};
+    
+    // Number of write_begin() calls that haven't reached write_end() yet.
+    //   Several processes can write different parts of one exchange at once,
+    //   so this is a count, not a flag.
+    uint32_t writers;
+    
+    // CLOCK_MONOTONIC time of the last write_end(), in nanoseconds.
+    monotonic_time_t write_time;
+    
+    // CLOCK_MONOTONIC time the written data was captured (e.g., camera frame time),
+    //   in nanoseconds.  Zero if the writer didn't say.
+    monotonic_time_t source_time;
 /*
     // This is an atomic integer, used as a mutex for data writes 
     std::atomic<uint32_t> write_lock;
@@ -145,6 +209,164 @@ struct data_exchange_disk_footer {
     uint32_t eof;
 };
 
+/** 
+ data_exchange_wait_any sleeps on this shared doorbell, so it can wake when
+ any of several exchanges gets written.  Only writes to exchanges flagged
+ with flag_wait_any ring it, so sleepers don't wake for every write in the system.
+ It lives in its own small file in the data exchange directory.
+*/
+struct data_exchange_doorbell {
+    uint32_t rings; // incremented after watched writes (futex word)
+    uint32_t waiters; // nonzero if somebody is asleep on rings
+    
+    // Return the process-wide doorbell (opened on first use)
+    static data_exchange_doorbell &get(void) {
+        static data_exchange_mmap bell(DATA_EXCHANGE_DIR "data_exchange.doorbell",sizeof(data_exchange_doorbell),true);
+        return *(data_exchange_doorbell *)bell.mem;
+    }
+    
+    // Ring the doorbell, waking any sleepers
+    void ring(void) {
+        __atomic_add_fetch(&rings,1,__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&waiters,__ATOMIC_SEQ_CST) 
+          && __atomic_exchange_n(&waiters,0,__ATOMIC_SEQ_CST))
+            data_exchange_futex_wake(&rings);
+    }
+};
+
+// Microseconds remaining until this deadline, or 0 if it's passed.
+inline long data_exchange_remaining_us(std::chrono::steady_clock::time_point deadline)
+{
+    long us=std::chrono::duration_cast<std::chrono::microseconds>
+        (deadline-std::chrono::steady_clock::now()).count();
+    return us>0?us:0;
+}
+
+/**
+ The type-independent parts of a data_exchange: the update counter,
+ and waiting for it to change.
+*/
+class data_exchange_channel {
+public:
+    // Return true if this data has been updated since the last read()
+    bool updated(void) const {
+        return last_update != header->updates;
+    }
+    
+    // Return the CLOCK_MONOTONIC time of the last write, in nanoseconds (0 if never written).
+    monotonic_time_t last_write_time(void) const {
+        return __atomic_load_n(&header->write_time,__ATOMIC_RELAXED);
+    }
+    
+    // Return the CLOCK_MONOTONIC time the last write's data was captured,
+    //   or the write time if the writer didn't provide a capture time.
+    monotonic_time_t source_time(void) const {
+        monotonic_time_t t=__atomic_load_n(&header->source_time,__ATOMIC_RELAXED);
+        return t?t:last_write_time();
+    }
+    
+    // Return the age, in seconds, of the last write.
+    double age(void) const {
+        return (time_in_nanoseconds_monotonic()-last_write_time())*1.0e-9;
+    }
+    
+    // Return the age, in seconds, of the last write's data (since capture).
+    double source_age(void) const {
+        return (time_in_nanoseconds_monotonic()-source_time())*1.0e-9;
+    }
+    
+    // Sleep until another write_end() finishes, or timeout_ms passes.
+    //   Returns true if there was a write since our last read() or wait, 
+    //   false on timeout.  Unlike updated(), this doesn't require a read() 
+    //   to reset it, so each write wakes you at most once.
+    bool wait_for_update(int timeout_ms) {
+        auto deadline=std::chrono::steady_clock::now()+std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            uint32_t seq=__atomic_load_n(&header->updates,__ATOMIC_SEQ_CST);
+            if (check_wake(seq)) return true;
+            long us=data_exchange_remaining_us(deadline);
+            if (us<=0) return false;
+            
+            // Ask the writer to wake us, then make sure we didn't miss its write
+            __atomic_fetch_or(&header->flags,(uint32_t)data_exchange_disk_header::flag_has_waiters,__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&header->updates,__ATOMIC_SEQ_CST)!=seq) continue;
+            
+            data_exchange_futex_wait(&header->updates,seq,us);
+        }
+    }
+    
+protected:
+    data_exchange_disk_header *header; // header of our mmap'd file
+    uint32_t last_update; // value of updates at our last read
+    uint32_t last_wake; // value of updates at our last read or wait
+    
+    data_exchange_channel() :header(0), last_update(0), last_wake(0) {}
+    
+    // Return true (and mark it seen) if seq is a finished write we haven't waited for.
+    bool check_wake(uint32_t seq) {
+        if (seq==last_wake) return false;
+        last_wake=seq;
+        return true;
+    }
+    
+    // Called by the writer after the update counter changes
+    void wake_waiters(void) {
+        if ((__atomic_load_n(&header->flags,__ATOMIC_SEQ_CST)&data_exchange_disk_header::flag_has_waiters)
+          && (__atomic_fetch_and(&header->flags,~(uint32_t)data_exchange_disk_header::flag_has_waiters,__ATOMIC_SEQ_CST)&data_exchange_disk_header::flag_has_waiters))
+            data_exchange_futex_wake(&header->updates);
+        if ((__atomic_load_n(&header->flags,__ATOMIC_SEQ_CST)&data_exchange_disk_header::flag_wait_any)
+          && (__atomic_fetch_and(&header->flags,~(uint32_t)data_exchange_disk_header::flag_wait_any,__ATOMIC_SEQ_CST)&data_exchange_disk_header::flag_wait_any))
+            data_exchange_doorbell::get().ring();
+    }
+    
+    // If this file was written with a different header layout, its data is 
+    //   in the wrong place: zero out the whole file and mark our layout.
+    static void reset_old_layout(void *file,size_t file_len,const std::string &filename) {
+        data_exchange_disk_header *h=(data_exchange_disk_header *)file;
+        if (h->layout == data_exchange_disk_header::layout_value) return;
+        if (h->T_size != 0) 
+            printf("Resetting data exchange file %s: it was written with a different header layout\n",
+                filename.c_str());
+        memset(file,0,file_len);
+        h->layout = data_exchange_disk_header::layout_value;
+    }
+    
+    friend int data_exchange_wait_any(std::initializer_list<data_exchange_channel *> channels,int timeout_ms);
+};
+
+/**
+ Sleep until any of these exchanges gets written, or timeout_ms passes.
+ Returns the index (in the list) of the first channel with a new write,
+ or -1 on timeout.  Every channel with a new write is marked as waited for.
+   Example:
+     int which=aurora::data_exchange_wait_any({&exchange_plan_current,&exchange_plan_target},500);
+*/
+inline int data_exchange_wait_any(std::initializer_list<data_exchange_channel *> channels,int timeout_ms)
+{
+    data_exchange_doorbell &bell=data_exchange_doorbell::get();
+    auto deadline=std::chrono::steady_clock::now()+std::chrono::milliseconds(timeout_ms);
+    while (true) {
+        // Ask to be woken *before* checking, so a write can't slip past us
+        __atomic_store_n(&bell.waiters,1,__ATOMIC_SEQ_CST);
+        uint32_t rings=__atomic_load_n(&bell.rings,__ATOMIC_SEQ_CST);
+        for (data_exchange_channel *c:channels)
+            __atomic_fetch_or(&c->header->flags,(uint32_t)data_exchange_disk_header::flag_wait_any,__ATOMIC_SEQ_CST);
+        
+        int first=-1, index=0;
+        for (data_exchange_channel *c:channels) {
+            if (c->check_wake(__atomic_load_n(&c->header->updates,__ATOMIC_SEQ_CST)) && first==-1) 
+                first=index;
+            index++;
+        }
+        if (first!=-1) return first;
+        
+        long us=data_exchange_remaining_us(deadline);
+        if (us<=0) return -1;
+        data_exchange_futex_wait(&bell.rings,rings,us);
+    }
+}
+
+
 /** 
  This is the on-disk storage format that we use to exchange data
  of type T, in files in /tmp/data_exchange/.
@@ -179,7 +401,7 @@ public:
  You shouldn't re-make it repeatedly (such as a local variable).
 */
 template <typename T>
-class data_exchange {
+class data_exchange : public data_exchange_channel {
 #if !defined(__GNUC__) || __GNUC__>=5 // missing from gcc 4
     // C++11 macro magic to enforce T datatype limits.
     static_assert(std::is_trivially_copyable<T>::value, "Data exchange datatypes are exchanged as raw bytes in files, so they can't contain pointers (like std::vector or std::string), or have copy constructors, move constructors, or destructors.  We use std::is_trivially_copyable to determine this.");
@@ -194,32 +416,68 @@ public:
     // Returns the current write count.
     uint32_t check(const char *when="");
     
-    // Return true if this data has been updated since the last read()
-    bool updated(void) const {
-        return last_update != mem->header.updates;
-    }
-    
-    // Get a read-only copy of the file data
+    // Get a read-only reference to the file data.
+    //   This is fast, but a writer in another process can change the data
+    //   while you're looking at it.  Use read_consistent for big structs.
     inline const T &read() { 
-        // Do I want a memory read fence here?  std::atomic_thread_fence();
-        last_update = mem->header.updates;
+        last_wake = last_update = __atomic_load_n(&mem->header.updates,__ATOMIC_ACQUIRE);
         return mem->data; 
     }
     
+    // Make one attempt to copy out the file data.
+    //   Returns true if the copy is consistent (no writer touched it during the copy).
+    inline bool try_snapshot(T &out) {
+        return try_copy([&](const T &data) { memcpy((void *)&out,(const void *)&data,sizeof(T)); });
+    }
+    
+    // Copy out a consistent snapshot of the file data, retrying if a writer interferes.
+    //   Returns false if we gave up after max_tries (e.g., a writer is very busy, 
+    //   or crashed mid-write); out then holds a best-effort (possibly torn) copy.
+    bool read_consistent(T &out,int max_tries=1000) {
+        for (int tries=0;tries<max_tries;tries++) {
+            if (try_snapshot(out)) return true;
+            if (tries>=10) data_exchange_yield(); // let the writer finish
+        }
+        out = read();
+        return false;
+    }
+    
+    // Like read_consistent, but calls copy(shared_data) to copy out only the parts you need,
+    //   retrying if a writer interferes.  copy may get called several times,
+    //   and must cope with torn data on the calls that get retried.
+    template <class copier>
+    bool read_consistent_with(copier copy,int max_tries=1000) {
+        for (int tries=0;tries<max_tries;tries++) {
+            if (try_copy(copy)) return true;
+            if (tries>=10) data_exchange_yield(); // let the writer finish
+        }
+        copy(read());
+        return false;
+    }
+    
     // Get a writeable copy of the file's stored data.
     //   Returns a reference to writeable data.
+    //   Several processes can write at once, but they should each write 
+    //   their own part of the data (like the nanoslots each write their own slot).
     inline T &write_begin(void) { 
         mem->header.T_size = sizeof(T); //<- our write is this size
-        mem->header.flags |= (uint32_t)(data_exchange_disk_header::flag_being_written);
+        __atomic_fetch_or(&mem->header.flags,(uint32_t)(data_exchange_disk_header::flag_being_written),__ATOMIC_RELAXED);
+        __atomic_add_fetch(&mem->header.writers,1,__ATOMIC_SEQ_CST);
+        std::atomic_thread_fence(std::memory_order_release); // writer count lands before our data writes
         return mem->data; 
     }
     
     // Finish a write operation, making these changes visible outside.
-    inline void write_end(void) {
-        last_update = ++mem->header.updates;
-        mem->header.flags &= ~(uint32_t)(data_exchange_disk_header::flag_being_written);
+    //   If you know when this data was captured (CLOCK_MONOTONIC nanoseconds, 
+    //   like from time_in_nanoseconds_monotonic), pass it as source_time.
+    inline void write_end(monotonic_time_t source_time=0) {
+        mem->header.write_time = time_in_nanoseconds_monotonic();
+        mem->header.source_time = source_time;
+        last_wake = last_update = __atomic_add_fetch(&mem->header.updates,2,__ATOMIC_SEQ_CST);
+        if (1==__atomic_fetch_sub(&mem->header.writers,1,__ATOMIC_SEQ_CST)) // we were the last writer
+            __atomic_fetch_and(&mem->header.flags,~(uint32_t)(data_exchange_disk_header::flag_being_written),__ATOMIC_RELAXED);
         mem->footer.eof = data_exchange_disk_footer::eof_value;
-        // Do I want a write fence here?  std::atomic_thread_fence(std::memory_order_release);
+        wake_waiters();
     }
     
     // Close this data_exchange
@@ -230,7 +488,21 @@ private:
     std::string filename;
     data_exchange_mmap mmap;
     data_exchange_ondisk<T> *mem; // mmap'd file
-    uint32_t last_update; // last-seen value of updates
+    
+    // Make one attempt to copy(shared_data) with no writer active.
+    //   Checks the writer count after updates (and again before it), so a writer 
+    //   that started during the copy is either still counted, or has bumped updates.
+    template <class copier>
+    bool try_copy(copier copy) {
+        uint32_t before = __atomic_load_n(&mem->header.updates,__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&mem->header.writers,__ATOMIC_ACQUIRE)!=0) return false; // a write is in progress now
+        copy((const T &)mem->data);
+        std::atomic_thread_fence(std::memory_order_acquire); // copy finishes before the re-check
+        if (__atomic_load_n(&mem->header.writers,__ATOMIC_ACQUIRE)!=0) return false; // a writer got in during our copy
+        if (before!=__atomic_load_n(&mem->header.updates,__ATOMIC_RELAXED)) return false; // ...and finished
+        last_wake = last_update = before;
+        return true;
+    }
     
     // Don't copy or assign this type
     data_exchange(const data_exchange &e) =delete;
@@ -250,6 +522,8 @@ data_exchange<T>::data_exchange(const std::string &name)
      mmap(filename.c_str(),sizeof(data_exchange_ondisk<T>))
 {
     mem = (data_exchange_ondisk<T> *)mmap.mem;
+    header = &mem->header;
+    reset_old_layout(mem,sizeof(*mem),filename);
     
     // Check the file's internal length attribute
     uint64_t old_size=mem->header.T_size;
@@ -271,16 +545,159 @@ data_exchange<T>::data_exchange(const std::string &name)
 template <typename T>
 uint32_t data_exchange<T>::check(const char *when)
 {
+    bool bad_layout = mem->header.layout != data_exchange_disk_header::layout_value;
     bool bad_size = mem->header.T_size != sizeof(T);
     bool bad_eof = mem->footer.eof != data_exchange_disk_footer::eof_value;
-    if (bad_size || bad_eof)
+    if (bad_layout || bad_size || bad_eof)
     {
-        throw std::runtime_error(std::string("Data exchange error: ")+when+" "+__FILE__+" found unexpected data in "+filename+":"+(bad_size?" invalid header size":"")+(bad_eof?" invalid eof marker":"")+".  Is another version running using a different data size?");
+        throw std::runtime_error(std::string("Data exchange error: ")+when+" "+__FILE__+" found unexpected data in "+filename+":"+(bad_layout?" invalid header layout":"")+(bad_size?" invalid header size":"")+(bad_eof?" invalid eof marker":"")+".  Is another version running using a different data size?");
     }
     return mem->header.updates;
 }
 
 
+/**
+ The on-disk format for a data_exchange_ring: a history of the last N values.
+ Each entry has its own seqlock sequence number, which is 2*k+2 once 
+ push number k (counting from zero) has finished writing that entry.
+*/
+template <typename T,int N>
+struct data_exchange_ring_ondisk {
+public:
+    data_exchange_disk_header header; // updates changes with every push
+    
+    uint64_t head; // total number of values ever pushed
+    
+    struct entry {
+        uint64_t sequence; // odd while being written, 2*k+2 after push k finishes
+        monotonic_time_t time; // CLOCK_MONOTONIC time of the push, in nanoseconds
+        T data;
+    };
+    entry entries[N];
+    
+    data_exchange_disk_footer footer;
+};
+
+/**
+ A single-writer, multi-reader ring buffer of the last N values of type T, 
+ in a data exchange file.  Unlike data_exchange, readers that wake up late 
+ don't just see the latest value, they can walk every value pushed since
+ their last read (up to N back).  
+ 
+ Each reader process has its own cursor, so readers don't interfere.
+ 
+ Typical writer:
+    ring.push(value);
+ Typical reader:
+    ring.wait_for_update(30);
+    T value;
+    while (ring.next(value)) { ... process every value in order ... }
+*/
+template <typename T,int N>
+class data_exchange_ring : public data_exchange_channel {
+#if !defined(__GNUC__) || __GNUC__>=5 // missing from gcc 4
+    static_assert(std::is_trivially_copyable<T>::value, "Data exchange ring datatypes are exchanged as raw bytes in files, so they must be trivially copyable.");
+#endif
+public:
+    typedef data_exchange_ring_ondisk<T,N> ondisk_t;
+    typedef typename ondisk_t::entry entry_t;
+    
+    // Open this ring.  Readers start at the newest value.
+    data_exchange_ring(const std::string &name)
+        :filename(DATA_EXCHANGE_DIR+name),
+         mmap(filename.c_str(),sizeof(ondisk_t)),
+         missed(0)
+    {
+        mem = (ondisk_t *)mmap.mem;
+        header = &mem->header;
+        reset_old_layout(mem,sizeof(*mem),filename);
+        
+        uint64_t old_size=mem->header.T_size;
+        if (old_size != 0 && old_size != sizeof(entry_t)*N) {
+            printf("Upgrading data exchange ring %s from %ld byte to %ld byte size\n",
+                filename.c_str(), (long)old_size, (long)sizeof(entry_t)*N);
+            mem->head=0; // old entries are garbage now
+            for (entry_t &e:mem->entries) e.sequence=0;
+        }
+        mem->header.T_size = sizeof(entry_t)*N;
+        mem->footer.eof = data_exchange_disk_footer::eof_value;
+        
+        cursor = head();
+        last_update = mem->header.updates;
+    }
+    
+    // Writer: add a new value to the ring (overwriting the oldest if full).
+    //   There should only be one writer for each ring.
+    void push(const T &value,monotonic_time_t time=time_in_nanoseconds_monotonic()) {
+        uint64_t k=__atomic_load_n(&mem->head,__ATOMIC_RELAXED);
+        entry_t &e=mem->entries[k%N];
+        __atomic_store_n(&e.sequence,2*k+1,__ATOMIC_RELAXED); // odd: being written
+        std::atomic_thread_fence(std::memory_order_release);
+        e.time=time;
+        e.data=value;
+        __atomic_store_n(&e.sequence,2*k+2,__ATOMIC_RELEASE); // even: finished
+        __atomic_store_n(&mem->head,k+1,__ATOMIC_RELEASE);
+        mem->header.write_time=time;
+        mem->header.source_time=time;
+        
+        __atomic_add_fetch(&mem->header.updates,2,__ATOMIC_SEQ_CST); // stays even, wakes waiters
+        wake_waiters();
+    }
+    
+    // Return the total number of values ever pushed.
+    uint64_t head(void) const {
+        return __atomic_load_n(&mem->head,__ATOMIC_ACQUIRE);
+    }
+    
+    // Reader: copy out the next value we haven't read yet.
+    //   Returns false if we've read everything pushed so far.
+    //   Values overwritten before we got to them are skipped (see missed()).
+    bool next(T &out,monotonic_time_t *time=0) {
+        while (true) {
+            uint64_t h=head();
+            last_wake = last_update = mem->header.updates;
+            if (cursor>=h) return false;
+            if (h-cursor>N) { // writer lapped us: skip ahead to the oldest still in the ring
+                missed+=h-N-cursor;
+                cursor=h-N;
+            }
+            
+            const entry_t &e=mem->entries[cursor%N];
+            uint64_t want=2*cursor+2;
+            if (__atomic_load_n(&e.sequence,__ATOMIC_ACQUIRE)==want) {
+                memcpy((void *)&out,(const void *)&e.data,sizeof(T));
+                monotonic_time_t t=e.time;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (__atomic_load_n(&e.sequence,__ATOMIC_RELAXED)==want) {
+                    if (time) *time=t;
+                    cursor++;
+                    return true;
+                }
+            }
+            // Entry was overwritten while we looked: loop around to skip ahead
+            if (head()-cursor<=N) { missed++; cursor++; }
+        }
+    }
+    
+    // Reader: skip everything pushed so far, so next() only returns new values.
+    void skip_to_latest(void) { cursor=head(); }
+    
+    // Reader: number of values that were overwritten before we could read them.
+    uint64_t missed_count(void) const { return missed; }
+    
+private:
+    std::string filename;
+    data_exchange_mmap mmap;
+    ondisk_t *mem; // mmap'd file
+    uint64_t cursor; // index of next value this reader will return
+    uint64_t missed; // values overwritten before we read them
+    
+    // Don't copy or assign this type
+    data_exchange_ring(const data_exchange_ring &e) =delete;
+    void operator=(const data_exchange_ring &e) =delete;
+};
+
+
 // Millisecond timestamps
 // Wraps around every half billion years
 typedef uint64_t millsecond_time_t;
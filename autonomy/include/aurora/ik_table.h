@@ -0,0 +1,474 @@
+/*
+  Precomputed inverse kinematics and reachability table for the excahauler arm.
+
+  excahauler_IK::solve_tilt puts the tilt pivot (the end of the stick) at a
+  point in the frame's YZ plane.  This table samples the boom and stick
+  angles that does it on a grid over the whole YZ workspace (the boom and
+  stick ranges from link_geometry), so a solve is a bilinear lookup plus
+  a Newton step on the two-link arm, with no trig inverse functions.
+
+  It also keeps two bitmaps:
+    reachable: the tilt pivot can get here within the boom and stick limits.
+    clear: with the tool at this angle too, every joint is in range, and the
+       grinder and tool back stay clear of the scoop and boom (using the
+       hazard points in excahaul_collision.h, for the table's fork and dump).
+  A sample is only clear if the tool has enough clearance to cover moving
+  half a sample, and its neighbors are clear too (so joint limits are
+  covered), which makes the nearest-sample lookup conservative.
+
+  The table takes a fraction of a second to build on all cores, so kinematics/ik/ik_table_gen
+  builds it once and saves it; programs load() it with mmap at startup.
+
+  Needs aurora/kinematic_links.cpp included first (for excahauler_IK and
+  the collision geometry).
+
+  This file is Public Domain.
+*/
+#ifndef __AURORA_IK_TABLE_H
+#define __AURORA_IK_TABLE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <errno.h>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "aurora/kinematics.h"
+
+namespace aurora {
+
+/**
+ Return how far (meters) the grinder and tool back are from the scoop and boom
+ in this joint state, less the safety gaps in excahaul_collision.h.
+ Negative means they hit, or the grinder head is down inside the scoop.
+ This is the static geometry behind joint_move_hazards.
+*/
+inline float arm_clearance(const robot_joint_state &joint)
+{
+    robot_link_coords links(joint);
+    const robot_coord3D &tool = links.coord3D(link_grinder);
+    const robot_coord3D &scoop = links.coord3D(link_dump);
+    const robot_coord3D &boom = links.coord3D(link_boom);
+
+    // Fix the 45 degree scoop offset, like joint_move_hazards
+    robot_coord3D mod_scoop = scoop;
+    float scoop_Y_angle = atan(scoop.Y.z/scoop.Y.y) + (3.1416f/4.0f);
+    float scoop_Z_angle = atan(scoop.Z.z/scoop.Z.y) + (3.1416f/4.0f);
+    mod_scoop.Y = vec3(0, cos(scoop_Y_angle), sin(scoop_Y_angle));
+    mod_scoop.Z = vec3(0, cos(scoop_Z_angle), sin(scoop_Z_angle));
+
+    vec3 tip = mod_scoop.local_from_world(tool.world_from_local(MINING_HEAD_MID));
+    vec3 back_lower = mod_scoop.local_from_world(tool.world_from_local(TOOL_BACK_LOWER));
+    vec3 back_upper = mod_scoop.local_from_world(tool.world_from_local(TOOL_BACK_UPPER));
+
+    // Grinder head down inside the scoop: the same box joint_move_hazards uses,
+    //   but as a distance (negative inside), so it changes smoothly with the joints
+    const float head = MINING_HEAD_R+SAFE_DIST;
+    float out_y=std::max(SCOOP_HAZ_UPPER.y-head-tip.y, tip.y-(SCOOP_HAZ_LOWER.y+head));
+    float out_z=std::max(SCOOP_HAZ_LOWER.z-head-tip.z, tip.z-(SCOOP_HAZ_UPPER.z+head));
+    float clear = (out_y<0.0f && out_z<0.0f)? std::max(out_y,out_z) :
+        sqrtf(std::max(out_y,0.0f)*std::max(out_y,0.0f)+std::max(out_z,0.0f)*std::max(out_z,0.0f));
+
+    // Grinder head against the scoop bottom and back
+    clear = std::min(clear, point_to_line_dist(SCOOP_HAZ_MID, SCOOP_HAZ_LOWER, tip)-head);
+    clear = std::min(clear, point_to_line_dist(SCOOP_HAZ_MID, SCOOP_HAZ_UPPER, tip)-head);
+
+    // Back of the tool against the scoop lip
+    clear = std::min(clear, point_to_line_dist(back_upper, back_lower, SCOOP_HAZ_UPPER)-SAFE_DIST);
+    clear = std::min(clear, point_to_line_dist(back_lower, tip, SCOOP_HAZ_UPPER)-SAFE_DIST);
+    clear = std::min(clear, point_to_line_dist(back_upper, back_lower, SCOOP_HAZ_LOWER)-SAFE_DIST);
+    clear = std::min(clear, point_to_line_dist(back_lower, tip, SCOOP_HAZ_LOWER)-SAFE_DIST);
+
+    // Grinder head and tool back against the boom
+    vec3 tip_to_boom = boom.local_from_world(tool.world_from_local(vec3(0,0,0)));
+    vec3 back_to_boom = boom.local_from_world(tool.world_from_local(TOOL_BACK_LOWER));
+    clear = std::min(clear, point_to_line_dist(BOOM_HAZ_LOWER, BOOM_HAZ_UPPER, tip_to_boom)-head);
+    clear = std::min(clear, point_to_line_dist(BOOM_HAZ_LOWER, BOOM_HAZ_UPPER, back_to_boom)-SAFE_DIST);
+    return clear;
+}
+
+
+/** On-disk header of an IK table file.  The arrays follow,
+  at the offsets excahauler_IK_table::layout computes. */
+struct excahauler_IK_table_header {
+    char magic[8]; // "AURIKTB"
+    uint32_t version; // file layout version
+    uint32_t geometry; // excahauler_IK_table::geometry_hash when built
+    int32_t ny, nz; // grid samples along frame Y and Z
+    int32_t ntool; // tool angle bins, covering -180 to +180 degrees
+    float y0, z0; // frame coordinates of sample 0 (meters)
+    float cell; // spacing between samples (meters)
+    float dtool; // size of each tool angle bin (degrees)
+    float fork, dump; // scoop joint angles used for the clear bitmap
+    uint64_t bytes; // total length of the file
+};
+
+/**
+ Lookup table version of excahauler_IK, with reachability and clearance.
+   Example:
+     excahauler_IK_table table;
+     if (!table.load("excahauler_ik.table")) ... // fall back to excahauler_IK
+     if (table.clear(tilt_loc,tool_deg)) table.solve_tilt(joint,tilt_loc,tool_deg);
+*/
+class excahauler_IK_table {
+public:
+    enum {version=1};
+
+    excahauler_IK_table()
+        :map(0), map_len(0), h(0)
+    {
+        const robot_link_geometry &boomG=link_geometry(link_boom), &stickG=link_geometry(link_stick), &tiltG=link_geometry(link_tilt);
+        pivot_y=boomG.origin.y; pivot_z=boomG.origin.z;
+        boom_len=length(stickG.origin); // same as excahauler_IK
+        stick_len=length(tiltG.origin);
+        boom_start=excahauler_IK::frame_degrees(stickG.origin);
+        stick_start=excahauler_IK::frame_degrees(tiltG.origin);
+    }
+    ~excahauler_IK_table() { unmap(); }
+
+    /// Return true if we have a table (from load or build)
+    bool loaded(void) const { return h!=0; }
+    const excahauler_IK_table_header &header(void) const { return *h; }
+
+    /**
+      Map this table file into memory.  Returns false (and leaves us empty)
+      if it's missing, or was built for different robot geometry.
+    */
+    bool load(const char *filename,bool verbose=true) {
+        unmap(); memory.clear(); h=0;
+        int fd=open(filename,O_RDONLY);
+        if (fd<0) {
+            if (verbose) printf("IK table %s: can't open (%s)\n",filename,strerror(errno));
+            return false;
+        }
+        struct stat st;
+        size_t len=(0==fstat(fd,&st))?(size_t)st.st_size:0;
+        void *mem=(len>=sizeof(excahauler_IK_table_header))?mmap(0,len,PROT_READ,MAP_PRIVATE,fd,0):MAP_FAILED;
+        close(fd);
+        if (mem==MAP_FAILED) {
+            if (verbose) printf("IK table %s: can't map %zd bytes\n",filename,len);
+            return false;
+        }
+        map=mem; map_len=len;
+
+        const excahauler_IK_table_header *hdr=(const excahauler_IK_table_header *)mem;
+        const char *problem=0;
+        if (0!=memcmp(hdr->magic,"AURIKTB",8) || hdr->version!=version) problem="not an IK table, or an old version";
+        else if (hdr->geometry!=geometry_hash()) problem="built for different robot geometry (rebuild it)";
+        else if (hdr->bytes!=len || layout(*hdr).bytes!=len) problem="wrong length";
+        if (problem) {
+            if (verbose) printf("IK table %s: %s\n",filename,problem);
+            unmap();
+            return false;
+        }
+        attach(hdr);
+        return true;
+    }
+
+    /// Write our table to this file.  Returns false on errors.
+    bool save(const char *filename) const {
+        if (!h) return false;
+        FILE *f=fopen(filename,"wb");
+        if (!f) return false;
+        bool ok=(1==fwrite(h,h->bytes,1,f));
+        return (0==fclose(f)) && ok;
+    }
+
+    /**
+      Compute the table in memory, with samples every cell meters,
+      tool angle bins every dtool degrees, and these scoop angles
+      (default: mine_joint_base).  Uses threads threads (0 for all cores).
+    */
+    void build(float fork=-17.0f,float dump=-30.0f,float cell=0.01f,float dtool=2.0f,int threads=0)
+    {
+        unmap();
+        excahauler_IK_table_header hdr;
+        memset(&hdr,0,sizeof(hdr));
+        memcpy(hdr.magic,"AURIKTB",8);
+        hdr.version=version;
+        hdr.geometry=geometry_hash();
+        hdr.cell=cell; hdr.dtool=dtool;
+        hdr.ntool=(int)ceilf(360.0f/dtool);
+        hdr.fork=fork; hdr.dump=dump;
+
+        // Find the workspace: everywhere the tilt pivot can go within the boom and stick limits
+        const robot_link_geometry &boomG=link_geometry(link_boom), &stickG=link_geometry(link_stick);
+        float ylo=1.0e3, yhi=-1.0e3, zlo=1.0e3, zhi=-1.0e3;
+        for (float b=boomG.angle_min;b<=boomG.angle_max;b+=0.5f)
+        for (float s=stickG.angle_min;s<=stickG.angle_max;s+=0.5f) {
+            float y,z;
+            tilt_pivot(b,s,y,z);
+            ylo=std::min(ylo,y); yhi=std::max(yhi,y);
+            zlo=std::min(zlo,z); zhi=std::max(zhi,z);
+        }
+        const int pad=3; // samples of margin, so interpolation works right up to the edges
+        hdr.y0=floorf(ylo/cell-pad)*cell; hdr.z0=floorf(zlo/cell-pad)*cell;
+        hdr.ny=(int)ceilf((yhi-hdr.y0)/cell)+pad+1;
+        hdr.nz=(int)ceilf((zhi-hdr.z0)/cell)+pad+1;
+
+        table_layout L=layout(hdr);
+        hdr.bytes=L.bytes;
+        memory.assign((L.bytes+7)/8,0);
+        memcpy(&memory[0],&hdr,sizeof(hdr));
+        attach((const excahauler_IK_table_header *)&memory[0]);
+
+        // Rows of Y are independent, so split them across threads
+        if (threads<=0) threads=std::max(1u,std::thread::hardware_concurrency());
+        std::vector<uint8_t> raw((size_t)hdr.ny*hdr.nz*hdr.ntool,0); // un-eroded clear bits
+        std::vector<std::thread> workers;
+        for (int t=0;t<threads;t++)
+            workers.push_back(std::thread([&,t]() {
+                for (int iy=t;iy<hdr.ny;iy+=threads) build_row(iy,raw);
+            }));
+        for (std::thread &w:workers) w.join();
+
+        // Erode the clear bitmap by one sample (Y, Z, and tool angle, which wraps around)
+        uint64_t *clear_bits=(uint64_t *)(base()+L.clear);
+        for (int iy=1;iy+1<hdr.ny;iy++)
+        for (int iz=1;iz+1<hdr.nz;iz++)
+        for (int it=0;it<hdr.ntool;it++) {
+            int prev=(it+hdr.ntool-1)%hdr.ntool, next=(it+1)%hdr.ntool;
+            if (raw[clear_index(iy,iz,it)] && raw[clear_index(iy,iz,prev)] && raw[clear_index(iy,iz,next)]
+             && raw[clear_index(iy-1,iz,it)] && raw[clear_index(iy+1,iz,it)]
+             && raw[clear_index(iy,iz-1,it)] && raw[clear_index(iy,iz+1,it)])
+                set_bit(clear_bits,clear_index(iy,iz,it));
+        }
+    }
+
+    /**
+      Interpolate the boom and stick angles that put the tilt pivot at
+      frame (y,z).  Returns false where the table can't say (near or past
+      the edge of the arm's reach).
+    */
+    bool lookup(float y,float z,float &boom,float &stick) const {
+        float fy=(y-h->y0)*inv_cell, fz=(z-h->z0)*inv_cell;
+        if (!(fy>=0.0f && fz>=0.0f)) return false; // also catches NaN
+        int iy=(int)fy, iz=(int)fz;
+        if (iy+1>=h->ny || iz+1>=h->nz) return false;
+        float ay=fy-iy, az=fz-iz;
+        size_t i=(size_t)iy*h->nz+iz;
+        const float *B=boom_table, *S=stick_table;
+        float b00=B[i], b01=B[i+1], b10=B[i+h->nz], b11=B[i+h->nz+1];
+        if (!(b00==b00 && b01==b01 && b10==b10 && b11==b11)) return false; // a corner is out of reach
+        if (fabsf(b00-b11)>90.0f || fabsf(b01-b10)>90.0f) return false; // straddles the wrap behind the boom pivot
+        float s00=S[i], s01=S[i+1], s10=S[i+h->nz], s11=S[i+h->nz+1];
+        float b0=b00+az*(b01-b00), b1=b10+az*(b11-b10);
+        float s0=s00+az*(s01-s00), s1=s10+az*(s11-s10);
+        boom=b0+ay*(b1-b0);
+        stick=s0+ay*(s1-s0);
+        return true;
+    }
+
+    /**
+      Same interface and answers as excahauler_IK::solve_tilt: set the boom
+      and stick to put the tilt pivot at tilt_loc, and the tilt to point the
+      tool at tool_deg.  Returns 1 if reachable, -1 if too far.
+      Interpolates the table, then takes a Newton step or two on the two-link arm,
+      which lands within a few microns; falls back to excahauler_IK at the edges.
+    */
+    int solve_tilt(robot_joint_state &joint,const vec3 &tilt_loc,float tool_deg) const {
+        // Exact reach test: the boom and stick make a triangle with the target
+        float dy=tilt_loc.y-pivot_y, dz=tilt_loc.z-pivot_z;
+        float b2=dy*dy+dz*dz;
+        float lo=boom_len-stick_len, hi=boom_len+stick_len;
+        const float edge=1.0e-4f; // right at the edge, let excahauler_IK's roundoff decide
+        if (b2>hi*hi*(1.0f+edge) || b2<lo*lo*(1.0f-edge)) return -1;
+
+        float boom, stick;
+        if (b2>hi*hi*(1.0f-edge) || b2<lo*lo*(1.0f+edge) ||
+            !lookup(tilt_loc.y,tilt_loc.z,boom,stick) || !refine(tilt_loc.y,tilt_loc.z,boom,stick))
+            return ik.solve_tilt(joint,tilt_loc,tool_deg);
+
+        joint.angle.boom=boom;
+        joint.angle.stick=stick;
+        joint.angle.tilt = tool_deg - stick - boom; // like excahauler_IK
+        if (joint.angle.tilt<-180.0f) joint.angle.tilt+=360.0f;
+        return 1;
+    }
+
+    /// Return true if the tilt pivot can reach frame (y,z) within the boom and stick limits
+    bool reachable(const vec3 &tilt_loc) const {
+        int iy, iz;
+        if (!nearest(tilt_loc,iy,iz)) return false;
+        return get_bit(reach_bits,(size_t)iy*h->nz+iz);
+    }
+
+    /// Return true if the arm can put the tilt pivot here and the tool at this angle,
+    ///  with every joint in range and the tool clear of the scoop and boom.
+    bool clear(const vec3 &tilt_loc,float tool_deg) const {
+        int iy, iz;
+        if (!nearest(tilt_loc,iy,iz) || !(tool_deg==tool_deg)) return false;
+        float f=(tool_deg+180.0f)*inv_dtool;
+        int it=(int)floorf(f)%h->ntool;
+        if (it<0) it+=h->ntool;
+        return get_bit(clear_bits,clear_index(iy,iz,it));
+    }
+
+    /**
+      Hash of everything the table depends on: the arm link geometry and
+      limits, and the collision geometry.  A table file with a different
+      hash is stale and won't load.
+    */
+    static uint32_t geometry_hash(void) {
+        uint32_t hash=2166136261u; // FNV-1a
+        auto add=[&](const void *data,size_t len) {
+            for (size_t i=0;i<len;i++) { hash^=((const uint8_t *)data)[i]; hash*=16777619u; }
+        };
+        auto add_vec=[&](const vec3 &v) { add(&v.x,sizeof(float)); add(&v.y,sizeof(float)); add(&v.z,sizeof(float)); };
+        for (int i=0;i<link_count;i++) {
+            const robot_link_geometry &G=link_geometry(robot_link_index(i));
+            int ints[4]={G.index,G.parent,G.axis,G.joint_index};
+            float floats[3]={G.fixed_angle,G.angle_min,G.angle_max};
+            add(ints,sizeof(ints)); add(floats,sizeof(floats)); add_vec(G.origin);
+        }
+        float floats[2]={SAFE_DIST,MINING_HEAD_R};
+        add(floats,sizeof(floats));
+        const vec3 points[9]={TOOL_BACK_LOWER,TOOL_BACK_UPPER,MINING_HEAD_MID,
+            SCOOP_HAZ_UPPER,SCOOP_HAZ_MID,SCOOP_HAZ_LOWER,SCOOP_HAZ_OUTER,BOOM_HAZ_LOWER,BOOM_HAZ_UPPER};
+        for (const vec3 &p:points) add_vec(p);
+        return hash;
+    }
+
+private:
+    std::vector<uint64_t> memory; // our table when we built it ourselves
+    void *map; size_t map_len; // our table when load()ed from a file
+    const excahauler_IK_table_header *h; // header of our table (in memory or map)
+    const float *boom_table, *stick_table; // angles at each sample, NAN if out of reach
+    const uint64_t *reach_bits, *clear_bits;
+    float inv_cell, inv_dtool;
+    mutable excahauler_IK ik; // solve_tilt isn't const, but doesn't change anything
+
+    // Two-link arm in the frame YZ plane: boom pivot, link lengths, and link origin angles
+    float pivot_y, pivot_z, boom_len, stick_len, boom_start, stick_start;
+
+    /// Byte offsets of each array in the table
+    struct table_layout {
+        size_t boom, stick, reach, clear, bytes;
+    };
+    static size_t align64(size_t n) { return (n+63)&~(size_t)63; }
+    static table_layout layout(const excahauler_IK_table_header &hdr) {
+        table_layout L;
+        size_t cells=(size_t)hdr.ny*hdr.nz;
+        L.boom=align64(sizeof(hdr));
+        L.stick=align64(L.boom+cells*sizeof(float));
+        L.reach=align64(L.stick+cells*sizeof(float));
+        L.clear=align64(L.reach+(cells+63)/64*8);
+        L.bytes=align64(L.clear+(cells*hdr.ntool+63)/64*8);
+        return L;
+    }
+
+    const char *base(void) const { return (const char *)h; }
+    void attach(const excahauler_IK_table_header *hdr) {
+        h=hdr;
+        table_layout L=layout(*h);
+        boom_table=(const float *)(base()+L.boom);
+        stick_table=(const float *)(base()+L.stick);
+        reach_bits=(const uint64_t *)(base()+L.reach);
+        clear_bits=(const uint64_t *)(base()+L.clear);
+        inv_cell=1.0f/h->cell;
+        inv_dtool=1.0f/h->dtool;
+    }
+    void unmap(void) {
+        if (map) munmap(map,map_len);
+        if (map && h==map) h=0;
+        map=0; map_len=0;
+    }
+
+    size_t clear_index(int iy,int iz,int it) const { return ((size_t)iy*h->nz+iz)*h->ntool+it; }
+    static bool get_bit(const uint64_t *bits,size_t i) { return (bits[i>>6]>>(i&63))&1; }
+    static void set_bit(uint64_t *bits,size_t i) { bits[i>>6] |= (uint64_t)1<<(i&63); }
+
+    bool nearest(const vec3 &p,int &iy,int &iz) const {
+        float fy=(p.y-h->y0)*inv_cell+0.5f, fz=(p.z-h->z0)*inv_cell+0.5f;
+        if (!(fy>=0.0f && fz>=0.0f)) return false;
+        iy=(int)fy; iz=(int)fz;
+        return iy<h->ny && iz<h->nz;
+    }
+
+    /// Frame YZ location of the tilt pivot for these boom and stick angles
+    void tilt_pivot(float boom,float stick,float &y,float &z) const {
+        float t1=(boom+boom_start)*float(DEG2RAD), t12=(boom+stick+stick_start)*float(DEG2RAD);
+        y=pivot_y+boom_len*cosf(t1)+stick_len*cosf(t12);
+        z=pivot_z+boom_len*sinf(t1)+stick_len*sinf(t12);
+    }
+
+    /// Newton steps moving boom and stick to put the tilt pivot at (y,z).
+    ///  Usually one step is plenty, but the interpolation is worse where the arm
+    ///  is nearly straight or folded, so we take another if the first was big.
+    ///  Returns false if the arm is too close to straight for this to be stable.
+    bool refine(float y,float z,float &boom,float &stick) const {
+        float step;
+        if (!newton(y,z,boom,stick,step)) return false;
+        if (step>0.01f && !newton(y,z,boom,stick,step)) return false;
+        return true;
+    }
+    bool newton(float y,float z,float &boom,float &stick,float &step) const {
+        float t1=(boom+boom_start)*float(DEG2RAD), t12=(boom+stick+stick_start)*float(DEG2RAD);
+        float c1=cosf(t1), s1=sinf(t1), c12=cosf(t12), s12=sinf(t12);
+        float ey=y-(pivot_y+boom_len*c1+stick_len*c12);
+        float ez=z-(pivot_z+boom_len*s1+stick_len*s12);
+        // Jacobian of the pivot location by the boom angle, and the stick angle
+        float j00=-boom_len*s1-stick_len*s12, j01=-stick_len*s12;
+        float j10=boom_len*c1+stick_len*c12, j11=stick_len*c12;
+        float det=j00*j11-j01*j10; // == boom_len*stick_len*sin(elbow angle)
+        if (fabsf(det)<0.1f*boom_len*stick_len) return false;
+        float inv=float(RAD2DEG)/det;
+        float db=(j11*ey-j01*ez)*inv, ds=(j00*ez-j10*ey)*inv;
+        boom+=db; stick+=ds;
+        step=fabsf(db)+fabsf(ds); // degrees
+        return true;
+    }
+
+    /// Fill in row iy of the angle tables and reach bits, and the raw clear flags
+    void build_row(int iy,std::vector<uint8_t> &raw) {
+        char *b=(char *)base();
+        table_layout L=layout(*h);
+        float *B=(float *)(b+L.boom), *S=(float *)(b+L.stick);
+        uint64_t *reach=(uint64_t *)(b+L.reach);
+        const robot_link_geometry &boomG=link_geometry(link_boom), &stickG=link_geometry(link_stick), &tiltG=link_geometry(link_tilt);
+        excahauler_IK solver;
+        robot_joint_state joint={h->fork,h->dump,0,0,0,0};
+        
+        // A lookup can be half a sample away in Y, Z, and tool angle, which
+        //  moves the tool by up to this much, so that's how clear we need to be.
+        robot_link_coords links(joint);
+        const robot_coord3D &tilt=links.coord3D(link_tilt), &tool=links.coord3D(link_grinder);
+        float tool_reach=0.0f;
+        const vec3 tool_points[4]={vec3(0,0,0),MINING_HEAD_MID,TOOL_BACK_LOWER,TOOL_BACK_UPPER};
+        for (const vec3 &p:tool_points) tool_reach=std::max(tool_reach,length(tool.world_from_local(p)-tilt.origin));
+        const float margin=0.5f*h->cell*sqrtf(2.0f) + tool_reach*0.5f*h->dtool*float(DEG2RAD);
+        for (int iz=0;iz<h->nz;iz++) {
+            size_t i=(size_t)iy*h->nz+iz;
+            vec3 target(0,h->y0+iy*h->cell,h->z0+iz*h->cell);
+            if (solver.solve_tilt(joint,target,0.0f)<=0) {
+                B[i]=S[i]=NAN;
+                continue;
+            }
+            B[i]=joint.angle.boom; S[i]=joint.angle.stick;
+            if (joint.angle.boom<boomG.angle_min || joint.angle.boom>boomG.angle_max ||
+                joint.angle.stick<stickG.angle_min || joint.angle.stick>stickG.angle_max) continue;
+            // Each row has its own 64-bit words only if nz is a multiple of 64, so set bits atomically
+            __atomic_fetch_or(&reach[i>>6],(uint64_t)1<<(i&63),__ATOMIC_RELAXED);
+
+            for (int it=0;it<h->ntool;it++) {
+                float tool_deg=-180.0f+(it+0.5f)*h->dtool;
+                float tilt=tool_deg-joint.angle.stick-joint.angle.boom; // like solve_tilt
+                if (tilt<-180.0f) tilt+=360.0f;
+                if (tilt<tiltG.angle_min || tilt>tiltG.angle_max) continue;
+                joint.angle.tilt=tilt;
+                if (joint_state_sane(joint) && arm_clearance(joint)>=margin)
+                    raw[clear_index(iy,iz,it)]=1;
+            }
+        }
+    }
+};
+
+}; /* end namespace aurora */
+
+#endif
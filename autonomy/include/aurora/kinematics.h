@@ -10,6 +10,8 @@ Dr. Orion Lawlor, lawlor@alaska.edu, 2023-03-08 (Public Domain)
 #ifndef __AURORA_ROBOT_KINEMATICS_H
 #define __AURORA_ROBOT_KINEMATICS_H
 
+#include <vector>
+#include <stdexcept>
 #include "../aurora/coords.h"
 
 namespace aurora {
@@ -100,6 +102,8 @@ struct robot_link_geometry {
 const robot_link_geometry &link_geometry(robot_link_index L);
 
 /** This class does coordinate system transforms for all robot links. 
+  Each link is only computed when you ask for it (along with its parents),
+  so keep one around and set_state it to reuse the links that didn't move.
 */
 class robot_link_coords {
 public:
@@ -175,6 +179,39 @@ public:
         return parent;
     }
 
+    /**
+     Return the coordinate system for just this one link, in this joint state,
+     computing only the links between it and the frame (e.g., a camera).
+     Gives the same answer as robot_link_coords(state,frameCoords).coord3D(L).
+    */
+    static robot_coord3D chain_coord3D(robot_link_index L,const robot_joint_state &state,const robot_coord3D &frameCoords=robot_coord3D())
+    {
+        if (L<=link_frame) {
+            if (L==link_frame) return frameCoords;
+            if (L==link_pit) return robot_coord3D();
+            throw std::runtime_error("Invalid link index in robot_link_coords::chain_coord3D");
+        }
+
+        // Walk up to the frame, recording the chain
+        robot_link_index chain[link_count];
+        int n=0;
+        for (robot_link_index curL=L; curL>link_frame; curL=link_geometry(curL).parent)
+        {
+            if (n>=link_count) throw std::runtime_error("robot_link_coords::chain_coord3D loop in parent walk");
+            chain[n++]=curL;
+        }
+
+        // Walk back down, composing transforms like compute does
+        robot_coord3D parent=frameCoords, cur;
+        while (n-->0) {
+            const robot_link_geometry &G=link_geometry(chain[n]);
+            cur.origin=parent.world_from_local(G.origin);
+            rotate_link(cur,parent,G.axis,link_degrees(chain[n],state));
+            parent=cur;
+        }
+        return parent;
+    }
+
 #ifdef __gl_h_ /* OpenGL support */
     /// Apply the incremental OpenGL transform to get from this link to its parent.
     static void glTransform(robot_link_index L,const robot_joint_state &state)
@@ -193,36 +230,225 @@ public:
 #endif
 
 
-/** Initialize this object from a joint state, to get coordinate transforms for all the robot's links. */
+/** Initialize this object from a joint state, to get coordinate transforms for the robot's links. 
+    Links are computed on demand by coord3D, and kept until their joints change. */
     robot_link_coords(const robot_joint_state &state_, robot_coord3D frameCoords=robot_coord3D())
         :state(state_) 
     {
-        links[link_pit].reset(); // pit has identity coordinate system
-        links[link_frame]=frameCoords;
-    // Preemptively fill in all coordinate system transforms. 
-    //  (future alternative option: memoize on-demand computed coordinate systems)
-        for (int i=link_frame+1;i<link_count;i++)
-        {
-            robot_link_index L=robot_link_index(i);
-            const robot_link_geometry &G=link_geometry(L);
-            const robot_coord3D &parent=(G.parent>=0)?links[G.parent]:links[link_pit];
-            links[L].origin=parent.world_from_local(G.origin);
-            rotate_link(links[L],parent,G.axis,link_degrees(L,state));
-        }
+        set_frame(frameCoords);
     }
 
 /** Access the coordinate transform for this robot link */
     const robot_coord3D &coord3D(robot_link_index L) {
-        if (L>=0 && L<link_count) return links[L];
+        if (L>=0 && L<link_count) {
+            if (!(valid & (1u<<L))) compute(L);
+            return links[L];
+        }
         else throw std::runtime_error("Invalid link index in robot_link_coords::coord3D");
     }
     
+/** Move to this new joint state.  Only links downstream of a joint 
+    that actually changed get recomputed (on their next coord3D). */
+    void set_state(const robot_joint_state &newState) {
+        for (int j=0;j<robot_joint_state::count;j++)
+            if (newState.array[j]!=state.array[j]) valid &= ~joint_dependents(j);
+        state=newState;
+    }
+    
+/** Move the robot frame to these coordinates.  All the links move with it. */
+    void set_frame(const robot_coord3D &frameCoords) {
+        links[link_pit].reset(); // pit has identity coordinate system
+        links[link_frame]=frameCoords;
+        valid=(1u<<link_pit)|(1u<<link_frame);
+    }
+    
+    const robot_joint_state &get_state(void) const { return state; }
+    
+/** Return a bitmask of the links that move when this joint (index into robot_joint_state.array) moves. */
+    static uint32_t joint_dependents(int joint) {
+        static const struct dependents_table {
+            uint32_t mask[robot_joint_state::count];
+            dependents_table() {
+                for (int j=0;j<robot_joint_state::count;j++) mask[j]=0;
+                for (int i=link_frame+1;i<link_count;i++)
+                    for (int L=i;L>link_frame;L=link_geometry(robot_link_index(L)).parent) {
+                        int j=link_geometry(robot_link_index(L)).joint_index;
+                        if (j>=0) mask[j] |= 1u<<i;
+                    }
+            }
+        } table;
+        return table.mask[joint];
+    }
+    
 private:
     robot_joint_state state;
     robot_coord3D links[link_count];
+    uint32_t valid; // bitmask of the links[] that are up to date
+    
+    // Compute this link's coordinates (and any of its parents that are out of date)
+    void compute(robot_link_index L) {
+        const robot_link_geometry &G=link_geometry(L);
+        if (G.parent==L) throw std::runtime_error("robot_link_coords::compute loop in parent walk");
+        robot_link_index P=(G.parent>=0)?G.parent:link_pit;
+        if (!(valid & (1u<<P))) compute(P);
+        const robot_coord3D &parent=links[P];
+        links[L].origin=parent.world_from_local(G.origin);
+        rotate_link(links[L],parent,G.axis,link_degrees(L,state));
+        valid |= 1u<<L;
+    }
 };
 
 
+/** Forward kinematics for many joint states at once.
+  Joint angles and results are stored as structure-of-arrays, so each
+  step down the link chain is a simple loop over states that the compiler
+  can vectorize.  Links without a joint (like the cameras and the grinder)
+  only compute their sin and cos once per batch.
+  
+  Example:
+      robot_link_batch batch(n);
+      for (int i=0;i<n;i++) batch.set_state(i,joints[i]);
+      batch.compute(link_grinder);
+      vec3 tip=batch.origin(17);
+*/
+class robot_link_batch {
+public:
+    /// Joint angles, in degrees: angles[j][i] is robot_joint_state.array[j] for state i
+    std::vector<float> angles[robot_joint_state::count];
+    
+    /// Results of the last compute(): the link's origin and X, Y, Z axes for each state
+    std::vector<float> ox,oy,oz, Xx,Xy,Xz, Yx,Yy,Yz, Zx,Zy,Zz;
+    
+    robot_link_batch(int n=0) { resize(n); }
+    
+    void resize(int n) {
+        for (std::vector<float> &a:angles) a.resize(n,0.0f);
+        for (std::vector<float> *r:results()) r->resize(n);
+    }
+    int size(void) const { return (int)ox.size(); }
+    
+    void set_state(int i,const robot_joint_state &state) {
+        for (int j=0;j<robot_joint_state::count;j++) angles[j][i]=state.array[j];
+    }
+    
+    /// Fill the result arrays with link L's coordinates in every joint state,
+    ///  for a robot frame at frameCoords (default: frame-relative).
+    void compute(robot_link_index L,const robot_coord3D &frameCoords=robot_coord3D())
+    {
+        if (L<0 || L>=link_count) throw std::runtime_error("Invalid link index in robot_link_batch::compute");
+        const int n=size();
+        
+        // Start everybody at the frame (or the pit)
+        const robot_coord3D start=(L==link_pit)?robot_coord3D():frameCoords;
+        fill(ox,start.origin.x); fill(oy,start.origin.y); fill(oz,start.origin.z);
+        fill(Xx,start.X.x); fill(Xy,start.X.y); fill(Xz,start.X.z);
+        fill(Yx,start.Y.x); fill(Yy,start.Y.y); fill(Yz,start.Y.z);
+        fill(Zx,start.Z.x); fill(Zy,start.Z.y); fill(Zz,start.Z.z);
+        
+        // Walk up to the frame, recording the chain
+        robot_link_index chain[link_count];
+        int depth=0;
+        for (robot_link_index curL=L; curL>link_frame; curL=link_geometry(curL).parent)
+        {
+            if (depth>=link_count) throw std::runtime_error("robot_link_batch::compute loop in parent walk");
+            chain[depth++]=curL;
+        }
+        
+        // Walk back down, applying each link's offset and rotation to every state
+        std::vector<float> &c=scratch_c, &s=scratch_s;
+        c.resize(n); s.resize(n);
+        while (depth-->0) {
+            const robot_link_geometry &G=link_geometry(chain[depth]);
+            translate(n,G.origin);
+            if (G.axis==axisNONE) continue;
+            if (G.joint_index<0) { // same rotation for everybody
+                float rad=G.fixed_angle*DEG2RAD;
+                fill(c,cosf(rad)); fill(s,sinf(rad));
+            }
+            else {
+                sincos_degrees(n,G.fixed_angle,&angles[G.joint_index][0],&s[0],&c[0]);
+            }
+            switch (G.axis) {
+            case axisX: rotate(n,Yx,Yy,Yz, Zx,Zy,Zz); break; // Y toward Z
+            case axisY: rotate(n,Xx,Xy,Xz, Zx,Zy,Zz); break; // X toward Z
+            case axisZ: rotate(n,Yx,Yy,Yz, Xx,Xy,Xz); break; // Y toward X
+            default: break;
+            }
+        }
+    }
+    
+    /// Extract one state's result
+    vec3 origin(int i) const { return vec3(ox[i],oy[i],oz[i]); }
+    robot_coord3D coord3D(int i) const {
+        return robot_coord3D(origin(i),vec3(Xx[i],Xy[i],Xz[i]),vec3(Yx[i],Yy[i],Yz[i]),vec3(Zx[i],Zy[i],Zz[i]));
+    }
+    
+private:
+    std::vector<float> scratch_c, scratch_s; // per-state cos and sin of the current link
+    
+    std::vector<std::vector<float> *> results(void) {
+        return {&ox,&oy,&oz, &Xx,&Xy,&Xz, &Yx,&Yy,&Yz, &Zx,&Zy,&Zz};
+    }
+    /* Sine and cosine of this angle in degrees, to about 3e-7.  Unlike sinf and cosf,
+       this is branch-free inline arithmetic, so loops calling it vectorize. */
+    static inline void sincos_degrees(float deg,float &s,float &c) {
+        // Subtract off the nearest quarter turn (exact in degrees), leaving +-45 degrees
+        int quarter=(int)(deg*(1.0f/90.0f)+copysignf(0.5f,deg));
+        float r=(deg-quarter*90.0f)*float(DEG2RAD);
+        float r2=r*r;
+        float sr=r*(1.0f+r2*(-1.0f/6+r2*(1.0f/120+r2*(-1.0f/5040))));
+        float cr=1.0f+r2*(-1.0f/2+r2*(1.0f/24+r2*(-1.0f/720+r2*(1.0f/40320))));
+        // Rotate back by the quarter turns (as arithmetic, not branches)
+        float swap=float(quarter&1);
+        float sign_s=1.0f-float(quarter&2), sign_c=1.0f-float((quarter+1)&2);
+        s=sign_s*(sr+swap*(cr-sr));
+        c=sign_c*(cr+swap*(sr-cr));
+    }
+    static void sincos_degrees(int n,float fixed,const float *__restrict__ a,float *__restrict__ s,float *__restrict__ c) {
+        for (int i=0;i<n;i++) sincos_degrees(fixed+a[i],s[i],c[i]);
+    }
+    static void fill(std::vector<float> &v,float value) {
+        for (float &f:v) f=value;
+    }
+    
+    // origin += X*o.x + Y*o.y + Z*o.z  (parent's world_from_local)
+    void translate(int n,const vec3 &o) {
+        translate(n,o.x,o.y,o.z,&ox[0],&oy[0],&oz[0],&Xx[0],&Xy[0],&Xz[0],&Yx[0],&Yy[0],&Yz[0],&Zx[0],&Zy[0],&Zz[0]);
+    }
+    static void translate(int n,float x,float y,float z,
+        float *__restrict__ px,float *__restrict__ py,float *__restrict__ pz,
+        const float *__restrict__ xx,const float *__restrict__ xy,const float *__restrict__ xz,
+        const float *__restrict__ yx,const float *__restrict__ yy,const float *__restrict__ yz,
+        const float *__restrict__ zx,const float *__restrict__ zy,const float *__restrict__ zz)
+    {
+        for (int i=0;i<n;i++) {
+            px[i]+=xx[i]*x+yx[i]*y+zx[i]*z;
+            py[i]+=xy[i]*x+yy[i]*y+zy[i]*z;
+            pz[i]+=xz[i]*x+yz[i]*y+zz[i]*z;
+        }
+    }
+    
+    // Rotate axis A toward axis B by the current cos and sin, like rotate_link:
+    //   A' = c*A + s*B;  B' = c*B - s*A
+    void rotate(int n,std::vector<float> &Ax,std::vector<float> &Ay,std::vector<float> &Az,
+                      std::vector<float> &Bx,std::vector<float> &By,std::vector<float> &Bz) 
+    {
+        rotate(n,&Ax[0],&Ay[0],&Az[0],&Bx[0],&By[0],&Bz[0],&scratch_c[0],&scratch_s[0]);
+    }
+    static void rotate(int n,
+        float *__restrict__ ax,float *__restrict__ ay,float *__restrict__ az,
+        float *__restrict__ bx,float *__restrict__ by,float *__restrict__ bz,
+        const float *__restrict__ c,const float *__restrict__ s)
+    {
+        for (int i=0;i<n;i++) {
+            float a0=ax[i], a1=ay[i], a2=az[i];
+            float b0=bx[i], b1=by[i], b2=bz[i];
+            ax[i]=c[i]*a0+s[i]*b0; ay[i]=c[i]*a1+s[i]*b1; az[i]=c[i]*a2+s[i]*b2;
+            bx[i]=c[i]*b0-s[i]*a0; by[i]=c[i]*b1-s[i]*a1; bz[i]=c[i]*b2-s[i]*a2;
+        }
+    }
+};
+
 
 }; /* end namespace */
 
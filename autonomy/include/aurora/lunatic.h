@@ -163,6 +163,11 @@ report the current drive track encoders:
 */
 #define MAKE_exchange_drive_encoders()   aurora::data_exchange<aurora::drive_encoders> exchange_drive_encoders("backend.encoders")
 
+/// History of every drive_encoders value the backend wrote, so the localizer can
+///  integrate each small step instead of one big jump when it wakes up late.
+typedef aurora::data_exchange_ring<aurora::drive_encoders,256> drive_encoders_ring;
+#define MAKE_exchange_drive_encoders_ring()   aurora::drive_encoders_ring exchange_drive_encoders_ring("backend.encoders.ring")
+
 
 /* ------------- Mining Depth Camera Data ------------
  This is the stripe of depth camera data we look at before mining starts.
@@ -190,6 +195,59 @@ report the current mining depth view:
 #define MAKE_exchange_mining_depth()   aurora::data_exchange<aurora::mining_depth> exchange_mining_depth("mining.depth")
 
 
+/* ------------- Mining Face Heightmap ------------
+ Dense 2D view of the face we're about to mine, in frame-relative coordinates.
+ This is an elevation view, looking forward along frame +Y: cells are 
+ spaced across frame X (across the robot) and Z (up), and each cell stores 
+ how far forward the surface is, in frame Y.
+ The exchange's source_time is the depth frame's capture time.
+*/
+struct mining_heightmap {
+    /// Frame-relative coordinate system used to acquire this data
+    robot_coord3D camera_coords;
+    
+    enum {NX=128, NZ=128}; ///< cells across, and up
+    enum {INVALID=-32768}; ///< forward value for cells where we didn't see anything
+    
+    float x0, z0; ///< frame coordinates (meters) of the low corner of cell (0,0)
+    float cell; ///< size of each cell (meters)
+    
+    /// Forward distance (frame Y, in millimeters) to the surface in each cell, or INVALID
+    int16_t forward[NZ][NX];
+    
+    mining_heightmap() { clear(); }
+    
+    /// Set the default area (1.28 meters square, centered in front of the frame), with no data
+    void clear(void) {
+        x0=-0.64f; z0=-0.64f; cell=0.01f;
+        for (int z=0;z<NZ;z++) for (int x=0;x<NX;x++) forward[z][x]=INVALID;
+    }
+    
+    bool valid(int ix,int iz) const { return forward[iz][ix]!=INVALID; }
+    
+    /// Frame coordinates of the surface seen in this cell (only if valid)
+    vec3 world(int ix,int iz) const {
+        return vec3(x0+(ix+0.5f)*cell,forward[iz][ix]*0.001f,z0+(iz+0.5f)*cell);
+    }
+    
+    /// Look up the forward distance (meters) to the surface at this frame x and z.
+    ///   Returns false if that's outside the map or we haven't seen it.
+    bool lookup(float x,float z,float &y) const {
+        int ix=(int)floorf((x-x0)/cell), iz=(int)floorf((z-z0)/cell);
+        if (ix<0 || ix>=NX || iz<0 || iz>=NZ || !valid(ix,iz)) return false;
+        y=forward[iz][ix]*0.001f;
+        return true;
+    }
+};
+
+/* This macro declares the variable used to 
+report the current mining face heightmap:
+    Written by vision_mining
+    Read by the backend
+*/
+#define MAKE_exchange_mining_heightmap()   aurora::data_exchange<aurora::mining_heightmap> exchange_mining_heightmap("mining.heightmap")
+
+
 /* -------------- Camera Pointing via Stepper Motor --------------
   This same struct is used to request or report the stepper motor position.
 */
@@ -290,6 +348,19 @@ struct vision_marker_report {
 // This is an array of reports for all currently visible markers
 typedef std::array<vision_marker_report, vision_marker_report::max_count> vision_marker_reports; 
 
+/*
+ These are the installed computer vision marker locations on the field.
+    x,y are in meters
+    angle is in degrees, facing along the +X direction of the marker
+ The localizer uses these to find the robot, and vision to guess where to look.
+*/
+const vision_marker_reports field_markers {
+    vision_marker_report(5.0, 10.0, 180.0, 2), //blocky, facing out toward drive area
+    vision_marker_report(0.0, 3.0, 83.0, 6), //ghost, behind charge area
+    vision_marker_report(12.0, 5.0, -90.0, 17), //descending bird, behind the pit
+    //vision_marker_report(field_x_trough_center, 00.0, 180.0, 2), //fabric
+    };
+
 /* This macro declares the variable used to 
 report a computer vision derived marker position to the localizer:
     Written by the computer vision system when it sees an aruco marker
@@ -304,6 +375,13 @@ Coordinate system: camera-relative coordinates
 /* -------------- Robot Obstacle Detection for Navigation --------------
   Stores a rasterized top-down view of the robot field.
     grid_pixel: datatype at each pixel
+  
+  The raster also records which tiles changed when, so readers like
+  the pathplanner only need to look at the changed regions:
+    - Writers call begin_changes() before each batch of set() calls.
+    - Readers call for_each_changed_tile with the epoch and version
+      they last saw.
+  Writes through at() aren't tracked, so only use it right after clear().
 */
 template <typename grid_pixel>
 class field_raster {
@@ -313,8 +391,15 @@ public:
   enum {GRIDY=obstacle_grid::GRIDY};
   enum {GRIDTOTAL=GRIDX*GRIDY}; // total pixel
   
+  enum {TILE=obstacle_grid::TILE}; // pixels per side of a change-tracking tile
+  enum {TILEX=obstacle_grid::TILEX, TILEY=obstacle_grid::TILEY, TILETOTAL=obstacle_grid::TILETOTAL};
+  
   grid_pixel raster[GRIDTOTAL];
   
+  uint64_t epoch; // set by clear(): versions are only comparable within an epoch
+  uint32_t version; // incremented by clear() and begin_changes()
+  uint32_t tile_version[TILETOTAL]; // version when each tile last changed
+  
   grid_pixel &at(int x,int y) { return raster[y*GRIDX + x]; }
   const grid_pixel &at(int x,int y) const { return raster[y*GRIDX + x]; }
   
@@ -324,10 +409,42 @@ public:
     return true;
   }
 
-  /* Assign this value everywhere */
+  /* Assign this value everywhere, and start a new epoch of changes */
   void clear(const grid_pixel &value) {
     for (size_t i=0;i<GRIDTOTAL;i++) raster[i]=value;
-  }  
+    epoch=time_in_nanoseconds_monotonic();
+    version=1;
+    for (uint32_t &v:tile_version) v=version;
+  }
+  
+  /* Start a new batch of changes */
+  void begin_changes(void) { version++; }
+  
+  /* Change this pixel, and record the change in its tile */
+  void set(int x,int y,const grid_pixel &value) {
+    grid_pixel &p=at(x,y);
+    if (p!=value) {
+      p=value;
+      tile_version[(y/TILE)*TILEX+x/TILE]=version;
+    }
+  }
+  
+  /* Call f(t) for each tile t that changed since we saw this epoch and version,
+     then update them to what we've now seen.  If the epoch changed, every tile
+     counts as changed.  Tile bounds are the same as obstacle_grid::tile_bounds.
+     We record the version from before the scan, so a tile that changes during
+     the scan shows up again next time.  Don't diff a field another process is 
+     writing, though: copy it out with read_consistent first. */
+  template <class tile_function>
+  void for_each_changed_tile(uint64_t &seen_epoch,uint32_t &seen_version,tile_function f) const {
+    uint64_t now_epoch=epoch;
+    uint32_t now_version=version;
+    bool all=(now_epoch!=seen_epoch || now_version<seen_version);
+    for (int t=0;t<TILETOTAL;t++)
+      if (all || tile_version[t]>seen_version) f(t);
+    seen_epoch=now_epoch;
+    seen_version=now_version;
+  }
 };
 
 /*
@@ -377,6 +494,10 @@ public:
     enum {max_path_len=30}; 
     typedef robot_loc2D path_t;
     path_t path_plan[max_path_len];
+    
+    // This path costs at most this many times the best possible path.
+    //   1.0 means optimal, larger is a quicker but worse anytime plan, 0 if unknown.
+    float suboptimality;
 };
 
 #define MAKE_exchange_path_plan()   aurora::data_exchange<aurora::path_plan> exchange_path_plan("path_plan.path")
@@ -15,8 +15,12 @@ Aurora Robotics 2017
 
 #include <iostream>
 #include <deque> 
-#include <queue> // for priority_queue
-#include <functional> // for reference_wrapper
+#include <vector>
+#include <algorithm>
+#include <thread> // for parallel proximity
+#include <chrono> // for anytime planning budget
+#include <limits>
+#include <stdint.h>
 #include <math.h>
 #include "osl/vec2.h"
 
@@ -157,15 +161,13 @@ public:
     vec2 drive;
     
     // Zero = no obstacle here
-    // Positive = persistent obstacles
+    // Positive = number of obstacles the robot would hit at this position
+    //   (a count, so obstacles can be removed again with unmark_obstacle)
     grid2D<int> obstacle;
     
     // Zero = totally safe driving
     // Higher values = closer to obstacles
     grid2D<int> proximity;
-    
-    // Nonzero bits here mark that we've visited this cell
-    grid2D<unsigned char> visit;
   };
   
   // The whole grid is just a list of slices, indexed by angle.
@@ -184,36 +186,149 @@ public:
       s.drive=vec2(cos(ang),sin(ang));
       s.obstacle.clear(0);
       s.proximity.clear(0);
-      s.visit.clear(0);
     }
     obstacles.clear(0);
     lastpath.clear(' ');
   }
   
+  // This is an axis-aligned rectangle of grid cells, [x0,x1) x [y0,y1)
+  class gridrect {
+  public:
+    int x0,y0,x1,y1;
+    
+    gridrect() { clear(); }
+    gridrect(int x0_,int y0_,int x1_,int y1_) :x0(x0_), y0(y0_), x1(x1_), y1(y1_) {}
+    
+    // The whole grid
+    static gridrect all(void) { return gridrect(0,0,GRIDX,GRIDY); }
+    
+    void clear(void) { x0=y0=1<<30; x1=y1=-(1<<30); }
+    bool empty(void) const { return x0>=x1 || y0>=y1; }
+    
+    // Grow to include this cell
+    void add(int x,int y) {
+      x0=std::min(x0,x); x1=std::max(x1,x+1);
+      y0=std::min(y0,y); y1=std::max(y1,y+1);
+    }
+    // Grow to include this rect
+    void add(const gridrect &r) {
+      if (r.empty()) return;
+      x0=std::min(x0,r.x0); x1=std::max(x1,r.x1);
+      y0=std::min(y0,r.y0); y1=std::max(y1,r.y1);
+    }
+    // Grow by this many cells in every direction
+    gridrect expanded(int cells) const {
+      if (empty()) return *this;
+      return gridrect(x0-cells,y0-cells,x1+cells,y1+cells);
+    }
+    // Clip to the grid boundaries
+    gridrect clipped(void) const {
+      return gridrect(std::max(x0,0),std::max(y0,0),std::min(x1,(int)GRIDX),std::min(y1,(int)GRIDY));
+    }
+  };
+  
+  // Slice obstacle cells that have changed since the last update_proximity
+  gridrect dirty;
+  
+  // Bumped every time obstacles change, so planners can tell their old search is stale
+  unsigned long obstacle_version=0;
+  
+  // Cells where proximity was recomputed (so obstacles or proximity may have changed).
+  //   Incremental planners read this and clear it.
+  gridrect changed;
+  
   // After marking obstacles, call this to compute proximity.
   //   This can be re-called if you mark new obstacles.
   void compute_proximity(int cells=3) {
-    for (int ia=0;ia<GRIDA;ia++) {
-      gridslice &s=slice[ia];
-      s.proximity.clear(0);
-      for (int y=-1;y<=GRIDY;y++)
-      for (int x=-1;x<=GRIDX;x++)
-      {
-        if (!gridposition(x,y,0).valid() || s.obstacle.at(x,y)!=0) 
-        { // mark all nearby cells as near obstacle
-          for (int dy=-cells;dy<=cells;dy++)
-          for (int dx=-cells;dx<=cells;dx++)
-          {
-            int cy=y+dy;
-            int cx=x+dx;
-            if (gridposition(cx,cy,0).valid())
-            {
-              int dist=cells+1 - std::max(std::abs(dx),std::abs(dy));
-              int &prox=s.proximity.at(cx,cy);
-              if (prox<dist) prox=dist;
-            }
-          }
-        }
+    compute_proximity(cells,gridrect::all());
+    dirty.clear();
+  }
+  
+  // After marking or unmarking some obstacles, call this to recompute 
+  //  proximity only around the obstacles that changed.
+  void update_proximity(int cells=3) {
+    if (dirty.empty()) return;
+    compute_proximity(cells,dirty.expanded(cells).clipped());
+    dirty.clear();
+  }
+  
+  // Recompute proximity inside this rectangle of cells.
+  //   Only obstacles within cells of the rectangle can affect it.
+  //   Slices are independent, so they're split across threads.
+  void compute_proximity(int cells,const gridrect &r) {
+    if (r.empty()) return;
+    changed.add(r);
+    int nthreads=std::max(1,std::min((int)std::thread::hardware_concurrency(),GRIDA));
+    std::vector<std::thread> threads;
+    for (int t=1;t<nthreads;t++)
+      threads.push_back(std::thread([this,cells,r,t,nthreads]() {
+        proximity_worker(cells,r,t,nthreads);
+      }));
+    proximity_worker(cells,r,0,nthreads);
+    for (std::thread &t:threads) t.join();
+  }
+  
+  // Compute proximity for every nthreads'th slice, starting at first.
+  void proximity_worker(int cells,const gridrect &r,int first,int nthreads) {
+    std::vector<unsigned char> dist; // reused across slices
+    for (int ia=first;ia<GRIDA;ia+=nthreads)
+      compute_slice_proximity(slice[ia],cells,r,dist);
+  }
+  
+  /* Compute proximity in one slice, inside the rectangle r.
+     Proximity is cells+1 minus the chessboard (max of |dx|,|dy|) distance to 
+     the nearest obstacle or off-grid cell, or zero if that's over cells away.
+     
+     This is a two-pass chessboard distance transform, which is exact and
+     takes time linear in the area (independent of cells), over a window big 
+     enough to see every obstacle within cells of r.  
+     dist is scratch space.
+  */
+  static void compute_slice_proximity(gridslice &s,int cells,const gridrect &r,std::vector<unsigned char> &dist) {
+    const int far=std::min(cells+1,255); // distances beyond cells don't matter
+    gridrect w=r.expanded(cells).clipped(); // window that sees all relevant obstacles
+    int wx=w.x1-w.x0, wy=w.y1-w.y0;
+    int stride=wx+2; // one cell of far padding on each side, so no bounds checks
+    dist.assign(stride*(wy+2),(unsigned char)far);
+    
+    // Seed: obstacles are distance 0, and the off-grid ring acts like obstacles
+    for (int y=w.y0;y<w.y1;y++) {
+      unsigned char *row=&dist[(y-w.y0+1)*stride+1]-w.x0;
+      int edge_y=std::min(y+1,GRIDY-y);
+      for (int x=w.x0;x<w.x1;x++) {
+        int d=std::min(std::min(x+1,GRIDX-x),edge_y);
+        if (s.obstacle.at(x,y)!=0) d=0;
+        row[x]=(unsigned char)std::min(d,far);
+      }
+    }
+    
+    // Forward pass: propagate from up and left neighbors
+    for (int y=1;y<=wy;y++) {
+      unsigned char *row=&dist[y*stride];
+      const unsigned char *up=row-stride;
+      for (int x=1;x<=wx;x++) {
+        int d=std::min(std::min(up[x-1],up[x]),up[x+1])+1;
+        d=std::min(d,row[x-1]+1);
+        if (d<row[x]) row[x]=(unsigned char)d;
+      }
+    }
+    // Backward pass: propagate from down and right neighbors
+    for (int y=wy;y>=1;y--) {
+      unsigned char *row=&dist[y*stride];
+      const unsigned char *down=row+stride;
+      for (int x=wx;x>=1;x--) {
+        int d=std::min(std::min(down[x-1],down[x]),down[x+1])+1;
+        d=std::min(d,row[x+1]+1);
+        if (d<row[x]) row[x]=(unsigned char)d;
+      }
+    }
+    
+    // Convert distance to proximity, only inside r
+    for (int y=r.y0;y<r.y1;y++) {
+      const unsigned char *row=&dist[(y-w.y0+1)*stride+1]-w.x0;
+      for (int x=r.x0;x<r.x1;x++) {
+        int d=row[x];
+        s.proximity.at(x,y)=(d<=cells)?cells+1-d:0;
       }
     }
   }
@@ -282,7 +397,8 @@ public:
   
   // This grid records all known obstacles on the field.
   //   zero indicates no known obstacles
-  //   They're kept here to avoid redundant obstacle updates.
+  //   They're kept here to avoid redundant obstacle updates,
+  //   and so obstacles can be removed later.
   grid2D<int> obstacles;
   
   // This grid stores the winning path (for display)
@@ -290,29 +406,34 @@ public:
   
   // Mark this obstacle location, xy in grid coordinates, as impassible for this robot.
   //  This can be called at startup, or at runtime for new obstacles.
+  //  If the location already has a taller obstacle, this does nothing.
   void mark_obstacle(int x,int y,int height, const robot_grid_geometry &robot) {
     if (gridposition(x,y,0).valid()) {
-      int &old=obstacles.at(x,y);
-      if (old>=height) return; // redundant obstacle
-      else old=height;
+      if (obstacles.at(x,y)>=height) return; // redundant obstacle
+      set_obstacle(x,y,height,robot);
     }
-    
-    // Mark where the robot would hit this obstacle in each orientation.
-    //   The corresponding robot center points are blocked.
-    for (int ia=0;ia<GRIDA;ia++) {
-      gridslice &navslice=slice[ia];
-      const robot_grid_slice &robotslice=robot.slice[ia];
-      for (gridposition g : robotslice) {
-        if (g.a<height) { // robot would hit this obstacle
-          gridposition hit(x-g.x, y-g.y, ia);
-          int &store=navslice.obstacle.at(hit.x,hit.y);
-          if (hit.valid() && store<height)
-            store=height;
-        }
-      }
+    else { // off-grid obstacles (like the edges) are permanent
+      stamp_obstacle(x,y,height,+1,robot);
     }
   }
   
+  // Remove any obstacle at this location, xy in grid coordinates.
+  //  (Call update_proximity after you're done changing obstacles.)
+  void unmark_obstacle(int x,int y, const robot_grid_geometry &robot) {
+    set_obstacle(x,y,0,robot);
+  }
+  
+  // Change the obstacle at this on-grid location to this height (0 for no obstacle).
+  //  (Call update_proximity after you're done changing obstacles.)
+  void set_obstacle(int x,int y,int height, const robot_grid_geometry &robot) {
+    if (!gridposition(x,y,0).valid()) return;
+    int &old=obstacles.at(x,y);
+    if (old==height) return; // no change
+    if (old>0) stamp_obstacle(x,y,old,-1,robot); // remove old obstacle
+    old=height;
+    if (height>0) stamp_obstacle(x,y,height,+1,robot); // add new obstacle
+  }
+  
   // Mark the edges of the grid as impassible for this robot
   void mark_edges(const robot_grid_geometry &robot) {
     for (int y=-1;y<=GRIDY;y++)
@@ -323,6 +444,39 @@ public:
     }
   }
   
+  // Remove all obstacles, leaving only the edges.
+  void clear_obstacles(const robot_grid_geometry &robot) {
+    for (int ia=0;ia<GRIDA;ia++) {
+      slice[ia].obstacle.clear(0);
+      slice[ia].proximity.clear(0);
+    }
+    obstacles.clear(0);
+    mark_edges(robot);
+    dirty=gridrect::all();
+    obstacle_version++;
+  }
+  
+  // Add (delta=+1) or remove (delta=-1) the robot positions that would hit 
+  //  an obstacle of this height at this location.
+  void stamp_obstacle(int x,int y,int height,int delta, const robot_grid_geometry &robot) {
+    obstacle_version++;
+    // Mark where the robot would hit this obstacle in each orientation.
+    //   The corresponding robot center points are blocked.
+    for (int ia=0;ia<GRIDA;ia++) {
+      gridslice &navslice=slice[ia];
+      const robot_grid_slice &robotslice=robot.slice[ia];
+      for (gridposition g : robotslice) {
+        if (g.a<height) { // robot would hit this obstacle
+          gridposition hit(x-g.x, y-g.y, ia);
+          if (hit.valid()) {
+            navslice.obstacle.at(hit.x,hit.y)+=delta;
+            dirty.add(hit.x,hit.y);
+          }
+        }
+      }
+    }
+  }
+  
 
 /*************** Path Planning *************************/
   // Convert discrete angles to grid cell equivalent.
@@ -380,7 +534,164 @@ public:
     }
   };
   
+  /*
+   Storage for path searches, kept between plans so planning doesn't allocate.
+   
+   Search nodes live in an arena that is reset (not freed) for each plan.
+   Each grid cell has a generation stamp saying whether this plan has 
+   seen it (and if so, cellnode holds its node index) or already closed it.
+   A new plan just bumps the generation, so nothing gets cleared.
+   The open list is a binary heap of node indices; each node remembers 
+   its heap slot so a cheaper route to an open cell can decrease its key.
+  */
+  class search_workspace {
+  public:
+    enum { NONE=0xffffffffu, INCONS=0xfffffffeu };
+    enum { initial_nodes=1<<14 }; // arena starts this big (under 1MB), and doubles as needed
+    
+    class searchnode {
+    public:
+      double cost; // cost to get here
+      double estimate; // estimate to reach target
+      drive_t drive;
+      fposition pos; // position of the robot at this point
+      uint32_t last; // index of preceding node, or NONE
+      uint32_t cell; // flat index of our grid cell
+      uint32_t heap_index; // our slot in the heap while open, NONE if not queued, INCONS if closed but improved
+    };
+    
+    std::vector<searchnode> nodes; // arena: only the first used nodes are live
+    uint32_t used=0;
+    
+    // Per grid cell: stamp==generation means open, stamp==generation+1 means closed,
+    //   anything else means this plan hasn't reached the cell yet.
+    std::vector<uint16_t> stamp;
+    uint16_t generation=0;
+    std::vector<uint32_t> cellnode; // grid cell -> node index (valid while stamped)
+    
+    // The heap keeps priorities next to node indices, so sifting stays in cache.
+    struct heapentry {
+      double key; // priority: cost + estimate
+      uint32_t node;
+    };
+    std::vector<heapentry> heap; // open list, min-heap on key
+    
+    static uint32_t cell_index(const gridposition &g) {
+      return ((uint32_t)g.a*GRIDY + g.y)*GRIDX + g.x;
+    }
+    
+    // Forget all nodes from the last search
+    void reset(void) {
+      if (stamp.empty()) {
+        stamp.resize((size_t)GRIDX*GRIDY*GRIDA,0);
+        cellnode.resize((size_t)GRIDX*GRIDY*GRIDA);
+        nodes.resize(initial_nodes);
+      }
+      generation+=2;
+      if (generation==0) 
+      { // stamps wrapped around: now we do need to clear them
+        std::fill(stamp.begin(),stamp.end(),0);
+        generation=2;
+      }
+      used=0;
+      heap.clear();
+    }
+    
+    // Bytes of memory we're using now
+    size_t bytes(void) const {
+      return stamp.size()*sizeof(stamp[0])+cellnode.size()*sizeof(cellnode[0])
+        +nodes.size()*sizeof(searchnode)+heap.capacity()*sizeof(heapentry);
+    }
+    
+    bool is_open(uint32_t cell) const { return stamp[cell]==generation; }
+    bool is_closed(uint32_t cell) const { return stamp[cell]==generation+1; }
+    
+    // Make a new open node for this unseen cell
+    uint32_t create(uint32_t cell) {
+      if (used>=nodes.size()) // each cell gets at most one node per plan
+        nodes.resize(std::min(2*nodes.size(),stamp.size()));
+      uint32_t n=used++;
+      nodes[n].cell=cell;
+      nodes[n].heap_index=NONE;
+      stamp[cell]=generation;
+      cellnode[cell]=n;
+      return n;
+    }
+    
+    // Reopen every closed node, without queueing it (for anytime search)
+    void unclose_all(void) {
+      for (uint32_t n=0;n<used;n++) {
+        uint32_t cell=nodes[n].cell;
+        if (is_closed(cell)) {
+          stamp[cell]=generation;
+          nodes[n].heap_index=NONE;
+        }
+      }
+    }
+    
+    // Restore heap order after changing keys in place
+    void heapify(void) {
+      for (size_t i=0;i<heap.size();i++) nodes[heap[i].node].heap_index=i;
+      for (size_t i=heap.size()/2;i-->0;) sift_down(i);
+    }
+    
+    // Add this node to the open list, with this priority
+    void push(uint32_t n,double key) {
+      heap.push_back(heapentry{key,n});
+      sift_up(heap.size()-1);
+    }
+    
+    // Node n is already open, but has a new smaller priority
+    void decrease(uint32_t n,double key) {
+      uint32_t i=nodes[n].heap_index;
+      heap[i].key=key;
+      sift_up(i);
+    }
+    
+    // Remove and return the open node with the smallest key, marking it closed.
+    uint32_t pop(void) {
+      uint32_t top=heap[0].node;
+      heapentry back=heap.back(); heap.pop_back();
+      if (!heap.empty()) {
+        heap[0]=back;
+        sift_down(0);
+      }
+      stamp[nodes[top].cell]=generation+1;
+      return top;
+    }
+    
+  private:
+    void place(size_t i,const heapentry &e) {
+      heap[i]=e;
+      nodes[e.node].heap_index=i;
+    }
+    void sift_up(size_t i) {
+      heapentry e=heap[i];
+      while (i>0) {
+        size_t parent=(i-1)/2;
+        if (heap[parent].key<=e.key) break;
+        place(i,heap[parent]);
+        i=parent;
+      }
+      place(i,e);
+    }
+    void sift_down(size_t i) {
+      heapentry e=heap[i];
+      size_t size=heap.size();
+      while (true) {
+        size_t child=2*i+1;
+        if (child>=size) break;
+        if (child+1<size && heap[child+1].key<heap[child].key) child++;
+        if (e.key<=heap[child].key) break;
+        place(i,heap[child]);
+        i=child;
+      }
+      place(i,e);
+    }
+  };
   
+  // Search storage reused by every planner on this navigator
+  search_workspace workspace;
   
   /* 
   Build the sequence of steps needed to move the robot from origin to target.
@@ -397,55 +708,125 @@ public:
   */
   template <class planner_target>
   class planner {
+  protected:
     navigator_t &nav;
+    search_workspace &ws;
+    typedef typename search_workspace::searchnode searchnode;
+    
+    // Heuristic inflation: 1 for plain A*, higher is faster but may give a worse path.
+    double epsilon=1.0;
+    // If true, remember cheaper routes to already-closed cells in incons (anytime search).
+    bool reopen=false;
+    std::vector<uint32_t> incons; // closed nodes that got cheaper
     
-    // This is the active list of searched positions, sorted by distance to target.
-    typedef std::priority_queue<std::reference_wrapper<searchposition>,
-      std::vector< std::reference_wrapper<searchposition> >,
-      std::greater<searchposition> > search_t;
-    search_t search;
-    
-    // SUBTLE: to allow backtracking, we need to persistently store search positions.
-    //  std::deque has the nice property of not invalidating references.
-    typedef std::deque<searchposition> pool_t;
-    pool_t pool; // safely stores our search positions
-    
-    // Add this search position to our priority queue.
-    //   Returns true if the point was valid and could be added.
-    bool add_search(double cost,const drive_t &lastdrive,const drive_t &drive,const fposition &pos,const planner_target &target,const searchposition *last) {
-      // make sure we haven't already visited this point
+    // Consider reaching this position from node "last" with this cost.
+    //   Returns true if the point was valid and is now queued.
+    bool add_search(double cost,const drive_t &lastdrive,const drive_t &drive,const fposition &pos,const planner_target &target,uint32_t last) {
       gridposition g(pos);
       if (!g.valid()) return false; // out of bounds of our grid
       
-      gridslice &s=nav.slice[g.a];
-      unsigned char &visited=nav.slice[g.a].visit.at(g.x,g.y);
-      if (0!=visited) return false; // already visited here
-      
-      // create data structure to hold this point
-      visited=1; // mark as visited
-        
       // Check for obstacles in the way:
-      const unsigned char &obs=s.obstacle.at(g.x,g.y);
+      const int obs=nav.slice[g.a].obstacle.at(g.x,g.y);
       //if (obs!=0) return false; // has obstacle
       if (obs!=0) cost += 1000.0; // hitting obstacle counts as a 1 meter cost
       
-      // Seems legal, so use heuristic to estimate cost to target
       if (!(lastdrive == drive)) 
         cost+=40.0; // penalty for swapping drive directions
       
-      double estimate=target.get_cost_from(g);
-      pool.emplace_back(cost, estimate, drive,pos,last);
-      search.push(pool.back());
-
+      uint32_t cell=search_workspace::cell_index(g);
+      bool closed=ws.is_closed(cell);
+      if (closed && !reopen) return false; // already expanded here
+      
+      uint32_t n;
+      bool seen=closed || ws.is_open(cell);
+      if (seen) 
+      { // already reached: only keep the cheaper route
+        n=ws.cellnode[cell];
+        if (cost>=ws.nodes[n].cost) return false;
+      }
+      else 
+      { // first visit: use heuristic to estimate cost to target
+        n=ws.create(cell);
+        ws.nodes[n].estimate=target.get_cost_from(g);
+      }
+      
+      searchnode &node=ws.nodes[n];
+      node.cost=cost;
+      node.drive=drive;
+      node.pos=pos;
+      node.last=last;
+      if (closed) 
+      { // don't expand again now, but requeue it next round
+        if (node.heap_index!=search_workspace::INCONS) {
+          node.heap_index=search_workspace::INCONS;
+          incons.push_back(n);
+        }
+      }
+      else if (node.heap_index==search_workspace::NONE) ws.push(n,cost+epsilon*node.estimate);
+      else ws.decrease(n,cost+epsilon*node.estimate);
+      
       return true; // OK point
     }
     
+    // Queue up all the neighbors of this node
+    void expand(uint32_t curn,const planner_target &target) {
+      const searchnode cur=ws.nodes[curn]; // copy: the arena may grow below
+      gridposition gcur(cur.pos);
+      
+      // Compute 'obstacle proximity cost' scaling factor
+      double turncost=1.0; // extra cost for more turning
+      double proxcost=10.0; // extra cost for driving near obstacles
+      if (gcur.valid())
+        proxcost = 1.0 + 0.5*nav.slice[gcur.a].proximity.at(gcur.x,gcur.y);
+      
+      // Check all nearby cells
+      vec2 drivedir=nav.slice[gcur.a].drive;
+      for (float drive=+1.0;drive>=-1.0;drive-=2.0) {
+        // Drive at least into the next grid cell:
+        double distance=1.01*GRIDSIZE/std::max(fabs(drivedir.x),fabs(drivedir.y)); 
+        
+        double cost=cur.cost + proxcost * distance;
+        fposition next(cur.pos.v+distance*drive*drivedir,cur.pos.a);
+        add_search(cost,cur.drive,drive_t(drive,0.0f),next,target,curn);
+      }
+      for (float turn=-1.0;turn<=+1.0;turn+=2.0) {
+        double cost=cur.cost + proxcost *turncost * GRIDSIZE*TURN_COST_TO_GRID_COST;
+        fposition next(cur.pos.v,fmodplus(cur.pos.a+turn,GRIDA)); // angles wrap around
+        add_search(cost,cur.drive,drive_t(0.0f,turn),next,target,curn);
+      }
+    }
+    
+    // Follow the chain of "last" links from this node back to the origin,
+    //   or to root if the path should start there instead (costs are then from root).
+    void build_path(uint32_t goal,bool verbose,uint32_t root=search_workspace::NONE) {
+      path.clear();
+      if (verbose) std::cout<<"Target reached!  Reverse path:\n";
+      double root_cost=(root==search_workspace::NONE)?0.0:ws.nodes[root].cost;
+      for (uint32_t n=goal;n!=search_workspace::NONE && n!=root;n=ws.nodes[n].last) {
+        const searchnode &p=ws.nodes[n];
+        if (p.last!=search_workspace::NONE)
+          path.push_front(searchposition(p.cost-root_cost,p.estimate,p.drive,p.pos,NULL));
+        if (verbose) {
+          std::cout<<p.pos<<"\n";
+          gridposition gpath(p.pos);
+          if (gpath.valid()) nav.lastpath.at(gpath.x,gpath.y)='#'; // on path
+          nav.lastpath.print(std::cout,1);
+        }
+      }
+    }
+    
+    // Set up to plan without planning yet (for subclasses)
+    planner(navigator_t &nav_) 
+      :nav(nav_), ws(nav_.workspace), valid(false), searched(0)
+    {}
+    
   public:
     // This bool marks that we found a good path.
     //    false == "you can't get there from here"
     bool valid;
     
     // This is the sequence of steps from origin to target
+    //  (the "last" pointers are not filled in)
     std::deque<searchposition> path;
     
     // This is how many cells we expanded
@@ -453,81 +834,41 @@ public:
     
     
     planner(navigator_t &nav_,const fposition &origin,const planner_target &target,drive_t last_drive=drive_t(), bool verbose=false) 
-      :nav(nav_)
+      :nav(nav_), ws(nav_.workspace)
     {
       valid = plan_path(origin,target,last_drive,verbose);
     } 
     
     bool plan_path(const fposition &origin,const planner_target &target,drive_t last_drive=drive_t(), bool verbose=false)
     {
-      // Clear all previous visit marks
       searched=0;
-      for (int ia=0;ia<GRIDA;ia++) {
-        nav.slice[ia].visit.clear(0);
-      }
+      ws.reset();
       nav.lastpath.clear(' ');
       
       // Start search at specified origin
-      if (!add_search(0.0,last_drive,last_drive,origin,target,0)) 
+      if (!add_search(0.0,last_drive,last_drive,origin,target,search_workspace::NONE)) 
       { // Start point no good: can't do this.
         std::cout<<"Starting point is off the grid!?\n";
         return false;
       }
     
       // Repeatedly visit positions with the cheapest net cost
-      while (!search.empty()) {
-        const searchposition &cur=search.top(); search.pop();
+      while (!ws.heap.empty()) {
+        uint32_t curn=ws.pop();
         searched++;
         
-        // if (verbose) std::cout<<"At "<<cur.pos<<" cost "<<cur.cost<<": ";
-        
         // Find the grid location for this cell
-        gridposition gcur(cur.pos);
+        gridposition gcur(ws.nodes[curn].pos);
         if (verbose && gcur.valid()) {
           nav.lastpath.at(gcur.x,gcur.y)='.'; // checked
         }
         if (target.reached_target(gcur)) 
-        { // we're done!  Follow the chain of "last" pointers back to the origin.
-          if (verbose) std::cout<<"Target reached!  Reverse path:\n";
-          for (const searchposition *p=&cur;p!=NULL;p=p->last) {
-            if (p->last!=NULL)
-              path.push_front(*p);
-            if (verbose) {
-              std::cout<<p->pos<<"\n";
-              gridposition gpath(p->pos);
-              if (gpath.valid()) nav.lastpath.at(gpath.x,gpath.y)='#'; // on path
-              nav.lastpath.print(std::cout,1);
-            }
-          }
-          
-          // Clean out the pool for next time
-          search=search_t();
-          pool=pool_t();
-          
+        { // we're done!
+          build_path(curn,verbose);
           return true;
         }
         
-        // Compute 'obstacle proximity cost' scaling factor
-        double turncost=1.0; // extra cost for more turning
-        double proxcost=10.0; // extra cost for driving near obstacles
-        if (gcur.valid())
-          proxcost = 1.0 + 0.5*nav.slice[gcur.a].proximity.at(gcur.x,gcur.y);
-        
-        // Check all nearby cells
-        vec2 drivedir=nav.slice[gcur.a].drive;
-        for (float drive=+1.0;drive>=-1.0;drive-=2.0) {
-          // Drive at least into the next grid cell:
-          double distance=1.01*GRIDSIZE/std::max(fabs(drivedir.x),fabs(drivedir.y)); 
-          
-          double cost=cur.cost + proxcost * distance;
-          fposition next(cur.pos.v+distance*drive*drivedir,cur.pos.a);
-          add_search(cost,cur.drive,drive_t(drive,0.0f),next,target,&cur);
-        }
-        for (float turn=-1.0;turn<=+1.0;turn+=2.0) {
-          double cost=cur.cost + proxcost *turncost * GRIDSIZE*TURN_COST_TO_GRID_COST;
-          fposition next(cur.pos.v,fmodplus(cur.pos.a+turn,GRIDA)); // angles wrap around
-          add_search(cost,cur.drive,drive_t(0.0f,turn),next,target,&cur);
-        }
+        expand(curn,target);
       }
       
       // If we get here, we ran out of options before reaching the target.
@@ -535,6 +876,542 @@ public:
       return false;
     }
   }; // end planner class
+  
+  /*
+   Anytime path planner, using ARA* (Likhachev, Gordon & Thrun, NIPS 2003).
+   
+   The first search inflates the heuristic by epsilon_start, which finds
+   some path quickly.  Each later round shrinks epsilon and repairs the 
+   previous search instead of starting over, until epsilon reaches 1.
+   A path found with inflation epsilon costs at most epsilon times 
+   the best possible path; "suboptimality" reports this bound.
+   
+   Call plan() repeatedly with a time budget: work carries over between 
+   calls as long as the obstacles are unchanged, and the robot stays on
+   the best path found so far.  Then we keep the search rooted where it
+   started, and the path we publish starts at the robot's cell on it
+   (a piece of an optimal path is optimal, so once the search finishes,
+   following the path costs nothing).  If the robot leaves the best path,
+   or a later round finds a better path that doesn't pass the robot,
+   we start over from the robot.
+   Call restart() if the target changes.
+  */
+  template <class planner_target>
+  class anytime_planner : public planner<planner_target> {
+    typedef planner<planner_target> base;
+    typedef typename search_workspace::searchnode searchnode;
+    using base::nav; using base::ws; using base::epsilon; using base::incons;
+    
+    double epsilon_start; // first round's heuristic inflation
+    double epsilon_factor; // multiply epsilon by this each round
+    
+    // The search is only reusable if these are unchanged
+    bool started;
+    gridposition start_cell; // the robot's cell at the last call
+    unsigned long obstacle_version;
+    uint16_t generation;
+    
+    uint32_t goal; // cheapest node reaching the target so far, or NONE
+    uint32_t root; // node on the goal's path where the robot is now, or NONE if it's at the search start
+    
+    // Return the node on the current best path in this cell, or NONE if the path doesn't go there
+    uint32_t on_path(const gridposition &g) const {
+      if (goal==search_workspace::NONE || !g.valid()) return search_workspace::NONE;
+      uint32_t cell=search_workspace::cell_index(g);
+      for (uint32_t n=goal;n!=search_workspace::NONE;n=ws.nodes[n].last)
+        if (ws.nodes[n].cell==cell) return n;
+      return search_workspace::NONE;
+    }
+    
+    // Throw away the old search, and search from here.  Returns false if origin is off the grid.
+    bool start_over(const fposition &origin,const planner_target &target,drive_t last_drive) {
+      ws.reset();
+      incons.clear();
+      started=true;
+      start_cell=gridposition(origin);
+      obstacle_version=nav.obstacle_version;
+      generation=ws.generation;
+      epsilon=epsilon_start;
+      goal=root=search_workspace::NONE;
+      this->path.clear();
+      this->valid=false;
+      this->searched=0;
+      suboptimality=0.0;
+      finished=false;
+      starts++;
+      
+      if (!this->add_search(0.0,last_drive,last_drive,origin,target,search_workspace::NONE)) 
+      { // Start point no good: can't do this.
+        std::cout<<"Starting point is off the grid!?\n";
+        finished=true;
+        return false;
+      }
+      return true;
+    }
+    
+    typedef std::chrono::steady_clock clock;
+    
+    // Expand nodes until this round can't improve on the goal.
+    //   Returns false if we hit the deadline first.
+    bool improve_path(const planner_target &target,clock::time_point deadline) {
+      size_t count=0;
+      while (!ws.heap.empty()) {
+        if (goal!=search_workspace::NONE && ws.nodes[goal].cost<=ws.heap[0].key) 
+          return true; // nothing left on the open list could beat this goal
+        if ((++count&255)==0 && clock::now()>deadline) 
+          return false; // out of time
+        
+        uint32_t curn=ws.pop();
+        this->searched++;
+        if (target.reached_target(gridposition(ws.nodes[curn].pos))) 
+        { // reached target: no need to expand beyond here
+          if (goal==search_workspace::NONE || ws.nodes[curn].cost<ws.nodes[goal].cost)
+            goal=curn;
+          continue;
+        }
+        this->expand(curn,target);
+      }
+      return true;
+    }
+    
+    // Bound on how much worse the current path (from root) is than the best possible path
+    double current_bound(void) const {
+      double lower=std::numeric_limits<double>::max(); // lower bound on the best path cost
+      for (const typename search_workspace::heapentry &e : ws.heap) {
+        const searchnode &n=ws.nodes[e.node];
+        lower=std::min(lower,n.cost+n.estimate);
+      }
+      for (uint32_t i : incons) {
+        const searchnode &n=ws.nodes[i];
+        lower=std::min(lower,n.cost+n.estimate);
+      }
+      if (root==search_workspace::NONE) {
+        double bound=ws.nodes[goal].cost/lower;
+        return std::max(1.0,std::min(epsilon,bound));
+      }
+      // From root: getting to root cost c, so the best path from root costs at least lower-c.
+      //   (epsilon only bounds the whole path from the search start.)
+      double c=ws.nodes[root].cost;
+      if (ws.heap.empty() && incons.empty()) return 1.0; // search is done: the path is optimal
+      if (lower<=c) return epsilon_start; // no useful bound: report our loosest setting
+      return std::max(1.0,(ws.nodes[goal].cost-c)/(lower-c));
+    }
+    
+    // Set up the next round, with a smaller epsilon
+    void next_round(void) {
+      epsilon=std::max(1.0,epsilon*epsilon_factor);
+      ws.unclose_all();
+      for (uint32_t n : incons) {
+        ws.nodes[n].heap_index=search_workspace::NONE;
+        ws.heap.push_back(typename search_workspace::heapentry{0.0,n});
+      }
+      incons.clear();
+      for (typename search_workspace::heapentry &e : ws.heap) {
+        const searchnode &n=ws.nodes[e.node];
+        e.key=n.cost+epsilon*n.estimate;
+      }
+      ws.heapify();
+    }
+    
+  public:
+    // The current path costs at most this many times the optimal path (0 if no path yet)
+    double suboptimality;
+    
+    // True once the search is done: the path is optimal, or there is no path.
+    bool finished;
+    
+    // Number of fresh searches we've started (the rest of our calls kept working on one)
+    size_t starts;
+    
+    anytime_planner(navigator_t &nav_,double epsilon_start_=10.0,double epsilon_factor_=0.5)
+      :base(nav_), epsilon_start(epsilon_start_), epsilon_factor(epsilon_factor_),
+       started(false), start_cell(0,0,0), goal(search_workspace::NONE), root(search_workspace::NONE),
+       suboptimality(0.0), finished(false), starts(0)
+    {
+      base::reopen=true;
+    }
+    
+    // Throw away the old search, for example because the target moved
+    void restart(void) { started=false; }
+    
+    // Plan (or keep planning) a path from origin to target, for up to budget_ms milliseconds.
+    //   Returns true if we have a path.
+    bool plan(const fposition &origin,const planner_target &target,drive_t last_drive=drive_t(),double budget_ms=50.0)
+    {
+      clock::time_point deadline=clock::now()+std::chrono::microseconds((long)(budget_ms*1000.0));
+      
+      gridposition g(origin);
+      bool reuse=started && obstacle_version==nav.obstacle_version && generation==ws.generation;
+      if (reuse && !(g==start_cell)) 
+      { // The robot moved: keep the search if it's still on our best path
+        uint32_t n=on_path(g);
+        if (n==search_workspace::NONE) reuse=false;
+        else {
+          root=n;
+          start_cell=g;
+          this->build_path(goal,false,root);
+          suboptimality=current_bound();
+        }
+      }
+      if (!reuse && !start_over(origin,target,last_drive)) return false;
+      
+      while (!finished) {
+        if (!improve_path(target,deadline)) break; // out of time, resume next call
+        
+        if (goal!=search_workspace::NONE) 
+        { // finished this round: publish the improved path
+          if (root!=search_workspace::NONE && on_path(start_cell)!=root) 
+          { // the better path doesn't go past the robot: search again from the robot
+            if (!start_over(origin,target,last_drive)) return false;
+            continue;
+          }
+          this->build_path(goal,false,root);
+          this->valid=true;
+          suboptimality=current_bound();
+        }
+        if (goal==search_workspace::NONE || epsilon<=1.0) 
+          finished=true; // no path exists, or this path is optimal
+        else
+          next_round();
+      }
+      return this->valid;
+    }
+  }; // end anytime_planner class
+  
+  /*
+   Incremental replanner, using D* Lite (Koenig & Likhachev, AAAI 2002).
+   
+   This searches backwards from every cell in the target region to the
+   robot, and keeps its search between calls.  When the robot moves or 
+   obstacles change, only the part of the search that depends on the 
+   changed cells gets repaired, which is usually much less work than 
+   planning again from scratch.
+   
+   D* Lite needs to walk edges backwards, so it plans on a fixed lattice:
+   driving moves exactly one step of whole cells along the slice's drive 
+   direction (rounded), and turns move one slice.  Every move can be undone 
+   by the opposite move, so a cell's predecessors are its successors.
+   Costs match planner (proximity cost of the cell we leave, 
+   plus the obstacle cost of the cell we enter), except there is 
+   no penalty for swapping drive direction, since that depends on 
+   the path taken to reach a cell, not just the cell.
+   
+   Call restart() if the target changes.
+  */
+  template <class planner_target>
+  class dstar_planner {
+    navigator_t &nav;
+    
+    enum { NONE=0xffffffffu };
+    enum { NMOVES=4 }; // forward, backward, turn left, turn right
+    typedef float cost_t;
+    static cost_t infinity(void) { return std::numeric_limits<cost_t>::infinity(); }
+    
+    // Per-cell search state (allocated on first use)
+    std::vector<cost_t> g; // cost to target, as of the last expansion
+    std::vector<cost_t> rhs; // one-step lookahead cost to target
+    std::vector<uint32_t> heap_index; // slot in heap, or NONE
+    std::vector<bool> goal; // cell is inside the target region
+    std::vector<unsigned char> seen; // proximity and obstacle at the last replan
+    
+    struct key_t {
+      cost_t k1,k2;
+      bool operator<(const key_t &k) const { return k1<k.k1 || (k1==k.k1 && k2<k.k2); }
+      bool operator<=(const key_t &k) const { return !(k<*this); }
+    };
+    struct heapentry {
+      key_t key;
+      uint32_t cell;
+    };
+    std::vector<heapentry> heap; // open list, min-heap on key
+    
+    bool started; // false if we need to start over
+    uint32_t start; // robot's cell
+    uint32_t last_start; // robot's cell when km was last updated
+    cost_t km; // heuristic offset accumulated as the robot moves
+    
+    // Lattice moves, for each slice
+    int stepx[GRIDA], stepy[GRIDA]; // cells moved when driving forward
+    cost_t drive_cost[GRIDA]; // cm driven by one step
+    
+    static uint32_t cell_index(int x,int y,int a) { return ((uint32_t)a*GRIDY + y)*GRIDX + x; }
+    static gridposition cell_position(uint32_t c) {
+      return gridposition(c%GRIDX, (c/GRIDX)%GRIDY, c/(GRIDX*GRIDY));
+    }
+    
+    // Return the cell reached by this move from c, or NONE if it's off the grid
+    uint32_t move(uint32_t c,int m) const {
+      gridposition p=cell_position(c);
+      switch (m) {
+        case 0: p.x+=stepx[p.a]; p.y+=stepy[p.a]; break;
+        case 1: p.x-=stepx[p.a]; p.y-=stepy[p.a]; break;
+        case 2: p.a=(p.a+GRIDA-1)%GRIDA; break;
+        default: p.a=(p.a+1)%GRIDA; break;
+      }
+      if (!p.valid()) return NONE;
+      return cell_index(p.x,p.y,p.a);
+    }
+    
+    // Cost to make move m from cell a, arriving in cell b
+    cost_t cost(uint32_t a,int m,uint32_t b) const {
+      gridposition pa=cell_position(a), pb=cell_position(b);
+      cost_t proxcost=1.0 + 0.5*nav.slice[pa.a].proximity.at(pa.x,pa.y);
+      cost_t c=proxcost*(m<2?drive_cost[pa.a]:cost_t(GRIDSIZE*TURN_COST_TO_GRID_COST));
+      if (nav.slice[pb.a].obstacle.at(pb.x,pb.y)!=0) c+=1000.0; // hitting obstacle counts as a 1 meter cost
+      return c;
+    }
+    
+    // Admissible estimate of the cost between these cells: 
+    //   straight-line distance, plus the smallest turn.
+    cost_t heuristic(uint32_t a,uint32_t b) const {
+      gridposition pa=cell_position(a), pb=cell_position(b);
+      cost_t dist=GRIDSIZE*sqrtf((float)((pa.x-pb.x)*(pa.x-pb.x)+(pa.y-pb.y)*(pa.y-pb.y)));
+      int turn=std::abs(pa.a-pb.a);
+      if (turn>GRIDA/2) turn=GRIDA-turn;
+      return dist + turn*cost_t(GRIDSIZE*TURN_COST_TO_GRID_COST);
+    }
+    
+    // Summarize the costs of this cell, to notice when they change
+    unsigned char cost_code(uint32_t c) const {
+      gridposition p=cell_position(c);
+      int prox=std::min(nav.slice[p.a].proximity.at(p.x,p.y),127);
+      return prox | (nav.slice[p.a].obstacle.at(p.x,p.y)!=0?0x80:0);
+    }
+    
+    key_t calculate_key(uint32_t c) const {
+      cost_t m=std::min(g[c],rhs[c]);
+      return key_t{m+heuristic(start,c)+km, m};
+    }
+    
+    // Best lookahead cost from this cell: cheapest move plus cost to target from there
+    cost_t lookahead(uint32_t c) const {
+      if (goal[c]) return 0.0;
+      cost_t best=infinity();
+      for (int m=0;m<NMOVES;m++) {
+        uint32_t s=move(c,m);
+        if (s!=NONE && g[s]<infinity()) best=std::min(best,cost(c,m,s)+g[s]);
+      }
+      return best;
+    }
+    
+    // Put this cell in (or out of) the open list, depending on if it's consistent
+    void update_vertex(uint32_t c) {
+      bool open=heap_index[c]!=NONE;
+      if (g[c]!=rhs[c]) {
+        key_t k=calculate_key(c);
+        if (open) heap_update(c,k);
+        else heap_push(c,k);
+      }
+      else if (open) heap_remove(c);
+    }
+    
+    // Expand cells until the robot's cell is consistent.
+    void compute_shortest_path(void) {
+      while (!heap.empty() && (heap[0].key<calculate_key(start) || rhs[start]>g[start])) {
+        uint32_t u=heap[0].cell;
+        key_t kold=heap[0].key;
+        key_t knew=calculate_key(u);
+        searched++;
+        if (kold<knew) { // stale key: requeue
+          heap_update(u,knew);
+        }
+        else if (g[u]>rhs[u]) { // overconsistent: cost went down
+          g[u]=rhs[u];
+          heap_remove(u);
+          for (int m=0;m<NMOVES;m++) {
+            uint32_t s=move(u,m); // predecessor (moves are reversible)
+            if (s==NONE || goal[s]) continue;
+            int back=m^1; // the move from s that reaches u
+            rhs[s]=std::min(rhs[s],cost(s,back,u)+g[u]);
+            update_vertex(s);
+          }
+        }
+        else { // underconsistent: cost went up
+          g[u]=infinity();
+          update_vertex(u);
+          for (int m=0;m<NMOVES;m++) {
+            uint32_t s=move(u,m);
+            if (s==NONE || goal[s]) continue;
+            rhs[s]=lookahead(s);
+            update_vertex(s);
+          }
+        }
+      }
+    }
+    
+    // Start over with an empty search towards this target
+    void initialize(const planner_target &target) {
+      size_t total=(size_t)GRIDX*GRIDY*GRIDA;
+      g.assign(total,infinity());
+      rhs.assign(total,infinity());
+      heap_index.assign(total,NONE);
+      goal.assign(total,false);
+      seen.resize(total);
+      heap.clear();
+      km=0.0;
+      last_start=start;
+      for (uint32_t c=0;c<total;c++) {
+        seen[c]=cost_code(c);
+        if (target.reached_target(cell_position(c))) {
+          goal[c]=true;
+          rhs[c]=0.0;
+          heap_push(c,calculate_key(c));
+        }
+      }
+      nav.changed.clear();
+      started=true;
+    }
+    
+    // Repair the search for any cells whose costs changed
+    void update_changed(void) {
+      gridrect r=nav.changed;
+      nav.changed.clear();
+      if (r.empty()) return;
+      for (int a=0;a<GRIDA;a++)
+      for (int y=r.y0;y<r.y1;y++)
+      for (int x=r.x0;x<r.x1;x++)
+      {
+        uint32_t c=cell_index(x,y,a);
+        unsigned char code=cost_code(c);
+        if (code==seen[c]) continue;
+        seen[c]=code;
+        // Our outgoing moves changed (proximity), and so did moves into us (obstacle)
+        if (!goal[c]) { rhs[c]=lookahead(c); update_vertex(c); }
+        for (int m=0;m<NMOVES;m++) {
+          uint32_t s=move(c,m);
+          if (s==NONE || goal[s]) continue;
+          rhs[s]=lookahead(s);
+          update_vertex(s);
+        }
+      }
+    }
+    
+    // Walk downhill from the robot to the target, and store the path
+    void extract_path(void) {
+      path.clear();
+      valid=false;
+      if (g[start]>=infinity() && rhs[start]>=infinity()) return; // no path
+      uint32_t c=start;
+      size_t limit=4*(GRIDX+GRIDY+GRIDA); // sanity limit on path length
+      while (!goal[c]) {
+        int bestm=-1; uint32_t bests=NONE; cost_t best=infinity();
+        for (int m=0;m<NMOVES;m++) {
+          uint32_t s=move(c,m);
+          if (s==NONE || g[s]>=infinity()) continue;
+          cost_t v=cost(c,m,s)+g[s];
+          if (v<best) { best=v; bestm=m; bests=s; }
+        }
+        if (bestm<0 || path.size()>limit) { path.clear(); return; }
+        gridposition p=cell_position(bests);
+        drive_t drive;
+        if (bestm<2) drive=drive_t(bestm==0?+1.0f:-1.0f,0.0f);
+        else drive=drive_t(0.0f,bestm==2?-1.0f:+1.0f);
+        cost_t so_far=path.empty()?0.0:path.back().cost;
+        path.push_back(searchposition(so_far+best-g[bests],g[bests],drive,
+          fposition(vec2(p.x*GRIDSIZE,p.y*GRIDSIZE),p.a),NULL));
+        c=bests;
+      }
+      valid=true;
+    }
+    
+    // Indexed binary heap operations
+    void heap_place(size_t i,const heapentry &e) {
+      heap[i]=e;
+      heap_index[e.cell]=i;
+    }
+    void heap_sift_up(size_t i) {
+      heapentry e=heap[i];
+      while (i>0) {
+        size_t parent=(i-1)/2;
+        if (heap[parent].key<=e.key) break;
+        heap_place(i,heap[parent]);
+        i=parent;
+      }
+      heap_place(i,e);
+    }
+    void heap_sift_down(size_t i) {
+      heapentry e=heap[i];
+      size_t size=heap.size();
+      while (true) {
+        size_t child=2*i+1;
+        if (child>=size) break;
+        if (child+1<size && heap[child+1].key<heap[child].key) child++;
+        if (e.key<=heap[child].key) break;
+        heap_place(i,heap[child]);
+        i=child;
+      }
+      heap_place(i,e);
+    }
+    void heap_push(uint32_t c,const key_t &k) {
+      heap.push_back(heapentry{k,c});
+      heap_sift_up(heap.size()-1);
+    }
+    void heap_update(uint32_t c,const key_t &k) {
+      size_t i=heap_index[c];
+      heap[i].key=k;
+      heap_sift_up(i);
+      heap_sift_down(heap_index[c]);
+    }
+    void heap_remove(uint32_t c) {
+      size_t i=heap_index[c];
+      heap_index[c]=NONE;
+      heapentry back=heap.back(); heap.pop_back();
+      if (i<heap.size()) {
+        heap_place(i,back);
+        heap_sift_up(i);
+        heap_sift_down(heap_index[back.cell]);
+      }
+    }
+    
+  public:
+    // This bool marks that we found a good path.
+    bool valid;
+    
+    // This is the sequence of steps from origin to target
+    std::deque<searchposition> path;
+    
+    // This is how many cells we expanded during the last plan call
+    size_t searched;
+    
+    dstar_planner(navigator_t &nav_) 
+      :nav(nav_), started(false), start(0), last_start(0), km(0.0), valid(false), searched(0)
+    {
+      for (int a=0;a<GRIDA;a++) {
+        vec2 d=nav.slice[a].drive;
+        double scale=1.01/std::max(fabs(d.x),fabs(d.y)); // drive at least into the next grid cell
+        stepx[a]=(int)floor(d.x*scale+0.5);
+        stepy[a]=(int)floor(d.y*scale+0.5);
+        drive_cost[a]=GRIDSIZE*sqrt(stepx[a]*stepx[a]+stepy[a]*stepy[a]); // true length, keeps heuristic admissible
+      }
+    }
+    
+    // Throw away the old search, for example because the target moved
+    void restart(void) { started=false; }
+    
+    // Plan (or repair our last plan) from origin to target.
+    //   Returns true if we have a path.
+    bool plan(const fposition &origin,const planner_target &target)
+    {
+      searched=0;
+      gridposition p(origin);
+      if (!p.valid()) {
+        std::cout<<"Starting point is off the grid!?\n";
+        valid=false; path.clear();
+        return false;
+      }
+      start=cell_index(p.x,p.y,p.a);
+      
+      if (!started) initialize(target);
+      else {
+        km+=heuristic(last_start,start);
+        last_start=start;
+        update_changed();
+      }
+      compute_shortest_path();
+      extract_path();
+      return valid;
+    }
+  }; // end dstar_planner class
 
 }; // end templated class gridnavigator
 
@@ -127,6 +127,8 @@ public:
   };
   
   typedef navigator_t::planner<planner_navtarget> planner;
+  typedef navigator_t::anytime_planner<planner_navtarget> anytime_planner;
+  typedef navigator_t::dstar_planner<planner_navtarget> dstar_planner;
   
   // Discretized version of our geometry
   navigator_t::robot_grid_geometry robot;
@@ -141,6 +143,17 @@ public:
   void mark_obstacle(int x,int y,int height) {
      navigator.mark_obstacle((x+GRIDSIZE/2)/GRIDSIZE,(y+GRIDSIZE/2)/GRIDSIZE,height,robot);
   }
+  
+  // Set the obstacle height at this grid cell (0 to remove the obstacle).
+  //  Afterwards, call navigator.update_proximity.
+  void set_obstacle_cell(int gx,int gy,int height) {
+     navigator.set_obstacle(gx,gy,height,robot);
+  }
+  
+  // Remove all obstacles (except the field edges)
+  void clear_obstacles(void) {
+     navigator.clear_obstacles(robot);
+  }
 
 
  // gridnav::robot_geometry interface:
@@ -0,0 +1,90 @@
+/*
+  Benchmark and check gridnavigator::compute_proximity:
+  compares the distance-transform version against the original
+  obstacle stamping loop on sparse and dense random fields, 
+  and checks both give exactly the same proximity values.
+*/
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include "gridnav_RMC.h"
+
+typedef rmc_navigator::navigator_t navigator_t;
+
+// The original proximity computation: stamp a square around every obstacle.
+//  Cost is proportional to obstacles times cells squared.
+void reference_proximity(navigator_t &nav,int cells) {
+  for (int ia=0;ia<rmc_navigator::GRIDA;ia++) {
+    navigator_t::gridslice &s=nav.slice[ia];
+    s.proximity.clear(0);
+    for (int y=-1;y<=rmc_navigator::GRIDY;y++)
+    for (int x=-1;x<=rmc_navigator::GRIDX;x++)
+    {
+      if (!navigator_t::gridposition(x,y,0).valid() || s.obstacle.at(x,y)!=0) 
+      { // mark all nearby cells as near obstacle
+        for (int dy=-cells;dy<=cells;dy++)
+        for (int dx=-cells;dx<=cells;dx++)
+        {
+          int cy=y+dy;
+          int cx=x+dx;
+          if (navigator_t::gridposition(cx,cy,0).valid())
+          {
+            int dist=cells+1 - std::max(std::abs(dx),std::abs(dy));
+            int &prox=s.proximity.at(cx,cy);
+            if (prox<dist) prox=dist;
+          }
+        }
+      }
+    }
+  }
+}
+
+double milliseconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main() {
+  static rmc_navigator nav; // static: too big for the stack
+  static navigator_t::grid2D<int> saved[rmc_navigator::GRIDA]; // reference answer
+  int reps=3;
+  bool ok=true;
+  
+  const int densities[]={20,500,5000}; // obstacles on the field
+  for (int obstacles : densities)
+  for (int cells=1;cells<=4;cells*=2) {
+    nav.clear_obstacles();
+    srand(obstacles);
+    for (int i=0;i<obstacles;i++)
+      nav.set_obstacle_cell(rand()%rmc_navigator::GRIDX,rand()%rmc_navigator::GRIDY,30);
+    
+    auto start=std::chrono::steady_clock::now();
+    for (int r=0;r<reps;r++) reference_proximity(nav.navigator,cells);
+    double ref_ms=milliseconds_since(start)/reps;
+    for (int ia=0;ia<rmc_navigator::GRIDA;ia++) saved[ia]=nav.navigator.slice[ia].proximity;
+    
+    start=std::chrono::steady_clock::now();
+    for (int r=0;r<reps;r++) nav.navigator.compute_proximity(cells);
+    double new_ms=milliseconds_since(start)/reps;
+    
+    long mismatch=0;
+    for (int ia=0;ia<rmc_navigator::GRIDA;ia++)
+    for (int y=0;y<rmc_navigator::GRIDY;y++)
+    for (int x=0;x<rmc_navigator::GRIDX;x++)
+      if (saved[ia].at(x,y)!=nav.navigator.slice[ia].proximity.at(x,y)) mismatch++;
+    if (mismatch) ok=false;
+    
+    printf("%5d obstacles, %d cells: stamping %7.1f ms, distance transform %7.1f ms (%.1fx)  %s\n",
+      obstacles,cells,ref_ms,new_ms,ref_ms/new_ms,mismatch?"MISMATCH":"identical");
+  }
+  
+  // Incremental update after a small local change
+  nav.clear_obstacles();
+  nav.navigator.compute_proximity(1);
+  auto start=std::chrono::steady_clock::now();
+  for (int x=70;x<80;x++) nav.set_obstacle_cell(x,200,30);
+  nav.navigator.update_proximity(1);
+  printf("Local 10-cell obstacle change + update_proximity: %.1f ms\n",milliseconds_since(start));
+  
+  printf(ok?"OK\n":"FAIL: proximity values differ\n");
+  return ok?0:1;
+}
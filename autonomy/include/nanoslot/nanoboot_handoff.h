@@ -19,6 +19,7 @@
 #include "A_packet.h" // format packets on serial port
 #include "nanoslot_exchange.h" // data exchanged in A packets
 #include "nanoslot_sanity.h" // sanity checking for nanoslot data
+#include "nanoslot_update.h" // per-slot sequence numbers
 
 // Scale factor from raw HX711 readings to actual kilograms
 static inline float HX711_read_scale(int32_t raw,float zerocal=0.0f)
@@ -260,9 +261,11 @@ public:
         if (got_sensor)
         { // write sensor data to the exchange
             nanoslot_exchange &nano=exchange_nanoslot.write_begin();
+            nanoslot_update_begin(NANOSLOT_MY_EX.update);
             NANOSLOT_MY_EX.sensor=my_sensor;
             NANOSLOT_MY_EX.state=my_state;
             NANOSLOT_MY_EX.debug.packet_count++;
+            nanoslot_update_end(NANOSLOT_MY_EX.update);
             exchange_nanoslot.write_end();
         }
         
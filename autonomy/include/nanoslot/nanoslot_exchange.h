@@ -225,6 +225,14 @@ struct nanoslot_debug_t {
     
 };
 
+/** Per-slot update tracking, so readers can skip slots that haven't changed.
+    Written by the slot program after each sensor packet (see nanoslot_update.h). */
+struct nanoslot_update_t {
+    uint32_t sequence; // seqlock counter: odd while the slot program is writing, +2 per sensor packet
+    uint32_t spare; // keeps time 8-byte aligned on 32-bit machines
+    int64_t time; // CLOCK_MONOTONIC time of the last sensor packet, in nanoseconds
+};
+
 /** Each slot keeps this data on the exchange.
     The idea is we can send commands like nano.slot_A0.command.motor[1]=100;
 */
@@ -235,6 +243,7 @@ struct nanoslot_exchange_slot
     sensor_t sensor; ///< Sensor data received back from Arduino
     state_t state; ///< Persistent state data
     nanoslot_debug_t debug; ///< Debug data
+    nanoslot_update_t update; ///< Sequence number and timestamp of last sensor data
     
     nanoslot_padding_t pad; ///<- padding prevents false sharing slowdown (separate programs on separate cores may be updating each slot's data)
 };
@@ -0,0 +1,49 @@
+/*
+ Per-slot sequence numbers for the nanoslot exchange.
+ 
+ Each slot program updates its own slot's nanoslot_update_t every time
+ it posts new sensor data, so the backend can tell which slots changed
+ (and skip redoing the IMU and joint math for the ones that didn't),
+ without depending on the exchange-wide update counter that every slot shares.
+
+ This file is Public Domain.
+*/
+#ifndef __NANOSLOT_UPDATE_H
+#define __NANOSLOT_UPDATE_H 
+#include "aurora/data_exchange.h"
+#include "nanoslot_exchange.h"
+
+/// Slot program: call before writing new data into this slot.
+inline void nanoslot_update_begin(nanoslot_update_t &update)
+{
+    uint32_t seq=__atomic_load_n(&update.sequence,__ATOMIC_RELAXED);
+    __atomic_store_n(&update.sequence,(seq|1)+((seq&1)?2:0),__ATOMIC_RELAXED); // odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+/// Slot program: call after writing new data into this slot.
+inline void nanoslot_update_end(nanoslot_update_t &update)
+{
+    update.time=aurora::time_in_nanoseconds_monotonic();
+    uint32_t seq=__atomic_load_n(&update.sequence,__ATOMIC_RELAXED);
+    __atomic_store_n(&update.sequence,seq+1,__ATOMIC_RELEASE); // even: write finished
+}
+
+/** Reader side: remembers the last sequence number seen for one slot. */
+class nanoslot_update_watcher {
+public:
+    uint32_t last_seen; // sequence number at our last changed() call
+    
+    nanoslot_update_watcher() :last_seen(~0u) {}
+    
+    /// Return true if this slot has finished a new write since our last call.
+    ///  A write that's still in progress will show up on a later call.
+    bool changed(const nanoslot_update_t &update) {
+        uint32_t seq=__atomic_load_n(&update.sequence,__ATOMIC_ACQUIRE);
+        if ((seq&1) || seq==last_seen) return false;
+        last_seen=seq;
+        return true;
+    }
+};
+
+#endif
@@ -5,7 +5,8 @@
 
 aruco_detector::aruco_detector(float min_size, const char *cam_parameters) 
     :MDetector("TAG25h9"),
-    cam_param_resized(false)
+    cam_param_resized(false),
+    tracking(false), pyramid(0), last_full(true)
 {
   //	if (ThePyrDownLevel>0)
   //		params.pyrDown(ThePyrDownLevel);
@@ -29,8 +30,27 @@ void aruco_detector::find_markers(cv::Mat &color_image,marker_watcher &watcher,
         cam_param.resize(color_image.size());
     }
 	
-	// Detect all the markers
-	MDetector.detect(color_image,TheMarkers,cam_param,1.0,true);
+	if (!tracking && pyramid<=0)
+	{ // Detect all the markers, in the whole image
+		MDetector.detect(color_image,TheMarkers,cam_param,1.0,true);
+		last_full=true;
+	}
+	else 
+	{ // Detect markers in regions of interest (possibly from a coarse scan)
+		last_full=(!tracking || tracker.plan(color_image.cols,color_image.rows,rois));
+		TheMarkers.clear();
+		if (last_full) {
+			if (pyramid>0) coarse_rois(color_image,rois);
+			else MDetector.detect(color_image,TheMarkers,cam_param,1.0,true);
+		}
+		if (!last_full || pyramid>0) detect_rois(color_image,rois);
+		
+		if (tracking) {
+			for (const aruco::Marker &marker:TheMarkers)
+				tracker.found(marker.id,marker_box(marker));
+			tracker.end_frame();
+		}
+	}
 	
 	// Extract locations from different markers:
 	for (int i=0; i<(int)TheMarkers.size(); i++) {
@@ -65,6 +85,65 @@ void aruco_detector::find_markers(cv::Mat &color_image,marker_watcher &watcher,
 
 
 
+void aruco_detector::detect_rois(const cv::Mat &image,const std::vector<marker_roi> &rois)
+{
+	for (const marker_roi &r:rois) {
+		cv::Mat sub=image(cv::Rect(r.x0,r.y0,r.width(),r.height())); // no copy
+		MDetector.detect(sub,found); // no camera parameters: they're for the whole image
+		for (aruco::Marker &marker:found) {
+			bool duplicate=false; // rois don't overlap, but a marker could straddle two
+			for (const aruco::Marker &m:TheMarkers) if (m.id==marker.id) duplicate=true;
+			if (duplicate) continue;
+			
+			for (cv::Point2f &p:marker) { p.x+=r.x0; p.y+=r.y0; } // back to image coordinates
+			if (cam_param.isValid()) marker.calculateExtrinsics(1.0,cam_param,true);
+			TheMarkers.push_back(marker);
+		}
+	}
+}
+
+void aruco_detector::coarse_rois(const cv::Mat &image,std::vector<marker_roi> &rois)
+{
+	static thread_local cv::Mat small[2]; // pyramid levels, kept between frames
+	const cv::Mat *level=&image;
+	for (int l=0;l<pyramid;l++) {
+		cv::pyrDown(*level,small[l&1]);
+		level=&small[l&1];
+	}
+	
+	MDetector.detect(*level,found);
+	rois.clear();
+	float scale=1<<pyramid;
+	for (const aruco::Marker &marker:found) {
+		marker_roi box=marker_box(marker);
+		box=marker_roi(box.x0*scale,box.y0*scale,box.x1*scale,box.y1*scale);
+		// Corners are only good to a coarse pixel or two: pad generously
+		int pad=std::max(tracker.pad_min,box.width()/4);
+		marker_roi r=box.padded(pad,pad).clipped(image.cols,image.rows);
+		bool merged=false;
+		for (marker_roi &old:rois) 
+			if (old.overlaps(r)) { old.add(r); merged=true; }
+		if (!merged) rois.push_back(r);
+	}
+}
+
+marker_roi aruco_detector::marker_box(const aruco::Marker &marker)
+{
+	marker_roi box;
+	for (const cv::Point2f &p:marker) box.add(p.x,p.y);
+	return box;
+}
+
+void aruco_detector::predict_marker(int ID,const aurora::robot_coord3D &view,const vec3 &marker,float size_cm,float max_height_cm)
+{
+	if (!tracking || !cam_param_resized || !cam_param.isValid() || view.percent<=0.0) return;
+	const cv::Mat &K=cam_param.CameraMatrix;
+	marker_roi box=predict_marker_roi(view,marker,size_cm,max_height_cm,
+		K.at<float>(0,0),K.at<float>(1,1),K.at<float>(0,2),K.at<float>(1,2));
+	marker_roi image(0,0,cam_param.CamSize.width,cam_param.CamSize.height);
+	if (box.overlaps(image)) tracker.predict(ID,box);
+}
+
 /* Extract location data from this valid, detected marker. 
    Does not modify the location for an invalid marker.
 */
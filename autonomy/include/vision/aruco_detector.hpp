@@ -2,6 +2,12 @@
 High level interface to the aruco-3 computer vision marker 
 detection library.
 
+By default every frame gets a full-frame detection.  With tracking
+turned on, we only search padded boxes around where markers were last
+seen (or are predicted to be from the robot's pose), with a periodic
+full-frame scan to pick up new markers.  With a pyramid level, full
+scans first look for markers at reduced resolution, then refine them
+at full resolution.
 */
 #ifndef __AURORA_ARUCO_DETECTOR_H
 #define __AURORA_ARUCO_DETECTOR_H
@@ -15,6 +21,8 @@ detection library.
 #include "aruco/aruco.h"
 #include "aruco/cvdrawingutils.h"
 
+#include "marker_roi.hpp"
+
 
 class aruco_detector {
 public:
@@ -31,7 +39,43 @@ public:
     template <class marker_watcher>
     void find_markers(cv::Mat &image,marker_watcher &watcher, bool draw_debug=false);
     
+    /**
+      Only search near known marker locations, with a full-frame scan 
+      every full_scan_interval frames (or whenever we lose a marker).
+    */
+    void set_tracking(bool track,int full_scan_interval=15) {
+        tracking=track;
+        tracker.full_scan_interval=full_scan_interval;
+    }
+    
+    /**
+      Do full-frame scans at 1/2^levels resolution, then refine the
+      markers found at full resolution.  0 turns this off.
+      Markers smaller than about 2^levels times the minimum size get missed.
+    */
+    void set_pyramid(int levels) { pyramid=levels; }
+    
+    /**
+      Suggest where marker ID should be in the next frame, from the camera's
+      view (cm) and the marker's field location (cm).  Needs the camera 
+      parameters, and only matters in tracking mode.
+    */
+    void predict_marker(int ID,const aurora::robot_coord3D &view,const vec3 &marker,float size_cm,float max_height_cm);
+    
+    // Return true if the last find_markers call scanned the whole frame
+    bool last_was_full_scan() const { return last_full; }
+    
 private:
+    /* Detect markers in just these parts of the image, and append them to TheMarkers */
+    void detect_rois(const cv::Mat &image,const std::vector<marker_roi> &rois);
+    
+    /* Detect markers at reduced resolution, and return boxes around them */
+    void coarse_rois(const cv::Mat &image,std::vector<marker_roi> &rois);
+    
+    /* Image bounding box of this marker */
+    static marker_roi marker_box(const aruco::Marker &marker);
+    
+
     /* Extract location data from this valid, detected marker. */
     template <class marker_watcher>
     void extract_location(const aruco::Marker &marker,marker_watcher &watcher);
@@ -41,6 +85,13 @@ private:
     aruco::MarkerDetector::Params params;
     aruco::CameraParameters cam_param;
     bool cam_param_resized;
+    
+    bool tracking; // only search regions of interest (between full scans)
+    int pyramid; // levels of pyrDown for full scans (0 for full resolution)
+    bool last_full; // last frame was a full scan
+    marker_roi_tracker tracker;
+    std::vector<marker_roi> rois; // regions of interest for this frame
+    std::vector<aruco::Marker> found; // scratch space for detections
 };
 
 #endif
@@ -0,0 +1,219 @@
+/*
+  Fast projection of a depth image onto the 2D obstacle grid.
+
+  Each camera-space direction is (xdir[x], ydir[y], 1), scaled by depth.
+  The view transform is linear, so the world position of a pixel is
+     origin + depth * (X*xdir[x] + Y*ydir[y] + Z)
+  which we split into a per-row part (Y*ydir[y] + Z) and a per-column
+  part (X*xdir[x]) stored as separate x/y/z arrays.  The inner loop is
+  then plain float multiply-adds over arrays, which the compiler
+  vectorizes (SSE/AVX2 on x86, NEON on ARM) without intrinsics.
+
+  Rows are split across a small persistent thread pool.  Each thread
+  accumulates into its own partial grid, which is merged at the end.
+  Only the tiles each thread touched get merged or cleared.
+
+  This header doesn't need OpenCV or librealsense, so it can be
+  benchmarked anywhere (see vision/depth_project_bench.cpp).
+
+  This file is Public Domain.
+*/
+#ifndef __AURORA_VISION_DEPTH_PROJECTION_HPP
+#define __AURORA_VISION_DEPTH_PROJECTION_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include "../aurora/coords.h"
+#include "grid.hpp"
+
+/* Filtering limits for depth data, in centimeters */
+struct depth_projection_limits {
+    float depth_scale=1.0f; // fudge factor to match real distances
+    float distance_min=60.0; // mostly parts of robot if they're too close
+    float distance_max=550.0; // depth gets ratty if it's too far out
+    float Z_max=300.0; // ignore ceiling (with wide error band for tilt)
+    float Z_min=-200.0; // ignore invalid too-low
+    int left_start=30; // invalid data left of here
+};
+
+/* Projects depth images onto an obstacle_grid, using several threads. */
+class depth_projection {
+public:
+    depth_projection_limits limits;
+
+    // Start up our threads.  nthreads==0 means one per core.
+    depth_projection(int nthreads=0)
+    {
+        if (nthreads<=0) nthreads=std::max(1u,std::thread::hardware_concurrency());
+        workers.resize(nthreads);
+        for (int t=1;t<nthreads;t++) {
+            workers[t].partial=new obstacle_grid;
+            workers[t].thread=std::thread([this,t]() { worker_loop(t); });
+        }
+    }
+    ~depth_projection() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            quit=true;
+        }
+        start_work.notify_all();
+        for (size_t t=1;t<workers.size();t++) {
+            workers[t].thread.join();
+            delete workers[t].partial;
+        }
+    }
+
+    /* Project this depth image into world coordinates, and add it to the map.
+         depth: w x h raw depth values, row-major
+         depth2cm: scale factor from raw depth to centimeters
+         xdir, ydir: camera-space direction per column and per row
+         view3D: camera to world transform
+    */
+    void project(const uint16_t *depth,int w,int h,float depth2cm,
+        const float *xdir,const float *ydir,
+        const aurora::robot_coord3D &view3D,
+        obstacle_grid &map2D)
+    {
+        // Per-column part of the transform, as separate x/y/z arrays
+        colx.resize(w); coly.resize(w); colz.resize(w);
+        for (int x=0;x<w;x++) {
+            vec3 c=view3D.X*xdir[x];
+            colx[x]=c.x; coly[x]=c.y; colz[x]=c.z;
+        }
+
+        job.depth=depth; job.w=w; job.h=h;
+        job.scale=depth2cm*limits.depth_scale;
+        job.ydir=ydir; job.view=view3D;
+        workers[0].partial=&map2D; // thread 0 works directly on the output
+
+        // Hand out the work
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            running=workers.size()-1;
+            generation++;
+        }
+        start_work.notify_all();
+
+        do_rows(0);
+
+        // Wait for everybody, and merge their results
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_done.wait(lock,[this]() { return running==0; });
+        }
+        for (size_t t=1;t<workers.size();t++) {
+            map2D.merge(*workers[t].partial);
+            workers[t].partial->clear();
+        }
+    }
+
+private:
+    // Per-thread state
+    struct worker {
+        std::thread thread;
+        obstacle_grid *partial=0; // grid this thread accumulates into
+        std::vector<float> wx,wy,wz; // world coordinates for one row
+        std::vector<unsigned char> valid; // 1 if this row pixel should be added
+    };
+    std::vector<worker> workers;
+
+    // The current frame
+    struct {
+        const uint16_t *depth;
+        int w,h;
+        float scale;
+        const float *ydir;
+        aurora::robot_coord3D view;
+    } job;
+    std::vector<float> colx,coly,colz; // X*xdir, per column
+
+    std::mutex mutex;
+    std::condition_variable start_work, work_done;
+    unsigned long generation=0; // bumped for each new frame
+    int running=0; // workers still busy on this frame
+    bool quit=false;
+
+    void worker_loop(int t) {
+        unsigned long seen=0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start_work.wait(lock,[&]() { return quit || generation!=seen; });
+                if (quit) return;
+                seen=generation;
+            }
+            do_rows(t);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                running--;
+            }
+            work_done.notify_one();
+        }
+    }
+
+    // Merge this run of points into the grid cell x,y
+    static void flush_run(obstacle_grid &grid,int x,int y,grid_square &run) {
+        grid.add_cell(x,y,run);
+        run.clear();
+    }
+
+    // Project thread t's share of the rows
+    void do_rows(int t) {
+        worker &k=workers[t];
+        int n=workers.size();
+        int ystart=job.h*t/n, yend=job.h*(t+1)/n;
+        int xstart=std::min(limits.left_start,job.w);
+        int w=job.w;
+        k.wx.resize(w); k.wy.resize(w); k.wz.resize(w); k.valid.resize(w);
+
+        const float ox=job.view.origin.x, oy=job.view.origin.y, oz=job.view.origin.z;
+        const float dmin=limits.distance_min, dmax=limits.distance_max;
+        const float zmin=limits.Z_min, zmax=limits.Z_max;
+        const float scale=job.scale;
+        const float *cx=&colx[0], *cy=&coly[0], *cz=&colz[0];
+        float *wx=&k.wx[0], *wy=&k.wy[0], *wz=&k.wz[0];
+        unsigned char *valid=&k.valid[0];
+
+        for (int y=ystart;y<yend;y++) {
+            const uint16_t *row=job.depth+(size_t)y*w;
+            vec3 r=job.view.Y*job.ydir[y]+job.view.Z; // per-row part of the transform
+            const float rx=r.x, ry=r.y, rz=r.z;
+
+            // Vectorizable: project every pixel in the row
+            for (int x=xstart;x<w;x++) {
+                float d=scale*row[x];
+                float X=ox+d*(rx+cx[x]);
+                float Y=oy+d*(ry+cy[x]);
+                float Z=oz+d*(rz+cz[x]);
+                wx[x]=X; wy[x]=Y; wz[x]=Z;
+                valid[x]=(d>dmin) & (d<=dmax) & (Z<zmax) & (Z>zmin);
+            }
+
+            // Scalar: scatter the valid pixels into the grid.
+            //   Neighboring pixels usually land in the same cell, so we collect
+            //   runs of points in a local square and merge it in once per run.
+            obstacle_grid &grid=*k.partial;
+            grid_square run;
+            int rx_cell=-1, ry_cell=-1;
+            for (int x=xstart;x<w;x++) {
+                if (!valid[x]) continue;
+                int gx=(int)(wx[x]*(1.0f/obstacle_grid::GRIDSIZE));
+                int gy=(int)(wy[x]*(1.0f/obstacle_grid::GRIDSIZE));
+                if (gx>=0 && gx<obstacle_grid::GRIDX && gy>=0 && gy<obstacle_grid::GRIDY) {
+                    if (gx!=rx_cell || gy!=ry_cell) {
+                        if (rx_cell>=0) flush_run(grid,rx_cell,ry_cell,run);
+                        rx_cell=gx; ry_cell=gy;
+                    }
+                    run.addPoint(wz[x]);
+                }
+            }
+            if (rx_cell>=0) flush_run(grid,rx_cell,ry_cell,run);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,167 @@
+/*
+  Recorded color + depth camera frames, so the vision code can be run,
+  profiled, and regression tested without a camera attached.
+
+  A recording is one file:
+     depth_recording_header: magic, intrinsics, image sizes
+     then any number of fixed-size frames, each:
+        depth_recording_frame: capture time and camera view
+        depth pixels: depth.width x depth.height uint16_t, row-major
+        color pixels: color_w x color_h x 3 bytes, BGR, row-major
+
+  Every frame is the same size, so playback just mmaps the file
+  and indexes into it; there is no parsing or copying per frame.
+
+  This header doesn't need OpenCV or librealsense.
+
+  This file is Public Domain.
+*/
+#ifndef __AURORA_VISION_DEPTH_RECORDING_HPP
+#define __AURORA_VISION_DEPTH_RECORDING_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../aurora/coords.h"
+
+/* Pinhole calibration for one camera stream */
+struct camera_intrinsics {
+    int32_t width, height; // image size, in pixels
+    float ppx, ppy; // principal point, in pixels
+    float fx, fy; // focal length, in pixels
+    float depth2cm; // scale factor from raw depth units to centimeters (depth stream only)
+};
+
+/* Start of a recording file */
+struct depth_recording_header {
+    char magic[8]; // "AURDEPTH"
+    int32_t version; // format version, currently 1
+    int32_t color_w, color_h; // color image size, in pixels
+    int32_t frame_bytes; // size of each frame, including its depth_recording_frame
+    camera_intrinsics depth; // depth camera calibration
+    int32_t reserved; // pads the header out to 8 bytes
+
+    enum {VERSION=1};
+
+    // Size of the frame for these image sizes
+    static int32_t frame_size(const camera_intrinsics &depth,int color_w,int color_h);
+};
+
+/* Start of each recorded frame */
+struct depth_recording_frame {
+    int64_t capture_time; // aurora::time_in_nanoseconds_monotonic at capture
+    aurora::robot_coord3D view; // camera to world transform, percent<=0 if unknown
+};
+
+inline int32_t depth_recording_header::frame_size(const camera_intrinsics &depth,int color_w,int color_h)
+{
+    size_t bytes=sizeof(depth_recording_frame)
+        +sizeof(uint16_t)*depth.width*depth.height
+        +3*color_w*color_h;
+    return (bytes+7)&~(size_t)7; // keep frames 8-byte aligned
+}
+
+/* Writes frames to a recording file */
+class depth_recorder {
+public:
+    depth_recording_header header;
+
+    depth_recorder(const std::string &filename,const camera_intrinsics &depth,int color_w,int color_h)
+        :frames(0)
+    {
+        memset(&header,0,sizeof(header));
+        memcpy(header.magic,"AURDEPTH",8);
+        header.version=depth_recording_header::VERSION;
+        header.color_w=color_w; header.color_h=color_h;
+        header.depth=depth;
+        header.frame_bytes=depth_recording_header::frame_size(depth,color_w,color_h);
+
+        out=fopen(filename.c_str(),"wb");
+        if (!out) throw std::runtime_error("Cannot create depth recording "+filename);
+        fwrite(&header,sizeof(header),1,out);
+    }
+    ~depth_recorder() { fclose(out); }
+
+    // Append one frame.  color is BGR, and may be 0 if there's no color stream.
+    void write(const depth_recording_frame &frame,const uint16_t *depth,const unsigned char *color)
+    {
+        size_t depth_bytes=sizeof(uint16_t)*header.depth.width*header.depth.height;
+        size_t color_bytes=3*header.color_w*header.color_h;
+        std::string pad(header.frame_bytes-sizeof(frame)-depth_bytes-color_bytes,'\0');
+        if (!color) pad.append(color_bytes,'\0');
+
+        fwrite(&frame,sizeof(frame),1,out);
+        fwrite(depth,depth_bytes,1,out);
+        if (color) fwrite(color,color_bytes,1,out);
+        if (!pad.empty()) fwrite(&pad[0],pad.size(),1,out);
+        if (ferror(out)) throw std::runtime_error("Error writing depth recording frame");
+        frames++;
+    }
+
+    int frame_count() const { return frames; }
+private:
+    FILE *out;
+    int frames;
+    depth_recorder(const depth_recorder &no_copies);
+    void operator=(const depth_recorder &no_copies);
+};
+
+/* Maps a recording file into memory for playback */
+class depth_playback {
+public:
+    const depth_recording_header *header;
+
+    depth_playback(const std::string &filename) {
+        int fd=open(filename.c_str(),O_RDONLY);
+        if (fd<0) throw std::runtime_error("Cannot open depth recording "+filename);
+        struct stat st;
+        fstat(fd,&st);
+        length=st.st_size;
+        if (length<sizeof(depth_recording_header)) {
+            close(fd);
+            throw std::runtime_error("Depth recording "+filename+" is too short");
+        }
+        // Private mapping: anything drawn on the images stays in our copy, not the file
+        base=(unsigned char *)mmap(0,length,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+        close(fd);
+        if (base==MAP_FAILED) throw std::runtime_error("Cannot mmap depth recording "+filename);
+
+        header=(const depth_recording_header *)base;
+        if (0!=memcmp(header->magic,"AURDEPTH",8) || header->version!=depth_recording_header::VERSION
+         || header->frame_bytes!=depth_recording_header::frame_size(header->depth,header->color_w,header->color_h))
+        {
+            munmap(base,length);
+            throw std::runtime_error("File "+filename+" is not a depth recording this code can read");
+        }
+        frames=(length-sizeof(depth_recording_header))/header->frame_bytes;
+    }
+    ~depth_playback() { munmap(base,length); }
+
+    int frame_count() const { return frames; }
+
+    // Access the parts of frame i (0 <= i < frame_count())
+    depth_recording_frame &frame(int i) const {
+        return *(depth_recording_frame *)(base+sizeof(depth_recording_header)+(size_t)i*header->frame_bytes);
+    }
+    uint16_t *depth(int i) const {
+        return (uint16_t *)(&frame(i)+1);
+    }
+    unsigned char *color(int i) const {
+        return (unsigned char *)(depth(i)+header->depth.width*header->depth.height);
+    }
+
+private:
+    unsigned char *base;
+    size_t length;
+    int frames;
+    depth_playback(const depth_playback &no_copies);
+    void operator=(const depth_playback &no_copies);
+};
+
+#endif
@@ -1,24 +1,85 @@
 #ifndef __AURORA_VISION_ERODE_HPP
 #define __AURORA_VISION_ERODE_HPP 1
 
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+/* Zeroes every depth pixel within an ellipse of radius r of an invalid (zero) pixel.
+   This gives exactly the same result as cv::erode with a MORPH_ELLIPSE
+   structuring element of size 2r+1, then zeroing wherever that was zero,
+   but it works on an invalid-pixel mask instead of the depth values:
+     - Each row gets a horizontal distance to the nearest invalid pixel.
+     - For each row of the ellipse, dy, with half-width hw[dy], a pixel is
+       zeroed if the row dy away has an invalid pixel within hw[dy].
+   The second and third steps are plain loops over byte arrays, which the
+   compiler vectorizes.  Buffers are kept between frames.
+*/
+class depth_eroder {
+public:
+    void erode(uint16_t *depth,int w,int h,int r) {
+        if (r<=0 || w<=0 || h<=0) return;
+        setup(w,h,r);
+        const uint8_t far=std::min(r+1,255); // farther than any half-width
+
+        // Horizontal distance from each pixel to the nearest invalid pixel in its row
+        for (int y=0;y<h;y++) {
+            const uint16_t *row=depth+(size_t)y*w;
+            uint8_t *d=&dist[(size_t)y*w];
+            uint8_t last=far;
+            for (int x=0;x<w;x++) {
+                last=(row[x]==0)?0:(last<far?last+1:far);
+                d[x]=last;
+            }
+            last=far;
+            for (int x=w-1;x>=0;x--) {
+                last=(d[x]==0)?0:(last<far?last+1:far);
+                if (last<d[x]) d[x]=last;
+            }
+        }
+
+        // Combine rows with the ellipse's half-widths, and zero the marked pixels
+        uint8_t *z=&zero[0];
+        for (int y=0;y<h;y++) {
+            std::fill(zero.begin(),zero.end(),0);
+            for (int dy=-r;dy<=r;dy++) {
+                int sy=y+dy;
+                if (sy<0 || sy>=h) continue; // outside the image doesn't count as invalid
+                const uint8_t *d=&dist[(size_t)sy*w];
+                const uint8_t hw=halfwidth[dy+r];
+                for (int x=0;x<w;x++) z[x]|=(d[x]<=hw);
+            }
+            uint16_t *row=depth+(size_t)y*w;
+            for (int x=0;x<w;x++) row[x]=z[x]?0:row[x];
+        }
+    }
+
+private:
+    int last_w=0, last_h=0, last_r=0;
+    std::vector<uint8_t> dist; // w*h horizontal distances, capped at r+1
+    std::vector<uint8_t> zero; // w flags for the current row: 1 means zero it
+    std::vector<uint8_t> halfwidth; // 2r+1 ellipse half-widths, by row
+
+    void setup(int w,int h,int r) {
+        if (w==last_w && h==last_h && r==last_r) return;
+        last_w=w; last_h=h; last_r=r;
+        dist.resize((size_t)w*h);
+        zero.resize(w);
+        // Same ellipse as OpenCV's getStructuringElement(MORPH_ELLIPSE, 2r+1 square)
+        halfwidth.resize(2*r+1);
+        double inv_r2=1.0/((double)r*r);
+        for (int dy=-r;dy<=r;dy++)
+            halfwidth[dy+r]=lrint(r*sqrt((r*r-dy*dy)*inv_r2));
+    }
+};
+
+#ifdef __VISION_REALSENSE_H
 /* Erode depth data: increase black space around missing data, for reliability*/
 void erode_depth(realsense_camera_capture &cap,int erode_depth) {
-    // erode the depth image here, to trim back depth sparkles
-    cv::Mat depth_eroded(cv::Size(cap.depth_w, cap.depth_h), CV_16U);
-    cv::Mat element=getStructuringElement(cv::MORPH_ELLIPSE,
-        cv::Size(2*erode_depth+1, 2*erode_depth+1),
-        cv::Point(erode_depth,erode_depth));
-    cv::erode(cap.depth_image,depth_eroded,element);
-
-    //depth_raw=depth_eroded; // swap back (easy, but systematic low-depth bias)
-
-    // Zero out depths for all pixels that were eroded
-    for (int y = 0; y < cap.depth_h; y++)
-    for (int x = 0; x < cap.depth_w; x++) {
-        if (0==depth_eroded.at<realsense_camera_capture::depth_t>(y,x))
-            cap.depth_image.at<realsense_camera_capture::depth_t>(y,x)=0;
-    }
+    static thread_local depth_eroder eroder; // keeps its buffers between frames
+    eroder.erode(cap.depth_data,cap.depth_w,cap.depth_h,erode_depth);
 }
-
 #endif
 
+#endif
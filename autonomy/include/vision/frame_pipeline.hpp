@@ -0,0 +1,165 @@
+/*
+  Pieces for running vision as a pipeline of threads:
+  a capture thread hands each frame to worker stages (aruco, obstacle)
+  through lock-free queues, and workers always take the newest frame,
+  dropping any stale ones that came in while they were busy.
+
+  This header doesn't need OpenCV or librealsense.
+
+  This file is Public Domain.
+*/
+#ifndef __AURORA_VISION_FRAME_PIPELINE_HPP
+#define __AURORA_VISION_FRAME_PIPELINE_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <utility>
+#include <chrono>
+#include "../aurora/data_exchange.h" // for futex wait/wake and monotonic time
+
+/**
+ Lock-free single-producer, single-consumer frame queue that drops stale frames.
+ 
+ Workers only ever want the newest frame, so this holds at most one
+ waiting frame: it's a triple buffer.  The producer fills its own back
+ slot, then swaps it with the shared middle slot.  The consumer swaps
+ the middle slot with its front slot when there's a fresh frame there.
+ If the producer swaps out a middle frame nobody took, that stale frame
+ is dropped.  Neither side ever blocks the other.
+*/
+template <typename T>
+class frame_queue {
+public:
+    frame_queue() :back(0), middle(1), front(2), pushes(0), waiting(0), closed(0), dropped(0) {}
+
+    // Producer: add this frame, replacing any frame the consumer hasn't taken yet.
+    void push(T &&frame) {
+        slots[back]=std::move(frame);
+        uint32_t prev=__atomic_exchange_n(&middle,back|FRESH,__ATOMIC_ACQ_REL);
+        back=prev&INDEX;
+        if (prev&FRESH) { // consumer never took that one
+            slots[back]=T(); // release it now
+            __atomic_add_fetch(&dropped,1,__ATOMIC_RELAXED);
+        }
+        __atomic_add_fetch(&pushes,1,__ATOMIC_SEQ_CST);
+        wake();
+    }
+
+    // Consumer: move the newest frame into out, waiting up to timeout_ms for one.
+    //   Returns false on timeout, or once the queue is closed and empty.
+    bool pop_latest(T &out,int timeout_ms) {
+        auto deadline=std::chrono::steady_clock::now()+std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            uint32_t seq=__atomic_load_n(&pushes,__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&middle,__ATOMIC_ACQUIRE)&FRESH) {
+                uint32_t prev=__atomic_exchange_n(&middle,front,__ATOMIC_ACQ_REL);
+                front=prev&INDEX;
+                out=std::move(slots[front]);
+                slots[front]=T();
+                return true;
+            }
+            if (__atomic_load_n(&closed,__ATOMIC_ACQUIRE)) return false;
+            long us=aurora::data_exchange_remaining_us(deadline);
+            if (us<=0) return false;
+
+            // Ask the producer to wake us, then make sure we didn't miss its push
+            __atomic_store_n(&waiting,1,__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&pushes,__ATOMIC_SEQ_CST)!=seq) continue;
+            aurora::data_exchange_futex_wait(&pushes,seq,us);
+        }
+    }
+
+    // Producer: no more frames are coming.  Wakes the consumer.
+    void close(void) {
+        __atomic_store_n(&closed,1,__ATOMIC_RELEASE);
+        __atomic_add_fetch(&pushes,1,__ATOMIC_SEQ_CST);
+        __atomic_store_n(&waiting,1,__ATOMIC_SEQ_CST);
+        wake();
+    }
+
+    // Return true once the producer has called close()
+    bool is_closed(void) const {
+        return __atomic_load_n(&closed,__ATOMIC_ACQUIRE);
+    }
+
+    // Number of frames waiting to be popped (0 or 1)
+    int depth(void) const {
+        return (__atomic_load_n(&middle,__ATOMIC_ACQUIRE)&FRESH)?1:0;
+    }
+
+    // Frames replaced before the consumer took them
+    uint32_t get_dropped(void) const { return __atomic_load_n(&dropped,__ATOMIC_RELAXED); }
+
+private:
+    enum {INDEX=3, FRESH=4}; // middle holds a slot index, plus FRESH if nobody's taken it
+    T slots[3];
+    uint32_t back; // producer's slot
+    uint32_t middle; // shared slot (and FRESH bit)
+    uint32_t front; // consumer's slot
+    uint32_t pushes; // incremented by every push (futex word)
+    uint32_t waiting; // nonzero if the consumer is asleep on pushes
+    uint32_t closed;
+    uint32_t dropped;
+
+    void wake(void) {
+        if (__atomic_load_n(&waiting,__ATOMIC_SEQ_CST)
+          && __atomic_exchange_n(&waiting,0,__ATOMIC_SEQ_CST))
+            aurora::data_exchange_futex_wake(&pushes);
+    }
+
+    // Don't copy or assign this type
+    frame_queue(const frame_queue &q) =delete;
+    void operator=(const frame_queue &q) =delete;
+};
+
+/**
+ Timing statistics for one pipeline stage, collected by the stage's
+ own thread and printed (and reset) periodically by another.
+ All times are in nanoseconds.
+*/
+class stage_stats {
+public:
+    const char *name;
+
+    stage_stats(const char *name_) :name(name_) { reset(); }
+
+    // Record one frame finished by this stage.
+    //   capture_time: when the frame was captured
+    //   start_time: when this stage started working on it
+    //   queue_depth: frames waiting in this stage's input queue
+    void add(aurora::monotonic_time_t capture_time,aurora::monotonic_time_t start_time,int queue_depth=0) {
+        aurora::monotonic_time_t now=aurora::time_in_nanoseconds_monotonic();
+        int64_t latency=now-capture_time;
+        __atomic_add_fetch(&frames,1,__ATOMIC_RELAXED);
+        __atomic_add_fetch(&latency_sum,latency,__ATOMIC_RELAXED);
+        __atomic_add_fetch(&busy_sum,now-start_time,__ATOMIC_RELAXED);
+        if (latency>__atomic_load_n(&latency_max,__ATOMIC_RELAXED))
+            __atomic_store_n(&latency_max,latency,__ATOMIC_RELAXED);
+        if (queue_depth>__atomic_load_n(&depth_max,__ATOMIC_RELAXED))
+            __atomic_store_n(&depth_max,queue_depth,__ATOMIC_RELAXED);
+    }
+
+    // Print stats since the last print, over this many seconds, and reset them.
+    //   dropped is the number of stale frames this stage's input queue has dropped.
+    void print(double seconds,uint32_t dropped=0) {
+        int64_t n=__atomic_exchange_n(&frames,0,__ATOMIC_RELAXED);
+        int64_t lat=__atomic_exchange_n(&latency_sum,0,__ATOMIC_RELAXED);
+        int64_t busy=__atomic_exchange_n(&busy_sum,0,__ATOMIC_RELAXED);
+        int64_t lat_max=__atomic_exchange_n(&latency_max,0,__ATOMIC_RELAXED);
+        int dmax=__atomic_exchange_n(&depth_max,0,__ATOMIC_RELAXED);
+        double div=n>0?1.0e-6/n:0.0;
+        printf("  %-9s %5.1f fps  latency %6.1f ms mean %6.1f max  work %6.1f ms  queue %d max  dropped %u\n",
+            name,n/seconds,lat*div,lat_max*1.0e-6,busy*div,dmax,(unsigned)dropped);
+    }
+
+    void reset(void) {
+        frames=latency_sum=busy_sum=latency_max=0;
+        depth_max=0;
+    }
+
+private:
+    int64_t frames, latency_sum, busy_sum, latency_max;
+    int depth_max;
+};
+
+#endif
@@ -9,6 +9,10 @@ grid_square::grid_square()
 {
   clear();
 }
+grid_square::grid_square(int count_,float sum_,float min_,float max_)
+	:max(max_), min(min_), sum(sum_), sumSquares(0), count(count_), flags(0)
+{
+}
 void grid_square::clear() 
 {
 	count=0;
@@ -33,6 +37,21 @@ void grid_square::addPoint(float z)
 		max=z;
 	}
 }
+void grid_square::merge(const grid_square &other)
+{
+	count+=other.count;
+	sum+=other.sum;
+	sumSquares+=other.sumSquares;
+	if(other.min<min)
+	{
+		min=other.min;
+	}
+	if(max<other.max)
+	{
+		max=other.max;
+	}
+	flags|=other.flags;
+}
 float grid_square::getMean() const
 {
 	return sum/count;
@@ -9,6 +9,11 @@
 #define GRIDHPP
 #include <fstream>
 #include <vector>
+#include <array>
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
 #include "../aurora/vec3.h"
 #include "../aurora/field_geometry.h"
 
@@ -23,12 +28,19 @@ private:
   int flags;
 public:
   grid_square();
+  
+  // Make a square with these statistics (sums of squares and flags aren't kept)
+  grid_square(int count,float sum,float min,float max);
 
   void clear();
 
   void addPoint(float z);
+  
+  // Add all the points from another square to this one
+  void merge(const grid_square &other);
 
   int getCount() const { return count; }
+  float getSum() const { return sum; }
   float getMean() const;
   float getTrimmedMean() const;
   float getVariance() const;
@@ -47,7 +59,17 @@ int compare(grid_square a, grid_square b);
 /// Make it easy to swap between float (fast for big arrays) and double
 typedef float real_t;
 
-/// Keeps track of location of obstacles
+/** Keeps track of location of obstacles.
+
+ Cells are stored as separate arrays (structure of arrays), with heights
+ in 16-bit fixed point, so the whole grid is about 2.3 MB instead of 5.6 MB.
+ 
+ The grid is split into TILE x TILE cell tiles.  A tile is marked dirty
+ when any point is added to it, and every cell with data is in a dirty
+ tile, so clearing, merging, and copying grids only touch dirty tiles.
+ Vision publishes with copy_tiles_from, and the cartographer only looks
+ at the dirty tiles, which is usually just the wedge the camera sees.
+*/
 class obstacle_grid {
 public:
 #if 1 // robot versions
@@ -60,27 +82,57 @@ public:
   enum {GRIDY=(30+field_y_size+GRIDSIZE-1)/GRIDSIZE};
 #endif
   enum {GRIDTOTAL=GRIDX*GRIDY}; // total grid cells
-
-  /* Raster pattern of GRIDX * GRIDY cells,
-     where we accumulate depth data. */
-  std::array<grid_square,GRIDTOTAL> grid;
-  grid_square &at(int x,int y) { return grid[y*obstacle_grid::GRIDX + x]; }
-  const grid_square &at(int x,int y) const { return grid[y*obstacle_grid::GRIDX + x]; }
   
-  obstacle_grid() 
-    :grid()
-  {
-  }
+  enum {TILE=16}; // cells per side of a dirty tile
+  enum {TILEX=(GRIDX+TILE-1)/TILE, TILEY=(GRIDY+TILE-1)/TILE};
+  enum {TILETOTAL=TILEX*TILEY};
+  
+  enum {HEIGHT_SCALE=16}; // fixed-point height units per cm
+  typedef int16_t height_t; // fixed-point height, covers +-2000 cm
+  
+  /* Raster pattern of GRIDX * GRIDY cells, where we accumulate depth data.
+     min and max are only meaningful in cells with count>0. */
+  uint16_t count[GRIDTOTAL]; // number of points in each cell
+  height_t min[GRIDTOTAL]; // lowest point
+  height_t max[GRIDTOTAL]; // highest point
+  int32_t sum[GRIDTOTAL]; // sum of all point heights
+  
+  uint64_t dirty[(TILETOTAL+63)/64]; // bitmap of tiles that may have data
+  
+  obstacle_grid() { clear_all(); }
   
   /* Return true if this point has data (in range, and count >0) */
   bool in_bounds(int x,int y) const {
     if (x<0 || x>=GRIDX || y<0 || y>=GRIDY) return false;
     return true;
   }
+  
+  /* Convert heights between centimeters and fixed point */
+  static height_t height_from_cm(float z) {
+    float h=z*HEIGHT_SCALE;
+    if (h>INT16_MAX) h=INT16_MAX;
+    if (h<INT16_MIN) h=INT16_MIN;
+    return (height_t)lrintf(h);
+  }
+  static float cm_from_height(float h) { return h*(1.0f/HEIGHT_SCALE); }
+  
+  /* Return the statistics for this cell */
+  grid_square at(int x,int y) const { 
+    int i=y*GRIDX+x;
+    if (count[i]==0) return grid_square();
+    return grid_square(count[i],cm_from_height(sum[i]),cm_from_height(min[i]),cm_from_height(max[i]));
+  }
 
   /* Flush all stored points */
   void clear(void) {
-    for (size_t i=0;i<grid.size();i++) grid[i]=grid_square();
+    for_each_dirty_tile([this](int t) { clear_tile(t); });
+    for (uint64_t &d:dirty) d=0;
+  }
+  /* Flush everything, even if it's not marked dirty (e.g., garbage data) */
+  void clear_all(void) {
+    memset(count,0,sizeof(count));
+    memset(sum,0,sizeof(sum));
+    memset(dirty,0,sizeof(dirty));
   }
 
   /* Add this point to our grid */ 
@@ -89,10 +141,79 @@ public:
     unsigned int y=world.y*(1.0/obstacle_grid::GRIDSIZE);
     if (x<obstacle_grid::GRIDX && y<obstacle_grid::GRIDY)
     {
-      at(x,y).addPoint(world.z);
+      add_point(x,y,world.z);
     }
   }
   
+  /* Add this height, in cm, to this cell */
+  void add_point(int x,int y,float z) {
+    int i=y*GRIDX+x;
+    height_t h=height_from_cm(z);
+    mark_dirty(x,y);
+    if (count[i]==0) {
+      count[i]=1; sum[i]=h; min[i]=max[i]=h;
+    }
+    else if (count[i]<UINT16_MAX) {
+      count[i]++; sum[i]+=h;
+      if (h<min[i]) min[i]=h;
+      if (h>max[i]) max[i]=h;
+    }
+  }
+  
+  /* Add all the points accumulated in this square to this cell */
+  void add_cell(int x,int y,const grid_square &s) {
+    if (s.getCount()<=0) return;
+    int i=y*GRIDX+x;
+    merge_cell(i,std::min(s.getCount(),(int)UINT16_MAX),
+      height_from_cm(s.getMin()),height_from_cm(s.getMax()),
+      lrintf(s.getSum()*HEIGHT_SCALE));
+    mark_dirty(x,y);
+  }
+  
+  /* Add all the points in the other grid to this one */
+  void merge(const obstacle_grid &other) {
+    other.for_each_dirty_tile([&](int t) {
+      set_dirty(t);
+      int x0,y0,x1,y1; tile_bounds(t,x0,y0,x1,y1);
+      for (int y=y0;y<y1;y++)
+      for (int i=y*GRIDX+x0;i<y*GRIDX+x1;i++)
+        if (other.count[i]>0) 
+          merge_cell(i,other.count[i],other.min[i],other.max[i],other.sum[i]);
+    });
+  }
+  
+  /* Make this grid match src, only copying tiles that are dirty in either one.
+     Vision uses this to publish its grid, and the cartographer to read it. */
+  void copy_tiles_from(const obstacle_grid &src) {
+    for (int w=0;w<(int)(sizeof(dirty)/sizeof(dirty[0]));w++) {
+      uint64_t src_bits=src.dirty[w]; // read once: src may be changing under a seqlock
+      for (uint64_t bits=dirty[w]|src_bits;bits;bits&=bits-1) {
+        int b=__builtin_ctzll(bits);
+        if ((src_bits>>b)&1) copy_tile(w*64+b,src);
+        else clear_tile(w*64+b);
+      }
+      dirty[w]=src_bits;
+    }
+  }
+  
+  /* Tiles are numbered in rows, ty*TILEX+tx.  
+     Get the cell range of tile t: x0<=x<x1, y0<=y<y1 */
+  static void tile_bounds(int t,int &x0,int &y0,int &x1,int &y1) {
+    x0=(t%TILEX)*TILE; x1=std::min(x0+(int)TILE,(int)GRIDX);
+    y0=(t/TILEX)*TILE; y1=std::min(y0+(int)TILE,(int)GRIDY);
+  }
+  bool get_dirty(int t) const { return (dirty[t>>6]>>(t&63))&1; }
+  void set_dirty(int t) { dirty[t>>6]|=1ull<<(t&63); }
+  void mark_dirty(int x,int y) { set_dirty((y/TILE)*TILEX+x/TILE); }
+  
+  /* Call f(t) for each dirty tile number t */
+  template <class tile_function>
+  void for_each_dirty_tile(tile_function f) const {
+    for (int w=0;w<(int)(sizeof(dirty)/sizeof(dirty[0]));w++)
+      for (uint64_t bits=dirty[w];bits;bits&=bits-1)
+        f(w*64+__builtin_ctzll(bits));
+  }
+  
 #ifdef OPENCV_CORE_HPP
   /* Get a top-down debug image.
      Scale the image up by depthscale */
@@ -102,22 +223,23 @@ public:
     int nh=obstacle_grid::GRIDY*depthscale;
     cv::Mat world_depth(cv::Size(nw,nh),
       CV_8UC3, cv::Scalar(0,0,0));
-    for (int h = 0; h < obstacle_grid::GRIDY; h++)
-    for (int w = 0; w < obstacle_grid::GRIDX; w++)
-    {
-      const grid_square &g=at(w,h);
-      for (int dy=0; dy<depthscale;dy++)
-      for (int dx=0; dx<depthscale;dx++)
+    for_each_dirty_tile([&](int t) {
+      int x0,y0,x1,y1; tile_bounds(t,x0,y0,x1,y1);
+      for (int h = y0; h < y1; h++)
+      for (int w = x0; w < x1; w++)
       {
-        int x=w*depthscale+dx;
-        int y=h*depthscale+dy;
-        if (g.getCount()>0) {
-          cv::Vec3b color(50+g.getMin(), 50+g.getTrimmedMean(), 50+g.getMax());
-          
+        grid_square g=at(w,h);
+        if (g.getCount()==0) continue;
+        cv::Vec3b color(50+g.getMin(), 50+g.getTrimmedMean(), 50+g.getMax());
+        for (int dy=0; dy<depthscale;dy++)
+        for (int dx=0; dx<depthscale;dx++)
+        {
+          int x=w*depthscale+dx;
+          int y=h*depthscale+dy;
           world_depth.at<cv::Vec3b>(nh-1-y,x)=color;
         }
       }
-    }
+    });
 
     return world_depth;
   }
@@ -132,7 +254,7 @@ public:
 #endif
     
     FILE *f=fopen((filename+".bin").c_str(),"wb");
-    fwrite(&grid[0],obstacle_grid::GRIDY*obstacle_grid::GRIDX,sizeof(grid[0]),f);
+    fwrite(this,sizeof(*this),1,f);
     fclose(f);
   }
 
@@ -143,11 +265,41 @@ public:
     FILE *f=fopen(filename.c_str(),"rb");
     if (!f) printf("Error opening %s\n",filename.c_str());
     else {
-      if (!fread(&grid[0],obstacle_grid::GRIDY*obstacle_grid::GRIDX,sizeof(grid[0]),f))
+      if (!fread(this,sizeof(*this),1,f))
         printf("Error doing read from %s\n",filename.c_str());
       fclose(f);
     }
   }
+
+private:
+  void merge_cell(int i,int n,height_t lo,height_t hi,int32_t total) {
+    if (count[i]==0) {
+      count[i]=n; sum[i]=total; min[i]=lo; max[i]=hi;
+      return;
+    }
+    if (count[i]+n>UINT16_MAX) return; // saturated: keep the mean we have
+    count[i]+=n; sum[i]+=total;
+    if (lo<min[i]) min[i]=lo;
+    if (hi>max[i]) max[i]=hi;
+  }
+  void clear_tile(int t) {
+    int x0,y0,x1,y1; tile_bounds(t,x0,y0,x1,y1);
+    for (int y=y0;y<y1;y++) {
+      int i=y*GRIDX+x0, n=x1-x0;
+      memset(&count[i],0,n*sizeof(count[0]));
+      memset(&sum[i],0,n*sizeof(sum[0]));
+    }
+  }
+  void copy_tile(int t,const obstacle_grid &src) {
+    int x0,y0,x1,y1; tile_bounds(t,x0,y0,x1,y1);
+    for (int y=y0;y<y1;y++) {
+      int i=y*GRIDX+x0, n=x1-x0;
+      memcpy(&count[i],&src.count[i],n*sizeof(count[0]));
+      memcpy(&min[i],&src.min[i],n*sizeof(min[0]));
+      memcpy(&max[i],&src.max[i],n*sizeof(max[0]));
+      memcpy(&sum[i],&src.sum[i],n*sizeof(sum[0]));
+    }
+  }
 };
 
 
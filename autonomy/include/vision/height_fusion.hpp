@@ -0,0 +1,176 @@
+/*
+  Persistent height map, fused from many frames of obstacle_grid data.
+
+  A single depth frame has noisy cells, especially far away or at grazing
+  angles, so classifying each frame on its own flips cells back and forth.
+  This keeps running statistics per cell instead:
+     weight: total evidence, decayed exponentially with age
+     mean, mean of squares: weighted height statistics
+  Each frame's cells are weighted by how many points they got, distance
+  from the camera (depth error grows with range), and incidence angle
+  (grazing looks at the ground are unreliable).
+
+  Decay is lazy: each cell remembers the frame it was last updated, and
+  is decayed when it's next touched, so a frame only costs work in the
+  tiles it dirtied.  Memory is fixed at about 3.6 MB.
+
+  A single frame's max-min height in a cell is mostly noise at range
+  (and every sparkle makes the cell look sloped), so slope is judged
+  from the step between neighboring fused means instead: see step().
+
+  This header doesn't need OpenCV.
+
+  This file is Public Domain.
+*/
+#ifndef __AURORA_VISION_HEIGHT_FUSION_HPP
+#define __AURORA_VISION_HEIGHT_FUSION_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "../aurora/vec3.h"
+#include "grid.hpp"
+
+/* Tuning for height fusion */
+struct height_fusion_params {
+    float decay=0.95; // weight kept per frame (0.95: half-life of about 14 frames)
+    float full_count=8; // a frame cell with this many points gets full weight
+    float full_distance=150.0; // cm; farther cells lose weight as 1/distance^2
+    float min_incidence=0.1; // cosine of the grazing angle where weight bottoms out
+    float max_weight=50.0; // cap on weight, so old evidence can be outvoted
+    float min_weight=0.5; // cells with less weight than this count as unknown
+};
+
+/* Fused statistics for one cell, all heights in cm */
+struct fused_cell {
+    float weight; // evidence (0 means no data)
+    float mean; // weighted mean height
+    float variance; // weighted variance of the per-frame heights
+};
+
+class fused_height_grid {
+public:
+    enum {GRIDX=obstacle_grid::GRIDX, GRIDY=obstacle_grid::GRIDY, GRIDTOTAL=obstacle_grid::GRIDTOTAL};
+    enum {MAX_AGE=256}; // cells older than this many frames count as empty
+
+    height_fusion_params params;
+
+    fused_height_grid() { clear(); }
+
+    /* Forget everything */
+    void clear(void) {
+        frame=0;
+        memset(weight,0,sizeof(weight));
+        memset(stamp,0,sizeof(stamp));
+        set_decay(params.decay);
+    }
+
+    /* Change the per-frame decay */
+    void set_decay(float decay) {
+        params.decay=decay;
+        float f=1.0f;
+        for (int age=0;age<MAX_AGE;age++) { decay_table[age]=f; f*=decay; }
+    }
+
+    /* Fuse in one frame's grid, seen from a camera at this location (cm).
+       Only the frame's dirty tiles are touched. */
+    void fuse(const obstacle_grid &obs,const vec3 &camera) {
+        frame++;
+        obs.for_each_dirty_tile([&](int t) {
+            int x0,y0,x1,y1; obstacle_grid::tile_bounds(t,x0,y0,x1,y1);
+            for (int y=y0;y<y1;y++)
+            for (int x=x0;x<x1;x++)
+            {
+                int i=y*GRIDX+x;
+                if (obs.count[i]==0) continue;
+                grid_square s=obs.at(x,y);
+                float z=s.getTrimmedMean();
+                vec3 cell((x+0.5f)*obstacle_grid::GRIDSIZE,(y+0.5f)*obstacle_grid::GRIDSIZE,z);
+                add(i,z,observation_weight(s.getCount(),cell,camera));
+            }
+        });
+    }
+
+    /* Return the fused statistics for this cell, decayed to the current frame */
+    fused_cell at(int x,int y) const {
+        int i=y*GRIDX+x;
+        fused_cell c;
+        c.weight=weight[i]*age_factor(i);
+        if (c.weight<=0.0f) {
+            c.weight=c.mean=c.variance=0.0f;
+            return c;
+        }
+        c.mean=mean[i];
+        c.variance=std::max(0.0f,meansq[i]-mean[i]*mean[i]);
+        return c;
+    }
+
+    /* Return true if this cell has at least min_weight of evidence */
+    bool known(int x,int y) const {
+        if (x<0 || x>=GRIDX || y<0 || y>=GRIDY) return false;
+        int i=y*GRIDX+x;
+        return weight[i]*age_factor(i)>=params.min_weight;
+    }
+
+    /* Return the biggest height step (cm) from this cell to a known neighbor */
+    float step(int x,int y) const {
+        float m=mean[y*GRIDX+x], biggest=0.0f;
+        static const int dx[4]={1,-1,0,0}, dy[4]={0,0,1,-1};
+        for (int n=0;n<4;n++)
+            if (known(x+dx[n],y+dy[n]))
+                biggest=std::max(biggest,fabsf(mean[(y+dy[n])*GRIDX+x+dx[n]]-m));
+        return biggest;
+    }
+
+    /* Weight for one frame's cell with this many points, at this world location */
+    float observation_weight(int count,const vec3 &cell,const vec3 &camera) const {
+        float w=std::min(count/params.full_count,1.0f);
+        vec3 ray=camera-cell;
+        float dist=std::max(length(ray),1.0f);
+        if (dist>params.full_distance) {
+            float r=params.full_distance/dist;
+            w*=r*r;
+        }
+        float incidence=ray.z/dist; // cosine of angle from the ground normal
+        w*=std::max(incidence,params.min_incidence);
+        return w;
+    }
+
+    int get_frame(void) const { return frame; }
+
+private:
+    uint32_t frame; // number of frames fused so far
+    float weight[GRIDTOTAL]; // weight as of stamp (mean etc only valid if >0)
+    float mean[GRIDTOTAL];
+    float meansq[GRIDTOTAL];
+    uint32_t stamp[GRIDTOTAL]; // frame when this cell was last updated
+    float decay_table[MAX_AGE]; // decay^age
+
+    float age_factor(int i) const {
+        uint32_t age=frame-stamp[i];
+        return age<MAX_AGE?decay_table[age]:0.0f;
+    }
+
+    /* Add this height observation with weight w to cell i */
+    void add(int i,float z,float w) {
+        if (w<=0.0f) return;
+        float old=weight[i]*age_factor(i);
+        stamp[i]=frame;
+        if (old<=0.0f) {
+            weight[i]=w; mean[i]=z; meansq[i]=z*z;
+            return;
+        }
+        float total=old+w;
+        float f=w/total; // fraction of the new observation
+        mean[i]+=f*(z-mean[i]);
+        meansq[i]+=f*(z*z-meansq[i]);
+        weight[i]=std::min(total,params.max_weight);
+    }
+
+    // Don't copy this type, it's big
+    fused_height_grid(const fused_height_grid &no_copies);
+    void operator=(const fused_height_grid &no_copies);
+};
+
+#endif
@@ -0,0 +1,188 @@
+/*
+  Image regions of interest for tracking aruco markers between frames.
+
+  Once we've seen a marker, it's usually close to where it was last
+  frame, so we only need to search a padded box around there, instead
+  of the whole image.  marker_roi_tracker keeps those boxes, predicts
+  where each marker will be next, and decides when to fall back to a
+  full-frame scan: periodically (to find new markers), when we have
+  nothing to track, and right after a tracked marker goes missing.
+
+  This header doesn't need OpenCV or aruco.
+
+  This file is Public Domain.
+*/
+#ifndef __AURORA_VISION_MARKER_ROI_HPP
+#define __AURORA_VISION_MARKER_ROI_HPP
+
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include "../aurora/coords.h"
+
+/* Axis-aligned pixel box, x0<=x<x1 and y0<=y<y1 */
+struct marker_roi {
+    int x0,y0,x1,y1;
+
+    marker_roi() :x0(0),y0(0),x1(0),y1(0) {}
+    marker_roi(int x0_,int y0_,int x1_,int y1_) :x0(x0_),y0(y0_),x1(x1_),y1(y1_) {}
+
+    bool empty() const { return x1<=x0 || y1<=y0; }
+    int width() const { return x1-x0; }
+    int height() const { return y1-y0; }
+    long area() const { return empty()?0:(long)width()*height(); }
+
+    // Grow to include this point
+    void add(float x,float y) {
+        if (empty()) { x0=x; y0=y; x1=x+1; y1=y+1; return; }
+        x0=std::min(x0,(int)x); y0=std::min(y0,(int)y);
+        x1=std::max(x1,(int)x+1); y1=std::max(y1,(int)y+1);
+    }
+    // Grow to include this box
+    void add(const marker_roi &r) {
+        if (r.empty()) return;
+        if (empty()) { *this=r; return; }
+        x0=std::min(x0,r.x0); y0=std::min(y0,r.y0);
+        x1=std::max(x1,r.x1); y1=std::max(y1,r.y1);
+    }
+    bool overlaps(const marker_roi &r) const {
+        return x0<r.x1 && r.x0<x1 && y0<r.y1 && r.y0<y1;
+    }
+    // Move by this many pixels
+    marker_roi shifted(float dx,float dy) const {
+        return marker_roi(x0+dx,y0+dy,x1+dx,y1+dy);
+    }
+    // Grow by this many pixels on each side
+    marker_roi padded(int px,int py) const {
+        return marker_roi(x0-px,y0-py,x1+px,y1+py);
+    }
+    // Trim to fit in a w x h image
+    marker_roi clipped(int w,int h) const {
+        return marker_roi(std::max(x0,0),std::max(y0,0),std::min(x1,w),std::min(y1,h));
+    }
+};
+
+/* Predict the image box of a field marker.
+     view: camera to field transform (cm), camera X right, Y down, Z forward
+     marker: marker location on the field (cm); the marker table doesn't
+        have heights, so the box covers heights from 0 to max_height
+     size: marker size (cm)
+     fx,fy,cx,cy: pinhole intrinsics of the image (pixels)
+   Returns an empty box if the marker is behind the camera. */
+inline marker_roi predict_marker_roi(const aurora::robot_coord3D &view,vec3 marker,float size,float max_height,
+    float fx,float fy,float cx,float cy)
+{
+    marker_roi box;
+    for (int corner=0;corner<8;corner++) {
+        vec3 p=marker+vec3((corner&1)?-size:size,(corner&2)?-size:size,(corner&4)?max_height:0.0f);
+        vec3 rel=p-view.origin;
+        float z=dot(rel,view.Z);
+        if (z<10.0f) return marker_roi(); // behind (or right on top of) the camera
+        box.add(fx*dot(rel,view.X)/z+cx,fy*dot(rel,view.Y)/z+cy);
+    }
+    return box;
+}
+
+/* Keeps track of where markers were seen, and plans where to look next */
+class marker_roi_tracker {
+public:
+    int full_scan_interval=15; // frames between periodic full-frame scans
+    int lost_frames=10; // forget a marker after this many frames without seeing it
+    float pad_fraction=0.5; // pad boxes by this fraction of the marker size per frame of age
+    int pad_min=16; // and at least this many pixels
+
+    marker_roi_tracker() :since_full(1<<20), force_full(true) {}
+
+    /* Decide where to look this frame, in a w x h image.
+       Returns true for a full-frame scan, or false and fills rois. */
+    bool plan(int w,int h,std::vector<marker_roi> &rois) {
+        rois.clear();
+        since_full++;
+        if (force_full || tracks.empty() || since_full>=full_scan_interval) {
+            since_full=0;
+            return true;
+        }
+        for (const track &t:tracks) {
+            float age=t.age+1; // frames since it was seen, as of this frame
+            marker_roi r=t.box.shifted(t.vx*age,t.vy*age);
+            int px=std::max(pad_min,(int)(pad_fraction*age*t.box.width()));
+            int py=std::max(pad_min,(int)(pad_fraction*age*t.box.height()));
+            add_roi(rois,r.padded(px,py).clipped(w,h));
+        }
+        for (const marker_roi &r:predicted) add_roi(rois,r.clipped(w,h));
+        return false;
+    }
+
+    /* Suggest a box where marker ID should be (e.g., from the robot's pose).
+       Only used for markers we aren't already tracking. */
+    void predict(int ID,const marker_roi &box) {
+        if (box.empty() || find(ID)) return;
+        predicted.push_back(box.padded(pad_min,pad_min));
+    }
+
+    /* Marker ID was seen in this box this frame */
+    void found(int ID,const marker_roi &box) {
+        track *t=find(ID);
+        if (!t) {
+            tracks.push_back(track());
+            t=&tracks.back();
+            t->ID=ID; t->vx=t->vy=0.0f;
+        }
+        else if (t->age<lost_frames) { // update velocity, in pixels per frame
+            float dt=t->age+1;
+            t->vx=0.5f*t->vx+0.5f*(center_x(box)-center_x(t->box))/dt;
+            t->vy=0.5f*t->vy+0.5f*(center_y(box)-center_y(t->box))/dt;
+        }
+        t->box=box;
+        t->age=-1; // incremented to 0 by end_frame
+    }
+
+    /* Finish this frame: age the tracks, and plan a full scan if we lost one */
+    void end_frame(void) {
+        force_full=false;
+        for (size_t i=0;i<tracks.size();) {
+            track &t=tracks[i];
+            t.age++;
+            if (t.age>0) force_full=true; // missed it: maybe it moved farther than our padding
+            if (t.age>=lost_frames) { tracks.erase(tracks.begin()+i); continue; }
+            i++;
+        }
+        predicted.clear();
+    }
+
+    int tracked_count(void) const { return tracks.size(); }
+
+private:
+    struct track {
+        int ID;
+        marker_roi box; // where we last saw it
+        float vx,vy; // motion of the box center, in pixels per frame
+        int age; // frames since we saw it
+    };
+    std::vector<track> tracks;
+    std::vector<marker_roi> predicted; // boxes from predict(), for this frame only
+    int since_full; // frames since the last full scan
+    bool force_full; // do a full scan next frame
+
+    track *find(int ID) {
+        for (track &t:tracks) if (t.ID==ID) return &t;
+        return 0;
+    }
+    static float center_x(const marker_roi &r) { return 0.5f*(r.x0+r.x1); }
+    static float center_y(const marker_roi &r) { return 0.5f*(r.y0+r.y1); }
+
+    // Add this box, merging it with any boxes it overlaps, so we don't search pixels twice
+    static void add_roi(std::vector<marker_roi> &rois,marker_roi r) {
+        if (r.empty()) return;
+        for (size_t i=0;i<rois.size();)
+            if (rois[i].overlaps(r)) {
+                r.add(rois[i]);
+                rois.erase(rois.begin()+i);
+                i=0; // the bigger box may overlap earlier ones
+            }
+            else i++;
+        rois.push_back(r);
+    }
+};
+
+#endif
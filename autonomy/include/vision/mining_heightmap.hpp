@@ -0,0 +1,117 @@
+/*
+  Fast projection of a depth image onto the mining face heightmap
+  (aurora::mining_heightmap, in lunatic.h).
+
+  Like depth_projection.hpp, each pixel's frame position is
+     origin + depth * (X*xdir[x] + Y*ydir[y] + Z)
+  split into a per-row part and per-column x/y/z arrays, so the
+  transform is plain float multiply-adds that the compiler vectorizes.
+  A second, scalar loop adds each point's forward distance to its cell,
+  and at the end each cell gets the mean.
+
+  This header doesn't need OpenCV or librealsense, so it can be
+  benchmarked anywhere (see vision/mining_heightmap_bench.cpp).
+
+  This file is Public Domain.
+*/
+#ifndef __AURORA_VISION_MINING_HEIGHTMAP_HPP
+#define __AURORA_VISION_MINING_HEIGHTMAP_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "../aurora/lunatic.h"
+
+/* Filtering limits for mining depth data, in meters (same as the old mining_depth stripe) */
+struct mining_heightmap_limits {
+    float depth_scale=1.0f; // fudge factor to match real distances
+    float distance_min=0.5; // mostly parts of robot if they're too close
+    float distance_max=7.5; // depth gets ratty if it's too far out
+    int x_start=0, x_end=1<<30; // pixel columns to use (clipped to the image)
+    int y_start=0, y_end=1<<30; // pixel rows to use
+};
+
+class mining_heightmap_projector {
+public:
+    mining_heightmap_limits limits;
+
+    /* Project this depth image into frame coordinates, and replace map's data.
+         depth: w x h raw depth values, row-major
+         depth2m: scale factor from raw depth to meters
+         xdir, ydir: camera-space direction per column and per row
+         view3D: camera to frame transform
+       The map's area (x0, z0, cell) is kept. */
+    void project(const uint16_t *depth,int w,int h,float depth2m,
+        const float *xdir,const float *ydir,
+        const aurora::robot_coord3D &view3D,
+        aurora::mining_heightmap &map)
+    {
+        enum {NX=aurora::mining_heightmap::NX, NZ=aurora::mining_heightmap::NZ};
+        int xa=std::max(limits.x_start,0), xb=std::min(limits.x_end,w);
+        int ya=std::max(limits.y_start,0), yb=std::min(limits.y_end,h);
+        int n=xb-xa;
+        map.camera_coords=view3D;
+        memset(sum,0,sizeof(sum));
+        memset(count,0,sizeof(count));
+        if (n<=0) { finish(map); return; }
+
+        // Per-column part of the transform, already in cell units for x and z
+        float inv=1.0f/map.cell;
+        colx.resize(n); coly.resize(n); colz.resize(n); cells.resize(n); fwd.resize(n);
+        for (int i=0;i<n;i++) {
+            vec3 c=view3D.X*xdir[xa+i];
+            colx[i]=c.x*inv; coly[i]=c.y; colz[i]=c.z*inv;
+        }
+        const float scale=depth2m*limits.depth_scale;
+        const float dmin=limits.distance_min/scale, dmax=limits.distance_max/scale;
+        const float ox=(view3D.origin.x-map.x0)*inv, oy=view3D.origin.y, oz=(view3D.origin.z-map.z0)*inv;
+
+        for (int y=ya;y<yb;y++) {
+            vec3 r=view3D.Y*ydir[y]+view3D.Z;
+            const float rx=r.x*inv, ry=r.y, rz=r.z*inv;
+            const uint16_t *row=depth+(size_t)y*w+xa;
+            int *cellp=&cells[0];
+            float *fwdp=&fwd[0];
+            const float *cx=&colx[0], *cy=&coly[0], *cz=&colz[0];
+
+            // Vectorized: transform every pixel, and compute its cell (or -1)
+            for (int i=0;i<n;i++) {
+                float d=row[i];
+                float fx=ox+d*(cx[i]+rx)*scale;
+                float fz=oz+d*(cz[i]+rz)*scale;
+                fwdp[i]=oy+d*(cy[i]+ry)*scale;
+                bool ok=(d>dmin) & (d<dmax) & (fx>=0.0f) & (fx<(float)NX) & (fz>=0.0f) & (fz<(float)NZ);
+                int c=(int)fz*NX+(int)fx;
+                cellp[i]=ok?c:-1;
+            }
+
+            // Scalar: add each point to its cell
+            for (int i=0;i<n;i++) {
+                int c=cellp[i];
+                if (c>=0) { sum[c]+=fwdp[i]; count[c]++; }
+            }
+        }
+        finish(map);
+    }
+
+private:
+    std::vector<float> colx,coly,colz; // per-column transform
+    std::vector<int> cells; // per-pixel cell index for one row
+    std::vector<float> fwd; // per-pixel forward distance for one row
+    float sum[aurora::mining_heightmap::NX*aurora::mining_heightmap::NZ]; // total forward distance (m)
+    uint32_t count[aurora::mining_heightmap::NX*aurora::mining_heightmap::NZ]; // points in each cell
+
+    // Convert our sums to the map's mean forward distances
+    void finish(aurora::mining_heightmap &map) {
+        int16_t *out=&map.forward[0][0];
+        for (int c=0;c<aurora::mining_heightmap::NX*aurora::mining_heightmap::NZ;c++) {
+            if (count[c]==0) { out[c]=aurora::mining_heightmap::INVALID; continue; }
+            float mm=1000.0f*sum[c]/count[c];
+            out[c]=(int16_t)lrintf(std::max(-32767.0f,std::min(32767.0f,mm)));
+        }
+    }
+};
+
+#endif
@@ -41,25 +41,79 @@ realsense_camera::~realsense_camera() {
 
 
 
-// Calling this constructor captures image data from the camera:
-realsense_camera_capture::realsense_camera_capture(realsense_camera &cam)
-    :frames(cam.pipe.wait_for_frames()),
-     color_frame(frames.get_color_frame()),
-     depth_frame(frames.get_depth_frame()),
-     color_w(color_frame.get_width()), color_h(color_frame.get_height()),
-     depth_w(depth_frame.get_width()), depth_h(depth_frame.get_height()),
-     color_image(cv::Size(color_w, color_h), CV_8UC3, 
-        (void*)color_frame.get_data(), cv::Mat::AUTO_STEP),
-     depth_data((depth_t*)depth_frame.get_data()),
-     depth_image(cv::Size(depth_w, depth_h), CV_16U, 
-        depth_data, cv::Mat::AUTO_STEP)
+// Wait for the next frame from the camera
+bool realsense_camera::grab(realsense_camera_capture &cap)
 {
-    if (!cam.depth_projector) { // <- only make once, at startup
-        cam.depth_projector=new realsense_projector(depth_frame);
+    cap.frames=pipe.wait_for_frames();
+    cap.color_frame=cap.frames.get_color_frame();
+    cap.depth_frame=cap.frames.get_depth_frame();
+    cap.color_w=cap.color_frame.get_width(); cap.color_h=cap.color_frame.get_height();
+    cap.depth_w=cap.depth_frame.get_width(); cap.depth_h=cap.depth_frame.get_height();
+    cap.color_image=cv::Mat(cv::Size(cap.color_w, cap.color_h), CV_8UC3, 
+        (void*)cap.color_frame.get_data(), cv::Mat::AUTO_STEP);
+    cap.depth_data=(realsense_camera_capture::depth_t*)cap.depth_frame.get_data();
+    cap.depth_image=cv::Mat(cv::Size(cap.depth_w, cap.depth_h), CV_16U, 
+        cap.depth_data, cv::Mat::AUTO_STEP);
+    
+    if (!depth_projector) { // <- only make once, at startup
+        auto video = cap.depth_frame.get_profile().as<rs2::video_stream_profile>();
+        rs2_intrinsics rs = video.get_intrinsics();
+        camera_intrinsics intrinsics;
+        intrinsics.width=rs.width; intrinsics.height=rs.height;
+        intrinsics.ppx=rs.ppx; intrinsics.ppy=rs.ppy;
+        intrinsics.fx=rs.fx; intrinsics.fy=rs.fy;
+        intrinsics.depth2cm=depth2cm;
+        depth_projector=new realsense_projector(intrinsics);
     } 
-    depth_projector=cam.depth_projector;
-    depth2cm = cam.depth2cm;
-    depth2m = cam.depth2cm*0.01;
+    cap.depth_projector=depth_projector;
+    cap.depth2cm = depth2cm;
+    cap.depth2m = depth2cm*0.01;
+    return true;
+}
+
+
+recorded_camera::recorded_camera(const std::string &filename)
+    :recording(filename),
+     depth_projector(recording.header->depth),
+     next(0)
+{
+}
+
+// Point the capture at the next recorded frame, without copying it.
+//   The recording is mapped privately, so eroding the depth doesn't touch the file.
+bool recorded_camera::grab(realsense_camera_capture &cap)
+{
+    if (next>=recording.frame_count()) return false;
+    int i=next++;
+    const depth_recording_header &h=*recording.header;
+    cap.color_w=h.color_w; cap.color_h=h.color_h;
+    cap.depth_w=h.depth.width; cap.depth_h=h.depth.height;
+    cap.color_image=cv::Mat(cv::Size(cap.color_w, cap.color_h), CV_8UC3, 
+        recording.color(i), cv::Mat::AUTO_STEP);
+    cap.depth_data=recording.depth(i);
+    cap.depth_image=cv::Mat(cv::Size(cap.depth_w, cap.depth_h), CV_16U, 
+        cap.depth_data, cv::Mat::AUTO_STEP);
+    
+    cap.depth_projector=&depth_projector;
+    cap.depth2cm = h.depth.depth2cm;
+    cap.depth2m = h.depth.depth2cm*0.01;
+    cap.recorded_view = recording.frame(i).view;
+    return true;
 }
 
 
+realsense_camera_capture::realsense_camera_capture()
+    :color_frame(rs2::frame()), depth_frame(rs2::frame()),
+     color_w(0), color_h(0), depth_w(0), depth_h(0),
+     depth_data(0), depth_projector(0), depth2cm(0.0f), depth2m(0.0f)
+{
+}
+
+// Calling this constructor captures image data from the camera:
+realsense_camera_capture::realsense_camera_capture(camera_frame_source &cam)
+    :realsense_camera_capture()
+{
+    if (!cam.grab(*this))
+        throw std::runtime_error("Camera frame source has no more frames");
+}
+
@@ -7,6 +7,19 @@
 #include <librealsense2/rs.hpp>  
 #include <opencv2/opencv.hpp>  
 #include "../aurora/coords.h"  // for vec3 and robot_coord3D
+#include "depth_recording.hpp" // for camera_intrinsics and recorded frames
+
+class realsense_camera_capture;
+
+/* Anything that can supply color and depth frames: a live camera, or a recording. */
+class camera_frame_source {
+public:
+    virtual ~camera_frame_source() {}
+    
+    // Fill out this capture with the next frame.
+    //   Returns false if there are no more frames (end of a recording).
+    virtual bool grab(realsense_camera_capture &cap) =0;
+};
 
 
 /* Transforms raw realsense 2D + depth pixels into 3D:
@@ -17,48 +30,24 @@
 class realsense_projector {
 public:
   // Camera calibration
-  rs2_intrinsics intrinsics;
+  camera_intrinsics intrinsics;
   
   // Cached per-pixel direction vectors: scale by the depth to get to 3D
   std::vector<float> xdir;
   std::vector<float> ydir;
   
-  realsense_projector(const rs2::depth_frame &frame)
-    :xdir(frame.get_width()),
-     ydir(frame.get_height())
+  realsense_projector(const camera_intrinsics &intrinsics_)
+    :intrinsics(intrinsics_),
+     xdir(intrinsics.width),
+     ydir(intrinsics.height)
   {
-    auto stream_profile = frame.get_profile();
-    auto video = stream_profile.as<rs2::video_stream_profile>();
-    intrinsics = video.get_intrinsics();
-    
-    // Precompute per-pixel direction vectors (with distortion)
+    // Precompute per-pixel direction vectors.
+    //  Actual 400 series RealSense cameras always have zero distortion coeffs,
+    //  so this doesn't need to do any 2D distortion correction.
     for (int h = 0; h < intrinsics.height; ++h)
         ydir[h] = (h - intrinsics.ppy) * (1.0 / intrinsics.fy);
     for (int w = 0; w < intrinsics.width; ++w)
-        xdir[w] = (w - intrinsics.ppy) * (1.0 / intrinsics.fy);
-/*
- // Actual 400 series RealSense cameras always have zero distortion coeffs
- //   if they didn't you'd need to do 2D correction:
-    {
-      const float pixel[] = { (float)w, (float)h };
-
-      float x = (pixel[0] - intrinsics.ppx) * (1.0 / intrinsics.fx);
-      float y = (pixel[1] - intrinsics.ppy) * (1.0 / intrinsics.fy);
-
-      if (intrinsics.model == RS2_DISTORTION_INVERSE_BROWN_CONRADY)
-      {
-          float r2 = x * x + y * y;
-          float f = 1 + intrinsics.coeffs[0] * r2 + intrinsics.coeffs[1] * r2*r2 + intrinsics.coeffs[4] * r2*r2*r2;
-          float ux = x * f + 2 * intrinsics.coeffs[2] * x*y + intrinsics.coeffs[3] * (r2 + 2 * x*x);
-          float uy = y * f + 2 * intrinsics.coeffs[3] * x*y + intrinsics.coeffs[2] * (r2 + 2 * y*y);
-          x = ux;
-          y = uy;
-      }
-
-      xdir[h*intrinsics.width + w] = x;
-      ydir[h*intrinsics.width + w] = y;
-    }
-*/
+        xdir[w] = (w - intrinsics.ppx) * (1.0 / intrinsics.fx);
   }
   
   // Project this depth at this pixel into 3D camera coordinates
@@ -72,7 +61,7 @@ public:
 /**
  Manages communication with realsense camera.
 */
-class realsense_camera  {
+class realsense_camera : public camera_frame_source {
 public:
     realsense_camera(
         int res=720, // resolution, 720p is high res, 480p is medium res, 240p low res
@@ -80,6 +69,9 @@ public:
     );
     ~realsense_camera();
     
+    // Wait for the camera's next frame
+    virtual bool grab(realsense_camera_capture &cap);
+    
 private:
     realsense_camera(const realsense_camera &no_copies);
     void operator=(const realsense_camera &no_copies);
@@ -91,15 +83,37 @@ private:
     // These are cached during a capture
     realsense_projector *depth_projector;
     float depth2cm;
-    friend class realsense_camera_capture;
+};
+
+
+/**
+ Plays back frames from a depth_recording file, as fast as they're grabbed.
+*/
+class recorded_camera : public camera_frame_source {
+public:
+    recorded_camera(const std::string &filename);
+    
+    // Point the capture at the next recorded frame
+    virtual bool grab(realsense_camera_capture &cap);
+    
+    int frame_count() const { return recording.frame_count(); }
+    
+private:
+    depth_playback recording;
+    realsense_projector depth_projector;
+    int next; // index of the next frame to grab
 };
 
 
 /* One moment's data extracted from the camera */
 class realsense_camera_capture {
 public:
+    // Make an empty capture, for a camera_frame_source to grab into.
+    realsense_camera_capture();
+    
     // Calling this constructor captures one frame of image data from the camera.
-    realsense_camera_capture(realsense_camera &cam);
+    //   Throws if the source has run out of frames.
+    realsense_camera_capture(camera_frame_source &cam);
     
 public:
     // This is the librealsense handle to the frame's allocated memory.
@@ -124,6 +138,9 @@ public: // Actual captured data (read/write)
     const realsense_projector *depth_projector;
     float depth2cm,depth2m;
     
+    // Camera view saved with a recorded frame.  percent<=0 for live frames.
+    aurora::robot_coord3D recorded_view;
+    
     /// Return the last-grabbed depth at this (x,y) pixel in centimeters.
     ///   The value may be zero, indicating invalid depth data there.
     float get_depth_cm(int x,int y) const {
@@ -0,0 +1,183 @@
+/*
+ Forward kinematics benchmark: evaluations per second for
+    - computing every link up front (how robot_link_coords used to work),
+    - the on-demand robot_link_coords, for one link,
+    - the same object reused with set_state, when only some joints move,
+    - robot_link_batch, many joint states at once.
+ Also checks that they all agree.
+
+    ./fk_bench [batch size]
+
+ This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "aurora/lunatic.h"
+#include "aurora/kinematics.h"
+#include "aurora/kinematic_links.cpp"
+
+using namespace aurora;
+
+// Make a random float between lo and hi.  Calls rand()
+float rand_float(float lo,float hi)
+{
+    int limit=0xfffff;
+    float scale=(rand()%limit)*(1.0/limit);
+    return lo+scale*(hi-lo);
+}
+
+// Every link, computed up front: the old robot_link_coords constructor
+void eager_links(const robot_joint_state &state,robot_coord3D links[link_count])
+{
+    links[link_pit].reset();
+    links[link_frame].reset();
+    for (int i=link_frame+1;i<link_count;i++)
+    {
+        robot_link_index L=robot_link_index(i);
+        const robot_link_geometry &G=link_geometry(L);
+        const robot_coord3D &parent=(G.parent>=0)?links[G.parent]:links[link_pit];
+        links[L].origin=parent.world_from_local(G.origin);
+        robot_link_coords::rotate_link(links[L],parent,G.axis,robot_link_coords::link_degrees(L,state));
+    }
+}
+
+// Time this loop, and print millions of forward kinematics evaluations per second
+template <class op>
+double bench(const char *name,int evals,op f)
+{
+    auto start=std::chrono::steady_clock::now();
+    float sum=f();
+    double s=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    double rate=evals/s*1.0e-6;
+    printf("%-40s %8.2f M FK/sec  (%.1f ns each; checksum %.3f)\n",name,rate,1.0e9*s/evals,sum);
+    return rate;
+}
+
+int main(int argc,char *argv[]) {
+    int n=4096; // joint states per batch
+    if (argc>1) n=atoi(argv[1]);
+    const int reps=std::max(1,2000000/n);
+    const int evals=n*reps;
+
+    // Random arm poses, like ik_test uses
+    srand(1);
+    std::vector<robot_joint_state> joints(n);
+    robot_link_batch batch(n);
+    for (int i=0;i<n;i++) {
+        robot_joint_state &j=joints[i];
+        j.angle.fork=rand_float(-58.0,+10.0);
+        j.angle.dump=rand_float(-80.0,-10.0);
+        j.angle.boom=rand_float(-58.0,+52.0);
+        j.angle.stick=rand_float(-32.0,+60.0);
+        j.angle.tilt=rand_float(-75.0,+52.0);
+        j.angle.spin=rand_float(-30.0,+30.0);
+        batch.set_state(i,j);
+    }
+
+    // Check everybody agrees with computing every link
+    double worst=0.0;
+    robot_coord3D ref[link_count];
+    robot_link_coords reuse(joints[0]);
+    for (int L=link_pit;L<link_count;L++) {
+        batch.compute(robot_link_index(L));
+        for (int i=0;i<n;i++) {
+            eager_links(joints[i],ref);
+            robot_link_coords lazy(joints[i]);
+            reuse.set_state(joints[i]);
+            robot_coord3D got[4]={lazy.coord3D(robot_link_index(L)),reuse.coord3D(robot_link_index(L)),
+                batch.coord3D(i),robot_link_coords::chain_coord3D(robot_link_index(L),joints[i])};
+            for (const robot_coord3D &g:got) {
+                worst=std::max(worst,(double)length(g.origin-ref[L].origin));
+                worst=std::max(worst,(double)length(g.X-ref[L].X));
+                worst=std::max(worst,(double)length(g.Y-ref[L].Y));
+                worst=std::max(worst,(double)length(g.Z-ref[L].Z));
+            }
+        }
+    }
+    printf("Largest difference from computing every link: %.3g\n",worst);
+    if (worst>1.0e-5) { printf("ERROR: forward kinematics disagree!\n"); return 1; }
+
+    printf("Grinder tip, %d joint states:\n",n);
+    double eager=bench("every link, up front",evals,[&]() {
+        float sum=0;
+        for (int r=0;r<reps;r++) for (int i=0;i<n;i++) {
+            eager_links(joints[i],ref);
+            sum+=ref[link_grinder].origin.z;
+        }
+        return sum;
+    });
+    bench("robot_link_coords, on demand",evals,[&]() {
+        float sum=0;
+        for (int r=0;r<reps;r++) for (int i=0;i<n;i++) {
+            robot_link_coords links(joints[i]);
+            sum+=links.coord3D(link_grinder).origin.z;
+        }
+        return sum;
+    });
+    bench("chain_coord3D",evals,[&]() {
+        float sum=0;
+        for (int r=0;r<reps;r++) for (int i=0;i<n;i++)
+            sum+=robot_link_coords::chain_coord3D(link_grinder,joints[i]).origin.z;
+        return sum;
+    });
+    bench("set_state, only tilt moves",evals,[&]() {
+        float sum=0;
+        robot_joint_state j=joints[0];
+        robot_link_coords links(j);
+        for (int r=0;r<reps;r++) for (int i=0;i<n;i++) {
+            j.angle.tilt=joints[i].angle.tilt;
+            links.set_state(j);
+            sum+=links.coord3D(link_grinder).origin.z;
+        }
+        return sum;
+    });
+    double batched=bench("robot_link_batch",evals,[&]() {
+        float sum=0;
+        for (int r=0;r<reps;r++) {
+            batch.compute(link_grinder);
+            sum+=batch.oz[r%n];
+        }
+        return sum;
+    });
+    printf("Batch is %.1fx faster than computing every link\n",batched/eager);
+
+    printf("Depth camera, %d joint states:\n",n);
+    bench("every link, up front",evals,[&]() {
+        float sum=0;
+        for (int r=0;r<reps;r++) for (int i=0;i<n;i++) {
+            eager_links(joints[i],ref);
+            sum+=ref[link_depthcam].origin.z;
+        }
+        return sum;
+    });
+    bench("robot_link_coords, on demand",evals,[&]() {
+        float sum=0;
+        for (int r=0;r<reps;r++) for (int i=0;i<n;i++) {
+            robot_link_coords links(joints[i]);
+            sum+=links.coord3D(link_depthcam).origin.z;
+        }
+        return sum;
+    });
+    bench("set_state, only fork moves (cached)",evals,[&]() {
+        float sum=0;
+        robot_joint_state j=joints[0];
+        robot_link_coords links(j);
+        for (int r=0;r<reps;r++) for (int i=0;i<n;i++) {
+            j.angle.fork=joints[i].angle.fork;
+            links.set_state(j);
+            sum+=links.coord3D(link_depthcam).origin.z;
+        }
+        return sum;
+    });
+    bench("robot_link_batch",evals,[&]() {
+        float sum=0;
+        for (int r=0;r<reps;r++) {
+            batch.compute(link_depthcam);
+            sum+=batch.oz[r%n];
+        }
+        return sum;
+    });
+    return 0;
+}
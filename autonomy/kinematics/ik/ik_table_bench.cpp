@@ -0,0 +1,114 @@
+/*
+ Check and benchmark the IK table (aurora/ik_table.h) against excahauler_IK:
+    - load time for the table file,
+    - solve_tilt agreement and speed, over random tilt pivot targets,
+    - the clear bitmap against arm_clearance at random joint angles.
+
+    ./ik_table_bench [excahauler_ik.table]
+
+ This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "aurora/lunatic.h"
+#include "aurora/kinematics.h"
+#include "aurora/kinematic_links.cpp"
+#include "aurora/ik_table.h"
+
+using namespace aurora;
+
+// Make a random float between lo and hi.  Calls rand()
+float rand_float(float lo,float hi)
+{
+    int limit=0xfffff;
+    float scale=(rand()%limit)*(1.0/limit);
+    return lo+scale*(hi-lo);
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main(int argc,char *argv[]) {
+    const char *filename=(argc>1)?argv[1]:"excahauler_ik.table";
+    auto start=std::chrono::steady_clock::now();
+    excahauler_IK_table table;
+    if (!table.load(filename)) return 1;
+    printf("Loaded %s (%.1f MB) in %.3f ms\n",filename,table.header().bytes*1.0e-6,elapsed_ms(start));
+    const excahauler_IK_table_header &h=table.header();
+    long fail=0;
+
+    // Random tilt pivot targets across the whole table, with tool angles
+    srand(1);
+    const int n=1000000;
+    std::vector<vec3> targets(n);
+    std::vector<float> tools(n);
+    for (int i=0;i<n;i++) {
+        targets[i]=vec3(0,rand_float(h.y0,h.y0+(h.ny-1)*h.cell),rand_float(h.z0,h.z0+(h.nz-1)*h.cell));
+        tools[i]=rand_float(-180.0,180.0);
+    }
+
+    // Agreement with the analytic solver
+    excahauler_IK ik;
+    double worst_deg=0.0, worst_m=0.0;
+    long reach_mismatch=0, reachable=0;
+    for (int i=0;i<n;i++) {
+        robot_joint_state a={-17,-30,0,0,0,0}, b=a;
+        int ra=ik.solve_tilt(a,targets[i],tools[i]);
+        int rb=table.solve_tilt(b,targets[i],tools[i]);
+        if ((ra>0)!=(rb>0)) { reach_mismatch++; continue; }
+        if (ra<=0) continue;
+        reachable++;
+        for (int j=2;j<=4;j++) worst_deg=std::max(worst_deg,(double)fabs(a.array[j]-b.array[j]));
+        vec3 tilt_a=robot_link_coords(a).coord3D(link_tilt).origin;
+        vec3 tilt_b=robot_link_coords(b).coord3D(link_tilt).origin;
+        worst_m=std::max(worst_m,(double)length(tilt_a-tilt_b));
+    }
+    printf("solve_tilt: %ld targets reachable, worst difference from excahauler_IK %.2g deg, %.2g m at the tilt pivot\n",
+        reachable,worst_deg,worst_m);
+    if (reach_mismatch || worst_m>1.0e-4) {
+        printf("ERROR: %ld reachability mismatches, %.3g m worst error\n",reach_mismatch,worst_m);
+        fail++;
+    }
+
+    // Speed
+    float sum=0;
+    robot_joint_state joint={-17,-30,0,0,0,0};
+    start=std::chrono::steady_clock::now();
+    for (int i=0;i<n;i++) if (ik.solve_tilt(joint,targets[i],tools[i])>0) sum+=joint.angle.boom;
+    double ik_ns=1.0e6*elapsed_ms(start)/n;
+    start=std::chrono::steady_clock::now();
+    for (int i=0;i<n;i++) if (table.solve_tilt(joint,targets[i],tools[i])>0) sum+=joint.angle.boom;
+    double table_ns=1.0e6*elapsed_ms(start)/n;
+    start=std::chrono::steady_clock::now();
+    for (int i=0;i<n;i++) { float b,s; if (table.lookup(targets[i].y,targets[i].z,b,s)) sum+=b; }
+    double lookup_ns=1.0e6*elapsed_ms(start)/n;
+    start=std::chrono::steady_clock::now();
+    long clear=0;
+    for (int i=0;i<n;i++) clear+=table.clear(targets[i],tools[i]);
+    double clear_ns=1.0e6*elapsed_ms(start)/n;
+    start=std::chrono::steady_clock::now();
+    long safe=0;
+    for (int i=0;i<n;i++) 
+        if (ik.solve_tilt(joint,targets[i],tools[i])>0 && joint_state_sane(joint) && arm_clearance(joint)>=0.0f) safe++;
+    double check_ns=1.0e6*elapsed_ms(start)/n;
+    printf("excahauler_IK::solve_tilt %6.1f ns\n",ik_ns);
+    printf("table solve_tilt          %6.1f ns (interpolate and refine)\n",table_ns);
+    printf("table lookup              %6.1f ns (interpolate only)\n",lookup_ns);
+    printf("table clear               %6.1f ns, versus %.1f ns to solve and check the joints and clearance (checksum %.0f)\n",
+        clear_ns,check_ns,sum);
+
+    // The clear bitmap should be conservative: never clear where the arm isn't
+    long false_clear=0;
+    for (int i=0;i<n;i++) {
+        if (!table.clear(targets[i],tools[i])) continue;
+        robot_joint_state j={h.fork,h.dump,0,0,0,0};
+        if (ik.solve_tilt(j,targets[i],tools[i])<=0 || !joint_state_sane(j) || arm_clearance(j)<0.0f) false_clear++;
+    }
+    printf("clear bitmap: %ld of %ld random poses clear, %ld really clear, %ld wrongly marked clear\n",
+        clear,(long)n,safe,false_clear);
+    if (false_clear) { printf("ERROR: clear bitmap isn't conservative\n"); fail++; }
+    return fail?1:0;
+}
@@ -0,0 +1,62 @@
+/*
+ Build the excahauler IK and reachability table (aurora/ik_table.h)
+ and save it, so programs can load it at startup instead of building it.
+
+    ./ik_table_gen [--cell M] [--dtool DEG] [--fork DEG] [--dump DEG] [excahauler_ik.table]
+
+ The Makefile runs this, and it needs rerunning whenever the link
+ geometry in kinematic_links.cpp or excahaul_collision.h changes
+ (load() refuses a stale table).
+
+ This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "aurora/lunatic.h"
+#include "aurora/kinematics.h"
+#include "aurora/kinematic_links.cpp"
+#include "aurora/ik_table.h"
+
+using namespace aurora;
+
+int main(int argc,char *argv[]) {
+    const char *filename="excahauler_ik.table";
+    float cell=0.01, dtool=2.0, fork=-17.0, dump=-30.0; // default scoop angles are mine_joint_base
+    for (int argi=1;argi<argc;argi++) {
+        if (0==strcmp(argv[argi],"--cell") && argi+1<argc) cell=atof(argv[++argi]);
+        else if (0==strcmp(argv[argi],"--dtool") && argi+1<argc) dtool=atof(argv[++argi]);
+        else if (0==strcmp(argv[argi],"--fork") && argi+1<argc) fork=atof(argv[++argi]);
+        else if (0==strcmp(argv[argi],"--dump") && argi+1<argc) dump=atof(argv[++argi]);
+        else if (argv[argi][0]!='-') filename=argv[argi];
+        else {
+            printf("Usage: ik_table_gen [--cell M] [--dtool DEG] [--fork DEG] [--dump DEG] [excahauler_ik.table]\n");
+            return 1;
+        }
+    }
+
+    auto start=std::chrono::steady_clock::now();
+    excahauler_IK_table table;
+    table.build(fork,dump,cell,dtool);
+    double ms=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+    const excahauler_IK_table_header &h=table.header();
+
+    long reach=0, clear=0;
+    for (int iy=0;iy<h.ny;iy++)
+    for (int iz=0;iz<h.nz;iz++) {
+        vec3 p(0,h.y0+iy*h.cell,h.z0+iz*h.cell);
+        if (!table.reachable(p)) continue;
+        reach++;
+        for (int it=0;it<h.ntool;it++)
+            if (table.clear(p,-180.0f+(it+0.5f)*h.dtool)) clear++;
+    }
+    printf("IK table: %d x %d samples every %.1f cm from Y %.2f Z %.2f m, %d tool angles every %.1f deg (fork %.0f, dump %.0f)\n",
+        h.ny,h.nz,h.cell*100.0,h.y0,h.z0,h.ntool,h.dtool,h.fork,h.dump);
+    printf("  %ld samples reachable, %.1f%% of those tool angles clear; built in %.0f ms\n",
+        reach,reach?100.0*clear/((double)reach*h.ntool):0.0,ms);
+
+    if (!table.save(filename)) { printf("Can't write %s\n",filename); return 1; }
+    printf("  wrote %s, %.1f MB\n",filename,h.bytes*1.0e-6);
+    return 0;
+}
@@ -0,0 +1,362 @@
+/*
+ Extended Kalman filter localizer: fuses the wheel encoders, the drive
+ frame IMU yaw (nanoslot F1), and computer vision marker reports.
+
+ The state is the robot's field position x,y (meters), heading theta
+ (radians), and the offset between the IMU's yaw and our heading
+ (radians), since the IMU has no magnetometer: its yaw starts at an
+ arbitrary zero and slowly drifts, so we track that offset as a random walk.
+
+ Marker reports are delayed by the camera and vision pipeline, so we
+ keep a short history of recent events and filter states.  A marker is
+ applied at its capture time, and the later encoder and IMU events are
+ then re-applied on top of the corrected state.
+
+ This header doesn't need OpenCV or a camera (see ekf_replay.cpp).
+
+ This file is Public Domain.
+*/
+#ifndef __AURORA_EKF_LOCALIZER_H
+#define __AURORA_EKF_LOCALIZER_H
+
+#include <stdio.h>
+#include <math.h>
+#include <deque>
+#include "aurora/lunatic.h"
+
+/* Tuning parameters.  Distances in meters, angles in degrees. */
+struct ekf_params {
+    double wheelbase=1.9; // effective wheelbase, including slip (same as move_robot_encoder)
+    double maxjump=3.0; // ignore encoder changes bigger than this (startup glitches)
+    double wheel_noise=0.03; // wheel travel error, as a random walk (meters per sqrt(meter) of travel)
+    double turn_noise=3.0; // extra heading error from slip while turning (deg per sqrt(meter) of differential travel)
+    double imu_noise=1.0; // IMU yaw reading error (deg)
+    double imu_drift=0.3; // IMU yaw offset random walk (deg per sqrt(second))
+    double imu_sign=1.0; // IMU yaw direction relative to our heading (+1 for counterclockwise)
+    double marker_pos_noise=0.05; // marker-derived position error (meters)
+    double marker_pos_range=0.03; // plus this many meters per meter of range
+    double marker_angle_noise=2.0; // marker-derived heading error (deg)
+    double marker_angle_range=1.0; // plus this many degrees per meter of range
+    double marker_gate=16.0; // reject markers this many chi-squared units off our estimate (3 DOF)
+    int marker_gate_max=5; // but accept one after this many rejects in a row (we're lost)
+    double history_seconds=2.0; // keep events this long, for late markers
+    int history_max=2048; // and at most this many
+    double percent_pos=1.0; // percent confidence drops by 1/e for this much position error (meters)
+    double percent_angle=30.0; // and for this much heading error (deg)
+};
+
+/* The 2D robot pose implied by seeing this marker, or false if the report isn't usable.
+     pos: robot's position, used to place the camera (the result doesn't depend much on it)
+     camera_robot: camera location on the robot, in robot link coordinates
+        (from robot_link_coords with an identity frame: X right, Y forward, Z up)
+     report: marker location relative to the camera
+*/
+inline bool marker_implied_pose(const aurora::robot_loc2D &pos,const aurora::robot_coord3D &camera_robot,
+    const aurora::vision_marker_report &report,aurora::robot_loc2D &implied)
+{
+    if (!report.is_valid()) return false;
+    for (const aurora::vision_marker_report &known:aurora::field_markers)
+        if (known.markerID==report.markerID)
+        {
+            aurora::robot_loc2D camera2D=pos;
+            camera2D.angle-=90.0f; // robot Y instead of X axis (like the localizer)
+            aurora::robot_coord3D camera=camera2D.get3D().compose(camera_robot);
+            aurora::robot_coord3D marker=camera.compose(report.coords);
+            if (marker.Y.z<0.7) return false; // not sane: marker isn't upright
+
+            // Rotate the robot around the seen marker, to line it up with the known marker
+            float turn=aurora::angle_signed_diff(known.coords.extract_angle(),marker.extract_angle());
+            float c=cos(turn*M_PI/180.0), s=sin(turn*M_PI/180.0);
+            float rx=marker.origin.x-pos.x, ry=marker.origin.y-pos.y;
+            implied=pos;
+            implied.x=known.coords.origin.x-(c*rx-s*ry);
+            implied.y=known.coords.origin.y-(s*rx+c*ry);
+            implied.angle=pos.angle+turn;
+            return true;
+        }
+    return false; // not one of our markers
+}
+
+class ekf_localizer {
+public:
+    ekf_params params;
+
+    enum {N=4}; // state variables
+    enum {X=0,Y=1,TH=2,IMU=3}; // indexes into the state
+
+    // Statistics
+    long markers_used=0, markers_rejected=0, markers_late=0, markers_too_old=0;
+    double last_innovation[3]={0,0,0}; // last marker's x, y, heading (deg) difference from our estimate
+
+    /* Start at this location, with this standard deviation (meters and degrees) */
+    ekf_localizer(const aurora::robot_loc2D &start=aurora::robot_loc2D(5.0,15.0,90.0),
+        double sigma_pos=0.5,double sigma_angle=10.0,aurora::monotonic_time_t now=0)
+    {
+        reset(start,sigma_pos,sigma_angle,now);
+    }
+
+    void reset(const aurora::robot_loc2D &start,double sigma_pos,double sigma_angle,aurora::monotonic_time_t now)
+    {
+        for (int i=0;i<N;i++) for (int j=0;j<N;j++) base.P[i][j]=0.0;
+        base.x[X]=start.x; base.x[Y]=start.y; base.x[TH]=start.angle*M_PI/180.0; base.x[IMU]=0.0;
+        base.P[X][X]=base.P[Y][Y]=sigma_pos*sigma_pos;
+        base.P[TH][TH]=square(sigma_angle*M_PI/180.0);
+        base.P[IMU][IMU]=square(M_PI); // unknown until the first IMU reading
+        base.t=now;
+        cur=base;
+        history.clear();
+        marker_rejects=0;
+    }
+
+    /* Wheel encoder change (meters of travel per side), at this time */
+    void encoder(aurora::monotonic_time_t t,const aurora::drive_encoders &change) {
+        if (change.left==0 && change.right==0) return; // stopped (save CPU and history)
+        event e; e.kind=event::ENCODER; e.t=t; e.change=change;
+        add(e);
+    }
+
+    /* IMU yaw reading (degrees), at this time */
+    void imu(aurora::monotonic_time_t t,float yaw) {
+        event e; e.kind=event::IMU_YAW; e.t=t; e.yaw=yaw;
+        add(e);
+    }
+
+    /* Marker report captured at this time, by this camera (see marker_implied_pose).
+       Returns false if the marker is unknown, not sane, or too old to use. */
+    bool marker(aurora::monotonic_time_t t,const aurora::robot_coord3D &camera_robot,
+        const aurora::vision_marker_report &report)
+    {
+        aurora::robot_loc2D implied;
+        if (!marker_implied_pose(pos(),camera_robot,report,implied)) return false;
+        if (t<base.t) { markers_too_old++; return false; }
+        if (t<cur.t) markers_late++;
+        event e; e.kind=event::MARKER; e.t=t; e.camera=camera_robot; e.report=report;
+        add(e);
+        return true;
+    }
+
+    /* Our current position estimate, with percent from the covariance */
+    aurora::robot_loc2D pos(void) const {
+        aurora::robot_loc2D p(cur.x[X],cur.x[Y],cur.x[TH]*180.0/M_PI);
+        p.angle=aurora::angle_signed_diff(p.angle,0.0f); // keep in -180 to +180
+        p.percent=percent();
+        return p;
+    }
+
+    /* Current standard deviations of position (meters) and heading (degrees) */
+    double sigma_pos(void) const { return sqrt(0.5*(cur.P[X][X]+cur.P[Y][Y])); }
+    double sigma_angle(void) const { return sqrt(cur.P[TH][TH])*180.0/M_PI; }
+
+    /* Confidence from the covariance: 100% if exact, 37% at percent_pos or percent_angle error */
+    float percent(void) const {
+        return 100.0*exp(-(sigma_pos()/params.percent_pos+sigma_angle()/params.percent_angle));
+    }
+
+    /* Time of the newest event we've applied */
+    aurora::monotonic_time_t time(void) const { return cur.t; }
+
+private:
+    struct state {
+        double x[N]; // x, y, theta, IMU yaw offset
+        double P[N][N]; // covariance
+        aurora::monotonic_time_t t; // time of the last event applied
+    };
+    struct event {
+        enum {ENCODER=1,IMU_YAW=2,MARKER=3} kind;
+        aurora::monotonic_time_t t;
+        aurora::drive_encoders change; // ENCODER
+        float yaw; // IMU_YAW
+        aurora::robot_coord3D camera; // MARKER
+        aurora::vision_marker_report report; // MARKER
+        state after; // filter state after this event
+    };
+    state base; // filter state before the oldest event in history
+    state cur; // current filter state
+    std::deque<event> history; // recent events, sorted by time
+    int marker_rejects; // markers rejected in a row
+    bool replaying=false; // re-applying events after a late one (don't count statistics twice)
+
+    static double square(double v) { return v*v; }
+    static double wrap(double a) { // to -pi .. +pi
+        while (a>M_PI) a-=2.0*M_PI;
+        while (a<-M_PI) a+=2.0*M_PI;
+        return a;
+    }
+
+    /* Add this event in time order, replaying any later events */
+    void add(event &e) {
+        size_t i=history.size();
+        while (i>0 && history[i-1].t>e.t) i--;
+        if (i==history.size()) { // normal case: newest event
+            apply(cur,e);
+            e.after=cur;
+            history.push_back(e);
+        }
+        else { // late event: back up to just before it, and redo everything after
+            cur=(i>0)?history[i-1].after:base;
+            history.insert(history.begin()+i,e);
+            apply(cur,history[i]);
+            history[i].after=cur;
+            replaying=true;
+            for (i++;i<history.size();i++) {
+                apply(cur,history[i]);
+                history[i].after=cur;
+            }
+            replaying=false;
+        }
+        trim();
+    }
+
+    /* Drop events older than our history window */
+    void trim(void) {
+        aurora::monotonic_time_t oldest=cur.t-(aurora::monotonic_time_t)(params.history_seconds*1.0e9);
+        while (!history.empty() && (history.front().t<oldest || (int)history.size()>params.history_max)) {
+            base=history.front().after;
+            history.pop_front();
+        }
+    }
+
+    /* Apply this event to this filter state */
+    void apply(state &s,const event &e) {
+        // Let the IMU offset drift for the time since the last event
+        double dt=(e.t-s.t)*1.0e-9;
+        if (dt>0.0) {
+            s.P[IMU][IMU]+=square(params.imu_drift*M_PI/180.0)*dt;
+            s.t=e.t;
+        }
+        switch (e.kind) {
+        case event::ENCODER: predict(s,e.change); break;
+        case event::IMU_YAW: update_imu(s,e.yaw); break;
+        case event::MARKER: update_marker(s,e.camera,e.report); break;
+        }
+    }
+
+    /* Move the robot by this encoder change (same motion as move_robot_encoder) */
+    void predict(state &s,const aurora::drive_encoders &change) {
+        double dl=change.left, dr=change.right;
+        if (!(fabs(dl)<params.maxjump && fabs(dr)<params.maxjump)) return; // startup glitch
+        double W=params.wheelbase;
+        double d=0.5*(dl+dr), c=cos(s.x[TH]), sn=sin(s.x[TH]);
+        s.x[X]+=d*c;
+        s.x[Y]+=d*sn;
+        s.x[TH]=wrap(s.x[TH]+atan2(dr-dl,W));
+
+        // Jacobian of the motion with respect to the state
+        double F[N][N]={{1,0,-d*sn,0},{0,1,d*c,0},{0,0,1,0},{0,0,0,1}};
+        // and with respect to the two wheel travels
+        double turn=1.0/(W+square(dr-dl)/W); // d atan2(dr-dl,W) / d(dr-dl)
+        double G[N][2]={{0.5*c,0.5*c},{0.5*sn,0.5*sn},{-turn,turn},{0,0}};
+        // Random walk noise, so it doesn't depend on how often the encoders report
+        double ql=square(params.wheel_noise)*fabs(dl);
+        double qr=square(params.wheel_noise)*fabs(dr);
+
+        double FP[N][N];
+        for (int i=0;i<N;i++) for (int j=0;j<N;j++) {
+            double v=0.0;
+            for (int k=0;k<N;k++) v+=F[i][k]*s.P[k][j];
+            FP[i][j]=v;
+        }
+        for (int i=0;i<N;i++) for (int j=0;j<N;j++) {
+            double v=0.0;
+            for (int k=0;k<N;k++) v+=FP[i][k]*F[j][k];
+            s.P[i][j]=v+G[i][0]*ql*G[j][0]+G[i][1]*qr*G[j][1];
+        }
+        s.P[TH][TH]+=square(params.turn_noise*M_PI/180.0)*fabs(dr-dl);
+    }
+
+    /* IMU yaw measures our heading plus the IMU offset */
+    void update_imu(state &s,float yaw) {
+        double H[N]={0,0,1,1};
+        double y=wrap(params.imu_sign*yaw*M_PI/180.0-(s.x[TH]+s.x[IMU]));
+        update(s,&H,&y,square(params.imu_noise*M_PI/180.0),1);
+    }
+
+    /* Marker measures our position and heading directly */
+    void update_marker(state &s,const aurora::robot_coord3D &camera,const aurora::vision_marker_report &report) {
+        aurora::robot_loc2D prior(s.x[X],s.x[Y],s.x[TH]*180.0/M_PI);
+        aurora::robot_loc2D implied;
+        if (!marker_implied_pose(prior,camera,report,implied)) return;
+        double y[3]={implied.x-s.x[X],implied.y-s.x[Y],wrap((implied.angle-prior.angle)*M_PI/180.0)};
+
+        double range=length(report.coords.origin);
+        double rp=square(params.marker_pos_noise+params.marker_pos_range*range);
+        double ra=square((params.marker_angle_noise+params.marker_angle_range*range)*M_PI/180.0);
+        double R[3]={rp,rp,ra};
+
+        // Gate: is this marker consistent with where we think we are?
+        double S[3][3], Si[3][3];
+        for (int i=0;i<3;i++) for (int j=0;j<3;j++) S[i][j]=s.P[i][j]+(i==j?R[i]:0.0);
+        if (!invert3(S,Si)) return;
+        double d2=0.0;
+        for (int i=0;i<3;i++) for (int j=0;j<3;j++) d2+=y[i]*Si[i][j]*y[j];
+        if (!replaying) {
+            last_innovation[0]=y[0]; last_innovation[1]=y[1]; last_innovation[2]=y[2]*180.0/M_PI;
+        }
+        if (d2>params.marker_gate && marker_rejects<params.marker_gate_max) {
+            marker_rejects++;
+            if (!replaying) markers_rejected++;
+            return;
+        }
+        marker_rejects=0;
+        if (!replaying) markers_used++;
+
+        double H[3][N]={{1,0,0,0},{0,1,0,0},{0,0,1,0}};
+        update(s,H,y,R,3);
+    }
+
+    /* Kalman update with m measurements (m<=3): rows of H, innovation y, diagonal noise R */
+    void update(state &s,const double (*H)[N],const double *y,const double *R,int m) {
+        double PH[N][3]; // P H^T
+        for (int i=0;i<N;i++) for (int r=0;r<m;r++) {
+            double v=0.0;
+            for (int k=0;k<N;k++) v+=s.P[i][k]*H[r][k];
+            PH[i][r]=v;
+        }
+        double S[3][3]={{1,0,0},{0,1,0},{0,0,1}}, Si[3][3];
+        for (int r=0;r<m;r++) for (int c=0;c<m;c++) {
+            double v=(r==c)?R[r]:0.0;
+            for (int k=0;k<N;k++) v+=H[r][k]*PH[k][c];
+            S[r][c]=v;
+        }
+        if (!invert3(S,Si)) return;
+        double K[N][3];
+        for (int i=0;i<N;i++) for (int c=0;c<m;c++) {
+            double v=0.0;
+            for (int r=0;r<m;r++) v+=PH[i][r]*Si[r][c];
+            K[i][c]=v;
+        }
+        for (int i=0;i<N;i++)
+            for (int c=0;c<m;c++) s.x[i]+=K[i][c]*y[c];
+        s.x[TH]=wrap(s.x[TH]);
+        s.x[IMU]=wrap(s.x[IMU]);
+
+        // P -= K H P, kept symmetric
+        double KHP[N][N];
+        for (int i=0;i<N;i++) for (int j=0;j<N;j++) {
+            double v=0.0;
+            for (int c=0;c<m;c++) v+=K[i][c]*PH[j][c];
+            KHP[i][j]=v;
+        }
+        for (int i=0;i<N;i++) for (int j=0;j<N;j++)
+            s.P[i][j]-=0.5*(KHP[i][j]+KHP[j][i]);
+    }
+    void update(state &s,const double (*H)[N],const double *y,double R,int m) {
+        update(s,H,y,&R,m);
+    }
+
+    /* Invert a 3x3 matrix (unused rows and columns should be identity) */
+    static bool invert3(const double A[3][3],double out[3][3]) {
+        double det=A[0][0]*(A[1][1]*A[2][2]-A[1][2]*A[2][1])
+                  -A[0][1]*(A[1][0]*A[2][2]-A[1][2]*A[2][0])
+                  +A[0][2]*(A[1][0]*A[2][1]-A[1][1]*A[2][0]);
+        if (!(fabs(det)>1.0e-30)) return false;
+        double inv=1.0/det;
+        for (int i=0;i<3;i++) for (int j=0;j<3;j++) {
+            int i1=(j+1)%3, i2=(j+2)%3, j1=(i+1)%3, j2=(i+2)%3;
+            out[i][j]=(A[i1][j1]*A[i2][j2]-A[i1][j2]*A[i2][j1])*inv;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ Offline evaluation of the EKF localizer (ekf_localizer.h).
+
+ Replays a data exchange log recorded by lunabug's exchange_read,
+ which needs at least these files:
+    exchange_read /tmp/data_exchange/{backend.encoders.ring,nanoslot,backend.state,\
+        vision_marker_depth.reports,vision_marker_webcam.reports,plan_current.loc2D} > run.xcg
+    ./ekf_replay run.xcg
+
+ With no log, it drives a simulated robot around the field instead,
+ with slipping wheels, a drifting IMU, and late, noisy marker reports.
+ The IMU readings share the nanoslot exchange with other slots that
+ write it much more often (--slots, writes per second).
+
+ Each run compares three localizers:
+    blend: the old encoder plus 20% marker blend (localizer.h, localizer --blend)
+    ekf_now: the EKF, but applying markers when they arrive
+    ekf: the EKF, applying markers at their capture time
+ and with --mcl N, the particle filter localizer (mcl_localizer.h, localizer --mcl),
+ and reports how far each is from the simulated truth, or for a log,
+ how far each is from the marker poses and from the recorded plan_current.
+
+ This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "aurora/lunatic.h"
+#include "aurora/kinematics.h"
+#include "aurora/kinematic_links.cpp"
+#include "localizer.h"
+#include "ekf_localizer.h"
+#include "mcl_localizer.h"
+#include "localizer_replay.h"
+
+/* ----------------- Evaluation ------------ */
+
+/* Running error statistics for one localizer */
+struct pose_error {
+    const char *name;
+    double pos2=0.0, angle2=0.0, pos_max=0.0; // sums of squared errors, and worst error
+    long count=0;
+    double inside2sigma=0.0; // fraction of samples where the error was inside 2 sigma (EKF only)
+
+    pose_error(const char *name_) :name(name_) {}
+
+    void add(const aurora::robot_loc2D &est,const aurora::robot_loc2D &ref,double sigma=0.0) {
+        double dx=est.x-ref.x, dy=est.y-ref.y;
+        double d=sqrt(dx*dx+dy*dy);
+        double a=aurora::angle_signed_diff(est.angle,ref.angle);
+        pos2+=d*d; angle2+=a*a; count++;
+        pos_max=std::max(pos_max,d);
+        if (d<2.0*sigma) inside2sigma++;
+    }
+    double rms_pos(void) const { return count?sqrt(pos2/count):0.0; }
+    double rms_angle(void) const { return count?sqrt(angle2/count):0.0; }
+
+    void print(const char *versus) const {
+        printf("  %8s: %.3f m RMS (worst %.3f m), %.2f deg RMS from %s",
+            name,rms_pos(),pos_max,rms_angle(),versus);
+        if (inside2sigma>0) printf(", %.0f%% inside 2 sigma",100.0*inside2sigma/count);
+        printf("\n");
+    }
+};
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+/* Run the localizers over these events.  Returns false if the EKF does worse than blending. */
+bool evaluate(const std::vector<replay_event> &events,const aurora::robot_loc2D &start,int print_every,int particles) {
+    aurora::robot_loc2D blend=start;
+    blend.percent=90.0;
+    ekf_localizer ekf(start,0.5,10.0,events.empty()?0:events[0].t);
+    ekf_localizer ekf_now(start,0.5,10.0,events.empty()?0:events[0].t);
+    mcl_params mp;
+    mp.particles=std::max(1,particles);
+    mcl_localizer mcl(start,0.5,10.0,mp);
+
+    bool truth=false;
+    pose_error blend_err("blend"), now_err("ekf_now"), ekf_err("ekf"), mcl_err("mcl");
+    pose_error blend_marker("blend"), now_marker("ekf_now"), ekf_marker("ekf");
+    pose_error blend_rec("blend"), ekf_rec("ekf");
+    long counts[5]={0,0,0,0,0};
+    double ekf_ms=0.0, mcl_ms=0.0;
+    for (size_t i=0;i<events.size();i++) {
+        const replay_event &e=events[i];
+        counts[e.kind]++;
+        auto start_time=std::chrono::steady_clock::now();
+        switch (e.kind) {
+        case replay_event::ENCODER:
+            ekf.encoder(e.t,e.change);
+            ekf_ms+=elapsed_ms(start_time);
+            ekf_now.encoder(e.t,e.change);
+            blend=move_robot_encoder(blend,e.change);
+            if (particles>0) {
+                start_time=std::chrono::steady_clock::now();
+                mcl.encoder(e.t,e.change);
+                mcl_ms+=elapsed_ms(start_time);
+            }
+            break;
+        case replay_event::IMU_YAW:
+            ekf.imu(e.t,e.yaw);
+            ekf_ms+=elapsed_ms(start_time);
+            ekf_now.imu(e.t,e.yaw);
+            if (particles>0) {
+                start_time=std::chrono::steady_clock::now();
+                mcl.imu(e.t,e.yaw);
+                mcl_ms+=elapsed_ms(start_time);
+            }
+            break;
+        case replay_event::MARKER: {
+            // How far is each localizer from what this marker says?
+            aurora::robot_loc2D implied;
+            if (marker_implied_pose(blend,e.camera,e.report,implied)) blend_marker.add(blend,implied);
+            if (ekf.marker(e.t,e.camera,e.report)) {
+                ekf_ms+=elapsed_ms(start_time);
+                aurora::robot_loc2D innovation(ekf.last_innovation[0],ekf.last_innovation[1],ekf.last_innovation[2]);
+                ekf_marker.add(innovation,aurora::robot_loc2D());
+            }
+            if (ekf_now.marker(e.arrival,e.camera,e.report)) {
+                aurora::robot_loc2D innovation(ekf_now.last_innovation[0],ekf_now.last_innovation[1],ekf_now.last_innovation[2]);
+                now_marker.add(innovation,aurora::robot_loc2D());
+            }
+
+            aurora::robot_loc2D camera2D=blend;
+            camera2D.angle-=90.0f;
+            aurora::vision_marker_reports reports;
+            reports[0]=e.report;
+            update_from_markers(blend,camera2D.get3D().compose(e.camera),reports,false);
+            if (particles>0) {
+                start_time=std::chrono::steady_clock::now();
+                mcl.marker(e.t,e.camera,e.report);
+                mcl_ms+=elapsed_ms(start_time);
+            }
+            break;
+        }
+        case replay_event::RECORDED:
+            blend_rec.add(blend,e.pos);
+            ekf_rec.add(ekf.pos(),e.pos);
+            break;
+        }
+
+        if (e.has_truth) {
+            truth=true;
+            blend_err.add(blend,e.truth);
+            now_err.add(ekf_now.pos(),e.truth,ekf_now.sigma_pos());
+            ekf_err.add(ekf.pos(),e.truth,ekf.sigma_pos());
+            if (particles>0) {
+                aurora::robot_loc2D p=mcl.pos();
+                mcl_err.add(p,e.truth,mcl.sigma_pos());
+            }
+        }
+        if (print_every>0 && (i%print_every)==0) {
+            printf("%8.3f s  blend ",(e.arrival-events[0].arrival)*1.0e-9); blend.print(stdout,"");
+            printf("   ekf "); ekf.pos().print(stdout,"");
+            if (e.has_truth) { printf("   truth "); e.truth.print(stdout,""); }
+            printf("\n");
+        }
+    }
+
+    printf("%ld encoder, %ld IMU, %ld marker events (%ld late, %ld too old), %ld recorded poses\n",
+        counts[replay_event::ENCODER],counts[replay_event::IMU_YAW],counts[replay_event::MARKER],
+        ekf.markers_late,ekf.markers_too_old,counts[replay_event::RECORDED]);
+    printf("EKF: %ld markers used, %ld rejected; %.2f us per event; final sigma %.3f m, %.2f deg, %.0f%%\n",
+        ekf.markers_used,ekf.markers_rejected,events.empty()?0.0:1000.0*ekf_ms/events.size(),
+        ekf.sigma_pos(),ekf.sigma_angle(),ekf.percent());
+    if (particles>0)
+        printf("MCL: %d particles, %ld markers used, %ld resamples, %ld particles recovered; %.2f us per event\n",
+            mcl.size(),mcl.markers_used,mcl.resamples,mcl.recovered,events.empty()?0.0:1000.0*mcl_ms/events.size());
+    printf("Final poses:\n  blend "); blend.print();
+    printf("  ekf   "); ekf.pos().print();
+    if (particles>0) { printf("  mcl   "); mcl.pos().print(); }
+
+    if (truth) {
+        printf("Error from true pose:\n");
+        blend_err.print("truth"); now_err.print("truth"); ekf_err.print("truth");
+        if (particles>0) mcl_err.print("truth");
+    }
+    if (ekf_marker.count) {
+        printf("Disagreement with each marker, before using it:\n");
+        blend_marker.print("marker"); now_marker.print("marker"); ekf_marker.print("marker");
+    }
+    if (ekf_rec.count) {
+        printf("Difference from the recorded localizer output:\n");
+        blend_rec.print("recorded"); ekf_rec.print("recorded");
+    }
+    if (truth && ekf_err.rms_pos()>blend_err.rms_pos()) {
+        printf("ERROR: EKF is less accurate than the blended localizer\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc,char *argv[]) {
+    const char *log=0;
+    int print_every=0;
+    int particles=0;
+    double seconds=120.0, latency=0.25, range=7.0, mismatch=0.0;
+    int slots=500; // about 10 other slots at 50Hz
+    for (int argi=1;argi<argc;argi++) {
+        std::string arg=argv[argi];
+        if (arg=="--print" && argi+1<argc) print_every=atoi(argv[++argi]);
+        else if (arg=="--seconds" && argi+1<argc) seconds=atof(argv[++argi]);
+        else if (arg=="--latency" && argi+1<argc) latency=atof(argv[++argi]);
+        else if (arg=="--range" && argi+1<argc) range=atof(argv[++argi]);
+        else if (arg=="--mismatch" && argi+1<argc) mismatch=atof(argv[++argi]);
+        else if (arg=="--slots" && argi+1<argc) slots=atoi(argv[++argi]);
+        else if (arg=="--mcl" && argi+1<argc) particles=atoi(argv[++argi]);
+        else if (arg[0]!='-' && !log) log=argv[argi];
+        else {
+            printf("Usage: ekf_replay [--print N] [--mcl N] [log.xcg]\n"
+                   "   or: ekf_replay [--print N] [--mcl N] [--seconds S] [--latency S] [--range M] [--mismatch F] [--slots HZ]   (simulated robot)\n");
+            return 1;
+        }
+    }
+
+    std::vector<replay_event> events;
+    aurora::robot_loc2D start(5.0,15.0,90.0); // the localizer's start location
+    if (log) {
+        if (!read_log(log,events,print_every>0)) return 1;
+        for (const replay_event &e:events) // start where the recorded localizer started, if we have it
+            if (e.kind==replay_event::RECORDED) { start=e.pos; break; }
+        printf("%s: %zd events\n",log,events.size());
+    }
+    else {
+        srand(1);
+        aurora::robot_loc2D truth;
+        events=simulate(seconds,latency,truth,range,mismatch,slots);
+        start=truth;
+        start.x+=0.3; start.y-=0.2; start.angle+=5.0; // we don't start exactly where we think
+        printf("Simulated %.0f seconds, markers %.0f ms late, other slots writing %d/s: %zd events\n",
+            seconds,latency*1000.0,slots,events.size());
+    }
+    return evaluate(events,start,print_every,particles)?0:1;
+}
@@ -0,0 +1,119 @@
+/*
+ Measure the localizer's pose latency and CPU use.
+
+ Starts a localizer, stands in for the backend by pushing encoder values
+ into the encoder ring, and times how long it takes each one to show up
+ in plan_current (which carries the encoder's time as its source_time).
+ It also reads the localizer's CPU time while idle and while driving.
+
+    ./loc_latency [--seconds S] [--hz H] [localizer command and flags]
+
+ The default command is "./localizer --sim".  This uses the real
+ /tmp/data_exchange files, so don't run it while the backend is running.
+
+ This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <vector>
+#include <algorithm>
+#include "aurora/lunatic.h"
+
+/* User plus system CPU seconds used so far by this process, from /proc */
+double process_cpu_seconds(pid_t pid) {
+    char name[100];
+    snprintf(name,sizeof(name),"/proc/%d/stat",(int)pid);
+    FILE *f=fopen(name,"r");
+    if (!f) return 0.0;
+    char buf[1024];
+    size_t len=fread(buf,1,sizeof(buf)-1,f);
+    fclose(f);
+    buf[len]=0;
+    // Fields after the ")" closing the command name: state is field 3, utime and stime are 14 and 15
+    const char *p=strrchr(buf,')');
+    unsigned long utime=0, stime=0;
+    if (!p || 2!=sscanf(p+2,"%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",&utime,&stime)) return 0.0;
+    return (utime+stime)/(double)sysconf(_SC_CLK_TCK);
+}
+
+void report(const char *name,std::vector<double> &lat_us) {
+    if (lat_us.empty()) { printf("%-22s no samples\n",name); return; }
+    std::sort(lat_us.begin(),lat_us.end());
+    double sum=0.0;
+    for (double l:lat_us) sum+=l;
+    size_t n=lat_us.size();
+    printf("%-22s %5d poses: mean %8.1f us  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n",
+        name,(int)n, sum/n, lat_us[n/2], lat_us[n*99/100], lat_us[n-1]);
+}
+
+int main(int argc,char *argv[]) {
+    double seconds=5.0; // length of the idle and driving phases
+    double hz=50.0; // backend encoder rate
+    std::vector<char *> command;
+    for (int argi=1;argi<argc;argi++) {
+        if (0==strcmp(argv[argi],"--seconds") && argi+1<argc) seconds=atof(argv[++argi]);
+        else if (0==strcmp(argv[argi],"--hz") && argi+1<argc) hz=atof(argv[++argi]);
+        else command.push_back(argv[argi]);
+    }
+    if (command.empty()) {
+        static char prog[]="./localizer", flag[]="--sim";
+        command.push_back(prog); command.push_back(flag);
+    }
+    command.push_back(0);
+
+    MAKE_exchange_drive_encoders_ring();
+    MAKE_exchange_plan_current();
+
+    pid_t localizer=fork();
+    if (localizer==0) {
+        if (!freopen("/dev/null","w",stdout)) return 1;
+        execvp(command[0],&command[0]);
+        perror("exec localizer");
+        _exit(1);
+    }
+
+    // Let it start up, then see what it costs us while nothing happens
+    aurora::data_exchange_sleep(1000);
+    exchange_plan_current.read();
+    double cpu0=process_cpu_seconds(localizer);
+    aurora::data_exchange_sleep((int)(seconds*1000));
+    double idle_cpu=process_cpu_seconds(localizer)-cpu0;
+    bool idle_writes=exchange_plan_current.updated();
+
+    // Drive slowly forward, timing each encoder value to its pose
+    std::vector<double> lat;
+    aurora::drive_encoders enc;
+    long missed=0;
+    int count=(int)(seconds*hz);
+    cpu0=process_cpu_seconds(localizer);
+    for (int i=0;i<count;i++) {
+        enc.left+=0.004; enc.right+=0.004;
+        aurora::monotonic_time_t t=aurora::time_in_nanoseconds_monotonic();
+        exchange_drive_encoders_ring.push(enc,t);
+
+        // Wait for the pose that used this encoder value
+        //  (a localizer that doesn't timestamp its poses gets credit for its next write)
+        bool got=false;
+        while (exchange_plan_current.wait_for_update(100))
+            if (exchange_plan_current.source_time()>=t) { got=true; break; }
+        if (got) lat.push_back((exchange_plan_current.last_write_time()-t)*1.0e-3);
+        else missed++;
+
+        aurora::data_exchange_sleep((int)(1000.0/hz));
+    }
+    double drive_cpu=process_cpu_seconds(localizer)-cpu0;
+
+    kill(localizer,SIGTERM);
+    waitpid(localizer,0,0);
+
+    printf("Localizer \"%s\":\n",command[0]);
+    report("encoder to plan_current",lat);
+    if (missed) printf("  %ld of %d encoder values never got their own pose\n",missed,count);
+    printf("  idle CPU: %.2f%%%s\n",100.0*idle_cpu/seconds,idle_writes?" (and it published while idle)":"");
+    printf("  driving CPU at %.0f Hz: %.2f%%\n",hz,100.0*drive_cpu/seconds);
+    return 0;
+}
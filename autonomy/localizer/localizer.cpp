@@ -1,7 +1,12 @@
 /*
  The localizer figures out where the robot is located in 3D space, based on:
     - Wheel encoders
+    - Drive frame IMU yaw
     - Computer vision markers
+ By default these are fused in an extended Kalman filter (ekf_localizer.h);
+ --mcl uses a particle filter instead (mcl_localizer.h), which copes better
+ with long stretches without markers and with bad marker matches, and
+ --blend uses the older encoder plus 20% marker blend (localizer.h).
 
  Matt Perry & Orion Lawlor, 2019-2023 (Public Domain)
 */
@@ -11,128 +16,10 @@
 #include "aurora/lunatic.h"
 #include "aurora/kinematics.h"
 #include "aurora/kinematic_links.cpp"
-
-/*
- These are the installed computer vision marker locations on the field.
-    x,y are in meters
-    angle is in degrees, facing along the +X direction of the marker
-*/
-const aurora::vision_marker_reports knownMarkers {
-    aurora::vision_marker_report(5.0, 10.0, 180.0, 2), //blocky, facing out toward drive area
-    aurora::vision_marker_report(0.0, 3.0, 83.0, 6), //ghost, behind charge area
-    aurora::vision_marker_report(12.0, 5.0, -90.0, 17), //descending bird, behind the pit
-    //aurora::vision_marker_report(field_x_trough_center, 00.0, 180.0, 2), //fabric
-    };
-
-void marker_update_robot_pos(aurora::robot_loc2D & currentPos, const aurora::robot_coord3D & currentReportCoord,const int32_t markerID)
-{
-    for(aurora::vision_marker_report known : knownMarkers){
-         if ( markerID == known.markerID){
-            float weight=0.2; // <- blend in this much of the new report (higher=faster, more jitter).  FIXME: should depend on the confidence value or range.
-            
-            vec3 diff = known.coords.origin - currentReportCoord.origin;
-            float diffwt = weight;
-            currentPos.x += diff.x*diffwt;
-            currentPos.y+= diff.y*diffwt;
-
-            
-            float anglediff = aurora::angle_signed_diff(known.coords.extract_angle(), currentReportCoord.extract_angle());
-            float anglediffwt = weight;
-            currentPos.angle += anglediff*anglediffwt;
-            if (0) 
-            {
-                std::cout << anglediff << "= angle diff \n";
-                std::cout << known.coords.extract_angle() << " = known angle, " <<  currentReportCoord.extract_angle() << " = reported angle \n";
-            }
-            
-            // If the differences are small, we've converged and should have more confidence.
-            if (length(diff)<0.5) currentPos.percent+=5.0;
-            else if (length(diff)<1.0) { /* stay with confidence */ }
-            else currentPos.percent *=0.99;
-            
-            if (fabs(anglediff)<5.0) currentPos.percent+=5.0;
-            else if (fabs(anglediff)<10.0) { /* stay constant */ }
-            else currentPos.percent *=0.99; /* disagree with estimate */
-            
-            if (currentPos.percent>100.0f) currentPos.percent=100.0f;
-        }
-    }
-   
-}
-
-/// Update this robot position based on the computer vision markers seen
-void update_from_markers(aurora::robot_loc2D &pos,const aurora::robot_coord3D &camera,const aurora::vision_marker_reports &reports,bool print)
-{
-    for (aurora::vision_marker_report report : reports)
-        if (report.is_valid())
-        {
-            // Put the marker in world coordinates
-            aurora::robot_coord3D marker_coords=camera.compose(report.coords);
-            marker_coords.percent = report.coords.percent; //<- camera is essentially fixed here
-            
-            // Sanity-check marker coordinates
-            if (marker_coords.Y.z<0.7) { // not sane
-                if (print) { printf("     Invalid marker%d: ",report.markerID); marker_coords.print(); }
-            }
-            else 
-            { 
-                // Re-estimate robot position from marker position
-                marker_update_robot_pos(pos,marker_coords,report.markerID);
-                if (print) { printf("     Marker%d: ",report.markerID); marker_coords.print(); }
-            }
-        }
-}
-
-
-// Move the robot based on wheel encoder ticks
-aurora::robot_loc2D move_robot_encoder(const aurora::robot_loc2D &pos,const aurora::drive_encoders &encoderchange)
-{
-    float wheelbase=1.9; // width in meters between tire centers (effective, including slip: actual is 1.05 meters)
-    
-    // Don't move if the encoders are stopped (save CPU and confidence loss)
-    if (encoderchange.left == 0 && encoderchange.right==0) return pos;
-    
-    aurora::robot_loc2D new2D=pos;
-    
-    // Extract position and orientation from absolute location
-    //Interesting issue, the pos used in the new iteration is not 3d cords. the vec3 is a a 3d cord stuff?
-    vec3 P=vec3(pos.x, pos.y,0.0); // position of robot (center of wheels)
-    double ang_rads=pos.angle*M_PI/180.0; // 2D rotation of robot
-
-// Reconstruct coordinate system and wheel locations 
-    vec3 FW=vec3(cos(ang_rads),sin(ang_rads),0.0); // forward vector
-    vec3 UP=vec3(0,0,1); // up vector
-    vec3 LR=FW.cross(UP); // left-to-right vector
-    vec3 wheel[2];
-    wheel[0]=P-0.5*wheelbase*LR;
-    wheel[1]=P+0.5*wheelbase*LR;
-
-//How does wheels vs tracks work?
-// Move wheels forward by specified amounts
-    float maxjump=3.0f; // < avoids huge jumps due to startup
-    if (fabs(encoderchange.left<maxjump) && fabs(encoderchange.right<maxjump)) 
-    {
-        wheel[0]+=FW*encoderchange.left;
-        wheel[1]+=FW*encoderchange.right;
-    }
-
-// Extract new robot position and orientation
-    P=(wheel[0]+wheel[1])*0.5;
-    LR=normalize(wheel[1]-wheel[0]);
-    FW=UP.cross(LR);
-    ang_rads=atan2(FW.y,FW.x);
-
-// Put back into merged absolute location
-    new2D.angle=180.0/M_PI*ang_rads;
-    new2D.x=P.x; new2D.y=P.y;
-    
-    // Lose a little confidence due to error accumulating, especially on turns
-    float turn=fabs(encoderchange.left-encoderchange.right);
-    new2D.percent=pos.percent*(1.0-0.0001f-0.001f*turn);
-    
-    return new2D;
-}
-
+#include "nanoslot/nanoslot_update.h"
+#include "localizer.h"
+#include "ekf_localizer.h"
+#include "mcl_localizer.h"
 
 // Initialize the obstacle view field for a clean startup
 void reinitialize_field(aurora::field_drivable &field) {
@@ -149,17 +36,26 @@ void reinitialize_field(aurora::field_drivable &field) {
 
 int main(int argc, const char *argv[]) {
     bool sim=false;
+    bool blend=false; // use the old blended localizer instead of the EKF
+    bool mcl=false; // use the particle filter instead of the EKF
+    bool mcl_field=false; // particle filter also uses the cartographer's field_drivable
+    mcl_params mp;
     for (int argi=1;argi<argc;argi++) {
         if (0==strcmp(argv[argi],"--sim")) { sim=true; }
+        else if (0==strcmp(argv[argi],"--blend")) { blend=true; }
+        else if (0==strcmp(argv[argi],"--mcl")) { mcl=true; }
+        else if (0==strcmp(argv[argi],"--mcl_field")) { mcl=true; mcl_field=true; }
+        else if (0==strcmp(argv[argi],"--particles") && argi+1<argc) { mcl=true; mp.particles=atoi(argv[++argi]); }
         else { printf("Unrecognized command line argument %s\n",argv[argi]); return 1; }
     }
     
     //Data sources need to read from, these are defined in lunatic.h
-    MAKE_exchange_drive_commands();
     MAKE_exchange_drive_encoders();
+    MAKE_exchange_drive_encoders_ring();
     MAKE_exchange_marker_reports_depth();
     MAKE_exchange_marker_reports_webcam();
     MAKE_exchange_backend_state();
+    MAKE_exchange_nanoslot();
 
     //Data source needed to write to, these are defined in lunatic.h
     MAKE_exchange_plan_current();
@@ -176,61 +72,110 @@ int main(int argc, const char *argv[]) {
     pos.y = 15.0; // start location
     pos.angle=90.0f;
     pos.percent=90.0f; //<- placeholder, so we can see it change
+    ekf_localizer ekf(pos,0.5,10.0,aurora::time_in_nanoseconds_monotonic());
+    if (!mcl) mp.particles=1; // not using it
+    mcl_localizer particles(pos,0.5,10.0,mp);
     
     aurora::drive_encoders lastencoder=exchange_drive_encoders.read();
-    int printcount=0; // <- moderate printing pace, for easier debugging
+    aurora::monotonic_time_t encoder_time=aurora::time_in_nanoseconds_monotonic(); // capture time of the newest encoder value
+    aurora::monotonic_time_t next_print=0; // <- moderate printing pace, for easier debugging
+    nanoslot_update_watcher watch_F1; // every slot writes the nanoslot exchange, only F1 has our IMU
     bool loc_changed=true;
     while (true) {
         bool print=false;
-        if ((printcount++%30)==0) print=true;
-        
-        if (sim) pos.percent=83.0;
+        aurora::monotonic_time_t now=aurora::time_in_nanoseconds_monotonic();
+        if (now>=next_print) { print=true; next_print=now+1000000000; }
         
-        aurora::drive_commands currentdrive = exchange_drive_commands.read();
-        
-        // Update position based on new encoder values
-        aurora::drive_encoders currentencoder = exchange_drive_encoders.read();
-        aurora::drive_encoders encoder_change = currentencoder - lastencoder;
-        if (encoder_change.left!=0 || encoder_change.right!=0) {
-            loc_changed=true;
-        }
-        aurora::robot_loc2D new2D=move_robot_encoder(pos,encoder_change);
-        pos=new2D;
-        lastencoder = currentencoder;
-        if (loc_changed) {
+        // Update position based on every new encoder value, in order,
+        //   and publish each one so the pathplanner never waits on us.
+        aurora::drive_encoders currentencoder;
+        while (exchange_drive_encoders_ring.next(currentencoder,&encoder_time)) {
+            aurora::drive_encoders encoder_change = currentencoder - lastencoder;
+            if (blend) pos=move_robot_encoder(pos,encoder_change);
+            else if (mcl) { particles.encoder(encoder_time,encoder_change); pos=particles.pos(); }
+            else { ekf.encoder(encoder_time,encoder_change); pos=ekf.pos(); }
+            lastencoder = currentencoder;
+            
+            if (sim) pos.percent=83.0;
             exchange_plan_current.write_begin() = pos;
-            exchange_plan_current.write_end();
+            exchange_plan_current.write_end(encoder_time);
             loc_changed=false;
         }
         
-        // FIXME: incorporate gyro data here?
-
+        // Drive frame IMU yaw keeps our heading from drifting between markers
+        //   (only fuse it when slot F1 posts a new reading, not when other slots write)
+        const nanoslot_slot_0xF1 &F1=exchange_nanoslot.read().slot_F1;
+        if (!blend && watch_F1.changed(F1.update)) {
+            const nanoslot_IMU_state &frame=F1.state.frame;
+            if (frame.valid) {
+                if (mcl) particles.imu(F1.update.time,frame.yaw);
+                else ekf.imu(F1.update.time,frame.yaw);
+                loc_changed=true;
+            }
+        }
 
-        // Create camera coordinate transform
-        // Camera wants robot's X axis (rotated by 90)
-        aurora::robot_loc2D  camera2D=pos;
-        camera2D.angle -= 90.0f; // robot Y instead of X axis
-        aurora::robot_coord3D robot3D=camera2D.get3D();
-        
-        // If you see a newly updated aruco marker, incorporate it into your likely position
-        aurora::robot_link_coords robot_links(exchange_backend_state.read().joint,robot3D);
-        if (exchange_marker_reports_depth.updated()) {
-            const aurora::robot_coord3D &camera=robot_links.coord3D(aurora::link_depthcam);
-            update_from_markers(pos,camera,exchange_marker_reports_depth.read(),print);
+        // If you see a newly updated aruco marker, incorporate it into your likely position.
+        //  We only need the arm joints (and the camera transforms) when a report is waiting.
+        bool depth=exchange_marker_reports_depth.updated(), webcam=exchange_marker_reports_webcam.updated();
+        if (depth || webcam) {
+            const robot_joint_state &joint=exchange_backend_state.read().joint;
+            
+            // Blending puts markers in the field now, so it wants the cameras in field coordinates;
+            //  the EKF and particles place markers at their capture time, so they want the cameras relative to the robot.
+            aurora::robot_coord3D robot3D;
+            if (blend) {
+                // Camera wants robot's X axis (rotated by 90)
+                aurora::robot_loc2D  camera2D=pos;
+                camera2D.angle -= 90.0f; // robot Y instead of X axis
+                robot3D=camera2D.get3D();
+            }
+            
+            if (depth) {
+                const aurora::vision_marker_reports &reports=exchange_marker_reports_depth.read();
+                aurora::monotonic_time_t t=exchange_marker_reports_depth.source_time();
+                aurora::robot_coord3D camera=aurora::robot_link_coords::chain_coord3D(aurora::link_depthcam,joint,robot3D);
+                if (blend) update_from_markers(pos,camera,reports,print);
+                else for (const aurora::vision_marker_report &report:reports)
+                    if (mcl) particles.marker(t,camera,report);
+                    else ekf.marker(t,camera,report);
+            }
+            if (webcam) {
+                const aurora::vision_marker_reports &reports=exchange_marker_reports_webcam.read();
+                aurora::monotonic_time_t t=exchange_marker_reports_webcam.source_time();
+                aurora::robot_coord3D camera=aurora::robot_link_coords::chain_coord3D(aurora::link_drivecam,joint,robot3D);
+                if (blend) update_from_markers(pos,camera,reports,print);
+                else for (const aurora::vision_marker_report &report:reports)
+                    if (mcl) particles.marker(t,camera,report);
+                    else ekf.marker(t,camera,report);
+            }
             loc_changed=true;
         }
-        if (exchange_marker_reports_webcam.updated()) {
-            const aurora::robot_coord3D &camera=robot_links.coord3D(aurora::link_drivecam);
-            update_from_markers(pos,camera,exchange_marker_reports_webcam.read(),print);
-            loc_changed=true;
+        
+        // We can't be inside obstacles the cartographer has seen
+        //  (only does the work after we've driven a ways, so the next encoder update publishes it)
+        if (mcl_field) particles.field(exchange_field_drivable.read());
+        
+        // Markers and IMU move the estimate we last published
+        if (loc_changed) {
+            if (!blend) pos=mcl?particles.pos():ekf.pos();
+            if (sim) pos.percent=83.0;
+            exchange_plan_current.write_begin() = pos;
+            exchange_plan_current.write_end(encoder_time);
+            loc_changed=false;
         }
             
-        if (print) { printf("Robot: "); pos.print(); }
+        if (print) { 
+            printf("Robot: "); pos.print(); 
+            if (mcl) printf("   MCL: %d particles, %.2f m, %.1f deg spread, %ld markers used, %ld resamples\n",
+                particles.size(),particles.sigma_pos(),particles.sigma_angle(),particles.markers_used,particles.resamples);
+            else if (!blend) printf("   EKF: %.2f m, %.1f deg sigma, %ld markers used, %ld rejected, %ld late\n",
+                ekf.sigma_pos(),ekf.sigma_angle(),ekf.markers_used,ekf.markers_rejected,ekf.markers_late);
+        }
         
-
-        // Limit our cycle rate (to save CPU)
-        aurora::data_exchange_sleep(30);
-
+        // Sleep until new encoder or marker data arrives.  The backend writes 
+        //  encoders every loop, so the timeout only matters when it's not running.
+        aurora::data_exchange_wait_any({&exchange_drive_encoders_ring,
+            &exchange_marker_reports_depth,&exchange_marker_reports_webcam},500);
     }
     return 0;
 }
@@ -0,0 +1,127 @@
+/*
+ Simple blended localizer: integrates the wheel encoders, and nudges
+ the position toward each computer vision marker seen.
+ Used by the localizer with --blend, and by ekf_replay for comparison.
+
+ Matt Perry & Orion Lawlor, 2019-2023 (Public Domain)
+*/
+#ifndef __AURORA_LOCALIZER_H
+#define __AURORA_LOCALIZER_H
+
+#include <iostream>
+#include <stdio.h>
+#include "aurora/lunatic.h"
+
+// The installed computer vision marker locations on the field (see lunatic.h)
+const aurora::vision_marker_reports &knownMarkers=aurora::field_markers;
+
+void marker_update_robot_pos(aurora::robot_loc2D & currentPos, const aurora::robot_coord3D & currentReportCoord,const int32_t markerID)
+{
+    for(aurora::vision_marker_report known : knownMarkers){
+         if ( markerID == known.markerID){
+            float weight=0.2; // <- blend in this much of the new report (higher=faster, more jitter).  FIXME: should depend on the confidence value or range.
+            
+            vec3 diff = known.coords.origin - currentReportCoord.origin;
+            float diffwt = weight;
+            currentPos.x += diff.x*diffwt;
+            currentPos.y+= diff.y*diffwt;
+
+            
+            float anglediff = aurora::angle_signed_diff(known.coords.extract_angle(), currentReportCoord.extract_angle());
+            float anglediffwt = weight;
+            currentPos.angle += anglediff*anglediffwt;
+            if (0) 
+            {
+                std::cout << anglediff << "= angle diff \n";
+                std::cout << known.coords.extract_angle() << " = known angle, " <<  currentReportCoord.extract_angle() << " = reported angle \n";
+            }
+            
+            // If the differences are small, we've converged and should have more confidence.
+            if (length(diff)<0.5) currentPos.percent+=5.0;
+            else if (length(diff)<1.0) { /* stay with confidence */ }
+            else currentPos.percent *=0.99;
+            
+            if (fabs(anglediff)<5.0) currentPos.percent+=5.0;
+            else if (fabs(anglediff)<10.0) { /* stay constant */ }
+            else currentPos.percent *=0.99; /* disagree with estimate */
+            
+            if (currentPos.percent>100.0f) currentPos.percent=100.0f;
+        }
+    }
+   
+}
+
+/// Update this robot position based on the computer vision markers seen
+void update_from_markers(aurora::robot_loc2D &pos,const aurora::robot_coord3D &camera,const aurora::vision_marker_reports &reports,bool print)
+{
+    for (aurora::vision_marker_report report : reports)
+        if (report.is_valid())
+        {
+            // Put the marker in world coordinates
+            aurora::robot_coord3D marker_coords=camera.compose(report.coords);
+            marker_coords.percent = report.coords.percent; //<- camera is essentially fixed here
+            
+            // Sanity-check marker coordinates
+            if (marker_coords.Y.z<0.7) { // not sane
+                if (print) { printf("     Invalid marker%d: ",report.markerID); marker_coords.print(); }
+            }
+            else 
+            { 
+                // Re-estimate robot position from marker position
+                marker_update_robot_pos(pos,marker_coords,report.markerID);
+                if (print) { printf("     Marker%d: ",report.markerID); marker_coords.print(); }
+            }
+        }
+}
+
+
+// Move the robot based on wheel encoder ticks
+aurora::robot_loc2D move_robot_encoder(const aurora::robot_loc2D &pos,const aurora::drive_encoders &encoderchange)
+{
+    float wheelbase=1.9; // width in meters between tire centers (effective, including slip: actual is 1.05 meters)
+    
+    // Don't move if the encoders are stopped (save CPU and confidence loss)
+    if (encoderchange.left == 0 && encoderchange.right==0) return pos;
+    
+    aurora::robot_loc2D new2D=pos;
+    
+    // Extract position and orientation from absolute location
+    //Interesting issue, the pos used in the new iteration is not 3d cords. the vec3 is a a 3d cord stuff?
+    vec3 P=vec3(pos.x, pos.y,0.0); // position of robot (center of wheels)
+    double ang_rads=pos.angle*M_PI/180.0; // 2D rotation of robot
+
+// Reconstruct coordinate system and wheel locations 
+    vec3 FW=vec3(cos(ang_rads),sin(ang_rads),0.0); // forward vector
+    vec3 UP=vec3(0,0,1); // up vector
+    vec3 LR=FW.cross(UP); // left-to-right vector
+    vec3 wheel[2];
+    wheel[0]=P-0.5*wheelbase*LR;
+    wheel[1]=P+0.5*wheelbase*LR;
+
+//How does wheels vs tracks work?
+// Move wheels forward by specified amounts
+    float maxjump=3.0f; // < avoids huge jumps due to startup
+    if (fabs(encoderchange.left<maxjump) && fabs(encoderchange.right<maxjump)) 
+    {
+        wheel[0]+=FW*encoderchange.left;
+        wheel[1]+=FW*encoderchange.right;
+    }
+
+// Extract new robot position and orientation
+    P=(wheel[0]+wheel[1])*0.5;
+    LR=normalize(wheel[1]-wheel[0]);
+    FW=UP.cross(LR);
+    ang_rads=atan2(FW.y,FW.x);
+
+// Put back into merged absolute location
+    new2D.angle=180.0/M_PI*ang_rads;
+    new2D.x=P.x; new2D.y=P.y;
+    
+    // Lose a little confidence due to error accumulating, especially on turns
+    float turn=fabs(encoderchange.left-encoderchange.right);
+    new2D.percent=pos.percent*(1.0-0.0001f-0.001f*turn);
+    
+    return new2D;
+}
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ Inputs for offline localizer evaluation (ekf_replay.cpp and mcl_bench.cpp):
+ read from a data exchange log recorded by lunabug's exchange_read,
+ or from a simulated robot driving around the field.
+
+ This file is Public Domain.
+*/
+#ifndef __AURORA_LOCALIZER_REPLAY_H
+#define __AURORA_LOCALIZER_REPLAY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "aurora/lunatic.h"
+#include "aurora/kinematics.h"
+#include "nanoslot/nanoslot_update.h"
+#include "../lunabug/exchange_datatypes.h"
+
+using aurora::monotonic_time_t;
+
+/* One input to the localizers */
+struct replay_event {
+    enum {ENCODER=1,IMU_YAW=2,MARKER=3,RECORDED=4} kind;
+    monotonic_time_t t; // capture time
+    monotonic_time_t arrival; // when the localizer would see it
+    aurora::drive_encoders change; // ENCODER
+    float yaw; // IMU_YAW
+    aurora::robot_coord3D camera; // MARKER: camera relative to the robot
+    aurora::vision_marker_report report; // MARKER
+    aurora::robot_loc2D pos; // RECORDED: localizer output from the log
+    bool has_truth; // simulated true pose follows
+    aurora::robot_loc2D truth;
+
+    replay_event() :t(0), arrival(0), yaw(0.0f), has_truth(false) {}
+    bool operator<(const replay_event &e) const { return arrival<e.arrival; }
+};
+
+/* Make an IMU yaw event from this copy of the nanoslot exchange, 
+   if slot F1 has posted a new drive frame reading since watch_F1 last looked.
+   Every slot writes the nanoslot exchange, so most writes aren't F1's. */
+bool nanoslot_imu_event(const nanoslot_exchange &nano,nanoslot_update_watcher &watch_F1,replay_event &e) {
+    if (!watch_F1.changed(nano.slot_F1.update)) return false;
+    const nanoslot_IMU_state &frame=nano.slot_F1.state.frame;
+    if (!frame.valid) return false;
+    e.kind=replay_event::IMU_YAW;
+    e.t=e.arrival=nano.slot_F1.update.time;
+    e.yaw=frame.yaw;
+    return true;
+}
+
+/* ----------------- Simulated robot ------------ */
+
+float noise(float scale) { return scale*((rand()%2001)-1000)*0.001f; }
+
+// Depth camera on the robot: X right, Y down, Z forward (robot link coords are X right, Y forward, Z up)
+aurora::robot_coord3D sim_camera(void) {
+    return aurora::robot_coord3D(vec3(0.0,0.5,1.0),vec3(1,0,0),vec3(0,0,-1),vec3(0,1,0),100.0);
+}
+
+// Express this world coordinate system relative to this camera
+aurora::robot_coord3D camera_relative(const aurora::robot_coord3D &camera,const aurora::robot_coord3D &world) {
+    aurora::robot_coord3D rel;
+    rel.origin=camera.local_from_world(world.origin);
+    rel.X=vec3(dot(world.X,camera.X),dot(world.X,camera.Y),dot(world.X,camera.Z));
+    rel.Y=vec3(dot(world.Y,camera.X),dot(world.Y,camera.Y),dot(world.Y,camera.Z));
+    rel.Z=vec3(dot(world.Z,camera.X),dot(world.Z,camera.Y),dot(world.Z,camera.Z));
+    rel.percent=100.0;
+    return rel;
+}
+
+/* Drive in a circle around the middle of the field, with
+   unequal wheel slip, a drifting IMU, and markers that arrive late.
+     max_range: vision only sees markers closer than this (meters)
+     mismatch: this fraction of marker reports have the wrong marker ID
+     other_slots: writes per second to the nanoslot exchange by slots other than 
+        the IMU's, which (like on the robot) shouldn't become IMU events */
+std::vector<replay_event> simulate(double seconds,double latency,aurora::robot_loc2D &start,
+    float max_range=7.0,float mismatch=0.0,int other_slots=0)
+{
+    std::vector<replay_event> events;
+    const double dt=0.02, W=1.9; // 50Hz encoders and IMU
+    const double speed=0.5, radius=3.5; // meters/sec, meters
+    const vec2 center(6.0,7.0);
+    const float slip_left=1.03, slip_right=0.98; // encoders read this much of the real travel
+    const monotonic_time_t ns=1000000000;
+    monotonic_time_t t0=1000*ns;
+    aurora::robot_coord3D camera_robot=sim_camera();
+    int markers=0; // valid field markers (they're first in the table)
+    for (const aurora::vision_marker_report &known:aurora::field_markers) if (known.is_valid()) markers++;
+    
+    // The IMU readings go through a simulated nanoslot exchange
+    std::vector<nanoslot_exchange> nano(1);
+    memset((void *)&nano[0],0,sizeof(nano[0]));
+    nanoslot_update_watcher watch_F1;
+    int other_per_step=(int)(other_slots*dt+0.5);
+
+    aurora::robot_loc2D truth(center.x+radius,center.y,90.0,100.0);
+    start=truth;
+    for (int step=1;step*dt<=seconds;step++) {
+        monotonic_time_t t=t0+(monotonic_time_t)(step*dt*ns);
+        // Wheel travel for this step along the circle (using the effective wheelbase)
+        double turn=speed*dt/radius; // radians
+        double d=speed*dt;
+        double dl=d-0.5*W*tan(turn), dr=d+0.5*W*tan(turn);
+        double th=truth.angle*M_PI/180.0;
+        truth.x+=d*cos(th); truth.y+=d*sin(th);
+        truth.angle=aurora::angle_signed_diff(truth.angle+turn*180.0/M_PI,0.0f);
+
+        replay_event e;
+        e.kind=replay_event::ENCODER;
+        e.t=e.arrival=t;
+        e.change.left=dl*slip_left*(1.0+noise(0.01));
+        e.change.right=dr*slip_right*(1.0+noise(0.01));
+        e.has_truth=true; e.truth=truth;
+        events.push_back(e);
+
+        // IMU: arbitrary zero, slowly drifting, slightly noisy
+        replay_event imu;
+        nanoslot_slot_0xF1 &F1=nano[0].slot_F1;
+        F1.state.frame.yaw=aurora::angle_signed_diff(truth.angle+40.0f+0.02f*step*dt+noise(0.3f),0.0f);
+        F1.state.frame.valid=true;
+        F1.update.time=t+5000000;
+        F1.update.sequence+=2;
+        if (nanoslot_imu_event(nano[0],watch_F1,imu)) events.push_back(imu);
+        
+        // Other slots (like the arm IMUs and load cells) keep writing in between
+        for (int w=0;w<other_per_step;w++) {
+            nanoslot_update_t &A1=nano[0].slot_A1.update;
+            A1.time=t+(monotonic_time_t)(w*dt*ns/other_per_step);
+            A1.sequence+=2;
+            if (nanoslot_imu_event(nano[0],watch_F1,imu)) events.push_back(imu);
+        }
+
+        // Markers at 5 fps, if they're in view of the depth camera
+        if (step%10==0) {
+            aurora::robot_loc2D camera2D=truth;
+            camera2D.angle-=90.0f;
+            aurora::robot_coord3D camera=camera2D.get3D().compose(camera_robot);
+            for (const aurora::vision_marker_report &known:aurora::field_markers) {
+                if (!known.is_valid()) continue;
+                vec3 rel=camera.local_from_world(known.coords.origin+vec3(0,0,0.5));
+                float range=length(rel);
+                if (rel.z<1.0f || range>max_range || fabs(rel.x)>0.7f*rel.z) continue; // out of view
+                // What vision sees: the marker upright, a little off in position and angle
+                float ang=known.coords.extract_angle()+noise(1.5f);
+                vec3 X=aurora::vec3_from_angle(ang), Y(0,0,1);
+                aurora::robot_coord3D seen(known.coords.origin+vec3(noise(0.01f*range),noise(0.01f*range),0.5),
+                    X,Y,X.cross(Y),100.0);
+                replay_event m;
+                m.kind=replay_event::MARKER;
+                m.t=t;
+                m.arrival=t+(monotonic_time_t)(latency*ns);
+                m.camera=camera_robot;
+                m.report.markerID=known.markerID;
+                if (rand()%1000<mismatch*1000) // vision mixed it up with another marker
+                    m.report.markerID=aurora::field_markers[rand()%markers].markerID;
+                m.report.coords=camera_relative(camera,seen);
+                events.push_back(m);
+            }
+        }
+    }
+    std::stable_sort(events.begin(),events.end());
+    return events;
+}
+
+
+/* ----------------- Log reading ------------ */
+
+/* Read a log from exchange_read into events, sorted by arrival time */
+bool read_log(const char *filename,std::vector<replay_event> &events,bool verbose) {
+    FILE *f=fopen(filename,"rb");
+    if (!f) { printf("Can't open log %s\n",filename); return false; }
+    std::vector<std::string> filenames;
+    std::vector<uint64_t> filesizes;
+    exchange_recv(filenames,f);
+    exchange_recv(filesizes,f);
+
+    enum {OTHER=0,ENCODERS,NANOSLOT,STATE,DEPTH,WEBCAM,PLAN};
+    std::vector<int> kinds;
+    uint64_t max_size=0;
+    for (size_t i=0;i<filenames.size();i++) {
+        std::string name=filenames[i].substr(filenames[i].rfind('/')+1);
+        int kind=OTHER;
+        uint64_t want=0;
+        if (name=="backend.encoders.ring") { kind=ENCODERS; want=sizeof(aurora::drive_encoders_ring::ondisk_t); }
+        else if (name=="nanoslot") { kind=NANOSLOT; want=sizeof(aurora::data_exchange_ondisk<nanoslot_exchange>); }
+        else if (name=="backend.state") { kind=STATE; want=sizeof(aurora::data_exchange_ondisk<aurora::backend_state>); }
+        else if (name=="vision_marker_depth.reports") { kind=DEPTH; want=sizeof(aurora::data_exchange_ondisk<aurora::vision_marker_reports>); }
+        else if (name=="vision_marker_webcam.reports") { kind=WEBCAM; want=sizeof(aurora::data_exchange_ondisk<aurora::vision_marker_reports>); }
+        else if (name=="plan_current.loc2D") { kind=PLAN; want=sizeof(aurora::data_exchange_ondisk<aurora::robot_loc2D>); }
+        if (kind!=OTHER && filesizes[i]!=want) {
+            printf("Skipping %s: %ld bytes, expected %ld (recorded with a different version?)\n",
+                name.c_str(),(long)filesizes[i],(long)want);
+            kind=OTHER;
+        }
+        if (verbose) printf("Log file %d: %s\n",(int)i,name.c_str());
+        kinds.push_back(kind);
+        max_size=std::max(max_size,filesizes[i]);
+    }
+    std::vector<char> buf(max_size);
+
+    uint64_t ring_cursor=0; // next encoder value to read
+    bool have_encoder=false;
+    aurora::drive_encoders last_encoder;
+    nanoslot_update_watcher watch_F1; // drive frame IMU readings we've seen
+    robot_joint_state joint; // from the latest backend.state
+    memset((void *)&joint,0,sizeof(joint));
+
+    while (true) {
+        uint64_t stamp, index;
+        if (1!=fread(&stamp,sizeof(stamp),1,f)) break; // end of log
+        if (1!=fread(&index,sizeof(index),1,f) || index>=filenames.size()) {
+            printf("Log record has a bad file index\n"); break;
+        }
+        if (1!=fread(&buf[0],filesizes[index],1,f)) {
+            printf("Log ended in the middle of a record\n"); break;
+        }
+        const char *mem=&buf[0];
+        replay_event e;
+        switch (kinds[index]) {
+        case ENCODERS: {
+            const aurora::drive_encoders_ring::ondisk_t &ring=*(const aurora::drive_encoders_ring::ondisk_t *)mem;
+            const int N=sizeof(ring.entries)/sizeof(ring.entries[0]);
+            if (!have_encoder || ring.head<ring_cursor) ring_cursor=ring.head?ring.head-1:0; // start at the newest value
+            if (ring.head-ring_cursor>(uint64_t)N) ring_cursor=ring.head-N;
+            for (;ring_cursor<ring.head;ring_cursor++) {
+                const aurora::drive_encoders_ring::entry_t &entry=ring.entries[ring_cursor%N];
+                if (entry.sequence!=2*ring_cursor+2) continue; // overwritten or mid-write
+                if (have_encoder) {
+                    e.kind=replay_event::ENCODER;
+                    e.t=e.arrival=entry.time;
+                    e.change=entry.data-last_encoder;
+                    events.push_back(e);
+                }
+                last_encoder=entry.data;
+                have_encoder=true;
+            }
+            break;
+        }
+        case NANOSLOT: {
+            const aurora::data_exchange_ondisk<nanoslot_exchange> &nano=*(const aurora::data_exchange_ondisk<nanoslot_exchange> *)mem;
+            if (nanoslot_imu_event(nano.data,watch_F1,e)) events.push_back(e);
+            break;
+        }
+        case STATE:
+            joint=((const aurora::data_exchange_ondisk<aurora::backend_state> *)mem)->data.joint;
+            break;
+        case DEPTH: case WEBCAM: {
+            const aurora::data_exchange_ondisk<aurora::vision_marker_reports> &reports=
+                *(const aurora::data_exchange_ondisk<aurora::vision_marker_reports> *)mem;
+            aurora::robot_link_coords links(joint);
+            e.kind=replay_event::MARKER;
+            e.arrival=reports.header.write_time;
+            e.t=reports.header.source_time?reports.header.source_time:e.arrival;
+            e.camera=links.coord3D(kinds[index]==DEPTH?aurora::link_depthcam:aurora::link_drivecam);
+            for (const aurora::vision_marker_report &report:reports.data)
+                if (report.is_valid()) {
+                    e.report=report;
+                    events.push_back(e);
+                }
+            break;
+        }
+        case PLAN: {
+            const aurora::data_exchange_ondisk<aurora::robot_loc2D> &plan=*(const aurora::data_exchange_ondisk<aurora::robot_loc2D> *)mem;
+            e.kind=replay_event::RECORDED;
+            e.t=e.arrival=plan.header.write_time;
+            e.pos=plan.data;
+            events.push_back(e);
+            break;
+        }
+        default: break;
+        }
+    }
+    fclose(f);
+    std::stable_sort(events.begin(),events.end());
+    return true;
+}
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ Benchmark the particle filter localizer (mcl_localizer.h):
+ CPU time per update for 1k, 4k, and 16k particles, on one thread and
+ on all cores, and its accuracy on the simulated drive from ekf_replay.
+
+    ./mcl_bench [--threads N] [--seconds S]
+
+ The localizer gets encoder and IMU updates at about 50Hz, and markers
+ at 5 fps per camera, so at 16k particles it needs the motion update
+ well under 20 ms on the Pi.
+
+ This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include "aurora/lunatic.h"
+#include "aurora/kinematics.h"
+#include "aurora/kinematic_links.cpp"
+#include "mcl_localizer.h"
+#include "localizer_replay.h"
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+// Time this operation, in microseconds per call
+template <class op>
+double time_us(int reps,op f) {
+    auto start=std::chrono::steady_clock::now();
+    for (int r=0;r<reps;r++) f(r);
+    return 1000.0*elapsed_ms(start)/reps;
+}
+
+/* CPU time for each kind of update with this many particles */
+void bench_updates(int particles,int threads,const aurora::field_drivable &field) {
+    mcl_params p;
+    p.particles=particles;
+    p.threads=threads;
+    p.min_per_thread=1; // use every thread we're given, to see what they buy us
+    p.field_every=0.0; // weight by the field on every call
+    aurora::robot_loc2D start(6.0,5.0,90.0);
+    mcl_localizer mcl(start,0.3,5.0,p);
+
+    // A marker 3 meters ahead of the robot, like the simulated depth camera sees it
+    aurora::robot_coord3D camera=sim_camera();
+    aurora::robot_loc2D camera2D=start;
+    camera2D.angle-=90.0f;
+    aurora::robot_coord3D world_camera=camera2D.get3D().compose(camera);
+    const aurora::vision_marker_report &known=aurora::field_markers[0];
+    vec3 X=aurora::vec3_from_angle(known.coords.extract_angle()), Y(0,0,1);
+    aurora::vision_marker_report report;
+    report.markerID=known.markerID;
+    report.coords=camera_relative(world_camera,aurora::robot_coord3D(known.coords.origin+vec3(0,0,0.5),X,Y,X.cross(Y),100.0));
+
+    const int reps=std::max(10,200000/particles);
+    aurora::monotonic_time_t t=0, ns_step=20000000;
+    aurora::drive_encoders change; change.left=0.009; change.right=0.011;
+    double encoder_us=time_us(reps,[&](int) { mcl.encoder(t+=ns_step,change); });
+    double imu_us=time_us(reps,[&](int r) { mcl.imu(t+=ns_step,90.0f+0.01f*r); });
+    double marker_us=time_us(reps,[&](int) { mcl.marker(t-ns_step,camera,report); });
+    double field_us=time_us(reps,[&](int) { mcl.encoder(t+=ns_step,change); mcl.field(field); })-encoder_us;
+    double pos_us=time_us(reps,[&](int) { mcl.pos(); });
+    printf("%6d particles, %d thread%s: encoder %7.1f us, IMU %7.1f us, marker+resample %7.1f us, field %7.1f us, estimate %7.1f us\n",
+        particles,threads,threads>1?"s":" ",encoder_us,imu_us,marker_us,field_us,pos_us);
+}
+
+/* Accuracy on the simulated drive */
+void bench_accuracy(int particles,const std::vector<replay_event> &events,aurora::robot_loc2D start) {
+    mcl_params p;
+    p.particles=particles;
+    mcl_localizer mcl(start,0.5,10.0,p);
+    double err2=0.0, angle2=0.0, ms=0.0;
+    long count=0;
+    for (const replay_event &e:events) {
+        auto start_time=std::chrono::steady_clock::now();
+        if (e.kind==replay_event::ENCODER) mcl.encoder(e.t,e.change);
+        if (e.kind==replay_event::IMU_YAW) mcl.imu(e.t,e.yaw);
+        if (e.kind==replay_event::MARKER) mcl.marker(e.t,e.camera,e.report);
+        ms+=elapsed_ms(start_time);
+        if (e.has_truth && (count++%10)==0) {
+            aurora::robot_loc2D est=mcl.pos();
+            err2+=(est.x-e.truth.x)*(est.x-e.truth.x)+(est.y-e.truth.y)*(est.y-e.truth.y);
+            float a=aurora::angle_signed_diff(est.angle,e.truth.angle);
+            angle2+=a*a;
+        }
+    }
+    long samples=(count+9)/10;
+    printf("%6d particles: %.3f m RMS, %.2f deg RMS from truth; %.1f ms CPU for %zd events\n",
+        particles,sqrt(err2/samples),sqrt(angle2/samples),ms,events.size());
+}
+
+int main(int argc,char *argv[]) {
+    int threads=std::max(1u,std::thread::hardware_concurrency());
+    double seconds=60.0;
+    for (int argi=1;argi<argc;argi++) {
+        std::string arg=argv[argi];
+        if (arg=="--threads" && argi+1<argc) threads=atoi(argv[++argi]);
+        else if (arg=="--seconds" && argi+1<argc) seconds=atof(argv[++argi]);
+        else {
+            printf("Usage: mcl_bench [--threads N] [--seconds S]\n");
+            return 1;
+        }
+    }
+
+    // Flat field with the usual fixed obstacles, and a few rocks
+    static aurora::field_drivable field;
+    field.clear(aurora::field_flat);
+    for (int r=0;r<20;r++) {
+        int cx=rand()%aurora::field_drivable::GRIDX, cy=rand()%aurora::field_drivable::GRIDY;
+        for (int y=cy-5;y<cy+5;y++) for (int x=cx-5;x<cx+5;x++)
+            if (field.in_bounds(x,y)) field.at(x,y)=aurora::field_toohigh;
+    }
+
+    printf("CPU time per update:\n");
+    int sizes[3]={1024,4096,16384};
+    for (int n:sizes) {
+        bench_updates(n,1,field);
+        if (threads>1) bench_updates(n,threads,field);
+    }
+
+    printf("Simulated drive, %.0f seconds:\n",seconds);
+    srand(1);
+    aurora::robot_loc2D truth;
+    std::vector<replay_event> events=simulate(seconds,0.25,truth);
+    truth.x+=0.3; truth.y-=0.2; truth.angle+=5.0;
+    for (int n:sizes) bench_accuracy(n,events,truth);
+    return 0;
+}
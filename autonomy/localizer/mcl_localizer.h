@@ -0,0 +1,460 @@
+/*
+ Monte Carlo (particle filter) localizer, for driving with few markers
+ in view: each particle is one guess of the robot's pose, so a bad
+ marker match only costs the particles it doesn't fit, and the filter
+ can hold several hypotheses until the next marker sorts them out.
+
+ Particles are stored as separate arrays (structure of arrays), with the
+ heading as a cos/sin unit vector, so the encoder motion update and the
+ marker likelihood are plain float math over the arrays that the
+ compiler vectorizes (no trig per particle).  Marker weighting,
+ cartographer field weighting, and systematic resampling are split
+ across threads for big particle counts.
+
+ When the markers stop fitting any particles, we add a few particles
+ around the pose the marker implies (augmented MCL), so we can recover
+ from being lost or from a bad match.
+
+ This header doesn't need OpenCV or a camera (see mcl_bench.cpp).
+
+ This file is Public Domain.
+*/
+#ifndef __AURORA_MCL_LOCALIZER_H
+#define __AURORA_MCL_LOCALIZER_H
+
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <algorithm>
+#include "aurora/lunatic.h"
+#include "ekf_localizer.h" /* for marker_implied_pose */
+
+/* Tuning parameters.  Distances in meters, angles in degrees. */
+struct mcl_params {
+    int particles=4096; // number of particles
+    int threads=0; // threads for weighting and resampling (0: all cores)
+    int min_per_thread=2048; // particles per thread, below this we use fewer threads
+    double wheelbase=1.9; // effective wheelbase, including slip (same as move_robot_encoder)
+    double maxjump=3.0; // ignore encoder changes bigger than this (startup glitches)
+    double wheel_noise=0.03; // wheel travel random walk (meters per sqrt(meter) of travel)
+    double imu_noise=0.2; // IMU turn error per reading (deg)
+    double imu_max_fix=10.0; // ignore IMU turns that differ from the encoders' by more than this (deg)
+    double imu_sign=1.0; // IMU yaw direction relative to our heading (+1 for counterclockwise)
+    double history_seconds=2.0; // keep odometry this long, for late markers
+    double marker_pos_noise=0.1; // marker position error (meters)
+    double marker_pos_range=0.05; // plus this many meters per meter of range
+    double marker_angle_noise=3.0; // marker angle error (deg)
+    double marker_angle_range=1.0; // plus this many degrees per meter of range
+    double marker_outlier=0.01; // likelihood floor, so one bad marker can't wipe out the right particles
+    double field_every=0.25; // weight by the cartographer's field after this much travel (meters)
+    double field_blocked=0.2; // likelihood of sitting on an obstacle or fixed object
+    double field_outside=0.02; // likelihood of being outside the field
+    double resample_fraction=0.5; // resample when the effective particle count drops below this fraction
+    double recover_fast=0.2, recover_slow=0.02; // averaging rates for the marker fit (augmented MCL)
+    double recover_fit=0.1; // starting long term marker fit (typical fit when we're not lost)
+    double recover_sigma_pos=0.3; // spread of recovery particles around the marker's pose (meters)
+    double recover_sigma_angle=5.0; // (deg)
+    double percent_pos=1.0; // percent confidence drops by 1/e for this much position spread (meters)
+    double percent_angle=30.0; // and for this much heading spread (deg)
+};
+
+class mcl_localizer {
+public:
+    mcl_params params;
+
+    // Statistics
+    long markers_used=0, resamples=0, recovered=0;
+
+    /* Start with particles spread around this location (meters and degrees) */
+    mcl_localizer(const aurora::robot_loc2D &start=aurora::robot_loc2D(5.0,15.0,90.0),
+        double sigma_pos=0.5,double sigma_angle=10.0,const mcl_params &p=mcl_params())
+        :params(p)
+    {
+        reset(start,sigma_pos,sigma_angle);
+    }
+
+    void reset(const aurora::robot_loc2D &start,double sigma_pos,double sigma_angle) {
+        int n=params.particles;
+        x.resize(n); y.resize(n); c.resize(n); s.resize(n); w.resize(n);
+        spread(0,n,start,sigma_pos,sigma_angle);
+        for (int i=0;i<n;i++) w[i]=1.0f/n;
+        w_fast=w_slow=params.recover_fit;
+        travel=0.0;
+        have_recovery=false;
+        odom.clear();
+        have_imu=false;
+    }
+
+    int size(void) const { return x.size(); }
+
+    /* Move every particle by this encoder change (meters of travel per side)
+       at this time, each with its own wheel noise. */
+    void encoder(aurora::monotonic_time_t t,const aurora::drive_encoders &change) {
+        float dl=change.left, dr=change.right;
+        if (dl==0 && dr==0) return;
+        if (!(fabs(dl)<params.maxjump && fabs(dr)<params.maxjump)) return; // startup glitch
+        if (fabs(dr-dl)>0.25*params.wheelbase) { // too much turn for our small angle math: split it
+            aurora::drive_encoders half=change;
+            half.left*=0.5; half.right*=0.5;
+            encoder(t,half); encoder(t,half);
+            return;
+        }
+        move_odometry(t,0.5*(dl+dr),atan2(dr-dl,params.wheelbase));
+        // Irwin-Hall: the sum of 4 uniforms in [-1,1] has variance 4/3
+        float nl=params.wheel_noise*sqrt(fabs(dl)*0.75f), nr=params.wheel_noise*sqrt(fabs(dr)*0.75f);
+        float invW=1.0f/params.wheelbase;
+        uint32_t seed=next_seed();
+        int n=size();
+        float *px=&x[0], *py=&y[0], *pc=&c[0], *ps=&s[0];
+        for (int i=0;i<n;i++) { // vectorized
+            float l=dl+nl*noise4(seed,2*i);
+            float r=dr+nr*noise4(seed,2*i+1);
+            float d=0.5f*(l+r);
+            float a=(r-l)*invW; // turn angle: tan(a)=(r-l)/W, and a is small
+            a=a-a*a*a*(1.0f/3.0f);
+            float ci=pc[i], si=ps[i];
+            px[i]+=d*ci;
+            py[i]+=d*si;
+            rotate(pc[i],ps[i],a);
+        }
+        travel+=fabs(0.5f*(dl+dr))+0.5f*fabs(dr-dl);
+    }
+
+    /* Drive frame IMU yaw (degrees) at this time.  The IMU's zero drifts,
+       but it measures turns better than the slipping wheels, so we
+       replace the encoders' turn since the last reading with the IMU's.
+       A reading that isn't newer than the last one is ignored: applying
+       the same yaw again would just add noise and spread the particles. */
+    void imu(aurora::monotonic_time_t t,float yaw) {
+        if (have_imu && t<=imu_t) return; // repeated or out of order reading
+        double th=odom.empty()?0.0:odom.back().th;
+        double yaw_rad=params.imu_sign*yaw*M_PI/180.0;
+        if (have_imu) {
+            double fix=wrap((yaw_rad-imu_last)-(th-imu_odom_last));
+            if (fabs(fix)<params.imu_max_fix*M_PI/180.0) {
+                float n=params.imu_noise*M_PI/180.0*sqrt(0.75);
+                uint32_t seed=next_seed();
+                int count=size();
+                float *pc=&c[0], *ps=&s[0];
+                for (int i=0;i<count;i++) // vectorized
+                    rotate(pc[i],ps[i],fix+n*noise4(seed,i));
+                move_odometry(t,0.0,fix);
+                th+=fix;
+            }
+        }
+        have_imu=true;
+        imu_t=t;
+        imu_last=yaw_rad;
+        imu_odom_last=th;
+    }
+
+    /* Weight the particles by how well they fit this marker report, captured at time t.
+         camera_robot: camera location on the robot, in robot link coordinates
+           (from robot_link_coords with an identity frame: X right, Y forward, Z up)
+       The particles have moved since the capture, so we move the marker
+       back by our odometry since then.  Returns false if the report isn't usable. */
+    bool marker(aurora::monotonic_time_t t,const aurora::robot_coord3D &camera_robot,const aurora::vision_marker_report &report) {
+        const aurora::vision_marker_report *known=0;
+        for (const aurora::vision_marker_report &k:aurora::field_markers)
+            if (k.is_valid() && k.markerID==report.markerID) known=&k;
+        if (!known || !report.is_valid()) return false;
+
+        // Marker relative to the robot: the same for every particle
+        aurora::robot_coord3D m=camera_robot.compose(report.coords);
+        if (m.Y.z<0.7) return false; // not sane: marker isn't upright
+        float ulen=sqrt(m.X.x*m.X.x+m.X.y*m.X.y);
+        if (ulen<0.1f) return false;
+        marker_fit f;
+        f.mx=m.origin.x; f.my=m.origin.y;
+        f.ux=m.X.x/ulen; f.uy=m.X.y/ulen;
+        since_capture(t,f);
+        f.kx=known->coords.origin.x; f.ky=known->coords.origin.y;
+        float ka=known->coords.extract_angle()*M_PI/180.0;
+        f.kc=cos(ka); f.ks=sin(ka);
+        float range=length(report.coords.origin);
+        float sp=params.marker_pos_noise+params.marker_pos_range*range;
+        float sa=(params.marker_angle_noise+params.marker_angle_range*range)*M_PI/180.0;
+        f.pos_scale=-0.5f/(sp*sp);
+        f.angle_scale=-1.0f/(sa*sa); // 2(1-cos e) is about e^2
+        f.outlier=params.marker_outlier;
+
+        // Weight each particle (in parallel), and average the fit
+        std::vector<double> fit(thread_count());
+        parallel(fit.size(),[&](int t,int start,int end) {
+            fit[t]=weigh_marker(f,start,end);
+        });
+        double avg=0.0;
+        for (double v:fit) avg+=v;
+
+        // Remember where this marker says we are, for recovery
+        aurora::robot_loc2D best=pos();
+        have_recovery=marker_implied_pose(best,camera_robot,report,recovery);
+        w_fast+=params.recover_fast*(avg-w_fast);
+        w_slow+=params.recover_slow*(avg-w_slow);
+
+        markers_used++;
+        normalize_and_resample(recover_count()>0);
+        return true;
+    }
+
+    /* Weight the particles by the cartographer's view of the field:
+       we can't be sitting inside obstacles, or outside the field.
+       Only does the work after we've driven field_every meters. */
+    void field(const aurora::field_drivable &field) {
+        if (travel<params.field_every) return;
+        travel=0.0;
+        parallel(thread_count(),[&](int,int start,int end) {
+            weigh_field(field,start,end);
+        });
+        normalize_and_resample();
+    }
+
+    /* Best estimate (weighted mean), with percent from the particle spread */
+    aurora::robot_loc2D pos(void) const {
+        double sw=0, sx=0, sy=0, sc=0, ss=0;
+        int n=size();
+        for (int i=0;i<n;i++) {
+            sw+=w[i]; sx+=w[i]*x[i]; sy+=w[i]*y[i]; sc+=w[i]*c[i]; ss+=w[i]*s[i];
+        }
+        aurora::robot_loc2D p(sx/sw,sy/sw,atan2(ss,sc)*180.0/M_PI);
+        double vx=0, vy=0;
+        for (int i=0;i<n;i++) {
+            vx+=w[i]*(x[i]-p.x)*(x[i]-p.x); vy+=w[i]*(y[i]-p.y)*(y[i]-p.y);
+        }
+        last_sigma_pos=sqrt(0.5*(vx+vy)/sw);
+        double R=std::min(1.0,sqrt(sc*sc+ss*ss)/sw); // mean resultant length
+        last_sigma_angle=sqrt(-2.0*log(std::max(R,1.0e-6)))*180.0/M_PI;
+        p.percent=100.0*exp(-(last_sigma_pos/params.percent_pos+last_sigma_angle/params.percent_angle));
+        return p;
+    }
+
+    /* Spread of the particles, as of the last call to pos(): meters and degrees */
+    double sigma_pos(void) const { return last_sigma_pos; }
+    double sigma_angle(void) const { return last_sigma_angle; }
+
+private:
+    std::vector<float> x,y; // particle positions (meters)
+    std::vector<float> c,s; // particle headings, as cos and sin
+    std::vector<float> w; // particle weights
+    std::vector<float> nx,ny,nc,ns; // resampling output
+    std::vector<double> cumulative; // resampling: running total of weights
+    double w_fast, w_slow; // short and long term average marker fit
+    double travel; // meters driven since the last field weighting
+
+    /* Dead-reckoned robot motion, to move late markers up to now */
+    struct odometry {
+        aurora::monotonic_time_t t;
+        double x,y,th; // meters and radians, in an arbitrary frame
+    };
+    std::deque<odometry> odom;
+    bool have_imu=false;
+    aurora::monotonic_time_t imu_t=0; // time of the last IMU reading
+    double imu_last=0.0, imu_odom_last=0.0; // radians: last IMU yaw, and our odometry heading then
+    uint32_t seed_counter=0;
+    bool have_recovery; // recovery is where the last marker says we are
+    aurora::robot_loc2D recovery;
+    mutable double last_sigma_pos=0.0, last_sigma_angle=0.0;
+
+    /* Marker weighting constants, in the field */
+    struct marker_fit {
+        float mx,my; // marker position relative to the robot (robot link coordinates)
+        float ux,uy; // marker X direction relative to the robot (unit length)
+        float kx,ky; // known marker position on the field
+        float kc,ks; // known marker X direction on the field
+        float pos_scale, angle_scale; // -1/(2 sigma^2) for position and angle
+        float outlier; // likelihood floor
+    };
+
+    /* Multiply in the marker likelihood for particles start..end-1.
+       Returns the new total weight (the weighted average likelihood, if the weights were normalized). */
+    double weigh_marker(const marker_fit &f,int start,int end) {
+        const float *px=&x[0], *py=&y[0], *pc=&c[0], *ps=&s[0];
+        float *pw=&w[0];
+        float sum=0.0f;
+        for (int i=start;i<end;i++) { // vectorized, except expf
+            // Robot link coordinates: X is the robot's right (s,-c), Y its forward (c,s)
+            float ci=pc[i], si=ps[i];
+            float ex=px[i]+si*f.mx+ci*f.my-f.kx;
+            float ey=py[i]-ci*f.mx+si*f.my-f.ky;
+            float dx=si*f.ux+ci*f.uy, dy=-ci*f.ux+si*f.uy; // marker direction on the field
+            float cosang=dx*f.kc+dy*f.ks;
+            float ll=f.pos_scale*(ex*ex+ey*ey)+f.angle_scale*(1.0f-cosang);
+            float like=expf(ll)+f.outlier;
+            pw[i]*=like;
+            sum+=pw[i];
+        }
+        return sum;
+    }
+
+    /* Multiply in the field likelihood for particles start..end-1 */
+    void weigh_field(const aurora::field_drivable &field,int start,int end) {
+        const float cell=100.0f/aurora::field_drivable::GRIDSIZE; // cells per meter
+        for (int i=start;i<end;i++) {
+            int gx=(int)floorf(x[i]*cell), gy=(int)floorf(y[i]*cell);
+            float like=1.0f;
+            if (!field.in_bounds(gx,gy)) like=params.field_outside;
+            else {
+                unsigned char v=field.at(gx,gy);
+                if (v!=aurora::field_unknown && v<aurora::field_driveable) like=params.field_blocked;
+            }
+            w[i]*=like;
+        }
+    }
+
+    /* Normalize the weights, and resample if too few particles carry the weight */
+    void normalize_and_resample(bool force=false) {
+        int n=size();
+        double total=0.0, total2=0.0;
+        for (int i=0;i<n;i++) { total+=w[i]; total2+=(double)w[i]*w[i]; }
+        if (!(total>0.0)) { // every particle is impossible: start over around the marker
+            if (have_recovery) spread(0,n,recovery,params.recover_sigma_pos,params.recover_sigma_angle);
+            for (int i=0;i<n;i++) w[i]=1.0f/n;
+            recovered+=n;
+            return;
+        }
+        float inv=1.0/total;
+        for (int i=0;i<n;i++) w[i]*=inv;
+        double neff=total*total/total2;
+        if (force || neff<params.resample_fraction*n) resample();
+    }
+
+    /* Systematic resampling: one random offset, then evenly spaced picks
+       through the cumulative weights.  Each thread builds a chunk of the output. */
+    void resample(void) {
+        int n=size();
+        nx.resize(n); ny.resize(n); nc.resize(n); ns.resize(n);
+        cumulative.resize(n);
+        double sum=0.0;
+        for (int i=0;i<n;i++) { sum+=w[i]; cumulative[i]=sum; }
+
+        int inject=recover_count();
+        int keep=n-inject;
+
+        double u0=uniform(next_seed(),0)*sum/keep;
+        double step=sum/keep;
+        parallel(thread_count(),[&](int,int start,int end) {
+            if (start>=keep) return;
+            end=std::min(end,keep);
+            double u=u0+start*step;
+            int j=std::lower_bound(cumulative.begin(),cumulative.end(),u)-cumulative.begin();
+            for (int i=start;i<end;i++,u+=step) {
+                while (j<n-1 && cumulative[j]<u) j++;
+                nx[i]=x[j]; ny[i]=y[j]; nc[i]=c[j]; ns[i]=s[j];
+            }
+        });
+        x.swap(nx); y.swap(ny); c.swap(nc); s.swap(ns);
+        if (inject>0) {
+            spread(keep,n,recovery,params.recover_sigma_pos,params.recover_sigma_angle);
+            recovered+=inject;
+            w_fast=w_slow; // give the new particles time to prove themselves
+        }
+        for (int i=0;i<n;i++) w[i]=1.0f/n;
+        resamples++;
+    }
+
+    static double wrap(double a) { // to -pi .. +pi
+        while (a>M_PI) a-=2.0*M_PI;
+        while (a<-M_PI) a+=2.0*M_PI;
+        return a;
+    }
+
+    /* Rotate this unit vector by a small angle a (radians) */
+    static inline void rotate(float &c,float &s,float a) {
+        float ca=1.0f-0.5f*a*a, sa=a-a*a*a*(1.0f/6.0f);
+        float cn=c*ca-s*sa, sn=s*ca+c*sa;
+        float k=1.5f-0.5f*(cn*cn+sn*sn); // one Newton step back to unit length
+        c=cn*k; s=sn*k;
+    }
+
+    /* Add this motion (forward meters, then turn radians) to our odometry */
+    void move_odometry(aurora::monotonic_time_t t,double d,double turn) {
+        odometry o={t,0.0,0.0,0.0};
+        if (!odom.empty()) o=odom.back();
+        o.t=std::max(o.t,t);
+        o.x+=d*cos(o.th); o.y+=d*sin(o.th);
+        o.th+=turn;
+        odom.push_back(o);
+        while (odom.size()>2 && odom.front().t<o.t-(aurora::monotonic_time_t)(params.history_seconds*1.0e9))
+            odom.pop_front();
+    }
+
+    /* Move this marker (relative to the robot when it was captured at time t)
+       to be relative to the robot now */
+    void since_capture(aurora::monotonic_time_t t,marker_fit &f) const {
+        if (odom.empty() || t>=odom.back().t) return;
+        size_t i=odom.size()-1;
+        while (i>0 && odom[i-1].t>t) i--;
+        // Odometry from before the capture, to the latest
+        const odometry &a=(i>0)?odom[i-1]:odom[0], &b=odom.back();
+        double ca=cos(a.th), sa=sin(a.th);
+        double bx=b.x-a.x, by=b.y-a.y;
+        double fwd=ca*bx+sa*by, left=-sa*bx+ca*by; // where we are now, in capture robot coords
+        double turn=b.th-a.th, ct=cos(turn), st=sin(turn);
+        // Robot link coordinates: X is right (-left), Y is forward
+        double mf=f.my-fwd, ml=-f.mx-left;
+        f.my=ct*mf+st*ml; f.mx=-(-st*mf+ct*ml);
+        double uf=f.uy, ul=-f.ux;
+        f.uy=ct*uf+st*ul; f.ux=-(-st*uf+ct*ul);
+    }
+
+    /* Augmented MCL: if markers fit worse lately than usual, we replace
+       this many particles with guesses around the marker's pose */
+    int recover_count(void) const {
+        if (!have_recovery || !(w_slow>0.0)) return 0;
+        return (int)(size()*std::max(0.0,std::min(0.25,1.0-w_fast/w_slow)));
+    }
+
+    /* Put particles start..end-1 randomly around this pose */
+    void spread(int start,int end,const aurora::robot_loc2D &center,double sigma_pos,double sigma_angle) {
+        uint32_t seed=next_seed();
+        float sp=sigma_pos*sqrt(0.75), sa=sigma_angle*M_PI/180.0*sqrt(0.75);
+        for (int i=start;i<end;i++) {
+            x[i]=center.x+sp*noise4(seed,3*i);
+            y[i]=center.y+sp*noise4(seed,3*i+1);
+            float a=center.angle*M_PI/180.0+sa*noise4(seed,3*i+2);
+            c[i]=cos(a); s[i]=sin(a);
+        }
+    }
+
+    /* Random numbers: a hash of (seed, index), so loops over particles vectorize
+       and threads don't share any random number state. */
+    uint32_t next_seed(void) { return hash(++seed_counter*0x9E3779B9u); }
+    static inline uint32_t hash(uint32_t v) {
+        v^=v>>16; v*=0x7feb352du;
+        v^=v>>15; v*=0x846ca68bu;
+        v^=v>>16;
+        return v;
+    }
+    // Uniform in [0,1)
+    static inline float uniform(uint32_t seed,uint32_t i) {
+        return (hash(seed+i*0x9E3779B9u)>>8)*(1.0f/16777216.0f);
+    }
+    // Roughly Gaussian, mean 0 and variance 4/3: sum of four uniforms in [-1,1]
+    static inline float noise4(uint32_t seed,uint32_t i) {
+        uint32_t h1=hash(seed^(i*0x9E3779B9u)), h2=hash(h1+0x632BE5ABu);
+        float a=(int32_t)(h1&0xffff)-32768, b=(int32_t)(h1>>16)-32768;
+        float c=(int32_t)(h2&0xffff)-32768, d=(int32_t)(h2>>16)-32768;
+        return (a+b+c+d)*(1.0f/32768.0f);
+    }
+
+    int thread_count(void) const {
+        int t=params.threads>0?params.threads:std::max(1u,std::thread::hardware_concurrency());
+        return std::max(1,std::min(t,size()/std::max(1,params.min_per_thread)));
+    }
+
+    /* Run f(thread,start,end) over nthreads even chunks of the particles */
+    template <class chunk_function>
+    void parallel(int nthreads,chunk_function f) {
+        int n=size();
+        if (nthreads<=1) { f(0,0,n); return; }
+        std::vector<std::thread> workers;
+        for (int t=1;t<nthreads;t++)
+            workers.push_back(std::thread(f,t,(int)((long)n*t/nthreads),(int)((long)n*(t+1)/nthreads)));
+        f(0,0,(int)((long)n/nthreads));
+        for (std::thread &t:workers) t.join();
+    }
+};
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ Print the write rate and age of every channel in /tmp/data_exchange,
+ using the write timestamps in each file's header.  Handy for spotting
+ stalled or slow processes:
+    exchange_age
+    exchange_age /tmp/data_exchange/backend.state /tmp/data_exchange/field_raw.grid
+*/
+#include <memory>
+#include <vector>
+#include <dirent.h>
+#include <algorithm>
+#include "aurora/data_exchange.h"
+using namespace aurora;
+
+// Watches the header of one exchange file
+class exchange_header_watcher {
+public:
+    std::string name;
+    data_exchange_mmap mmap;
+    const data_exchange_disk_header *head;
+    uint32_t last_updates;
+    
+    exchange_header_watcher(const std::string &dir,const std::string &name_,size_t file_size)
+        :name(name_), mmap((dir+name).c_str(),file_size,true),
+         head((const data_exchange_disk_header *)mmap.mem),
+         last_updates(head->updates)
+    {}
+};
+
+// Return the length of this file, or 0 if it's not there
+size_t read_file_size(const std::string &filename)
+{
+    struct stat st;
+    if (0!=stat(filename.c_str(),&st)) return 0;
+    return st.st_size;
+}
+
+int main(int argc,char *argv[]) {
+    double interval=1.0; // seconds between reports
+    std::string dir=DATA_EXCHANGE_DIR;
+    std::vector<std::string> names;
+    
+    for (int i=1;i<argc;i++) {
+        std::string arg=argv[i];
+        if (arg=="--interval") interval=atof(argv[++i]);
+        else { // a specific file to watch
+            size_t slash=arg.rfind('/');
+            if (slash!=std::string::npos) {
+                dir=arg.substr(0,slash+1);
+                arg=arg.substr(slash+1);
+            }
+            names.push_back(arg);
+        }
+    }
+    
+    if (names.size()==0) 
+    { // watch everything in the directory
+        DIR *d=opendir(dir.c_str());
+        if (!d) { printf("Can't open data exchange directory %s\n",dir.c_str()); return 1; }
+        while (struct dirent *e=readdir(d)) 
+            if (e->d_name[0]!='.') names.push_back(e->d_name);
+        closedir(d);
+        std::sort(names.begin(),names.end());
+    }
+    
+    std::vector<std::unique_ptr<exchange_header_watcher> > watchers;
+    for (const std::string &name:names) {
+        size_t file_size=read_file_size(dir+name);
+        if (file_size<sizeof(data_exchange_disk_header)+sizeof(data_exchange_disk_footer)) continue; // not an exchange (e.g., the doorbell)
+        watchers.push_back(std::make_unique<exchange_header_watcher>(dir,name,file_size));
+        if (watchers.back()->head->layout != data_exchange_disk_header::layout_value
+         || watchers.back()->head->T_size > file_size) watchers.pop_back(); // not an exchange either
+    }
+    if (watchers.size()==0) { printf("No data exchange files found in %s\n",dir.c_str()); return 1; }
+    
+    while (true) {
+        data_exchange_sleep((int)(interval*1000));
+        
+        monotonic_time_t now=time_in_nanoseconds_monotonic();
+        printf("\n%-28s %10s %12s %12s\n","channel","writes/s","age (ms)","data age (ms)");
+        for (auto &w:watchers) {
+            uint32_t updates=w->head->updates;
+            double rate=(uint32_t)(updates-w->last_updates)*0.5/interval; // seqlock: 2 per write
+            w->last_updates=updates;
+            
+            monotonic_time_t write_time=w->head->write_time;
+            monotonic_time_t source_time=w->head->source_time;
+            printf("%-28s %10.1f ",w->name.c_str(),rate);
+            if (write_time==0) printf("%12s ","never");
+            else printf("%12.1f ",(now-write_time)*1.0e-6);
+            if (source_time==0) printf("%12s\n","-");
+            else printf("%12.1f\n",(now-source_time)*1.0e-6);
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
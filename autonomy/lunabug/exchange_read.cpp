@@ -13,8 +13,9 @@ size_t read_file_T_size(const char *filename)
     FILE *f=fopen(filename,"rb");
     if (!f) return 0;
     data_exchange_disk_header head;
-    if (1!=fread(&head,sizeof(head),1,f)) return 0;
+    size_t len=fread(&head,sizeof(head),1,f);
     fclose(f);
+    if (len!=1 || head.layout!=data_exchange_disk_header::layout_value) return 0; // not ours
     return head.T_size;
 }
 
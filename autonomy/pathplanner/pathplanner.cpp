@@ -2,25 +2,37 @@
   The path planner takes a target, and plans a safe path to drive to it.
 */
 #include "pathplanner.h"
+#include "plan_record.h"
 #include <iostream>
 #include <stdio.h>
+#include <chrono>
 #include "aurora/data_exchange.h"
 #include "aurora/lunatic.h"
 
 
 int main(int argc,char *argv[]) {
-    int delaytime=500; // <- delay, in ms, between planning runs.  Higher: less CPU, less jittery
+    int delaytime=500; // <- max delay, in ms, waiting for new data between planning runs
+    bool debug_dump=false; // write debug_nav.txt every plan (slow)
+    plan_recorder *recorder=0; // --record: save planning problems for plan_bench
+    double anytime_ms=0.0; // --anytime: planning time budget in ms (0 for plain A*)
+    bool dstar=false; // --dstar: use the incremental D* Lite planner
     for (int argi=1;argi<argc;argi++) {
       std::string arg=argv[argi];
       if (arg=="--lag") delaytime=atoi(argv[++argi]); 
+      else if (arg=="--debug") debug_dump=true;
+      else if (arg=="--record") recorder=new plan_recorder(argv[++argi]);
+      else if (arg=="--anytime") anytime_ms=atof(argv[++argi]);
+      else if (arg=="--dstar") dstar=true;
       else {
         std::cerr<<"Unknown argument '"<<arg<<"'.  Exiting.\n";
         return 1;
       }
     }
 
-    //Make the pathplanning object
-    robot_autodriver autodriver;
+    //Make the pathplanning object (static, it's too big for the stack)
+    static robot_autodriver autodriver;
+    autodriver.anytime_budget_ms=anytime_ms;
+    autodriver.use_dstar=dstar;
 
     //Data sources need to write to, these are defined by lunatic.h for what files we will be communicating through
     MAKE_exchange_drive_commands();
@@ -30,6 +42,13 @@ int main(int argc,char *argv[]) {
     MAKE_exchange_plan_target();
     MAKE_exchange_plan_current();
     MAKE_exchange_field_drivable();
+    static aurora::field_drivable field; // our copy of the field (static, it's too big for the stack)
+    bool field_pending=false; // the cartographer kept writing while we copied: try again
+
+    // Replan timing, printed once a second (poses arrive at 50Hz)
+    int replans=0;
+    double replan_ms=0.0, replan_max_ms=0.0;
+    auto last_report=std::chrono::steady_clock::now();
 
     while (true) {
         bool try_plan=exchange_plan_current.updated() || exchange_plan_target.updated();
@@ -37,10 +56,15 @@ int main(int argc,char *argv[]) {
         if (target.valid()) { // we have a valid target
             aurora::robot_loc2D current = exchange_plan_current.read();
             
-            if (exchange_field_drivable.updated()) 
-            { // New field obstacles detected: update driver
-                autodriver.update_field(exchange_field_drivable.read());
-                try_plan=true;
+            auto start=std::chrono::steady_clock::now();
+            if (exchange_field_drivable.updated() || field_pending) 
+            { // New field obstacles detected: update driver from a consistent copy
+                field_pending=!exchange_field_drivable.read_consistent(field);
+                if (!field_pending) {
+                    autodriver.update_field(field);
+                    if (recorder) recorder->record_field(field);
+                    try_plan=true;
+                }
             }
             
             if (try_plan)
@@ -50,9 +74,15 @@ int main(int argc,char *argv[]) {
                 
                 aurora::path_plan debug; 
                 debug.plan_len=0;
+                debug.suboptimality=0.0;
                 
-                autodriver.debug_dump();
-                if (autodriver.autodrive(current, target, newDrive,debug))
+                if (debug_dump) autodriver.debug_dump();
+                if (recorder) recorder->record_plan(current,target);
+                bool planned=autodriver.autodrive(current, target, newDrive,debug);
+                double ms=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+                if (debug_dump) printf("Replan took %.1f ms\n",ms);
+                replans++; replan_ms+=ms; replan_max_ms=std::max(replan_max_ms,ms);
+                if (planned)
                 {
                     exchange_drive_commands.write_begin() = newDrive;
                     exchange_drive_commands.write_end();
@@ -63,8 +93,17 @@ int main(int argc,char *argv[]) {
             }
         }
 
-        //Sleep? Forced latency?
-        aurora::data_exchange_sleep(delaytime);
+        auto now=std::chrono::steady_clock::now();
+        if (replans>0 && now-last_report>std::chrono::seconds(1)) {
+            printf("%d replans: mean %.1f ms, max %.1f ms\n",replans,replan_ms/replans,replan_max_ms);
+            fflush(stdout);
+            replans=0; replan_ms=replan_max_ms=0.0;
+            last_report=now;
+        }
+
+        // Sleep until our position, target, or field changes
+        aurora::data_exchange_wait_any({&exchange_plan_current,
+            &exchange_plan_target,&exchange_field_drivable},delaytime);
     }
     return 0;
 }
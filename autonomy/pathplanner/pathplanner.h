@@ -22,8 +22,29 @@ public:
   int replan_counter;
   
   aurora::field_drivable last_field;
+  uint64_t field_epoch; // epoch and version of the last field we updated from
+  uint32_t field_version;
+  
+  // If positive, plan with the anytime planner, spending at most this many ms per call.
+  double anytime_budget_ms;
+  rmc_navigator::anytime_planner anytime;
+  
+  // If true, plan with the incremental D* Lite planner.
+  bool use_dstar;
+  rmc_navigator::dstar_planner dstar;
+  
+  aurora::robot_navtarget search_target; // target of the search the planners keep between calls
+  
+  // Several field pixels land in each navigator cell.  
+  //   This counts the obstacle field pixels in each navigator cell,
+  //   so we know when the last one goes away.
+  rmc_navigator::navigator_t::grid2D<unsigned char> obstacle_pixels;
+  
+  enum {obstacle_height=30}; // height, in cm, of obstacles from the field
 
   robot_autodriver()
+    :anytime_budget_ms(0.0), anytime(navigator.navigator),
+     use_dstar(false), dstar(navigator.navigator)
   {
     flush_field();
     flush_path();
@@ -34,39 +55,67 @@ public:
   // Clear all stored obstacles, so we start from zero
   void flush_field() {
     last_field.clear(0);
+    field_epoch=~(uint64_t)0; // no real epoch: next update looks at every tile
+    field_version=0;
+    obstacle_pixels.clear(0);
     
-    navigator=rmc_navigator(); // reinitialize the navigator
+    navigator.clear_obstacles();
+  }
+  
+  // Return true if these targets are the same
+  static bool same_target(const aurora::robot_navtarget &a,const aurora::robot_navtarget &b) {
+    return a.x==b.x && a.y==b.y && a.angle==b.angle &&
+      a.error.x==b.error.x && a.error.y==b.error.y && a.error.angle==b.error.angle;
+  }
+  
+  // Return true if this field pixel value is an obstacle
+  static bool is_obstacle(int fp) {
+    return fp>aurora::field_unknown && fp<aurora::field_driveable;
   }
   
+  // Update the navigator to match this new field.
+  //   Only the field tiles the cartographer changed since the last update get
+  //   looked at, only field pixels that changed get touched,
+  //   and proximity is only recomputed around the navigator cells that changed.
   void update_field(const aurora::field_drivable &f) {
-    flush_field(); //<- otherwise it will never forget any obstacle
-    
-    for (int y=0;y<aurora::field_drivable::GRIDY;y++)
-    for (int x=0;x<aurora::field_drivable::GRIDX;x++)
-    {
+    f.for_each_changed_tile(field_epoch,field_version,[&](int t) {
+      int x0,y0,x1,y1; obstacle_grid::tile_bounds(t,x0,y0,x1,y1);
+      for (int y=y0;y<y1;y++)
+      for (int x=x0;x<x1;x++)
+      {
         int fp = f.at(x,y); // field pixel
         int lp = last_field.at(x,y); // last-seen pixel
         if (fp != lp) 
         {
             last_field.at(x,y)=fp; // update last_field
-            if (fp>aurora::field_unknown && fp<aurora::field_driveable)
-            { // mark the obstacle
-                navigator.mark_obstacle(
-                    x*aurora::field_drivable::GRIDSIZE,
-                    y*aurora::field_drivable::GRIDSIZE,
-                    30);
-            }
+            bool now=is_obstacle(fp), was=is_obstacle(lp);
+            if (now!=was) change_obstacle_pixel(x,y,now?+1:-1);
         }
-    }
+      }
+    });
     
-    compute_proximity();
+    const int obstacle_proximity=15/navigator_res; // distance in grid cells to start penalizing paths
+    navigator.navigator.update_proximity(obstacle_proximity);
+  }
+  
+  // Add or remove one obstacle field pixel
+  void change_obstacle_pixel(int x,int y,int delta) {
+    // Same rounding as rmc_navigator::mark_obstacle
+    int gx=(x*aurora::field_drivable::GRIDSIZE+navigator_res/2)/navigator_res;
+    int gy=(y*aurora::field_drivable::GRIDSIZE+navigator_res/2)/navigator_res;
+    if (gx>=rmc_navigator::GRIDX || gy>=rmc_navigator::GRIDY) return; // off the navigator grid (edges are already obstacles)
+    
+    unsigned char &count=obstacle_pixels.at(gx,gy);
+    count+=delta;
+    if (delta>0 && count==1) navigator.set_obstacle_cell(gx,gy,obstacle_height);
+    if (delta<0 && count==0) navigator.set_obstacle_cell(gx,gy,0);
   }
 
   // Mark this field location as an obstacle of this height
   //  (you MUST call compute_proximity after marking obstacles)
   inline void mark_obstacle(int x,int y,int ht) { navigator.mark_obstacle(x,y,ht); }
 
-  // Recompute proximity costs (after marking obstacles)
+  // Recompute all proximity costs (after marking obstacles)
   void compute_proximity() {
     // Recompute proximity costs after marking obstacles
     const int obstacle_proximity=15/navigator_res; // distance in grid cells to start penalizing paths
@@ -130,11 +179,41 @@ public:
     debug.target=target;
 
     rmc_navigator::planner_navtarget navtarget(target);
-    rmc_navigator::planner plan(navigator.navigator,fstart,navtarget,last_drive,false);
+    bool valid; size_t searched;
+    if (!same_target(target,search_target)) 
+    { // new target: old searches are useless
+      anytime.restart();
+      dstar.restart();
+      search_target=target;
+    }
+    if (use_dstar)
+    { // Repair our last plan for the robot's motion and any field changes
+      dstar.plan(fstart,navtarget);
+      planned_path=dstar.path;
+      valid=dstar.valid; searched=dstar.searched;
+      debug.suboptimality=1.0;
+    }
+    else if (anytime_budget_ms>0.0)
+    { // Keep improving our last plan, within our time budget
+      anytime.plan(fstart,navtarget,last_drive,anytime_budget_ms);
+      planned_path=anytime.path;
+      valid=anytime.valid; searched=anytime.searched;
+      debug.suboptimality=anytime.suboptimality;
+      if (!valid && !anytime.finished) {
+        printf("Path planning still searching: %zd cells so far\n",searched);
+        return false;
+      }
+    }
+    else
+    { // Plan the optimal path from scratch
+      rmc_navigator::planner plan(navigator.navigator,fstart,navtarget,last_drive,false);
+      planned_path=plan.path;
+      valid=plan.valid; searched=plan.searched;
+      debug.suboptimality=1.0;
+    }
     int steps=0;
-    for (const rmc_navigator::searchposition &p : plan.path)
+    for (const rmc_navigator::searchposition &p : planned_path)
     {
-        planned_path.push_back(p);
         if (steps<replan_length)
         {
           p.print();
@@ -157,8 +236,8 @@ public:
     printf("Planned path from %.0f,%.0f@%.0f to target %.0f,%.0f@%.0f: %d steps\n",
       cur.x,cur.y,cur.angle,
       target.x,target.y,target.angle, steps);
-    if (!plan.valid) {
-        printf("Path planning FAILED: searched %zd cells\n",plan.searched);
+    if (!valid) {
+        printf("Path planning FAILED: searched %zd cells\n",searched);
         return false;
     }
       
@@ -0,0 +1,264 @@
+/*
+  Benchmark the path planner: replay a set of start/target/field problems
+  and report nodes expanded per second and planning latency percentiles.
+
+    ./plan_bench --replay DIR     replays problems recorded by "pathplanner --record DIR"
+    ./plan_bench                  makes up random fields and problems
+    ./plan_bench --anytime MS     uses the anytime planner with this budget per call,
+                                  and reports latency to the first path
+    ./plan_bench --dstar          compares A* from scratch against D* Lite repairs
+    ./plan_bench --drive N        turns each made-up problem into a drive of N replans, 
+                                  with the robot moving and new obstacles appearing
+    ./plan_bench --anytime MS --follow N   also drives the robot up to N steps along 
+                                  each anytime path, replanning at every step, with and 
+                                  without keeping the search as the start moves
+
+  This file is Public Domain.
+*/
+#include "pathplanner.h"
+#include "plan_record.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+
+// Make a random field: flat, with some tall obstacle blobs
+void synthetic_field(aurora::field_drivable &f,int obstacles) {
+  typedef aurora::field_drivable F;
+  f.clear(aurora::field_flat);
+  for (int o=0;o<obstacles;o++) {
+    int cx=rand()%F::GRIDX, cy=rand()%F::GRIDY;
+    int r=2+rand()%8; // radius in field pixels
+    for (int y=cy-r;y<=cy+r;y++)
+    for (int x=cx-r;x<=cx+r;x++)
+      if (f.in_bounds(x,y) && (x-cx)*(x-cx)+(y-cy)*(y-cy)<=r*r)
+        f.at(x,y)=aurora::field_toohigh;
+  }
+}
+
+// Add an obstacle blob of this radius (in field pixels) at this cm location
+void add_blob(aurora::field_drivable &f,float x,float y,int r) {
+  typedef aurora::field_drivable F;
+  int cx=x/F::GRIDSIZE, cy=y/F::GRIDSIZE;
+  f.begin_changes();
+  for (int y=cy-r;y<=cy+r;y++)
+  for (int x=cx-r;x<=cx+r;x++)
+    if (f.in_bounds(x,y) && (x-cx)*(x-cx)+(y-cy)*(y-cy)<=r*r)
+      f.set(x,y,aurora::field_toohigh);
+}
+
+// Random location on the field, away from the walls
+aurora::robot_center2D synthetic_location(void) {
+  const int margin=100; // cm
+  return aurora::robot_center2D(
+    margin+rand()%(field_x_size-2*margin),
+    margin+rand()%(field_y_size-2*margin),
+    rand()%360);
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+// Collects statistics for one planner
+struct plan_stats {
+  std::vector<double> latency; // milliseconds per plan
+  size_t expanded=0, found=0;
+  double total_ms=0.0;
+  
+  void add(double ms,size_t searched,bool valid) {
+    latency.push_back(ms);
+    total_ms+=ms;
+    expanded+=searched;
+    if (valid) found++;
+  }
+  
+  void print(const char *name) {
+    if (latency.empty()) return;
+    double mean=0.0;
+    for (double ms : latency) mean+=ms/latency.size();
+    std::sort(latency.begin(),latency.end());
+    auto percentile=[&](double pct) { // nearest-rank percentile
+      size_t rank=(size_t)ceil(pct*0.01*latency.size());
+      return latency[std::max(rank,(size_t)1)-1];
+    };
+    printf("%s: found %zd of %zd paths, %.0f nodes expanded per plan, %.2f M nodes/sec\n",
+      name,found,latency.size(),expanded/(double)latency.size(),expanded/(total_ms*1.0e3));
+    printf("%s latency ms: mean %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+      name,mean,percentile(50),percentile(90),percentile(99),latency.back());
+  }
+};
+
+int main(int argc,char *argv[]) {
+  std::string replay="";
+  int nfields=5, nproblems=10, nobstacles=40;
+  int range=0; // if nonzero, targets are at most this many cm from the start
+  double anytime_ms=0.0; // if nonzero, anytime planner budget per call
+  bool dstar=false; // compare against D* Lite
+  int drive=1; // replans per synthetic problem
+  int follow=0; // anytime replans while following each path
+  for (int argi=1;argi<argc;argi++) {
+    std::string arg=argv[argi];
+    if (arg=="--replay") replay=argv[++argi];
+    else if (arg=="--fields") nfields=atoi(argv[++argi]);
+    else if (arg=="--problems") nproblems=atoi(argv[++argi]);
+    else if (arg=="--obstacles") nobstacles=atoi(argv[++argi]);
+    else if (arg=="--range") range=atoi(argv[++argi]);
+    else if (arg=="--anytime") anytime_ms=atof(argv[++argi]);
+    else if (arg=="--dstar") dstar=true;
+    else if (arg=="--drive") drive=atoi(argv[++argi]);
+    else if (arg=="--follow") follow=atoi(argv[++argi]);
+    else {
+      fprintf(stderr,"Usage: plan_bench [--replay DIR] [--fields N] [--problems per field] [--obstacles N] [--range cm] [--anytime ms] [--dstar] [--drive N] [--follow N]\n");
+      return 1;
+    }
+  }
+
+  std::vector<plan_problem> problems;
+  std::vector<aurora::field_drivable> fields;
+  if (replay!="") {
+    plan_record_load(replay,problems,fields);
+  }
+  else {
+    srand(1);
+    for (int f=0;f<nfields;f++) {
+      fields.emplace_back();
+      synthetic_field(fields.back(),nobstacles);
+      for (int p=0;p<nproblems;p++) {
+        plan_problem prob;
+        prob.field=f;
+        prob.start=synthetic_location();
+        aurora::robot_center2D t=synthetic_location();
+        if (range>0) { // pull the target in close to the start
+          vec2 d=vec2(t.x-prob.start.x,t.y-prob.start.y);
+          float len=length(d);
+          if (len>range) { d=d*(range/len); t.x=prob.start.x+d.x; t.y=prob.start.y+d.y; }
+        }
+        prob.target=aurora::robot_navtarget(t.x,t.y,t.angle, 20.0,20.0,30.0);
+        prob.field=fields.size()-1;
+        problems.push_back(prob);
+        
+        for (int step=1;step<drive;step++) 
+        { // Drive towards the target, sometimes seeing a new obstacle ahead
+          vec2 d=vec2(t.x-prob.start.x,t.y-prob.start.y);
+          float len=length(d);
+          if (len>16.0) d=d*(16.0/len);
+          prob.start.x+=d.x; prob.start.y+=d.y;
+          if (step%5==0 && len>150.0) {
+            aurora::field_drivable next=fields.back();
+            add_blob(next,prob.start.x+d.x*6,prob.start.y+d.y*6,3);
+            fields.push_back(next);
+            prob.field=fields.size()-1;
+          }
+          problems.push_back(prob);
+        }
+      }
+    }
+  }
+  printf("Planning %zd problems on %zd fields\n",problems.size(),fields.size());
+
+  static robot_autodriver autodriver; // static, it's too big for the stack
+  int field=-1;
+  plan_stats astar, anytime, dstar_stats;
+  double first_bound=0.0, first_ratio=0.0; // anytime stats
+  aurora::robot_navtarget last_target;
+  for (const plan_problem &p : problems) {
+    if (p.field!=field) {
+      field=p.field;
+      autodriver.update_field(fields[field]);
+    }
+    rmc_navigator::fposition fstart(p.start.x,p.start.y,p.start.angle);
+    rmc_navigator::planner_navtarget navtarget(p.target);
+
+    auto start=std::chrono::steady_clock::now();
+    if (anytime_ms>0.0) 
+    { // call the anytime planner until it has a path, then until it's optimal
+      rmc_navigator::anytime_planner &plan=autodriver.anytime;
+      plan.restart();
+      double ms=-1.0, first_cost=0.0;
+      while (true) {
+        plan.plan(fstart,navtarget,rmc_navigator::navigator_t::drive_t(),anytime_ms);
+        if (ms<0.0 && (plan.valid || plan.finished)) 
+        { // first answer
+          ms=elapsed_ms(start);
+          if (plan.valid) {
+            first_bound+=plan.suboptimality;
+            first_cost=plan.path.back().cost;
+          }
+        }
+        if (plan.finished) break;
+      }
+      anytime.add(ms,plan.searched,plan.valid);
+      anytime.total_ms+=elapsed_ms(start)-ms; // count time to optimal too
+      if (plan.valid) first_ratio+=first_cost/plan.path.back().cost;
+    }
+    else
+    { // plain A*
+      rmc_navigator::planner plan(autodriver.navigator.navigator,fstart,navtarget);
+      astar.add(elapsed_ms(start),plan.searched,plan.valid);
+    }
+    
+    if (dstar) 
+    { // D* Lite keeps its search as long as the target stays the same
+      rmc_navigator::dstar_planner &plan=autodriver.dstar;
+      if (!robot_autodriver::same_target(p.target,last_target)) plan.restart();
+      last_target=p.target;
+      start=std::chrono::steady_clock::now();
+      plan.plan(fstart,navtarget);
+      dstar_stats.add(elapsed_ms(start),plan.searched,plan.valid);
+    }
+  }
+  
+  if (anytime_ms>0.0) {
+    if (anytime.found>0) 
+      printf("Anytime: first path bound %.2f, first path costs %.2fx optimal\n",
+        first_bound/anytime.found,first_ratio/anytime.found);
+    anytime.print("Anytime (first path)");
+  }
+  else astar.print("A*");
+  if (dstar) dstar_stats.print("D* Lite");
+  
+  if (anytime_ms>0.0 && follow>0) 
+  { // Drive along each path a step at a time, replanning from each new cell like the pathplanner
+    rmc_navigator::anytime_planner &plan=autodriver.anytime;
+    for (int keep=1;keep>=0;keep--) {
+      plan_stats stats;
+      double bound=0.0;
+      size_t starts=0, bounds=0;
+      for (const plan_problem &p : problems) {
+        if (p.field!=field) {
+          field=p.field;
+          autodriver.update_field(fields[field]);
+        }
+        rmc_navigator::fposition pos(p.start.x,p.start.y,p.start.angle);
+        rmc_navigator::planner_navtarget navtarget(p.target);
+        plan.restart();
+        size_t starts0=plan.starts;
+        for (int step=0;step<follow;step++) {
+          if (!keep) plan.restart(); // the old behavior: any start change starts over
+          size_t s0=plan.starts, searched0=plan.searched;
+          auto start=std::chrono::steady_clock::now();
+          plan.plan(pos,navtarget,rmc_navigator::navigator_t::drive_t(),anytime_ms);
+          stats.add(elapsed_ms(start),plan.starts==s0?plan.searched-searched0:plan.searched,plan.valid);
+          if (!plan.valid) {
+            if (plan.finished) break; // no path
+            continue; // still looking: stay put
+          }
+          bound+=plan.suboptimality; bounds++;
+          if (plan.path.size()<=1) break; // arrived
+          pos=plan.path.front().pos; // drive to the next cell on the path
+        }
+        starts+=plan.starts-starts0;
+      }
+      const char *name=keep?"Anytime following, keeping search":"Anytime following, restarting";
+      printf("%s: %zd searches started in %zd calls, mean bound %.2f\n",
+        name,starts,stats.latency.size(),bounds?bound/bounds:0.0);
+      stats.print(name);
+    }
+  }
+  
+  const rmc_navigator::navigator_t::search_workspace &ws=autodriver.navigator.navigator.workspace;
+  printf("Search workspace: %.1f MB, arena grew from %d to %zd nodes\n",
+    ws.bytes()*1.0e-6,(int)ws.initial_nodes,ws.nodes.size());
+  return 0;
+}
@@ -0,0 +1,90 @@
+/*
+  Record and replay path planning problems, so the planner can be
+  benchmarked on the start/target/field combinations the robot really saw.
+
+  A recording directory holds:
+    field_NNNN.bin: raw aurora::field_drivable snapshots, numbered from 0.
+    plans.txt: one planning problem per line:
+       field_number  start.x start.y start.angle  target.x target.y target.angle  error.x error.y error.angle
+
+  This file is Public Domain.
+*/
+#ifndef PATHPLANNER_PLAN_RECORD_H
+#define PATHPLANNER_PLAN_RECORD_H
+
+#include "aurora/lunatic.h"
+#include <stdio.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/* One path planning problem */
+struct plan_problem {
+  int field; // index of the field snapshot
+  aurora::robot_center2D start;
+  aurora::robot_navtarget target;
+};
+
+/* Appends planning problems to a recording directory */
+class plan_recorder {
+  std::string dir;
+  FILE *plans;
+  int fields; // number of field snapshots written
+public:
+  plan_recorder(const std::string &dir_) :dir(dir_), fields(0) {
+    mkdir(dir.c_str(),0755);
+    plans=fopen((dir+"/plans.txt").c_str(),"w");
+    if (!plans) throw std::runtime_error("Cannot create plan recording in "+dir);
+  }
+  ~plan_recorder() { fclose(plans); }
+
+  // Save a new field snapshot, used by the following plans
+  void record_field(const aurora::field_drivable &f) {
+    char name[32]; snprintf(name,sizeof(name),"/field_%04d.bin",fields++);
+    FILE *out=fopen((dir+name).c_str(),"wb");
+    if (!out) throw std::runtime_error("Cannot write field snapshot "+dir+name);
+    fwrite(&f,sizeof(f),1,out);
+    fclose(out);
+  }
+
+  // Save a planning problem against the most recent field
+  void record_plan(const aurora::robot_center2D &start,const aurora::robot_navtarget &target) {
+    fprintf(plans,"%d  %.2f %.2f %.2f  %.2f %.2f %.2f  %.2f %.2f %.2f\n",
+      fields-1,
+      start.x,start.y,start.angle,
+      target.x,target.y,target.angle,
+      target.error.x,target.error.y,target.error.angle);
+    fflush(plans);
+  }
+};
+
+/* Load all the problems and field snapshots in a recording directory */
+inline void plan_record_load(const std::string &dir,
+  std::vector<plan_problem> &problems,std::vector<aurora::field_drivable> &fields)
+{
+  FILE *in=fopen((dir+"/plans.txt").c_str(),"r");
+  if (!in) throw std::runtime_error("Cannot read plan recording "+dir+"/plans.txt");
+  plan_problem p;
+  while (10==fscanf(in,"%d %f %f %f %f %f %f %f %f %f",
+      &p.field,
+      &p.start.x,&p.start.y,&p.start.angle,
+      &p.target.x,&p.target.y,&p.target.angle,
+      &p.target.error.x,&p.target.error.y,&p.target.error.angle))
+  {
+    if (p.field<0) continue; // planned before any field arrived
+    while ((int)fields.size()<=p.field)
+    { // load field snapshots as they're referenced
+      char name[32]; snprintf(name,sizeof(name),"/field_%04d.bin",(int)fields.size());
+      fields.emplace_back();
+      FILE *f=fopen((dir+name).c_str(),"rb");
+      if (!f || 1!=fread(&fields.back(),sizeof(aurora::field_drivable),1,f))
+        throw std::runtime_error("Cannot read field snapshot "+dir+name);
+      fclose(f);
+    }
+    problems.push_back(p);
+  }
+  fclose(in);
+}
+
+#endif
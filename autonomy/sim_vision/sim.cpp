@@ -81,7 +81,7 @@ public:
                 // add depth noise to each sample
                 float noise=0.1*(rand()%64);
                 
-                map2d.at(ox,oy).addPoint(z+noise);
+                map2d.add_point(ox,oy,z+noise);
                 count_samples++;
             }
         }
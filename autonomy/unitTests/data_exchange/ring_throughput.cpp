@@ -0,0 +1,93 @@
+/* Benchmark a data_exchange_ring: a forked writer pushes samples
+   at 1 kHz, and this reader wakes up every 30ms (like the localizer)
+   to process the whole batch.  Checks no samples get lost or reordered,
+   and reports the batch sizes and sample latency.
+   Then measures how fast one process can push with nobody pacing it. */
+#include <iostream>
+#include <stdio.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <vector>
+#include <algorithm>
+#include "aurora/data_exchange.h"
+
+struct ring_sample {
+    uint64_t index; // counts up by one per push
+    double payload[3]; // stand-in for encoder or IMU data
+};
+typedef aurora::data_exchange_ring<ring_sample,256> sample_ring;
+
+int main(int argc,char *argv[]) {
+    double seconds=2.0;
+    if (argc>1) seconds=atof(argv[1]);
+    
+    sample_ring ring("ring_throughput.test");
+    
+    pid_t writer=fork();
+    if (writer==0) 
+    { // child process: push at 1 kHz
+        sample_ring out("ring_throughput.test");
+        ring_sample s{};
+        auto next=std::chrono::steady_clock::now();
+        while (true) {
+            out.push(s);
+            s.index++;
+            next+=std::chrono::microseconds(1000);
+            long us=aurora::data_exchange_remaining_us(next);
+            if (us>0) usleep(us);
+        }
+    }
+    
+    long batches=0, samples=0, out_of_order=0;
+    size_t max_batch=0;
+    std::vector<double> latency_us;
+    uint64_t last_index=0;
+    bool first=true;
+    
+    auto start=std::chrono::steady_clock::now();
+    while (std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count()<seconds)
+    {
+        aurora::data_exchange_sleep(30); // a slow reader
+        
+        size_t batch=0;
+        ring_sample s;
+        aurora::monotonic_time_t t;
+        while (ring.next(s,&t)) {
+            if (!first && s.index!=last_index+1) out_of_order++;
+            first=false;
+            last_index=s.index;
+            latency_us.push_back((aurora::time_in_nanoseconds_monotonic()-t)*1.0e-3);
+            batch++;
+        }
+        samples+=batch;
+        batches++;
+        if (batch>max_batch) max_batch=batch;
+    }
+    kill(writer,SIGKILL);
+    waitpid(writer,0,0);
+    
+    std::sort(latency_us.begin(),latency_us.end());
+    size_t n=latency_us.size();
+    printf("1 kHz writer, 30ms reader: %ld samples in %ld batches (max batch %d), %ld gaps, %ld overwritten\n",
+        samples,batches,(int)max_batch,out_of_order,(long)ring.missed_count());
+    if (n>0) printf("  sample age when read: p50 %.1f ms, max %.1f ms\n",
+        latency_us[n/2]*1.0e-3, latency_us[n-1]*1.0e-3);
+    
+    // Unpaced push rate
+    {
+        sample_ring out("ring_throughput_fast.test");
+        ring_sample s{};
+        long pushes=2000000;
+        auto t0=std::chrono::steady_clock::now();
+        for (long i=0;i<pushes;i++) { s.index=i; out.push(s); }
+        double dt=std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+        printf("Unpaced push: %.1f ns per push (%.1f M pushes/sec)\n",dt*1.0e9/pushes,pushes*1.0e-6/dt);
+    }
+    
+    if (out_of_order>0 || ring.missed_count()>0) {
+        printf("FAIL: lost samples\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,124 @@
+/* Stress test for torn reads: a forked writer process fills a
+   big struct with copies of one counter value, and this reader
+   checks every copy is identical.  Plain read() copies can tear; 
+   read_consistent() copies must never tear.
+   
+   Then several writer processes each fill their own part of the struct
+   (like the nanoslots share one exchange), and each part of every 
+   read_consistent() copy must be identical, and no finished write may
+   be lost from the update count. */
+#include <iostream>
+#include <stdio.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <vector>
+#include "aurora/data_exchange.h"
+
+class torn_read_test {
+public:
+    enum {n=4096};
+    uint32_t value[n];
+    
+    // Return true if all our values match, in each of these parts
+    bool consistent(int parts=1) const {
+        int len=n/parts;
+        for (int p=0;p<parts;p++)
+            for (int i=p*len+1;i<(p+1)*len;i++) 
+                if (value[i]!=value[p*len]) return false;
+        return true;
+    }
+};
+
+/* Several writers, each writing its own part: returns false if read_consistent tears */
+bool multi_writer_test(aurora::data_exchange<torn_read_test> &exch,int writers,uint32_t writes) {
+    const int len=torn_read_test::n/writers;
+    uint32_t start=exch.check("before multi-writer test");
+    std::vector<pid_t> kids;
+    for (int w=0;w<writers;w++) {
+        pid_t kid=fork();
+        if (kid==0) 
+        { // child process: write our part this many times
+            aurora::data_exchange<torn_read_test> out("torn_read.test");
+            for (uint32_t count=1;count<=writes;count++) {
+                torn_read_test &t=out.write_begin();
+                for (int i=w*len;i<(w+1)*len;i++) t.value[i]=count;
+                out.write_end();
+            }
+            _exit(0);
+        }
+        kids.push_back(kid);
+    }
+    
+    static torn_read_test copy;
+    long reads=0, torn=0, fails=0;
+    for (int running=writers;running>0;) {
+        if (!exch.read_consistent(copy)) fails++;
+        else {
+            reads++;
+            if (!copy.consistent(writers)) torn++;
+        }
+        running=0;
+        for (pid_t kid:kids) if (0==waitpid(kid,0,WNOHANG)) running++;
+    }
+    for (pid_t kid:kids) waitpid(kid,0,0);
+    
+    uint32_t finished=(exch.check("after multi-writer test")-start)/2;
+    printf("%d writers: read_consistent(): %ld reads, %ld torn, %ld gave up; %u of %u writes counted\n",
+        writers,reads,torn,fails,finished,writers*writes);
+    return torn==0 && finished==writers*writes;
+}
+
+int main(int argc,char *argv[]) {
+    double seconds=2.0;
+    if (argc>1) seconds=atof(argv[1]);
+    
+    aurora::data_exchange<torn_read_test> exch("torn_read.test");
+    memset(&exch.write_begin(),0,sizeof(torn_read_test)); // consistent starting data
+    exch.write_end();
+    
+    pid_t writer=fork();
+    if (writer==0) 
+    { // child process: write forever
+        aurora::data_exchange<torn_read_test> out("torn_read.test");
+        for (uint32_t count=1;;count++) {
+            torn_read_test &t=out.write_begin();
+            for (int i=0;i<torn_read_test::n;i++) t.value[i]=count;
+            out.write_end();
+        }
+    }
+    
+    static torn_read_test copy;
+    long plain_reads=0, plain_torn=0;
+    long consistent_reads=0, consistent_torn=0, consistent_fails=0;
+    
+    auto start=std::chrono::steady_clock::now();
+    while (std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count()<seconds)
+    {
+        copy=exch.read();
+        plain_reads++;
+        if (!copy.consistent()) plain_torn++;
+        
+        if (!exch.read_consistent(copy)) consistent_fails++;
+        else {
+            consistent_reads++;
+            if (!copy.consistent()) consistent_torn++;
+        }
+    }
+    kill(writer,SIGKILL);
+    waitpid(writer,0,0);
+    
+    printf("read(): %ld reads, %ld torn\n",plain_reads,plain_torn);
+    printf("read_consistent(): %ld reads, %ld torn, %ld gave up\n",
+        consistent_reads,consistent_torn,consistent_fails);
+    
+    if (consistent_torn>0) {
+        printf("FAIL: read_consistent returned torn data\n");
+        return 1;
+    }
+    if (!multi_writer_test(exch,4,100000)) {
+        printf("FAIL: several writers tore a read_consistent copy, or lost a write\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
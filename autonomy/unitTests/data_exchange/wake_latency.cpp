@@ -0,0 +1,102 @@
+/* Benchmark the latency between a write_end() in one process
+   and the reader noticing it in another process, comparing
+   the old sleep-and-poll loop against wait_for_update and 
+   data_exchange_wait_any.  Also checks that writes to exchanges
+   nobody is waiting on don't ring the wait_any doorbell. */
+#include <iostream>
+#include <stdio.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <vector>
+#include <algorithm>
+#include "aurora/data_exchange.h"
+
+typedef int64_t nanosecond_time_t;
+nanosecond_time_t monotonic_ns(void) {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC,&tp);
+    return tp.tv_sec*1000000000L + tp.tv_nsec;
+}
+
+void report(const char *name,std::vector<double> &lat_us) {
+    std::sort(lat_us.begin(),lat_us.end());
+    double sum=0.0; 
+    for (double l:lat_us) sum+=l;
+    size_t n=lat_us.size();
+    printf("%-22s %5d wakes: mean %8.1f us  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n",
+        name,(int)n, sum/n, lat_us[n/2], lat_us[n*99/100], lat_us[n-1]);
+}
+
+int main(int argc,char *argv[]) {
+    int samples=200; // samples per method
+    int write_ms=7; // writer's period (not a multiple of the poll time)
+    if (argc>1) samples=atoi(argv[1]);
+    
+    aurora::data_exchange<nanosecond_time_t> exch("wake_latency.test");
+    aurora::data_exchange<nanosecond_time_t> other("wake_latency_other.test");
+    
+    pid_t writer=fork();
+    if (writer==0) 
+    { // child process: write the current time periodically
+        aurora::data_exchange<nanosecond_time_t> out("wake_latency.test");
+        while (true) {
+            aurora::data_exchange_sleep(write_ms);
+            out.write_begin()=monotonic_ns();
+            out.write_end();
+        }
+    }
+    
+    std::vector<double> lat;
+    
+    // Old style: poll updated(), sleep 10ms
+    lat.clear();
+    exch.read();
+    while ((int)lat.size()<samples) {
+        if (exch.updated()) lat.push_back((monotonic_ns()-exch.read())*1.0e-3);
+        aurora::data_exchange_sleep(10);
+    }
+    report("poll + sleep(10)",lat);
+    
+    // Old style, but with a fast 1ms poll (burns more CPU)
+    lat.clear();
+    exch.read();
+    while ((int)lat.size()<samples) {
+        if (exch.updated()) lat.push_back((monotonic_ns()-exch.read())*1.0e-3);
+        aurora::data_exchange_sleep(1);
+    }
+    report("poll + sleep(1)",lat);
+    
+    // Futex on this one exchange
+    lat.clear();
+    exch.read();
+    while ((int)lat.size()<samples) {
+        if (exch.wait_for_update(100)) lat.push_back((monotonic_ns()-exch.read())*1.0e-3);
+    }
+    report("wait_for_update",lat);
+    
+    // Doorbell across several exchanges
+    lat.clear();
+    exch.read();
+    while ((int)lat.size()<samples) {
+        if (0==aurora::data_exchange_wait_any({&other,&exch},100)) continue;
+        if (exch.updated()) lat.push_back((monotonic_ns()-exch.read())*1.0e-3);
+    }
+    report("data_exchange_wait_any",lat);
+    
+    // Now nobody waits on exch, so its writes shouldn't wake wait_any sleepers
+    aurora::data_exchange_sleep(3*write_ms); // the next write clears our old wait_any flag
+    aurora::data_exchange_doorbell &bell=aurora::data_exchange_doorbell::get();
+    uint32_t rings=__atomic_load_n(&bell.rings,__ATOMIC_SEQ_CST);
+    int woke=aurora::data_exchange_wait_any({&other},200);
+    rings=__atomic_load_n(&bell.rings,__ATOMIC_SEQ_CST)-rings;
+    printf("wait_any on an idle exchange: doorbell rang %d times during %d unwatched writes\n",
+        (int)rings,200/write_ms);
+    
+    kill(writer,SIGKILL);
+    waitpid(writer,0,0);
+    if (woke!=-1 || rings!=0) {
+        printf("ERROR: unwatched writes rang the doorbell\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+/*
+  Benchmark aruco marker tracking on a recording made by
+  "vision_capture --record FILE", without a camera:
+
+    ./aruco_bench FILE [--track N] [--pyramid L]
+
+  Every frame goes through two detectors: one doing full-frame
+  detection (the reference), and one tracking markers in regions of
+  interest with a full-frame scan every N frames (default 15), and
+  optionally a pyramid coarse pass at 1/2^L resolution.  Reports
+  the detection time per frame for each, and the hit rate: the
+  fraction of markers the reference found that tracking also found.
+
+  This file is Public Domain.
+*/
+#include <iostream>
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+#include "aurora/lunatic.h"
+
+#include "vision/realsense_camera.hpp"
+#include "vision/realsense_camera.cpp"
+
+#include "vision/aruco_detector.hpp"
+#include "vision/aruco_detector.cpp"
+#include "vision/aruco_watcher.hpp"
+
+// Just collects the IDs of the markers found
+struct marker_id_watcher {
+    std::vector<int> IDs;
+    void found_marker(const cv::Mat &matrix4x4,const aruco::Marker &marker,int ID) {
+        IDs.push_back(ID);
+    }
+};
+
+// Time per frame for one detector
+struct detect_timer {
+    const char *name;
+    std::vector<double> ms;
+
+    detect_timer(const char *name_) :name(name_) {}
+
+    void print() {
+        if (ms.empty()) return;
+        std::sort(ms.begin(),ms.end());
+        double sum=0.0;
+        for (double m:ms) sum+=m;
+        printf("  %-9s %7.2f ms/frame mean, %7.2f ms median, %7.2f ms max\n",
+            name,sum/ms.size(),ms[ms.size()/2],ms.back());
+    }
+};
+
+// Find markers in this image, and return the time it took in ms
+double time_detect(aruco_detector &detector,cv::Mat &image,marker_id_watcher &watcher) {
+    auto start=std::chrono::steady_clock::now();
+    detector.find_markers(image,watcher,false);
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main(int argc,const char *argv[]) {
+    std::string play="";
+    int track=15, pyramid=0;
+    for (int argi=1;argi<argc;argi++) {
+      std::string arg=argv[argi];
+      if (arg=="--track") track=atoi(argv[++argi]);
+      else if (arg=="--pyramid") pyramid=atoi(argv[++argi]);
+      else if (play=="" && arg[0]!='-') play=arg;
+      else {
+        std::cerr<<"Usage: aruco_bench FILE [--track N] [--pyramid L]\n";
+        return 1;
+      }
+    }
+    if (play=="" || track<1) {
+        std::cerr<<"Usage: aruco_bench FILE [--track N] [--pyramid L]\n";
+        return 1;
+    }
+
+    recorded_camera cam(play);
+    printf("Tracking markers in %d frames from %s, full scan every %d frames, pyramid %d\n",
+        cam.frame_count(),play.c_str(),track,pyramid);
+
+    aruco_detector full, tracked;
+    tracked.set_tracking(true,track);
+    tracked.set_pyramid(pyramid);
+
+    detect_timer full_time("full"), tracked_time("tracked"), roi_time("roi only");
+    long reference=0, hits=0, extra=0;
+    while (true) {
+        realsense_camera_capture cap;
+        if (!cam.grab(cap)) break;
+
+        const aurora::robot_coord3D &view3D=cap.recorded_view;
+        for (const aurora::vision_marker_report &m:aurora::field_markers)
+            if (m.is_valid())
+                tracked.predict_marker(m.markerID,view3D,100.0f*m.coords.origin,
+                    100.0f*vision_marker_size,150.0f);
+
+        marker_id_watcher ref, mine;
+        full_time.ms.push_back(time_detect(full,cap.color_image,ref));
+        double ms=time_detect(tracked,cap.color_image,mine);
+        tracked_time.ms.push_back(ms);
+        if (!tracked.last_was_full_scan()) roi_time.ms.push_back(ms);
+
+        reference+=ref.IDs.size();
+        for (int ID:ref.IDs)
+            if (std::find(mine.IDs.begin(),mine.IDs.end(),ID)!=mine.IDs.end()) hits++;
+        for (int ID:mine.IDs)
+            if (std::find(ref.IDs.begin(),ref.IDs.end(),ID)==ref.IDs.end()) extra++;
+    }
+
+    printf("%zd frames:\n",full_time.ms.size());
+    full_time.print();
+    tracked_time.print();
+    roi_time.print();
+    if (reference>0)
+        printf("  hit rate %.1f%% (%ld of %ld markers), %ld markers only tracking found\n",
+            hits*100.0/reference,hits,reference,extra);
+    else
+        printf("  no markers in this recording\n");
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+  Benchmark and check the depth-to-obstacle-grid projection:
+  compares depth_projection against the original per-pixel loop
+  from vision.cpp, on made-up or recorded depth frames.
+
+    ./depth_project_bench                  synthetic floor-and-rocks frames
+    ./depth_project_bench --raw FILE W H   raw 16-bit millimeter depth frames, back to back
+    ./depth_project_bench --play FILE      frames recorded by "vision_capture --record FILE"
+
+  Doesn't need OpenCV or a camera.
+
+  This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include "aurora/coords.h"
+#include "vision/grid.hpp"
+#include "vision/grid.cpp"
+#include "vision/depth_projection.hpp"
+#include "vision/depth_recording.hpp"
+
+// A set of depth frames with their camera model
+struct depth_frames {
+    int w=848, h=480;
+    float depth2cm=0.1; // millimeter depth units
+    std::vector<float> xdir, ydir;
+    std::vector< std::vector<uint16_t> > frames;
+    std::vector<aurora::robot_coord3D> views;
+
+    // Set up pinhole directions for typical 848x480 realsense intrinsics
+    void make_directions(void) {
+        float fx=425.0*w/848, fy=425.0*h/480, ppx=w*0.5, ppy=h*0.5;
+        xdir.resize(w); ydir.resize(h);
+        for (int x=0;x<w;x++) xdir[x]=(x-ppx)/fx;
+        for (int y=0;y<h;y++) ydir[y]=(y-ppy)/fy;
+    }
+};
+
+// Camera at this field location, height, heading, and downward tilt (degrees).
+//   Camera X is right, Y is down, Z is forward.
+aurora::robot_coord3D camera_view(float x,float y,float height,float heading,float tilt) {
+    float c=cos(tilt*M_PI/180), s=sin(tilt*M_PI/180);
+    float ch=cos(heading*M_PI/180), sh=sin(heading*M_PI/180);
+    vec3 forward(ch,sh,0), right(sh,-ch,0), up(0,0,1);
+    aurora::robot_coord3D view;
+    view.origin=vec3(x,y,height);
+    view.Z=forward*c-up*s;
+    view.Y=-(forward*s+up*c);
+    view.X=right;
+    view.percent=100.0;
+    return view;
+}
+
+// Render a flat floor with some flat-topped rocks
+void synthetic_frames(depth_frames &f,int count) {
+    f.make_directions();
+    srand(1);
+    struct rock { float x,y,r,h; };
+    std::vector<rock> rocks;
+    for (int i=0;i<40;i++)
+        rocks.push_back(rock{(float)(rand()%800),(float)(rand()%1000),(float)(10+rand()%30),(float)(5+rand()%30)});
+
+    for (int i=0;i<count;i++) {
+        aurora::robot_coord3D view=camera_view(300+3*i,100+10*i,60,80+i,20);
+        std::vector<uint16_t> depth(f.w*f.h);
+        for (int y=0;y<f.h;y++)
+        for (int x=0;x<f.w;x++) {
+            vec3 dir=view.X*f.xdir[x]+view.Y*f.ydir[y]+view.Z; // camera Z=1 depth units
+            float t=0.0;
+            if (dir.z<0) {
+                t=-view.origin.z/dir.z; // hits floor
+                for (const rock &r : rocks) {
+                    float tr=(r.h-view.origin.z)/dir.z; // hits rock top plane
+                    vec3 p=view.origin+dir*tr;
+                    if ((p.x-r.x)*(p.x-r.x)+(p.y-r.y)*(p.y-r.y)<r.r*r.r && tr<t) t=tr;
+                }
+            }
+            if (rand()%20==0) t=0.0; // sparkle holes
+            depth[y*f.w+x]=std::min(t/f.depth2cm,65535.0f);
+        }
+        f.frames.push_back(depth);
+        f.views.push_back(view);
+    }
+}
+
+// Read back-to-back raw millimeter frames from this file
+void raw_frames(depth_frames &f,const char *filename,int w,int h) {
+    f.w=w; f.h=h;
+    f.make_directions();
+    FILE *in=fopen(filename,"rb");
+    if (!in) { printf("Can't open %s\n",filename); exit(1); }
+    std::vector<uint16_t> depth(w*h);
+    int i=0;
+    while (1==fread(&depth[0],w*h*sizeof(uint16_t),1,in)) {
+        f.frames.push_back(depth);
+        f.views.push_back(camera_view(300,100,60,90+i++,20));
+    }
+    fclose(in);
+}
+
+// Read the depth frames and camera views from this recording
+void recorded_frames(depth_frames &f,const char *filename) {
+    depth_playback rec(filename);
+    const camera_intrinsics &in=rec.header->depth;
+    f.w=in.width; f.h=in.height;
+    f.depth2cm=in.depth2cm;
+    f.xdir.resize(f.w); f.ydir.resize(f.h);
+    for (int x=0;x<f.w;x++) f.xdir[x]=(x-in.ppx)/in.fx;
+    for (int y=0;y<f.h;y++) f.ydir[y]=(y-in.ppy)/in.fy;
+    for (int i=0;i<rec.frame_count();i++) {
+        const uint16_t *depth=rec.depth(i);
+        f.frames.push_back(std::vector<uint16_t>(depth,depth+f.w*f.h));
+        aurora::robot_coord3D view=rec.frame(i).view;
+        if (view.percent<=0.0) view=camera_view(300,100,60,90,20); // no localizer view recorded
+        f.views.push_back(view);
+    }
+}
+
+// The original loop from vision.cpp's project_depth_to_2D
+void reference_projection(const depth_frames &f,const uint16_t *depth,
+    const aurora::robot_coord3D &view3D,obstacle_grid &map2D)
+{
+    depth_projection_limits limits;
+    for (int y = 0; y < f.h; y++)
+    for (int x = limits.left_start; x < f.w; x++)
+    {
+        float d=f.depth2cm*depth[x+y*f.w];
+        if (d<=limits.distance_min || d>limits.distance_max)
+            continue; // out of range value
+        d *= limits.depth_scale;
+        vec3 cam(f.xdir[x]*d, f.ydir[y]*d, d);
+        vec3 world = view3D.world_from_local(cam);
+        if (world.z<limits.Z_max && world.z>limits.Z_min)
+            map2D.add(world);
+    }
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main(int argc,char *argv[]) {
+    depth_frames f;
+    int nthreads=0, count=10;
+    for (int argi=1;argi<argc;argi++) {
+        std::string arg=argv[argi];
+        if (arg=="--raw" && argi+3<argc) {
+            raw_frames(f,argv[argi+1],atoi(argv[argi+2]),atoi(argv[argi+3]));
+            argi+=3;
+        }
+        else if (arg=="--play" && argi+1<argc) recorded_frames(f,argv[++argi]);
+        else if (arg=="--threads") nthreads=atoi(argv[++argi]);
+        else if (arg=="--frames") count=atoi(argv[++argi]);
+        else {
+            printf("Usage: depth_project_bench [--raw FILE W H | --play FILE] [--threads N] [--frames N]\n");
+            return 1;
+        }
+    }
+    if (f.frames.empty()) synthetic_frames(f,count);
+    printf("%zd frames of %d x %d depth\n",f.frames.size(),f.w,f.h);
+
+    static obstacle_grid ref, fast; // static, too big for the stack
+    depth_projection projector(nthreads);
+    double ref_ms=0.0, fast_ms=0.0;
+    long points=0, mismatched=0;
+    for (size_t i=0;i<f.frames.size();i++) {
+        const uint16_t *depth=&f.frames[i][0];
+        ref.clear(); fast.clear();
+
+        auto start=std::chrono::steady_clock::now();
+        reference_projection(f,depth,f.views[i],ref);
+        ref_ms+=elapsed_ms(start);
+
+        start=std::chrono::steady_clock::now();
+        projector.project(depth,f.w,f.h,f.depth2cm,&f.xdir[0],&f.ydir[0],f.views[i],fast);
+        fast_ms+=elapsed_ms(start);
+
+        // Float rounding differs a little, so a few points may land in a neighboring cell
+        for (int c=0;c<obstacle_grid::GRIDTOTAL;c++) {
+            points+=ref.count[c];
+            mismatched+=std::abs(ref.count[c]-fast.count[c]);
+        }
+    }
+    int n=f.frames.size();
+    printf("Reference:        %.2f ms/frame\n",ref_ms/n);
+    printf("depth_projection: %.2f ms/frame (%.1fx faster)\n",fast_ms/n,ref_ms/fast_ms);
+    printf("%ld points, %ld landed in a different cell (%.4f%%)\n",
+        points,mismatched/2,mismatched*50.0/std::max(points,1L));
+    return 0;
+}
@@ -0,0 +1,107 @@
+/*
+  Benchmark and check depth erosion: compares depth_eroder against the
+  original cv::erode version of erode_depth, and makes sure every
+  output pixel is identical.
+
+    ./erode_bench                 synthetic depth frames with sparkle holes
+    ./erode_bench --play FILE     frames recorded by "vision_capture --record FILE"
+    ./erode_bench --erode N       erosion radius (default 4, like vision)
+
+  Needs OpenCV (for the original version), but not a camera.
+
+  This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "vision/erode.hpp"
+#include "vision/depth_recording.hpp"
+
+// The original erode_depth, from before depth_eroder
+void erode_depth_opencv(cv::Mat &depth_image,int erode_depth) {
+    // erode the depth image here, to trim back depth sparkles
+    cv::Mat depth_eroded(depth_image.size(), CV_16U);
+    cv::Mat element=getStructuringElement(cv::MORPH_ELLIPSE,
+        cv::Size(2*erode_depth+1, 2*erode_depth+1),
+        cv::Point(erode_depth,erode_depth));
+    cv::erode(depth_image,depth_eroded,element);
+
+    // Zero out depths for all pixels that were eroded
+    for (int y = 0; y < depth_image.rows; y++)
+    for (int x = 0; x < depth_image.cols; x++) {
+        if (0==depth_eroded.at<uint16_t>(y,x))
+            depth_image.at<uint16_t>(y,x)=0;
+    }
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main(int argc,char *argv[]) {
+    int w=848, h=480, count=20, erode=4;
+    std::vector< std::vector<uint16_t> > frames;
+    for (int argi=1;argi<argc;argi++) {
+        std::string arg=argv[argi];
+        if (arg=="--play" && argi+1<argc) {
+            depth_playback rec(argv[++argi]);
+            w=rec.header->depth.width; h=rec.header->depth.height;
+            for (int i=0;i<rec.frame_count();i++)
+                frames.push_back(std::vector<uint16_t>(rec.depth(i),rec.depth(i)+w*h));
+        }
+        else if (arg=="--erode") erode=atoi(argv[++argi]);
+        else if (arg=="--frames") count=atoi(argv[++argi]);
+        else {
+            printf("Usage: erode_bench [--play FILE] [--erode N] [--frames N]\n");
+            return 1;
+        }
+    }
+    if (frames.empty())
+    { // Smooth depth, with scattered holes and a few big invalid blobs
+        srand(1);
+        for (int i=0;i<count;i++) {
+            std::vector<uint16_t> depth(w*h);
+            for (int y=0;y<h;y++)
+            for (int x=0;x<w;x++)
+                depth[y*w+x]=(rand()%30==0)?0:1000+x+2*y;
+            for (int b=0;b<10;b++) {
+                int cx=rand()%w, cy=rand()%h, r=5+rand()%30;
+                for (int y=std::max(0,cy-r);y<std::min(h,cy+r);y++)
+                for (int x=std::max(0,cx-r);x<std::min(w,cx+r);x++)
+                    depth[y*w+x]=0;
+            }
+            frames.push_back(depth);
+        }
+    }
+    printf("%zd frames of %d x %d depth, erode %d\n",frames.size(),w,h,erode);
+
+    depth_eroder eroder;
+    double ref_ms=0.0, fast_ms=0.0;
+    long mismatched=0;
+    for (const std::vector<uint16_t> &frame : frames) {
+        std::vector<uint16_t> ref=frame, fast=frame;
+
+        cv::Mat ref_image(cv::Size(w,h),CV_16U,&ref[0],cv::Mat::AUTO_STEP);
+        auto start=std::chrono::steady_clock::now();
+        erode_depth_opencv(ref_image,erode);
+        ref_ms+=elapsed_ms(start);
+
+        start=std::chrono::steady_clock::now();
+        eroder.erode(&fast[0],w,h,erode);
+        fast_ms+=elapsed_ms(start);
+
+        for (int i=0;i<w*h;i++) if (ref[i]!=fast[i]) mismatched++;
+    }
+    int n=frames.size();
+    printf("cv::erode:    %.2f ms/frame\n",ref_ms/n);
+    printf("depth_eroder: %.2f ms/frame (%.1fx faster)\n",fast_ms/n,ref_ms/fast_ms);
+    if (mismatched) {
+        printf("ERROR: %ld pixels differ\n",mismatched);
+        return 1;
+    }
+    printf("Output is bit-exact\n");
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+  Check and time the vision pipeline's frame_queue:
+  a fast producer and a slower consumer, to make sure frames arrive
+  in order, stale ones get dropped, none are lost or duplicated,
+  and the consumer always ends up with the last frame.
+
+  This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "vision/frame_pipeline.hpp"
+
+struct test_frame {
+    uint64_t seq=0; // 1-based frame number, 0 for empty
+    aurora::monotonic_time_t time=0; // when pushed
+};
+
+int main(int argc,char *argv[]) {
+    int count=argc>1?atoi(argv[1]):20000;
+    frame_queue<test_frame> queue;
+    stage_stats stats("consumer");
+    aurora::monotonic_time_t begin=aurora::time_in_nanoseconds_monotonic();
+
+    std::thread producer([&]() {
+        for (int i=1;i<=count;i++) {
+            test_frame f;
+            f.seq=i;
+            f.time=aurora::time_in_nanoseconds_monotonic();
+            queue.push(std::move(f));
+            if (i%16==0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        queue.close();
+    });
+
+    uint64_t last=0, popped=0;
+    std::vector<double> wake_us; // push to pop delay
+    test_frame f;
+    while (true) {
+        int queued=queue.depth();
+        if (!queue.pop_latest(f,1000)) break;
+        aurora::monotonic_time_t start=aurora::time_in_nanoseconds_monotonic();
+        if (f.seq<=last) {
+            printf("ERROR: frame %d arrived after frame %d\n",(int)f.seq,(int)last);
+            return 1;
+        }
+        last=f.seq;
+        popped++;
+        wake_us.push_back((start-f.time)*1.0e-3);
+        if (popped%4==0) std::this_thread::sleep_for(std::chrono::microseconds(300)); // busy sometimes
+        stats.add(f.time,start,queued);
+    }
+    producer.join();
+
+    uint64_t accounted=popped+queue.get_dropped();
+    printf("%d pushed: %d popped, %d dropped stale\n",
+        count,(int)popped,(int)queue.get_dropped());
+    std::sort(wake_us.begin(),wake_us.end());
+    printf("push to pop: median %.1f us, p99 %.1f us\n",
+        wake_us[wake_us.size()/2],wake_us[wake_us.size()*99/100]);
+    if (accounted!=(uint64_t)count || last!=(uint64_t)count) {
+        printf("ERROR: frames lost (%d accounted for, last was %d)\n",(int)accounted,(int)last);
+        return 1;
+    }
+    stats.print((aurora::time_in_nanoseconds_monotonic()-begin)*1.0e-9,queue.get_dropped());
+    printf("frame_queue OK\n");
+    return 0;
+}
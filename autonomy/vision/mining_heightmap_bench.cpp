@@ -0,0 +1,153 @@
+/*
+  Benchmark and check the mining face heightmap projection:
+  compares mining_heightmap_projector against a plain per-pixel loop
+  (like project_depth_to_mining in vision_mining.cpp), on made-up
+  848x480 depth frames of a sloped, bumpy mining face.
+
+    ./mining_heightmap_bench [--frames N]
+
+  vision_mining runs at 5 fps, so the whole projection needs to fit
+  well inside 200 ms per frame on the Pi.
+
+  Doesn't need OpenCV or a camera.
+
+  This file is Public Domain.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "aurora/lunatic.h"
+#include "vision/mining_heightmap.hpp"
+
+const int w=848, h=480;
+const float depth2m=0.001; // millimeter depth units
+
+// Forward distance (m) to the mining face at this frame x and z
+float face_y(float x,float z) {
+    return 0.9f+0.6f*z+0.04f*sinf(11.0f*x)*cosf(7.0f*z);
+}
+
+// Camera on the robot, looking forward and tilted down (degrees)
+aurora::robot_coord3D camera_view(float tilt) {
+    float c=cos(tilt*M_PI/180), s=sin(tilt*M_PI/180);
+    vec3 forward(0,1,0), up(0,0,1);
+    aurora::robot_coord3D view;
+    view.origin=vec3(0.05,-0.2,0.7);
+    view.Z=forward*c-up*s;
+    view.Y=-(forward*s+up*c);
+    view.X=vec3(1,0,0);
+    view.percent=100.0;
+    return view;
+}
+
+// Render the face, with some noise and dropouts
+void render(const aurora::robot_coord3D &view,const std::vector<float> &xdir,const std::vector<float> &ydir,
+    std::vector<uint16_t> &depth)
+{
+    depth.resize(w*h);
+    for (int y=0;y<h;y++)
+    for (int x=0;x<w;x++) {
+        vec3 D=view.X*xdir[x]+view.Y*ydir[y]+view.Z;
+        float t=1.0f;
+        for (int iter=0;iter<8;iter++) { // fixed-point: move along the ray to the face
+            vec3 p=view.origin+D*t;
+            t+=(face_y(p.x,p.z)-p.y)/D.y*0.7f;
+        }
+        float noise=0.004f*t*t*((rand()%200)-100)*0.01f;
+        bool drop=(rand()%50)==0 || t<0.0f;
+        depth[y*w+x]=drop?0:(uint16_t)std::max(0.0f,std::min(65535.0f,(t+noise)/depth2m));
+    }
+}
+
+// The simple version: each pixel through world_from_local, then into its cell
+void naive_project(const uint16_t *depth,const std::vector<float> &xdir,const std::vector<float> &ydir,
+    const aurora::robot_coord3D &view3D,aurora::mining_heightmap &map)
+{
+    enum {NX=aurora::mining_heightmap::NX, NZ=aurora::mining_heightmap::NZ};
+    static double sum[NZ][NX];
+    static int count[NZ][NX];
+    memset(sum,0,sizeof(sum)); memset(count,0,sizeof(count));
+    for (int y=0;y<h;y++)
+    for (int x=0;x<w;x++) {
+        float d=depth[y*w+x]*depth2m;
+        if (!(d>0.5f && d<7.5f)) continue;
+        vec3 world=view3D.world_from_local(vec3(xdir[x]*d,ydir[y]*d,d));
+        int ix=(int)floorf((world.x-map.x0)/map.cell), iz=(int)floorf((world.z-map.z0)/map.cell);
+        if (ix<0 || ix>=NX || iz<0 || iz>=NZ) continue;
+        sum[iz][ix]+=world.y; count[iz][ix]++;
+    }
+    map.camera_coords=view3D;
+    for (int z=0;z<NZ;z++)
+    for (int x=0;x<NX;x++)
+        map.forward[z][x]=count[z][x]?(int16_t)lrint(1000.0*sum[z][x]/count[z][x]):(int16_t)aurora::mining_heightmap::INVALID;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main(int argc,char *argv[]) {
+    int frames=20;
+    for (int argi=1;argi<argc;argi++) {
+        std::string arg=argv[argi];
+        if (arg=="--frames" && argi+1<argc) frames=atoi(argv[++argi]);
+        else {
+            printf("Usage: mining_heightmap_bench [--frames N]\n");
+            return 1;
+        }
+    }
+    srand(1);
+    std::vector<float> xdir(w), ydir(h);
+    float fx=425.0, fy=425.0, ppx=w*0.5, ppy=h*0.5;
+    for (int x=0;x<w;x++) xdir[x]=(x-ppx)/fx;
+    for (int y=0;y<h;y++) ydir[y]=(y-ppy)/fy;
+
+    static mining_heightmap_projector projector;
+    static aurora::mining_heightmap fast, naive;
+    std::vector<uint16_t> depth;
+    double fast_ms=0.0, naive_ms=0.0;
+    long valid=0, mismatched=0, worst=0;
+    double diff_sum=0.0, face_err=0.0;
+    for (int f=0;f<frames;f++) {
+        aurora::robot_coord3D view=camera_view(30.0f+f*0.5f);
+        render(view,xdir,ydir,depth);
+
+        auto start=std::chrono::steady_clock::now();
+        projector.project(&depth[0],w,h,depth2m,&xdir[0],&ydir[0],view,fast);
+        fast_ms+=elapsed_ms(start);
+
+        start=std::chrono::steady_clock::now();
+        naive_project(&depth[0],xdir,ydir,view,naive);
+        naive_ms+=elapsed_ms(start);
+
+        for (int z=0;z<aurora::mining_heightmap::NZ;z++)
+        for (int x=0;x<aurora::mining_heightmap::NX;x++) {
+            if (fast.valid(x,z)!=naive.valid(x,z)) { mismatched++; continue; }
+            if (!fast.valid(x,z)) continue;
+            valid++;
+            long diff=labs((long)fast.forward[z][x]-naive.forward[z][x]);
+            if (diff>worst) worst=diff;
+            diff_sum+=diff;
+            vec3 p=fast.world(x,z);
+            face_err+=fabs(p.y-face_y(p.x,p.z));
+        }
+    }
+    printf("%d x %d depth, %d x %d heightmap, %d frames:\n",w,h,
+        (int)aurora::mining_heightmap::NX,(int)aurora::mining_heightmap::NZ,frames);
+    printf("  projector %.2f ms/frame, per-pixel loop %.2f ms/frame (budget 200 ms at 5 fps)\n",
+        fast_ms/frames,naive_ms/frames);
+    printf("  %.0f valid cells/frame, %ld cells differ in validity (float rounding at cell edges)\n",
+        valid*1.0/frames,mismatched);
+    // Points right on a cell edge can land in the neighbor cell, so a few cells differ by a few mm
+    double diff_mean=valid?diff_sum/valid:0.0;
+    printf("  mean difference %.3f mm (worst %ld mm), mean error from true face %.1f mm\n",
+        diff_mean,worst,valid?1000.0*face_err/valid:0.0);
+    if (diff_mean>0.1 || worst>20) {
+        printf("ERROR: projector disagrees with the per-pixel loop\n");
+        return 1;
+    }
+    return 0;
+}
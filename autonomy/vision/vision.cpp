@@ -2,7 +2,19 @@
 This is the computer vision system, reading color and depth data
 from a realsense camera, and writing data used by the localizer.
 
+With --play FILE it reads frames recorded by "vision_capture --record FILE"
+instead of the camera, as fast as it can process them.
+
+Capture, aruco, and obstacle detection run as a pipeline of threads,
+so the camera keeps capturing while we compute, and each stage works on
+the newest frame.  Every few seconds it prints per-stage frame rate,
+latency since capture, work time, queue depth, and dropped stale frames.
+--serial (or --gui) runs everything in one thread instead.
+
 From the color images, we extract aruco marker locations.
+--track only searches near where markers were seen (or should be,
+from the camera's view), with a full-frame scan every N frames;
+--pyramid L does full-frame scans at 1/2^L resolution first.
 
 From the depth images, we extract drivable / non-drivable areas.
 */
@@ -23,6 +35,10 @@ From the depth images, we extract drivable / non-drivable areas.
 #include "vision/grid.hpp"
 #include "vision/grid.cpp"
 #include "vision/erode.hpp"
+#include "vision/depth_projection.hpp"
+#include "vision/frame_pipeline.hpp"
+#include <thread>
+#include <functional>
 
 #include "aurora/kinematics.h"
 
@@ -33,33 +49,19 @@ void project_depth_to_2D(const realsense_camera_capture &cap,
     obstacle_grid &map2D)
 {
     printf("Camera view: "); view3D.print();
-    const float depth_calibration_scale_factor=1.0f; // fudge factor to match real distances
-    const float sanity_distance_min = 60.0; // mostly parts of robot if they're too close
-    const float sanity_distance_max = 550.0; // depth gets ratty if it's too far out
-    const float sanity_Z_max = 300.0; // ignore ceiling (with wide error band for tilt)
-    const float sanity_Z_min = -200.0; // ignore invalid too-low
-    const int realsense_left_start=30; // invalid data left of here
-    for (int y = 0; y < cap.depth_h; y++)
-    for (int x = realsense_left_start; x < cap.depth_w; x++)
-    {
-        float depth=cap.get_depth_cm(x,y);
-        if (depth<=sanity_distance_min || depth>sanity_distance_max) 
-            continue; // out of range value
-        
-        depth *= depth_calibration_scale_factor;
-        
-        vec3 cam = cap.project_3D(depth,x,y);
-        vec3 world = view3D.world_from_local(cam);
-        
-        if (world.z<sanity_Z_max && world.z>sanity_Z_min)
-        {
-            map2D.add(world);
-        }
-    }   
+    static depth_projection projector; // keeps its threads between frames
+    projector.project(cap.depth_data,cap.depth_w,cap.depth_h,cap.depth2cm,
+        &cap.depth_projector->xdir[0],&cap.depth_projector->ydir[0],
+        view3D,map2D);
 }
 
 /* Mark grid cells as driveable or non-driveable */
 
+/* One frame moving through the pipeline */
+struct vision_frame {
+    realsense_camera_capture cap;
+    aurora::monotonic_time_t capture_time=0; // for exchange source_time
+};
 
 int main(int argc,const char *argv[]) {
     int show_GUI=0;
@@ -78,6 +80,11 @@ int main(int argc,const char *argv[]) {
     bool obstacle=true; // look for obstacles/driveable areas in depth data
     bool tabletop=false; // tabletop testing mode: build map from fixed location, no robot
     int erode=4; // image erosion passes / pixels (reduces border bleed)
+    std::string play=""; // recording to play back instead of the camera
+    bool serial=false; // run aruco and obstacle detection in series, not pipelined
+    int report_interval=5; // seconds between pipeline stats reports
+    int track=0; // if nonzero, track markers with a full-frame scan this often
+    int pyramid=0; // pyramid levels for full-frame marker scans
     for (int argi=1;argi<argc;argi++) {
       std::string arg=argv[argi];
       if (arg=="--gui") show_GUI++;
@@ -87,6 +94,11 @@ int main(int argc,const char *argv[]) {
       else if (arg=="--no-obstacle") obstacle=false; 
       else if (arg=="--tabletop") tabletop=true; 
       else if (arg=="--erode") erode=atoi(argv[++argi]);
+      else if (arg=="--play") play=argv[++argi];
+      else if (arg=="--serial") serial=true;
+      else if (arg=="--report") report_interval=atoi(argv[++argi]);
+      else if (arg=="--track") track=atoi(argv[++argi]);
+      else if (arg=="--pyramid") pyramid=atoi(argv[++argi]);
       
       else {
         std::cerr<<"Unknown argument '"<<arg<<"'.  Exiting.\n";
@@ -96,67 +108,146 @@ int main(int argc,const char *argv[]) {
 
     //Data sources need to write to, these are defined by lunatic.h for what files we will be communicating through
     
-    printf("Connecting to realsense camera...\n");
-    realsense_camera cam(res,fps);
-    printf("Connected.\n");
+    if (show_GUI) serial=true; // OpenCV windows need to stay in the main thread
+    
+    camera_frame_source *cam=0;
+    if (play!="") {
+        cam=new recorded_camera(play);
+        printf("Playing back %s\n",play.c_str());
+    }
+    else {
+        printf("Connecting to realsense camera...\n");
+        cam=new realsense_camera(res,fps);
+        printf("Connected.\n");
+    }
     
     aruco_detector *detector=0;
     if (aruco) {
         detector = new aruco_detector();
+        if (track>0) detector->set_tracking(true,track);
+        detector->set_pyramid(pyramid);
     }
-
-    while (true) {
-        // Grab data from realsense
-        realsense_camera_capture cap(cam);
-        // If the two captures dont have the same data do not draw the obsticles.
-        // Maybe solution is to iterate over the two realsense scene.
-        // Helper script maybe define an way to compare in realsense.h
-        // ex: cap.blend(last);
-
+    
+    // Run aruco marker detection on color image
+    auto find_markers=[&](vision_frame &frame) {
+        if (track>0) 
+        { // Tell the detector where the field markers should be
+            aurora::robot_coord3D view3D = exchange_obstacle_view.read();
+            if (frame.cap.recorded_view.percent>0.0) view3D=frame.cap.recorded_view; // played back
+            for (const aurora::vision_marker_report &m:aurora::field_markers)
+                if (m.is_valid()) 
+                    detector->predict_marker(m.markerID,view3D,100.0f*m.coords.origin,
+                        100.0f*vision_marker_size,150.0f); // table is in meters, and has no heights
+        }
+        vision_marker_watcher watcher;
+        detector->find_markers(frame.cap.color_image,watcher,show_GUI);
+        if (watcher.found_markers()>0) { // only write if we actually saw something.
+            exchange_marker_reports_depth.write_begin()=watcher.reports;
+            exchange_marker_reports_depth.write_end(frame.capture_time);
+        }
+    };
+    
+    // Run obstacle detection on depth image
+    static obstacle_grid map2D; // static, too big for a thread's stack
+    auto find_obstacles=[&](vision_frame &frame) {
+        realsense_camera_capture &cap=frame.cap;
+        if (erode) erode_depth(cap,erode);
         
-        // Run aruco marker detection on color image
-        if (aruco)
+        // Project to 2D map
+        map2D.clear();
+        aurora::robot_coord3D view3D = exchange_obstacle_view.read();
+        if (cap.recorded_view.percent>0.0) view3D=cap.recorded_view; // played back
+        
+        if (tabletop) { // tabletop hardcoded depth camera testing: 
+            aurora::robot_coord3D camera;
+            camera.reset();
+            camera.percent=101.0;
+            camera.origin=vec3(field_x_size/2,field_y_size,100);
+            float scale=4.0;
+            camera.X=vec3(-scale,0,0);
+            camera.Y=vec3(0,0,-1.0); 
+            camera.Z=vec3(0,-scale,0); 
+            view3D = camera;
+            aurora::robot_link_coords::rotate_link(view3D,camera,aurora::axisX,-20.0);
+        }
+        if (serial) std::cout << "current percent: " << view3D.percent << "\n";
+        
+        if(view3D.percent > 0.0)
         {
-            vision_marker_watcher watcher;
-            detector->find_markers(cap.color_image,watcher,show_GUI);
-            if (watcher.found_markers()>0) { // only write if we actually saw something.
-                exchange_marker_reports_depth.write_begin()=watcher.reports;
-                exchange_marker_reports_depth.write_end();
-            }
+            project_depth_to_2D(cap,view3D,map2D);
+            exchange_field_raw.write_begin().copy_tiles_from(map2D); // only the tiles we saw (or saw last time)
+            exchange_field_raw.write_end(frame.capture_time);
         }
+    };
+    
+    if (!serial) 
+    { // Pipeline: capture here, aruco and obstacles each in their own thread
+        frame_queue<vision_frame> aruco_queue, obstacle_queue;
+        stage_stats capture_stats("capture"), aruco_stats("aruco"), obstacle_stats("obstacle");
         
-        // Run obstacle detection on depth image
-        if (obstacle) {
-            if (erode) erode_depth(cap,erode);
-            
-            // Project to 2D map
-            obstacle_grid map2D;
-            aurora::robot_coord3D view3D = exchange_obstacle_view.read();
-            
-            if (tabletop) { // tabletop hardcoded depth camera testing: 
-                aurora::robot_coord3D camera;
-                camera.reset();
-                camera.percent=101.0;
-                camera.origin=vec3(field_x_size/2,field_y_size,100);
-                float scale=4.0;
-                camera.X=vec3(-scale,0,0);
-                camera.Y=vec3(0,0,-1.0); 
-                camera.Z=vec3(0,-scale,0); 
-                view3D = camera;
-                aurora::robot_link_coords::rotate_link(view3D,camera,aurora::axisX,-20.0);
+        // Each worker takes the newest frame from its queue until capture stops
+        auto worker=[](frame_queue<vision_frame> &queue,stage_stats &stats,
+            std::function<void(vision_frame &)> stage) 
+        {
+            vision_frame frame;
+            while (true) {
+                int queued=queue.depth();
+                if (!queue.pop_latest(frame,1000)) {
+                    if (queue.is_closed()) return;
+                    continue; // timeout, camera is slow
+                }
+                aurora::monotonic_time_t start=aurora::time_in_nanoseconds_monotonic();
+                stage(frame);
+                stats.add(frame.capture_time,start,queued);
+                frame=vision_frame(); // release the camera's frame
             }
-            std::cout << "current percent: " << view3D.percent << "\n";
-            
+        };
+        std::thread aruco_thread, obstacle_thread;
+        if (aruco) aruco_thread=std::thread(worker,std::ref(aruco_queue),std::ref(aruco_stats),find_markers);
+        if (obstacle) obstacle_thread=std::thread(worker,std::ref(obstacle_queue),std::ref(obstacle_stats),find_obstacles);
+        
+        aurora::monotonic_time_t last_report=aurora::time_in_nanoseconds_monotonic();
+        while (true) {
+            aurora::monotonic_time_t start=aurora::time_in_nanoseconds_monotonic();
+            vision_frame frame;
+            if (!cam->grab(frame.cap)) break; // end of recording
+            aurora::monotonic_time_t capture_time=aurora::time_in_nanoseconds_monotonic();
+            frame.capture_time=capture_time; // for exchange source_time
+            capture_stats.add(capture_time,start);
             
-            if(view3D.percent > 0.0)
-            {
-                project_depth_to_2D(cap,view3D,map2D);
-                exchange_field_raw.write_begin() = map2D;
-                exchange_field_raw.write_end();
+            // Both workers share the frame's image data: aruco only reads color, obstacle only changes depth
+            if (aruco && obstacle) {
+                vision_frame copy(frame);
+                aruco_queue.push(std::move(copy));
             }
+            else if (aruco) aruco_queue.push(std::move(frame));
+            if (obstacle) obstacle_queue.push(std::move(frame));
             
-            
-            
+            if (capture_time-last_report>=report_interval*1000000000LL) {
+                double seconds=(capture_time-last_report)*1.0e-9;
+                last_report=capture_time;
+                printf("Vision pipeline:\n");
+                capture_stats.print(seconds);
+                if (aruco) aruco_stats.print(seconds,aruco_queue.get_dropped());
+                if (obstacle) obstacle_stats.print(seconds,obstacle_queue.get_dropped());
+                fflush(stdout);
+            }
+        }
+        aruco_queue.close(); obstacle_queue.close();
+        if (aruco) aruco_thread.join();
+        if (obstacle) obstacle_thread.join();
+    }
+    else while (true) 
+    { // Serial: one frame at a time (needed for the GUI windows)
+        vision_frame frame;
+        if (!cam->grab(frame.cap)) break; // end of recording
+        frame.capture_time=aurora::time_in_nanoseconds_monotonic(); // for exchange source_time
+        realsense_camera_capture &cap=frame.cap;
+        
+        if (aruco) find_markers(frame);
+        
+        if (obstacle) {
+            find_obstacles(frame);
             if (show_GUI) {
                 cv::Mat debug=map2D.get_debug_2D(2);
                 imshow("Top-down 2D Map",debug);
@@ -175,8 +266,7 @@ int main(int argc,const char *argv[]) {
             if (key == 27 || key=='q')  
                 break;  
         }
-        // Store The previous copy of the data before grabbing new
-        realsense_camera_capture last(cap);
     }
+    delete cam;
     return 0;
 }
@@ -0,0 +1,127 @@
+/*
+  Benchmark the vision pipeline on a recording made by
+  "vision_capture --record FILE", without a camera:
+
+    ./vision_bench FILE [--erode N] [--no-aruco] [--no-obstacle]
+
+  Runs each frame through the same stages as vision (erosion, aruco
+  marker detection, depth projection), as fast as possible, and reports
+  the time spent in each stage.
+
+  This file is Public Domain.
+*/
+#include <iostream>
+#include <stdio.h>
+#include <chrono>
+#include <opencv2/opencv.hpp>
+#include "aurora/lunatic.h"
+
+#include "vision/realsense_camera.hpp"
+#include "vision/realsense_camera.cpp"
+
+#include "vision/aruco_detector.hpp"
+#include "vision/aruco_detector.cpp"
+#include "vision/aruco_watcher.hpp"
+
+#include "vision/grid.hpp"
+#include "vision/grid.cpp"
+#include "vision/erode.hpp"
+#include "vision/depth_projection.hpp"
+
+// Accumulates the time spent in one stage
+struct stage_timer {
+    const char *name;
+    double total_ms=0.0, max_ms=0.0;
+    int count=0;
+    std::chrono::steady_clock::time_point start_time;
+
+    stage_timer(const char *name_) :name(name_) {}
+
+    void start() { start_time=std::chrono::steady_clock::now(); }
+    void stop() {
+        double ms=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start_time).count();
+        total_ms+=ms; count++;
+        if (ms>max_ms) max_ms=ms;
+    }
+    void print() const {
+        if (count>0) printf("  %-12s %7.2f ms/frame mean, %7.2f ms max\n",name,total_ms/count,max_ms);
+    }
+};
+
+int main(int argc,const char *argv[]) {
+    std::string play="";
+    bool aruco=true, obstacle=true;
+    int erode=4;
+    for (int argi=1;argi<argc;argi++) {
+      std::string arg=argv[argi];
+      if (arg=="--no-aruco") aruco=false;
+      else if (arg=="--no-obstacle") obstacle=false;
+      else if (arg=="--erode") erode=atoi(argv[++argi]);
+      else if (play=="" && arg[0]!='-') play=arg;
+      else {
+        std::cerr<<"Usage: vision_bench FILE [--erode N] [--no-aruco] [--no-obstacle]\n";
+        return 1;
+      }
+    }
+    if (play=="") {
+        std::cerr<<"Usage: vision_bench FILE [--erode N] [--no-aruco] [--no-obstacle]\n";
+        return 1;
+    }
+
+    recorded_camera cam(play);
+    printf("Benchmarking %d frames from %s\n",cam.frame_count(),play.c_str());
+
+    aruco_detector *detector=0;
+    if (aruco) detector = new aruco_detector();
+    depth_projection projector;
+    static obstacle_grid map2D; // static, too big for the stack
+
+    stage_timer grab("grab"), markers("aruco"), eroding("erode"), projecting("project"), total("total");
+    int marker_count=0;
+    while (true) {
+        total.start();
+        grab.start();
+        realsense_camera_capture cap;
+        if (!cam.grab(cap)) break;
+        grab.stop();
+
+        if (aruco) {
+            markers.start();
+            vision_marker_watcher watcher;
+            detector->find_markers(cap.color_image,watcher,false);
+            marker_count+=watcher.found_markers();
+            markers.stop();
+        }
+
+        if (obstacle) {
+            eroding.start();
+            if (erode) erode_depth(cap,erode);
+            eroding.stop();
+
+            projecting.start();
+            map2D.clear();
+            aurora::robot_coord3D view3D=cap.recorded_view;
+            if (view3D.percent<=0.0)
+            { // no recorded view: camera 1 meter up, looking along +Y
+                view3D.origin=vec3(field_x_size/2,0,100);
+                view3D.X=vec3(1,0,0); view3D.Y=vec3(0,0,-1); view3D.Z=vec3(0,1,0);
+                view3D.percent=100.0;
+            }
+            projector.project(cap.depth_data,cap.depth_w,cap.depth_h,cap.depth2cm,
+                &cap.depth_projector->xdir[0],&cap.depth_projector->ydir[0],
+                view3D,map2D);
+            projecting.stop();
+        }
+        total.stop();
+    }
+
+    printf("%d frames, %d markers seen\n",total.count,marker_count);
+    grab.print();
+    markers.print();
+    eroding.print();
+    projecting.print();
+    total.print();
+    if (total.total_ms>0.0) printf("  %.1f frames/sec\n",total.count*1000.0/total.total_ms);
+    delete detector;
+    return 0;
+}
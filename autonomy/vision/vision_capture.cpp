@@ -3,6 +3,8 @@ This is the computer vision system, reading color and depth data
 from a realsense camera, and writing data used by the localizer.
 
 This version specialized to capture the depth data to an STL file.
+With --record FILE, it instead records color and depth frames (and the
+localizer's obstacle view) for "vision --play FILE".
 
 
 From the color images, we extract aruco marker locations.
@@ -137,6 +139,7 @@ int main(int argc,const char *argv[]) {
     //Data sources need to write to, these are defined by lunatic.h for what files we will be communicating through
     MAKE_exchange_backend_state(); // for joint angles
     MAKE_exchange_mining_depth(); // for viewed depth data
+    MAKE_exchange_obstacle_view(); // for recorded camera views
 
     // res=720; fps=30; // <- 200% of gaming laptop CPU
     // res=540; fps=60; // <- 220% of gaming laptop CPU
@@ -145,12 +148,16 @@ int main(int argc,const char *argv[]) {
     int res=480; // camera's requested vertical resolution
     int fps=5; // camera's frames per second 
     int erode=1; // image erosion passes (remove bad data around depth discontinuities)
+    std::string record=""; // file to record frames into
+    int record_frames=0; // stop after recording this many frames (0: keep going)
     for (int argi=1;argi<argc;argi++) {
       std::string arg=argv[argi];
       if (arg=="--gui") show_GUI++;
       else if (arg=="--res") res=atoi(argv[++argi]); // manual resolution
       else if (arg=="--fps") fps=atoi(argv[++argi]); // manual framerate
       else if (arg=="--erode") erode=atoi(argv[++argi]);
+      else if (arg=="--record") record=argv[++argi];
+      else if (arg=="--frames") record_frames=atoi(argv[++argi]);
       
       else {
         std::cerr<<"Unknown argument '"<<arg<<"'.  Exiting.\n";
@@ -166,6 +173,7 @@ int main(int argc,const char *argv[]) {
     
     
     int frame_count=0;
+    depth_recorder *recorder=0;
 
     while (true) {
         // Grab data from realsense
@@ -176,8 +184,22 @@ int main(int argc,const char *argv[]) {
         // ex: cap.blend(last);
 
         
+        // Record raw frames (once it's stable)
+        if (record!="" && frame_count++ > 40) {
+            if (!recorder) {
+                recorder=new depth_recorder(record,cap.depth_projector->intrinsics,cap.color_w,cap.color_h);
+                printf("Recording to %s\n",record.c_str());
+            }
+            depth_recording_frame frame;
+            frame.capture_time=aurora::time_in_nanoseconds_monotonic();
+            frame.view=exchange_obstacle_view.read();
+            recorder->write(frame,cap.depth_data,cap.color_image.data);
+            
+            if (recorder->frame_count()==record_frames) break;
+        }
+        
         // Grab depth image (once it's stable)
-        if (frame_count++ > 40) {
+        else if (record=="" && frame_count++ > 40) {
             if (erode) erode_depth(cap,erode);
             
             // Project to frame coordinates
@@ -212,5 +234,7 @@ int main(int argc,const char *argv[]) {
         // Store The previous copy of the data before grabbing new
         //realsense_camera_capture last(cap);
     }
+    if (recorder) printf("Recorded %d frames\n",recorder->frame_count());
+    delete recorder;
     return 0;
 }
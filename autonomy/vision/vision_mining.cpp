@@ -3,11 +3,13 @@ This is the computer vision system, reading color and depth data
 from a realsense camera, and writing data used by the localizer.
 
     This version specialized for mining only.
+    With --play FILE it reads recorded frames instead of the camera.
 
 
 From the color images, we extract aruco marker locations.
 
-From the depth images, we extract drivable / non-drivable areas.
+From the depth images, we extract drivable / non-drivable areas,
+and a dense heightmap of the mining face.
 */
 #include <iostream>
 #include <stdio.h>
@@ -28,6 +30,7 @@ From the depth images, we extract drivable / non-drivable areas.
 #include "vision/grid.hpp"
 #include "vision/grid.cpp"
 #include "vision/erode.hpp"
+#include "vision/mining_heightmap.hpp"
 
 using namespace aurora;
 
@@ -76,6 +79,7 @@ int main(int argc,const char *argv[]) {
     MAKE_exchange_marker_reports_depth(); // for reporting aruco markers
     MAKE_exchange_backend_state(); // for joint angles
     MAKE_exchange_mining_depth(); // for viewed depth data
+    MAKE_exchange_mining_heightmap(); // for the dense mining face
 
     // res=720; fps=30; // <- 200% of gaming laptop CPU
     // res=540; fps=60; // <- 220% of gaming laptop CPU
@@ -89,6 +93,7 @@ int main(int argc,const char *argv[]) {
     int erode=3; // image erosion passes
     float minSize=0.05; // fraction of image for aruco markers
     bool show_depth=false;
+    std::string play=""; // recording to play back instead of the camera
     for (int argi=1;argi<argc;argi++) {
       std::string arg=argv[argi];
       if (arg=="--gui") show_GUI++;
@@ -99,6 +104,7 @@ int main(int argc,const char *argv[]) {
       else if (arg=="--no-aruco") aruco=false; 
       else if (arg=="--no-obstacle") obstacle=false; 
       else if (arg=="--erode") erode=atoi(argv[++argi]);
+      else if (arg=="--play") play=argv[++argi];
       
       else {
         std::cerr<<"Unknown argument '"<<arg<<"'.  Exiting.\n";
@@ -108,9 +114,19 @@ int main(int argc,const char *argv[]) {
 
     //Data sources need to write to, these are defined by lunatic.h for what files we will be communicating through
     
-    printf("Connecting to realsense camera...\n");
-    realsense_camera cam(res,fps);
-    printf("Connected.\n");
+    camera_frame_source *cam=0;
+    if (play!="") {
+        cam=new recorded_camera(play);
+        printf("Playing back %s\n",play.c_str());
+    }
+    else {
+        printf("Connecting to realsense camera...\n");
+        cam=new realsense_camera(res,fps);
+        printf("Connected.\n");
+    }
+    
+    static mining_heightmap_projector heightmap_projector; // static, it's big
+    static mining_heightmap heightmap; // area set by its constructor
     
     aruco_detector *detector=0;
     if (aruco) {
@@ -119,7 +135,9 @@ int main(int argc,const char *argv[]) {
 
     while (true) {
         // Grab data from realsense
-        realsense_camera_capture cap(cam);
+        realsense_camera_capture cap;
+        if (!cam->grab(cap)) break; // end of recording
+        aurora::monotonic_time_t capture_time=aurora::time_in_nanoseconds_monotonic(); // for exchange source_time
         // If the two captures dont have the same data do not draw the obsticles.
         // Maybe solution is to iterate over the two realsense scene.
         // Helper script maybe define an way to compare in realsense.h
@@ -133,7 +151,7 @@ int main(int argc,const char *argv[]) {
             detector->find_markers(cap.color_image,watcher,show_GUI);
             if (watcher.found_markers()>0) { // only write if we actually saw something.
                 exchange_marker_reports_depth.write_begin()=watcher.reports;
-                exchange_marker_reports_depth.write_end();
+                exchange_marker_reports_depth.write_end(capture_time);
             }
         }
         
@@ -148,7 +166,13 @@ int main(int argc,const char *argv[]) {
             mining_depth mining;
             project_depth_to_mining(cap,view3D,mining);
             exchange_mining_depth.write_begin() = mining;
-            exchange_mining_depth.write_end();
+            exchange_mining_depth.write_end(capture_time);
+            
+            heightmap_projector.project(cap.depth_data,cap.depth_w,cap.depth_h,cap.depth2m,
+                &cap.depth_projector->xdir[0],&cap.depth_projector->ydir[0],
+                view3D,heightmap);
+            exchange_mining_heightmap.write_begin() = heightmap;
+            exchange_mining_heightmap.write_end(capture_time);
             
         }
         
@@ -178,5 +202,6 @@ int main(int argc,const char *argv[]) {
         // Store The previous copy of the data before grabbing new
         realsense_camera_capture last(cap);
     }
+    delete cam;
     return 0;
 }